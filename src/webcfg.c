@@ -34,7 +34,9 @@
 #include "webcfg_metadata.h"
 #include "webcfg_event.h"
 #include "webcfg_blob.h"
+#include "webcfg_apply.h"
 #include "webcfg_timer.h"
+#include "webcfg_scheduler.h"
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
@@ -67,6 +69,7 @@ static int g_supplementarySync = 0;
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
 void *WebConfigMultipartTask(void *status);
+static void runSyncJob(sync_job_t *job, int status);
 int handlehttpResponse(long response_code, char *webConfigData, int retry_count, char* transaction_uuid, char* ct, size_t dataSize);
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
@@ -92,20 +95,12 @@ void initWebConfigMultipartTask(unsigned long status)
 void *WebConfigMultipartTask(void *status)
 {
 	pthread_detach(pthread_self());
-	int rv=0;
-	int forced_sync=0;
         int Status = 0;
-	int retry_flag = 0;
-	int maintenance_doc_sync = 0;
-	char *syncDoc = NULL;
-	int value = 0;
-	int wait_flag = 1;
-	int maintenance_count = 0;
-	time_t t;
-	struct timespec ts;
+	sync_job_t job;
 	Status = (unsigned long)status;
 
 	initWebcfgProperties(WEBCFG_PROPERTIES_FILE);
+	loadApplyConfig(WEBCFG_PROPERTIES_FILE);
 
 	//start webconfig notification thread.
 	initWebConfigNotifyTask();
@@ -114,16 +109,9 @@ void *WebConfigMultipartTask(void *status)
 
 	initDB(WEBCFG_DB_FILE);
 
-	//To disable supplementary sync for RDKV platforms
-#if !defined(RDK_PERSISTENT_PATH_VIDEO)
-	initMaintenanceTimer();
-#endif
-	//For Primary sync set flag to 0
-	set_global_supplementarySync(0);
-	processWebconfgSync((int)Status, NULL);
-
-	//For supplementary sync set flag to 1
-	set_global_supplementarySync(1);
+	//Boot sync, primary first then each supplementary doc
+	clearSyncJobs();
+	scheduleSyncJob(SYNC_JOB_PRIMARY, NULL, 0, 0);
 
 	SupplementaryDocs_t *spDocs = NULL;
 	spDocs = get_global_spInfoHead();
@@ -132,168 +120,26 @@ void *WebConfigMultipartTask(void *status)
 	{
 		if(spDocs->name != NULL)
 		{
-			WebcfgInfo("Supplementary sync for %s\n",spDocs->name);
-			processWebconfgSync((int)Status, spDocs->name);
+			scheduleSyncJob(SYNC_JOB_SUPPLEMENTARY, spDocs->name, 0, 0);
 		}
 		spDocs = spDocs->next;
 	}
 
-	//Resetting the supplementary sync
-	set_global_supplementarySync(0);
+	//To disable supplementary sync for RDKV platforms
+#if !defined(RDK_PERSISTENT_PATH_VIDEO)
+	initMaintenanceTimer();
+	scheduleMaintenanceJob(0);
+#endif
 
-	while(1)
+	while(waitSyncJob(&job) == WEBCFG_SUCCESS)
 	{
-		if(forced_sync)
-		{
-			WebcfgDebug("Triggered Forced sync\n");
-			processWebconfgSync((int)Status, syncDoc);
-			WebcfgDebug("reset forced_sync after sync\n");
-			forced_sync = 0;
-			if(get_global_supplementarySync() && syncDoc !=NULL)
-			{
-				WEBCFG_FREE(syncDoc);
-			}
-			setForceSync("", "", 0);
-			set_global_supplementarySync(0);
-		}
-
-		if(!wait_flag)
-		{
-			if(maintenance_doc_sync == 1 && checkMaintenanceTimer() == 1 )
-			{
-				WebcfgDebug("Triggered Supplementary doc boot sync\n");
-				SupplementaryDocs_t *sp = NULL;
-				sp = get_global_spInfoHead();
-
-				while(sp != NULL)
-				{
-					if(sp->name != NULL)
-					{
-						WebcfgInfo("Supplementary sync for %s\n",sp->name);
-						processWebconfgSync((int)Status, sp->name);
-					}
-					sp = sp->next;
-				}
-
-				initMaintenanceTimer();
-				maintenance_doc_sync = 0;//Maintenance trigger flag
-				maintenance_count = 1;//Maintenance count to restrict one sync per day
-				set_global_supplementarySync(0);
-			}
-		}
-		pthread_mutex_lock (&sync_mutex);
-
-		if (g_shutdown)
-		{
-			WebcfgInfo("g_shutdown is %d, proceeding to kill webconfig thread\n", g_shutdown);
-			pthread_mutex_unlock (&sync_mutex);
-			break;
-		}
-
-		clock_gettime(CLOCK_REALTIME, &ts);
-
-		retry_flag = get_doc_fail();
-		WebcfgDebug("The retry flag value is %d\n", retry_flag);
-
-		if ( retry_flag == 0)
-		{
-		//To disable supplementary sync for RDKV platforms
-		#if !defined(RDK_PERSISTENT_PATH_VIDEO)
-			ts.tv_sec += getMaintenanceSyncSeconds(maintenance_count);
-			maintenance_doc_sync = 1;
-			WebcfgInfo("The Maintenance Sync triggers at %s\n", printTime((long long)ts.tv_sec));
-		#else
-			maintenance_doc_sync = 0;
-			maintenance_count = 0;
-			WebcfgDebug("maintenance_count is %d\n", maintenance_count);
-		#endif
-		}
-		else
-		{
-			if(get_global_retry_timestamp() != 0)
-			{
-				set_retry_timer(retrySyncSeconds());
-			}
-			ts.tv_sec += get_retry_timer();
-			WebcfgDebug("The retry triggers at %s\n", printTime((long long)ts.tv_sec));
-		}
-
-		if(retry_flag == 1 || maintenance_doc_sync == 1)
-		{
-			WebcfgDebug("B4 sync_condition pthread_cond_timedwait\n");
-			rv = pthread_cond_timedwait(&sync_condition, &sync_mutex, &ts);
-			WebcfgDebug("The retry flag value is %d\n", get_doc_fail());
-			WebcfgDebug("The value of rv %d\n", rv);
-		}
-		else 
-		{
-			rv = pthread_cond_wait(&sync_condition, &sync_mutex);
-		}
-
-		if(rv == ETIMEDOUT && !g_shutdown)
-		{
-			if(get_doc_fail() == 1)
-			{
-				set_doc_fail(0);
-				set_retry_timer(900);
-				set_global_retry_timestamp(0);
-				failedDocsRetry();
-				WebcfgDebug("After the failedDocsRetry\n");
-			}
-			else
-			{
-				time(&t);
-				wait_flag = 0;
-				maintenance_count = 0;
-				WebcfgDebug("Supplementary Sync Interval %d sec and syncing at %s\n",value,ctime(&t));
-			}
-		}
-		else if(!rv && !g_shutdown)
-		{
-			char *ForceSyncDoc = NULL;
-			char* ForceSyncTransID = NULL;
-
-			// Identify ForceSync based on docname
-			getForceSync(&ForceSyncDoc, &ForceSyncTransID);
-			WebcfgDebug("ForceSyncDoc %s ForceSyncTransID. %s\n", ForceSyncDoc, ForceSyncTransID);
-			if(ForceSyncTransID !=NULL)
-			{
-				if((ForceSyncDoc != NULL) && strlen(ForceSyncDoc)>0)
-				{
-					forced_sync = 1;
-					wait_flag = 1;
-					WebcfgDebug("Received signal interrupt to Force Sync\n");
-
-					//To check poke string received is supplementary doc or not.
-					if(isSupplementaryDoc(ForceSyncDoc) == WEBCFG_SUCCESS)
-					{
-						WebcfgInfo("Received supplementary poke request for %s\n", ForceSyncDoc);
-						set_global_supplementarySync(1);
-						syncDoc = strdup(ForceSyncDoc);
-						WebcfgDebug("syncDoc is %s\n", syncDoc);
-					}
-					WEBCFG_FREE(ForceSyncDoc);
-					WEBCFG_FREE(ForceSyncTransID);
-				}
-				else
-				{
-					WebcfgError("ForceSyncDoc is NULL\n");
-					WEBCFG_FREE(ForceSyncTransID);
-				}
-			}
+		runSyncJob(&job, Status);
+	}
 
-			WebcfgDebug("forced_sync is %d\n", forced_sync);
-		}
-		else if(g_shutdown)
-		{
-			WebcfgInfo("Received signal interrupt to RFC disable. g_shutdown is %d, proceeding to kill webconfig thread\n", g_shutdown);
-			pthread_mutex_unlock (&sync_mutex);
-			break;
-		}
-		
-		pthread_mutex_unlock(&sync_mutex);
+	clearSyncJobs();
+	stopWebcfgTimerService();
 
-	}
+	stopAkerWorker();
 
 	/* release all active threads before shutdown */
 	pthread_mutex_lock (get_global_client_mut());
@@ -308,8 +154,9 @@ void *WebConfigMultipartTask(void *status)
 	if(get_global_eventFlag())
 	{
 		pthread_mutex_lock (get_global_event_mut());
-		pthread_cond_signal (get_global_event_con());
+		pthread_cond_signal (get_global_event_handler_con());
 		pthread_mutex_unlock (get_global_event_mut());
+		wakeEventConsumer();
 
 		WebcfgDebug("event process thread: pthread_join\n");
 		JoinThread (get_global_process_threadid());
@@ -325,12 +172,10 @@ void *WebConfigMultipartTask(void *status)
 	JoinThread (get_global_client_threadid());
 
 	reset_global_eventFlag();
-	set_doc_fail(0);
 	reset_numOfMpDocs();
 	reset_successDocCount();
 	set_global_maintenance_time(0);
 	set_global_retry_timestamp(0);
-	set_retry_timer(0);
 	set_global_supplementarySync(0);
 	set_send_aker_flag(false);
 
@@ -403,6 +248,54 @@ int get_global_supplementarySync()
 /*----------------------------------------------------------------------------*/
 /*                             Internal functions                             */
 /*----------------------------------------------------------------------------*/
+//Runs one job taken from the sync scheduler on the sync thread.
+static void runSyncJob(sync_job_t *job, int status)
+{
+	SupplementaryDocs_t *sp = NULL;
+
+	switch(job->type)
+	{
+		case SYNC_JOB_PRIMARY:
+			WebcfgDebug("Primary sync, forced %d\n", job->forced);
+			//For Primary sync set flag to 0
+			set_global_supplementarySync(0);
+			processWebconfgSync(status, NULL);
+			break;
+		case SYNC_JOB_SUPPLEMENTARY:
+			//For supplementary sync set flag to 1
+			set_global_supplementarySync(1);
+			WebcfgInfo("Supplementary sync for %s\n", job->doc);
+			processWebconfgSync(status, job->doc);
+			break;
+		case SYNC_JOB_RETRY:
+			retryFailedDoc(job->doc);
+			break;
+		case SYNC_JOB_MAINTENANCE:
+			if(!isMaintenanceDue())
+			{
+				break;
+			}
+			WebcfgDebug("Triggered Supplementary doc boot sync\n");
+			//queued per doc, so pokes go ahead and merge with them
+			sp = get_global_spInfoHead();
+			while(sp != NULL)
+			{
+				if(sp->name != NULL)
+				{
+					scheduleSyncJob(SYNC_JOB_SUPPLEMENTARY, sp->name, 0, 0);
+				}
+				sp = sp->next;
+			}
+			initMaintenanceTimer();
+			//one maintenance sync per day
+			scheduleMaintenanceJob(1);
+			break;
+	}
+
+	//Resetting the supplementary sync
+	set_global_supplementarySync(0);
+}
+
 void processWebconfgSync(int status, char* docname)
 {
 	int retry_count=0;
@@ -464,7 +357,7 @@ int handlehttpResponse(long response_code, char *webConfigData, int retry_count,
 	int first_digit=0;
 	int msgpack_status=0;
 	int err = 0;
-	char version[512]={'\0'};
+	char *version = NULL;
 	uint32_t db_root_version = 0;
 	char *db_root_string = NULL;
 	int subdocList = 0;
@@ -513,7 +406,11 @@ int handlehttpResponse(long response_code, char *webConfigData, int retry_count,
 			if((contentLength !=NULL) && (strcmp(contentLength, "0") == 0))
 			{
 				WebcfgInfo("webConfigData content length is 0\n");
-				refreshConfigVersionList(version, response_code);
+				refreshConfigVersionList(&version, response_code);
+				if(version != NULL)
+				{
+					WEBCFG_FREE(version);
+				}
 				WEBCFG_FREE(contentLength);
 				set_global_contentLen(NULL);
 				WEBCFG_FREE(transaction_uuid);
@@ -572,7 +469,11 @@ int handlehttpResponse(long response_code, char *webConfigData, int retry_count,
 		if (response_code == 404)
 		{
 			//To set POST-NONE root version when 404
-			refreshConfigVersionList(version, response_code);
+			refreshConfigVersionList(&version, response_code);
+			if(version != NULL)
+			{
+				WEBCFG_FREE(version);
+			}
 		}
 		getRootDocVersionFromDBCache(&db_root_version, &db_root_string, &subdocList);
 		addWebConfgNotifyMsg(NULL, db_root_version, NULL, NULL, transaction_uuid, 0, "status", 0, db_root_string, response_code);
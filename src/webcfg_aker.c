@@ -27,6 +27,8 @@
 #include "webcfg_event.h"
 #include "webcfg_blob.h"
 #include "webcfg_param.h"
+#include "webcfg_latency.h"
+#include "webcfg_request.h"
 #include <wrp-c.h>
 #include <wdmp-c.h>
 #include <msgpack.h>
@@ -41,10 +43,19 @@
 #define CONTENT_TYPE_JSON       "application/json"
 #define AKER_UPDATE_PARAM       "Device.DeviceInfo.X_RDKCENTRAL-COM_Aker.Update"
 #define AKER_DELETE_PARAM       "Device.DeviceInfo.X_RDKCENTRAL-COM_Aker.Delete"
+#define AKER_BACKOFF_START      4
+#define AKER_BACKOFF_MAX        6
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
-/* none */
+//Deferred aker apply. Only the latest aker doc matters, so a newer one replaces the queued one.
+typedef struct aker_work
+{
+	multipartdocs_t *doc;		//private copy, the mp list may be freed meanwhile
+	int stop;			//written under aker_work_mut, read atomically by waitAkerStatus
+	int started;
+	pthread_t tid;
+} aker_work_t;
 
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
@@ -52,10 +63,14 @@
 int akerDocVersion=0;
 uint16_t akerTransId=0;
 int wakeFlag = 0;
-char *aker_status = NULL;
+int aker_online = -1;			//last known status, -1 when never received
+time_t aker_status_time = 0;		//monotonic time of the last status
 bool send_aker_flag = false;
 pthread_mutex_t client_mut=PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t client_con=PTHREAD_COND_INITIALIZER;
+static aker_work_t g_aker_work;
+pthread_mutex_t aker_work_mut=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t aker_work_con=PTHREAD_COND_INITIALIZER;
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
@@ -63,8 +78,14 @@ static char *decodePayload(char *payload);
 static void handleAkerStatus(int status, char *payload);
 static void free_crud_message(wrp_msg_t *msg);
 static char* parsePayloadForAkerStatus(char *payload);
-static char *get_global_status();
+static int waitAkerStatus();
 static void set_global_status(char *status);
+static time_t akerNowSec();
+static multipartdocs_t* copyAkerDoc(multipartdocs_t *akerIndex);
+static void freeAkerDoc(multipartdocs_t *doc);
+static void *akerWorker(void *arg);
+static void applyDeferredAker(multipartdocs_t *doc);
+static int akerWorkWait(unsigned int secs);
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -182,22 +203,54 @@ int send_aker_blob(char *paramName, char *blob, uint32_t blobSize, uint16_t docT
 				retry_count++;
 			}
 		}
+		if(ret != WDMP_SUCCESS)
+		{
+			invalidateAkerStatus();
+		}
 		free_crud_message(msg);
 	}
 	return ret;
 }
 
+//Returns 1 when aker is online, 0 when offline and -1 when the cached status is unknown or older than the TTL.
+int getAkerStatusCached()
+{
+	int online = -1;
+
+	pthread_mutex_lock (&client_mut);
+	if(aker_online != -1 && (akerNowSec() - aker_status_time) < AKER_STATUS_TTL_SEC)
+	{
+		online = aker_online;
+	}
+	pthread_mutex_unlock (&client_mut);
+	return online;
+}
+
+void invalidateAkerStatus()
+{
+	pthread_mutex_lock (&client_mut);
+	aker_online = -1;
+	pthread_mutex_unlock (&client_mut);
+}
+
 //send aker-status upstream RETRIEVE request to parodus to check aker registration
 WEBCFG_STATUS checkAkerStatus()
 {
 	wrp_msg_t *msg = NULL;
 	WEBCFG_STATUS rv = WEBCFG_FAILURE;
 	int sendStatus = -1;
-	char *status_val = NULL;
+	int online = -1;
 	char source[MAX_BUF_SIZE/4] = {'\0'};
 	char dest[MAX_BUF_SIZE/4] = {'\0'};
 	char *transaction_uuid = NULL;
 
+	//a recent online status is trusted, an offline one is always re-checked
+	if(getAkerStatusCached() == 1)
+	{
+		WebcfgDebug("Cached aker status is online\n");
+		return WEBCFG_SUCCESS;
+	}
+
 	msg = (wrp_msg_t *)malloc(sizeof(wrp_msg_t));
 	if(msg != NULL)
 	{
@@ -218,24 +271,24 @@ WEBCFG_STATUS checkAkerStatus()
 		}
 		msg->u.crud.content_type = strdup(CONTENT_TYPE_JSON);
 
+		//only a response to this request should wake us up
+		pthread_mutex_lock (&client_mut);
+		wakeFlag = 0;
+		pthread_mutex_unlock (&client_mut);
+
 		sendStatus = libparodus_send(get_webcfg_instance(), msg);
 		if(sendStatus == 0)
 		{
 			WebcfgInfo("Sent aker retrieve request to parodus\n");
-			//waiting to get response from parodus. add lock here while reading
-			status_val = get_global_status();
-			if(status_val !=NULL)
+			online = waitAkerStatus();
+			if(online == 1)
 			{
-				if (strcmp(status_val, AKER_STATUS_ONLINE) == 0)
-				{
-					WebcfgDebug("Received aker status as %s\n", status_val);
-					rv = WEBCFG_SUCCESS;
-				}
-				else
-				{
-					WebcfgError("Received aker status as %s\n", status_val);
-				}
-				WEBCFG_FREE(status_val);
+				WebcfgDebug("Received aker status as %s\n", AKER_STATUS_ONLINE);
+				rv = WEBCFG_SUCCESS;
+			}
+			else if(online == 0)
+			{
+				WebcfgError("Received aker status is not %s\n", AKER_STATUS_ONLINE);
 			}
 			else
 			{
@@ -252,6 +305,74 @@ WEBCFG_STATUS checkAkerStatus()
 	return rv;
 }
 
+//Queues the aker doc for the aker worker and returns without waiting for aker readiness.
+WEBCFG_STATUS deferAkerSubdoc(multipartdocs_t *akerIndex)
+{
+	multipartdocs_t *doc = NULL;
+	multipartdocs_t *old = NULL;
+	uint32_t version = 0;
+
+	doc = copyAkerDoc(akerIndex);
+	if(doc == NULL)
+	{
+		WebcfgError("Failed to queue aker doc\n");
+		return WEBCFG_FAILURE;
+	}
+	version = doc->etag;
+
+	pthread_mutex_lock (&aker_work_mut);
+	if(!g_aker_work.started)
+	{
+		__atomic_store_n(&g_aker_work.stop, 0, __ATOMIC_RELEASE);
+		if(pthread_create(&g_aker_work.tid, NULL, akerWorker, NULL) != 0)
+		{
+			pthread_mutex_unlock (&aker_work_mut);
+			WebcfgError("Error creating aker worker thread :[%s]\n", strerror(errno));
+			freeAkerDoc(doc);
+			return WEBCFG_FAILURE;
+		}
+		g_aker_work.started = 1;
+	}
+	old = g_aker_work.doc;
+	g_aker_work.doc = doc;
+	pthread_cond_signal(&aker_work_con);
+	pthread_mutex_unlock (&aker_work_mut);
+
+	if(old != NULL)
+	{
+		WebcfgInfo("aker doc version %lu superseded by %lu\n", (long)old->etag, (long)version);
+		freeAkerDoc(old);
+	}
+	WebcfgInfo("aker doc version %lu queued\n", (long)version);
+	return WEBCFG_SUCCESS;
+}
+
+void stopAkerWorker()
+{
+	pthread_mutex_lock (&aker_work_mut);
+	if(!g_aker_work.started)
+	{
+		pthread_mutex_unlock (&aker_work_mut);
+		return;
+	}
+	__atomic_store_n(&g_aker_work.stop, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&aker_work_con);
+	pthread_mutex_unlock (&aker_work_mut);
+
+	//an in-flight retrieve waits on client_con
+	pthread_mutex_lock (&client_mut);
+	pthread_cond_broadcast(&client_con);
+	pthread_mutex_unlock (&client_mut);
+
+	JoinThread(g_aker_work.tid);
+
+	pthread_mutex_lock (&aker_work_mut);
+	freeAkerDoc(g_aker_work.doc);
+	g_aker_work.doc = NULL;
+	g_aker_work.started = 0;
+	pthread_mutex_unlock (&aker_work_mut);
+}
+
 void updateAkerMaxRetry(webconfig_tmp_data_t *temp, char *docname)
 {
 	if (NULL != temp)
@@ -259,7 +380,7 @@ void updateAkerMaxRetry(webconfig_tmp_data_t *temp, char *docname)
 		WebcfgDebug("updateAkerMaxRetry: temp->name %s, temp->version %lu, temp->retry_count %d\n",temp->name, (long)temp->version, temp->retry_count);
 		if( strcmp(docname, temp->name) == 0)
 		{
-			updateTmpList(temp, temp->name, temp->version, "failed", "aker_service_unavailable", 0, 0, 0);
+			updateTmpList(temp, temp->name, temp->version, DOC_STATE_FAILED, "aker_service_unavailable", 0, 0, 0);
 			addWebConfgNotifyMsg(temp->name, temp->version, "failed", "aker_service_unavailable", temp->cloud_trans_id, 0, "status", 0, NULL, 200);
 			return;
 		}
@@ -267,15 +388,17 @@ void updateAkerMaxRetry(webconfig_tmp_data_t *temp, char *docname)
 	WebcfgError("updateAkerMaxRetry failed for doc %s\n", docname);
 }
 
-AKER_STATUS processAkerSubdoc(webconfig_tmp_data_t *docNode, multipartdocs_t *akerIndex)
+/* Applies the aker doc copy. The tmp doc is looked up by name and version on
+each update, cloud_trans_id is a copy, so the doc may be dropped meanwhile. */
+AKER_STATUS processAkerSubdoc(multipartdocs_t *akerIndex, char *cloud_trans_id)
 {
 	int i =0;
+	int blobOnly = 0;
 	AKER_STATUS rv = AKER_FAILURE;
-	param_t *reqParam = NULL;
+	webcfg_request_t *req = NULL;
+	REQUEST_BUILD_STATUS buildStatus = REQUEST_BUILD_SUCCESS;
 	WDMP_STATUS ret = WDMP_FAILURE;
-	int paramCount = 0;
 	uint16_t doc_transId = 0;
-	webcfgparam_t *pm = NULL;
 	multipartdocs_t *gmp = NULL;
 	uint16_t err = 0;
 	char* result = NULL;
@@ -289,14 +412,7 @@ AKER_STATUS processAkerSubdoc(webconfig_tmp_data_t *docNode, multipartdocs_t *ak
 		WebcfgError("processAkerSubdoc failed as mp cache is NULL\n");
 		err = getStatusErrorCodeAndMessage(AKER_SUBDOC_PROCESSING_FAILED, &result);
 		WebcfgDebug("The error_details is %s and err_code is %d\n", result, err);
-		if(docNode!=NULL)
-		{
-			updateTmpList(docNode, "aker", docNode->version, "failed", result, err, 0, 0);
-			if(docNode->cloud_trans_id !=NULL)
-			{
-				addWebConfgNotifyMsg("aker", docNode->version, "failed", result, docNode->cloud_trans_id ,0, "status", err, NULL, 200);
-			}
-		}
+		WebcfgError("No aker doc to apply, %s\n", result);
 		WEBCFG_FREE(result);
 
 		return AKER_FAILURE;
@@ -309,117 +425,88 @@ AKER_STATUS processAkerSubdoc(webconfig_tmp_data_t *docNode, multipartdocs_t *ak
 		WebcfgDebug("gmp->data %s\n" , gmp->data);
 		WebcfgDebug("gmp->data_size is %zu\n", gmp->data_size);
 
-		WebcfgDebug("--------------decode root doc-------------\n");
-		pm = webcfgparam_convert( gmp->data, gmp->data_size+1 );
+		buildStatus = buildWebcfgRequest(gmp->name_space, gmp->etag, gmp->data, gmp->data_size, &req);
 		err = errno;
-		if ( NULL != pm)
+		if(buildStatus == REQUEST_BUILD_SUCCESS)
 		{
-			paramCount = (int)pm->entries_count;
-
-			reqParam = (param_t *) malloc(sizeof(param_t) * paramCount);
-			memset(reqParam,0,(sizeof(param_t) * paramCount));
-
-			WebcfgDebug("paramCount is %d\n", paramCount);
-			for (i = 0; i < paramCount; i++)
+			//aker accepts blob params only
+			blobOnly = req->blob;
+			for(i = 0; i < req->count; i++)
 			{
-			        if(pm->entries[i].value != NULL)
-			        {
-					if(pm->entries[i].type == WDMP_BLOB)
-					{
-						char *appended_doc = NULL;
-						appended_doc = webcfg_appendeddoc( gmp->name_space, gmp->etag, pm->entries[i].value, pm->entries[i].value_size, &doc_transId);
-						if(appended_doc != NULL)
-						{
-							WebcfgDebug("webcfg_appendeddoc doc_transId : %hu\n", doc_transId);
-							if(pm->entries[i].name !=NULL)
-							{
-								reqParam[i].name = strdup(pm->entries[i].name);
-							}
-							WebcfgDebug("appended_doc length: %zu\n", strlen(appended_doc));
-							reqParam[i].value = strdup(appended_doc);
-							reqParam[i].type = WDMP_BASE64;
-							WEBCFG_FREE(appended_doc);
-						}
-						updateTmpList(docNode, gmp->name_space, gmp->etag, "pending", "none", 0, doc_transId, 0);
-
-						//Start event handler thread to process aker events if it is not started already.
-						WebcfgDebug("get_global_eventFlag is %d\n", get_global_eventFlag());
-						if(get_global_eventFlag() == 0)
-						{
-							WebcfgInfo("starting initEventHandlingTask during aker processing\n");
-							initEventHandlingTask();
-							processWebcfgEvents();
-							set_global_eventFlag();
-						}
-					}
-					else
-					{
-						WebcfgError("blob type is incorrect\n");
-						err = getStatusErrorCodeAndMessage(INCORRECT_BLOB_TYPE, &result);
-						WebcfgDebug("The error_details is %s and err_code is %d\n", result, err);
-						updateTmpList(docNode, gmp->name_space, gmp->etag, "failed", result, err, 0, 0);
-						if(docNode != NULL && docNode->cloud_trans_id != NULL )
-						{
-							addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", result, docNode->cloud_trans_id ,0, "status", err, NULL, 200);
-						}
-						WEBCFG_FREE(result);
-
-						WEBCFG_FREE(reqParam);
-						webcfgparam_destroy( pm );
-						return rv;
-					}
-			        }
-				WebcfgInfo("Request:> param[%d].name = %s, type = %d\n",i,reqParam[i].name,reqParam[i].type);
-				WebcfgDebug("Request:> param[%d].value = %s\n",i,reqParam[i].value);
+				if(req->params[i].type != WDMP_BASE64)
+				{
+					blobOnly = 0;
+				}
 			}
-
-			if(reqParam !=NULL && validate_request_param(reqParam, paramCount) == WEBCFG_SUCCESS)
+			if(!blobOnly)
 			{
-				ret = send_aker_blob(pm->entries[0].name, pm->entries[0].value,pm->entries[0].value_size, doc_transId, (int)gmp->etag);
-
-				if(ret == WDMP_SUCCESS)
+				WebcfgError("blob type is incorrect\n");
+				err = getStatusErrorCodeAndMessage(INCORRECT_BLOB_TYPE, &result);
+				WebcfgDebug("The error_details is %s and err_code is %d\n", result, err);
+				if(updateTmpListByName(gmp->name_space, gmp->etag, DOC_STATE_FAILED, result, err, 0, 0) == WEBCFG_SUCCESS && cloud_trans_id != NULL)
 				{
-					WebcfgDebug("aker doc send success\n");
-					set_send_aker_flag(true);
-					rv = AKER_SUCCESS;
+					addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", result, cloud_trans_id ,0, "status", err, NULL, 200);
 				}
-				else
-				{
+				WEBCFG_FREE(result);
 
-					err = getStatusErrorCodeAndMessage(AKER_SUBDOC_PROCESSING_FAILED, &result);
+				releaseWebcfgRequest(req);
+				return rv;
+			}
+			doc_transId = req->trans_id;
+			if(updateTmpListByName(gmp->name_space, gmp->etag, DOC_STATE_PENDING, "none", 0, doc_transId, 0) != WEBCFG_SUCCESS)
+			{
+				WebcfgInfo("aker doc version %lu is stale, skipping apply\n", (long)gmp->etag);
+				releaseWebcfgRequest(req);
+				return rv;
+			}
 
-					if(docNode != NULL)
-					{
-						WebcfgInfo("subdoc_name and err_code : %s %lu\n",docNode->name, (long)docNode->error_code);
-						WebcfgInfo("failure_reason %s\n", docNode->error_details);
+			//Start event handler thread to process aker events if it is not started already.
+			WebcfgDebug("get_global_eventFlag is %d\n", get_global_eventFlag());
+			if(get_global_eventFlag() == 0)
+			{
+				WebcfgInfo("starting initEventHandlingTask during aker processing\n");
+				initEventHandlingTask();
+				processWebcfgEvents();
+				set_global_eventFlag();
+			}
 
-						//Invalid aker request
-						updateTmpList(docNode, gmp->name_space, gmp->etag, "failed", "doc_rejected", err, 0, 0);
-						if(docNode->cloud_trans_id !=NULL)
-						{
-							addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", "doc_rejected", docNode->cloud_trans_id, 0, "status", err, NULL, 200);
+			latencyRecordApply(gmp->name_space, doc_transId);
+			ret = send_aker_blob(req->blob_name, req->blob_data, req->blob_size, doc_transId, (int)gmp->etag);
 
-						}
-					}
-					WEBCFG_FREE(result);
+			if(ret == WDMP_SUCCESS)
+			{
+				WebcfgDebug("aker doc send success\n");
+				set_send_aker_flag(true);
+				rv = AKER_SUCCESS;
+			}
+			else
+			{
+
+				err = getStatusErrorCodeAndMessage(AKER_SUBDOC_PROCESSING_FAILED, &result);
 
-					rv = AKER_FAILURE;
+				WebcfgInfo("subdoc_name and err_code : %s %lu\n", gmp->name_space, (long)err);
+
+				//Invalid aker request
+				if(updateTmpListByName(gmp->name_space, gmp->etag, DOC_STATE_FAILED, "doc_rejected", err, 0, 0) == WEBCFG_SUCCESS && cloud_trans_id != NULL)
+				{
+					addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", "doc_rejected", cloud_trans_id, 0, "status", err, NULL, 200);
 				}
-				reqParam_destroy(paramCount, reqParam);
+				WEBCFG_FREE(result);
+
+				rv = AKER_FAILURE;
 			}
-			webcfgparam_destroy( pm );
+			releaseWebcfgRequest(req);
 		}
-		else
+		else if(buildStatus == REQUEST_DECODE_FAILURE)
 		{
 			WebcfgError("--------------decode root doc failed-------------\n");
 			char * msg = NULL;
 			msg = (char *)webcfgparam_strerror(err);
 			err = getStatusErrorCodeAndMessage(DECODE_ROOT_FAILURE, &errMsg);
 			snprintf(value,MAX_VALUE_LEN,"%s:%s", errMsg, msg);
-			updateTmpList(docNode, gmp->name_space, gmp->etag, "failed", value, err, 0, 0);
-			if(docNode !=NULL && docNode->cloud_trans_id !=NULL)
+			if(updateTmpListByName(gmp->name_space, gmp->etag, DOC_STATE_FAILED, value, err, 0, 0) == WEBCFG_SUCCESS && cloud_trans_id != NULL)
 			{
-				addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", value, docNode->cloud_trans_id,0, "status", err, NULL, 200);
+				addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", value, cloud_trans_id,0, "status", err, NULL, 200);
 			}
 			WEBCFG_FREE(errMsg);
 		}
@@ -433,22 +520,38 @@ AKER_STATUS processAkerSubdoc(webconfig_tmp_data_t *docNode, multipartdocs_t *ak
 /*----------------------------------------------------------------------------*/
 /*                             Internal functions                             */
 /*----------------------------------------------------------------------------*/
-//set global aker status and to awake waiting getter threads
+//caches the aker status, wakes the pending retrieve and the aker worker once online
 static void set_global_status(char *status)
 {
+	int online = 0;
+
+	online = (strcmp(status, AKER_STATUS_ONLINE) == 0) ? 1 : 0;
 	pthread_mutex_lock (&client_mut);
 	WebcfgDebug("mutex lock in producer thread\n");
+	if(aker_online != online)
+	{
+		WebcfgInfo("aker status changed to %s\n", status);
+	}
+	aker_online = online;
+	aker_status_time = akerNowSec();
 	wakeFlag = 1;
-	aker_status = status;
-	pthread_cond_signal(&client_con);
+	pthread_cond_broadcast(&client_con);
 	pthread_mutex_unlock (&client_mut);
 	WebcfgDebug("mutex unlock in producer thread\n");
+	WEBCFG_FREE(status);
+
+	if(online)
+	{
+		pthread_mutex_lock (&aker_work_mut);
+		pthread_cond_signal(&aker_work_con);
+		pthread_mutex_unlock (&aker_work_mut);
+	}
 }
 
-//Combining getter func with pthread wait.
-static char *get_global_status()
+//Waits for the retrieve response, returns 1 online, 0 offline, -1 on timeout.
+static int waitAkerStatus()
 {
-	char *temp = NULL;
+	int online = -1;
 	int  rv;
 	struct timespec ts;
 	pthread_mutex_lock (&client_mut);
@@ -460,7 +563,8 @@ static char *get_global_status()
 
 	while (!wakeFlag)
 	{
-		if (get_global_shutdown())
+		//client_mut is held, aker_work_mut is taken before it elsewhere
+		if (get_global_shutdown() || __atomic_load_n(&g_aker_work.stop, __ATOMIC_ACQUIRE))
 		{
 			WebcfgDebug("g_shutdown in client consumer thread\n");
 			break;
@@ -471,14 +575,172 @@ static char *get_global_status()
 		{
 			WebcfgError("Timeout Error. Unable to get service_status even after %d seconds\n", WAIT_TIME_IN_SEC);
 			pthread_mutex_unlock(&client_mut);
-			return NULL;
+			return -1;
 		}
 	}
-	temp = aker_status;
+	if(wakeFlag)
+	{
+		online = aker_online;
+	}
 	wakeFlag = 0;
 	pthread_mutex_unlock (&client_mut);
 	WebcfgDebug("mutex unlock in consumer thread after cond wait\n");
-	return temp;
+	return online;
+}
+
+static time_t akerNowSec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static multipartdocs_t* copyAkerDoc(multipartdocs_t *akerIndex)
+{
+	multipartdocs_t *doc = NULL;
+
+	if(akerIndex == NULL || akerIndex->name_space == NULL || akerIndex->data == NULL)
+	{
+		return NULL;
+	}
+	doc = (multipartdocs_t *)malloc(sizeof(multipartdocs_t));
+	if(doc == NULL)
+	{
+		return NULL;
+	}
+	memset(doc, 0, sizeof(multipartdocs_t));
+	doc->etag = akerIndex->etag;
+	doc->isSupplementarySync = akerIndex->isSupplementarySync;
+	doc->data_size = akerIndex->data_size;
+	doc->name_space = strdup(akerIndex->name_space);
+	//webcfgparam_convert reads data_size+1 bytes
+	doc->data = (char *)malloc(akerIndex->data_size + 1);
+	if(doc->name_space == NULL || doc->data == NULL)
+	{
+		freeAkerDoc(doc);
+		return NULL;
+	}
+	memcpy(doc->data, akerIndex->data, akerIndex->data_size);
+	doc->data[akerIndex->data_size] = '\0';
+	return doc;
+}
+
+static void freeAkerDoc(multipartdocs_t *doc)
+{
+	if(doc != NULL)
+	{
+		WEBCFG_FREE(doc->name_space);
+		WEBCFG_FREE(doc->data);
+		WEBCFG_FREE(doc);
+	}
+}
+
+//Drains the deferred aker doc, off the multipart thread.
+static void *akerWorker(void *arg)
+{
+	multipartdocs_t *doc = NULL;
+
+	(void)arg;
+	while(1)
+	{
+		pthread_mutex_lock (&aker_work_mut);
+		while(g_aker_work.doc == NULL && !g_aker_work.stop)
+		{
+			pthread_cond_wait(&aker_work_con, &aker_work_mut);
+		}
+		if(g_aker_work.stop)
+		{
+			pthread_mutex_unlock (&aker_work_mut);
+			break;
+		}
+		doc = g_aker_work.doc;
+		g_aker_work.doc = NULL;
+		pthread_mutex_unlock (&aker_work_mut);
+
+		applyDeferredAker(doc);
+		freeAkerDoc(doc);
+		doc = NULL;
+	}
+	WebcfgInfo("aker worker exit\n");
+	return NULL;
+}
+
+static void applyDeferredAker(multipartdocs_t *doc)
+{
+	AKER_STATUS akerStatus = AKER_FAILURE;
+	webconfig_tmp_snapshot_t snap;
+	int online = 0;
+	int backoffRetryTime = 0;
+	int max_retry_sleep = (int) pow(2, AKER_BACKOFF_MAX) -1;
+	int c = AKER_BACKOFF_START;
+
+	while(1)
+	{
+		//check aker ready and is registered to parodus using RETRIEVE request to parodus.
+		WebcfgDebug("AkerStatus to check service ready\n");
+		online = (checkAkerStatus() == WEBCFG_SUCCESS) ? 1 : 0;
+
+		//a sync may have dropped or replaced this version while waiting for aker
+		if(getTmpSnapshot(doc->name_space, &snap) != WEBCFG_SUCCESS || snap.version != doc->etag)
+		{
+			WebcfgInfo("aker doc version %lu is stale, skipping apply\n", (long)doc->etag);
+			freeTmpSnapshot(&snap);
+			return;
+		}
+		if(online)
+		{
+			WebcfgInfo("process aker sub doc\n");
+			akerStatus = processAkerSubdoc(doc, snap.cloud_trans_id);
+			WebcfgInfo("Aker doc processed. akerStatus %d\n", akerStatus);
+			freeTmpSnapshot(&snap);
+			return;
+		}
+
+		WebcfgError("Aker is not ready to process requests, retry is required\n");
+		updateTmpListByName(doc->name_space, doc->etag, DOC_STATE_PENDING, "aker_service_unavailable", 0, 0, 0);
+		if(backoffRetryTime >= max_retry_sleep)
+		{
+			WebcfgError("aker doc max retry reached\n");
+			if(updateTmpListByName(doc->name_space, doc->etag, DOC_STATE_FAILED, "aker_service_unavailable", 0, 0, 0) == WEBCFG_SUCCESS)
+			{
+				addWebConfgNotifyMsg(doc->name_space, doc->etag, "failed", "aker_service_unavailable", snap.cloud_trans_id, 0, "status", 0, NULL, 200);
+			}
+			freeTmpSnapshot(&snap);
+			return;
+		}
+		freeTmpSnapshot(&snap);
+		backoffRetryTime = (int) pow(2, c) -1;
+		WebcfgError("aker doc is pending, retrying in backoff interval %dsec\n", backoffRetryTime);
+		if(akerWorkWait(backoffRetryTime))
+		{
+			WebcfgInfo("aker worker stopped or newer aker doc queued\n");
+			return;
+		}
+		c++;
+	}
+}
+
+//Waits out a backoff interval, cut short when aker turns online.
+//Returns 1 when the worker should drop the current doc.
+static int akerWorkWait(unsigned int secs)
+{
+	struct timespec ts;
+	int drop = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += secs;
+	pthread_mutex_lock (&aker_work_mut);
+	while(!g_aker_work.stop && g_aker_work.doc == NULL && getAkerStatusCached() != 1)
+	{
+		if(pthread_cond_timedwait(&aker_work_con, &aker_work_mut, &ts) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+	drop = (g_aker_work.stop || g_aker_work.doc != NULL || get_global_shutdown()) ? 1 : 0;
+	pthread_mutex_unlock (&aker_work_mut);
+	return drop;
 }
 
 static char *decodePayload(char *payload)
@@ -520,7 +782,7 @@ static char *decodePayload(char *payload)
 		docNode = getTmpNode("aker");
 		if(docNode !=NULL)
 		{
-			updateTmpList(docNode, "aker", docNode->version, "failed", errmsg, err, 0, 0);
+			updateTmpList(docNode, "aker", docNode->version, DOC_STATE_FAILED, errmsg, err, 0, 0);
 			if(docNode->cloud_trans_id !=NULL)
 			{
 				addWebConfgNotifyMsg("aker", docNode->version, "failed", errmsg, docNode->cloud_trans_id,0, "status", err, NULL, 200);
@@ -594,7 +856,7 @@ static void handleAkerStatus(int status, char *payload)
 			docNode = getTmpNode("aker");
 			if(docNode !=NULL)
 			{
-				updateTmpList(docNode, "aker", docNode->version, "failed", result, err, 0, 0);
+				updateTmpList(docNode, "aker", docNode->version, DOC_STATE_FAILED, result, err, 0, 0);
 				if(docNode->cloud_trans_id !=NULL)
 				{
 					addWebConfgNotifyMsg("aker", docNode->version, "failed", result, docNode->cloud_trans_id,0, "status", err, NULL, 200);
@@ -677,9 +939,8 @@ void processAkerRetrieve(wrp_msg_t *wrpMsg)
 		status = parsePayloadForAkerStatus(wrpMsg->u.crud.payload);
 		if(status !=NULL)
 		{
-			//set this as global status. add lock before update it.
-			set_global_status(status);
 			WebcfgDebug("set aker-status value as %s\n", status);
+			set_global_status(status);
 		}
 		WEBCFG_FREE(sourceService);
 		WEBCFG_FREE(sourceApplication);
@@ -24,6 +24,7 @@
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
+#define AKER_STATUS_TTL_SEC     60
 typedef enum
 {
     AKER_SUCCESS = 0,
@@ -38,10 +39,14 @@ typedef enum
 /*----------------------------------------------------------------------------*/
 int send_aker_blob(char *paramName, char *blob, uint32_t blobSize, uint16_t docTransId, int version);
 WEBCFG_STATUS checkAkerStatus();
+int getAkerStatusCached();
+void invalidateAkerStatus();
+WEBCFG_STATUS deferAkerSubdoc(multipartdocs_t *akerIndex);
+void stopAkerWorker();
 void processAkerUpdateDelete(wrp_msg_t *wrpMsg);
 void processAkerRetrieve(wrp_msg_t *wrpMsg);
 libpd_instance_t get_webcfg_instance(void);
-AKER_STATUS processAkerSubdoc(webconfig_tmp_data_t *docNode, multipartdocs_t *akerIndex);
+AKER_STATUS processAkerSubdoc(multipartdocs_t *akerIndex, char *cloud_trans_id);
 void updateAkerMaxRetry(webconfig_tmp_data_t *temp, char *docname);
 int akerwait__ (unsigned int secs);
 pthread_cond_t *get_global_client_con(void);
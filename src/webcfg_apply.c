@@ -0,0 +1,545 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <errno.h>
+#include "webcfg.h"
+#include "webcfg_log.h"
+#include "webcfg_apply.h"
+#include "webcfg_validate.h"
+#include "webcfg_rollback.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define APPLY_AFTER_ALL		"*"
+#define APPLY_SPEC_SIZE		1024
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+//doc is applied only after all its deps, or after every other doc when after_all
+typedef struct apply_rule
+{
+	char name[WEBCFG_APPLY_NAME_SIZE];
+	char deps[WEBCFG_APPLY_MAX_DEPS][WEBCFG_APPLY_NAME_SIZE];
+	int ndeps;
+	int after_all;
+} apply_rule_t;
+
+//params under prefix are handled by component, same component means same id
+typedef struct apply_component
+{
+	char prefix[WEBCFG_APPLY_PREFIX_SIZE];
+	char component[WEBCFG_APPLY_NAME_SIZE];
+	int id;
+} apply_component_t;
+
+//State of one schedule run, shared by its workers
+typedef struct apply_sched
+{
+	pthread_mutex_t mut;
+	pthread_cond_t con;
+	uint64_t deps[WEBCFG_APPLY_MAX_DOCS];
+	uint64_t pending;	//not yet dispatched
+	uint64_t done;		//apply returned
+	int running;
+	int applied;
+	int count;
+	webcfgApplyFn fn;
+	void *arg;
+} apply_sched_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static apply_rule_t g_apply_rules[WEBCFG_APPLY_MAX_RULES];
+static int g_apply_rule_count = 0;
+static int g_apply_rules_loaded = 0;
+static int g_apply_workers = WEBCFG_APPLY_DEFAULT_WORKERS;
+static apply_component_t g_apply_components[WEBCFG_APPLY_MAX_COMPONENTS];
+static int g_apply_component_count = 0;
+pthread_mutex_t apply_cfg_mut=PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static char* trimApplyToken(char *token);
+static apply_rule_t* getApplyRule(const char *name, int create);
+static void buildApplyGraph(char **names, int count, uint64_t *deps);
+static void *applyWorker(void *arg);
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/* Reads the apply knobs from webconfig.properties:
+ * WEBCONFIG_APPLY_WORKERS=<n>, docs applied concurrently, 1 applies in multipart order
+ * WEBCONFIG_APPLY_DEPS=<doc>:<dep>|<dep>,<doc>:*  a doc waits for its deps to be applied,
+ * "*" waits for every doc without a "*" rule. Defaults to aker:*
+ * WEBCONFIG_APPLY_BATCH=<param prefix>:<component>,...  consecutive scalar docs of one
+ * component are set together, off when not given
+ * WEBCONFIG_MAX_SUBDOC_SIZE=<bytes>, larger subdocs are rejected before apply, 0 is unlimited
+ * WEBCONFIG_LOCAL_ROLLBACK=true, a NACKed or expired doc is set back to its last good payload */
+void loadApplyConfig(char *filename)
+{
+	FILE *fp = NULL;
+	char str[APPLY_SPEC_SIZE] = {'\0'};
+	char *value = NULL;
+	int found = 0;
+
+	fp = fopen(filename, "r");
+	if(fp != NULL)
+	{
+		while(fgets(str, sizeof(str), fp) != NULL)
+		{
+			if(NULL != (value = strstr(str, "WEBCONFIG_APPLY_WORKERS=")))
+			{
+				value = value + strlen("WEBCONFIG_APPLY_WORKERS=");
+				setApplyWorkers(atoi(value));
+			}
+			else if(NULL != (value = strstr(str, "WEBCONFIG_APPLY_DEPS=")))
+			{
+				value = value + strlen("WEBCONFIG_APPLY_DEPS=");
+				if(setApplyDependencies(value) == WEBCFG_SUCCESS)
+				{
+					found = 1;
+				}
+			}
+			else if(NULL != (value = strstr(str, "WEBCONFIG_APPLY_BATCH=")))
+			{
+				value = value + strlen("WEBCONFIG_APPLY_BATCH=");
+				setApplyBatchComponents(value);
+			}
+			else if(NULL != (value = strstr(str, "WEBCONFIG_MAX_SUBDOC_SIZE=")))
+			{
+				value = value + strlen("WEBCONFIG_MAX_SUBDOC_SIZE=");
+				setValidateMaxDocSize(strtoul(value, NULL, 0));
+			}
+			else if(NULL != (value = strstr(str, "WEBCONFIG_LOCAL_ROLLBACK=")))
+			{
+				value = value + strlen("WEBCONFIG_LOCAL_ROLLBACK=");
+				setLocalRollback(strncmp(value, "true", strlen("true")) == 0);
+			}
+		}
+		fclose(fp);
+	}
+	else
+	{
+		WebcfgDebug("Failed to open %s, apply defaults used\n", filename);
+	}
+	if(!found)
+	{
+		setApplyDependencies(WEBCFG_APPLY_DEFAULT_DEPS);
+	}
+	WebcfgInfo("apply workers %d, dependency rules %d, batch prefixes %d, max subdoc size %zu, local rollback %d\n", g_apply_workers, g_apply_rule_count, g_apply_component_count, getValidateMaxDocSize(), isLocalRollbackEnabled());
+}
+
+//Replaces the dependency rules with the ones parsed from spec.
+WEBCFG_STATUS setApplyDependencies(const char *spec)
+{
+	char buf[APPLY_SPEC_SIZE] = {'\0'};
+	char *rest = NULL, *entry = NULL;
+	char *deps = NULL, *dep = NULL, *drest = NULL;
+	apply_rule_t *rule = NULL;
+
+	if(spec == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	strncpy(buf, spec, sizeof(buf)-1);
+
+	pthread_mutex_lock(&apply_cfg_mut);
+	memset(g_apply_rules, 0, sizeof(g_apply_rules));
+	g_apply_rule_count = 0;
+	g_apply_rules_loaded = 1;
+	rest = buf;
+	while((entry = strtok_r(rest, ",", &rest)) != NULL)
+	{
+		deps = strchr(entry, ':');
+		if(deps == NULL)
+		{
+			WebcfgError("Invalid apply dependency rule %s\n", entry);
+			continue;
+		}
+		*deps++ = '\0';
+		entry = trimApplyToken(entry);
+		rule = getApplyRule(entry, 1);
+		if(rule == NULL)
+		{
+			WebcfgError("Apply dependency rule for %s is dropped\n", entry);
+			continue;
+		}
+		drest = deps;
+		while((dep = strtok_r(drest, "|", &drest)) != NULL)
+		{
+			dep = trimApplyToken(dep);
+			if(strcmp(dep, APPLY_AFTER_ALL) == 0)
+			{
+				rule->after_all = 1;
+			}
+			else if(strlen(dep) > 0 && strlen(dep) < WEBCFG_APPLY_NAME_SIZE && rule->ndeps < WEBCFG_APPLY_MAX_DEPS)
+			{
+				strncpy(rule->deps[rule->ndeps++], dep, WEBCFG_APPLY_NAME_SIZE-1);
+			}
+		}
+	}
+	pthread_mutex_unlock(&apply_cfg_mut);
+	return WEBCFG_SUCCESS;
+}
+
+void setApplyWorkers(int workers)
+{
+	if(workers < 1)
+	{
+		workers = WEBCFG_APPLY_DEFAULT_WORKERS;
+	}
+	if(workers > WEBCFG_APPLY_MAX_WORKERS)
+	{
+		workers = WEBCFG_APPLY_MAX_WORKERS;
+	}
+	g_apply_workers = workers;
+}
+
+int getApplyWorkers()
+{
+	return g_apply_workers;
+}
+
+/* Applies the docs in dependency order. Docs whose deps are applied run
+concurrently on up to getApplyWorkers() threads, the caller being one of them.
+Among ready docs the lower index goes first, so one worker keeps the given order.
+Returns the number of docs applied. */
+int runApplySchedule(char **names, int count, webcfgApplyFn fn, void *arg)
+{
+	apply_sched_t sched;
+	pthread_t tids[WEBCFG_APPLY_MAX_WORKERS];
+	int started = 0;
+	int workers = 0;
+	int i = 0;
+
+	if(names == NULL || fn == NULL || count <= 0)
+	{
+		return 0;
+	}
+	if(count > WEBCFG_APPLY_MAX_DOCS)
+	{
+		WebcfgError("%d docs exceed the apply scheduler limit, applying in order\n", count);
+		for(i = 0; i < count; i++)
+		{
+			if(fn(i, arg))
+			{
+				return i + 1;
+			}
+		}
+		return count;
+	}
+
+	memset(&sched, 0, sizeof(sched));
+	pthread_mutex_init(&sched.mut, NULL);
+	pthread_cond_init(&sched.con, NULL);
+	sched.count = count;
+	sched.fn = fn;
+	sched.arg = arg;
+	sched.pending = (count == WEBCFG_APPLY_MAX_DOCS) ? ~0ULL : ((1ULL << count) - 1);
+	buildApplyGraph(names, count, sched.deps);
+
+	workers = (getApplyWorkers() < count) ? getApplyWorkers() : count;
+	for(i = 1; i < workers; i++)
+	{
+		if(pthread_create(&tids[started], NULL, applyWorker, &sched) != 0)
+		{
+			WebcfgError("Error creating apply worker thread :[%s]\n", strerror(errno));
+			break;
+		}
+		started++;
+	}
+	WebcfgInfo("Applying %d docs on %d workers\n", count, started + 1);
+	applyWorker(&sched);
+	for(i = 0; i < started; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+
+	pthread_cond_destroy(&sched.con);
+	pthread_mutex_destroy(&sched.mut);
+	return sched.applied;
+}
+
+//A doc with deps of its own must be left to the scheduler.
+int hasApplyDependencies(const char *name)
+{
+	apply_rule_t *rule = NULL;
+	int rv = 0;
+
+	pthread_mutex_lock(&apply_cfg_mut);
+	rule = getApplyRule(name, 0);
+	if(rule != NULL && (rule->after_all || rule->ndeps > 0))
+	{
+		rv = 1;
+	}
+	pthread_mutex_unlock(&apply_cfg_mut);
+	return rv;
+}
+
+//Replaces the prefix to component map, an empty spec turns batching off.
+WEBCFG_STATUS setApplyBatchComponents(const char *spec)
+{
+	char buf[APPLY_SPEC_SIZE] = {'\0'};
+	char *rest = NULL, *entry = NULL, *component = NULL;
+	apply_component_t *c = NULL;
+	int i = 0;
+
+	if(spec == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	strncpy(buf, spec, sizeof(buf)-1);
+
+	pthread_mutex_lock(&apply_cfg_mut);
+	memset(g_apply_components, 0, sizeof(g_apply_components));
+	g_apply_component_count = 0;
+	rest = buf;
+	while((entry = strtok_r(rest, ",", &rest)) != NULL)
+	{
+		component = strrchr(entry, ':');
+		if(component == NULL)
+		{
+			WebcfgError("Invalid apply batch rule %s\n", entry);
+			continue;
+		}
+		*component++ = '\0';
+		entry = trimApplyToken(entry);
+		component = trimApplyToken(component);
+		if(g_apply_component_count == WEBCFG_APPLY_MAX_COMPONENTS || strlen(entry) == 0 || strlen(entry) >= WEBCFG_APPLY_PREFIX_SIZE ||
+			strlen(component) == 0 || strlen(component) >= WEBCFG_APPLY_NAME_SIZE)
+		{
+			WebcfgError("Apply batch rule for %s is dropped\n", entry);
+			continue;
+		}
+		c = &g_apply_components[g_apply_component_count];
+		strncpy(c->prefix, entry, WEBCFG_APPLY_PREFIX_SIZE-1);
+		strncpy(c->component, component, WEBCFG_APPLY_NAME_SIZE-1);
+		c->id = g_apply_component_count;
+		for(i = 0; i < g_apply_component_count; i++)
+		{
+			if(strcmp(g_apply_components[i].component, c->component) == 0)
+			{
+				c->id = g_apply_components[i].id;
+				break;
+			}
+		}
+		g_apply_component_count++;
+	}
+	pthread_mutex_unlock(&apply_cfg_mut);
+	return WEBCFG_SUCCESS;
+}
+
+int isApplyBatchEnabled()
+{
+	return (g_apply_component_count > 0);
+}
+
+//Component of the longest prefix matching param, -1 when none matches.
+int getApplyComponent(const char *param)
+{
+	size_t best = 0, len = 0;
+	int id = -1;
+	int i = 0;
+
+	if(param == NULL)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&apply_cfg_mut);
+	for(i = 0; i < g_apply_component_count; i++)
+	{
+		len = strlen(g_apply_components[i].prefix);
+		if(len > best && strncmp(param, g_apply_components[i].prefix, len) == 0)
+		{
+			best = len;
+			id = g_apply_components[i].id;
+		}
+	}
+	pthread_mutex_unlock(&apply_cfg_mut);
+	return id;
+}
+
+const char* getApplyComponentName(int component)
+{
+	if(component < 0 || component >= g_apply_component_count)
+	{
+		return "unknown";
+	}
+	//ids are the index of the first rule of a component
+	return g_apply_components[component].component;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+static char* trimApplyToken(char *token)
+{
+	char *end = NULL;
+
+	while(isspace((unsigned char)*token))
+	{
+		token++;
+	}
+	end = token + strlen(token);
+	while(end > token && isspace((unsigned char)end[-1]))
+	{
+		*--end = '\0';
+	}
+	return token;
+}
+
+//Called with apply_cfg_mut held.
+static apply_rule_t* getApplyRule(const char *name, int create)
+{
+	apply_rule_t *rule = NULL;
+	int i = 0;
+
+	for(i = 0; i < g_apply_rule_count; i++)
+	{
+		if(strcmp(g_apply_rules[i].name, name) == 0)
+		{
+			return &g_apply_rules[i];
+		}
+	}
+	if(!create || g_apply_rule_count == WEBCFG_APPLY_MAX_RULES || strlen(name) == 0 || strlen(name) >= WEBCFG_APPLY_NAME_SIZE)
+	{
+		return NULL;
+	}
+	rule = &g_apply_rules[g_apply_rule_count++];
+	strncpy(rule->name, name, WEBCFG_APPLY_NAME_SIZE-1);
+	return rule;
+}
+
+//deps[i] is the set of docs of this sync that doc i waits for. Deps outside the sync are ignored.
+static void buildApplyGraph(char **names, int count, uint64_t *deps)
+{
+	apply_rule_t *rule = NULL;
+	uint64_t after_all = 0;
+	int i = 0, j = 0, k = 0;
+
+	pthread_mutex_lock(&apply_cfg_mut);
+	if(!g_apply_rules_loaded)
+	{
+		pthread_mutex_unlock(&apply_cfg_mut);
+		setApplyDependencies(WEBCFG_APPLY_DEFAULT_DEPS);
+		pthread_mutex_lock(&apply_cfg_mut);
+	}
+	for(i = 0; i < count; i++)
+	{
+		deps[i] = 0;
+		rule = (names[i] != NULL) ? getApplyRule(names[i], 0) : NULL;
+		if(rule == NULL)
+		{
+			continue;
+		}
+		if(rule->after_all)
+		{
+			after_all |= (1ULL << i);
+		}
+		for(k = 0; k < rule->ndeps; k++)
+		{
+			for(j = 0; j < count; j++)
+			{
+				if(j != i && names[j] != NULL && strcmp(rule->deps[k], names[j]) == 0)
+				{
+					deps[i] |= (1ULL << j);
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&apply_cfg_mut);
+
+	for(i = 0; i < count; i++)
+	{
+		if(after_all & (1ULL << i))
+		{
+			for(j = 0; j < count; j++)
+			{
+				if(!(after_all & (1ULL << j)))
+				{
+					deps[i] |= (1ULL << j);
+				}
+			}
+		}
+	}
+}
+
+static void *applyWorker(void *arg)
+{
+	apply_sched_t *sched = (apply_sched_t *)arg;
+	int index = -1;
+	int stop = 0;
+	int i = 0;
+
+	pthread_mutex_lock(&sched->mut);
+	while(sched->pending != 0)
+	{
+		index = -1;
+		for(i = 0; i < sched->count; i++)
+		{
+			if((sched->pending & (1ULL << i)) && (sched->deps[i] & ~sched->done) == 0)
+			{
+				index = i;
+				break;
+			}
+		}
+		if(index == -1 && sched->running == 0)
+		{
+			//nothing runs and nothing is ready, the rules have a cycle
+			for(i = 0; i < sched->count; i++)
+			{
+				if(sched->pending & (1ULL << i))
+				{
+					index = i;
+					break;
+				}
+			}
+			WebcfgError("Apply dependency cycle, forcing doc index %d\n", index);
+		}
+		if(index == -1)
+		{
+			pthread_cond_wait(&sched->con, &sched->mut);
+			continue;
+		}
+
+		sched->pending &= ~(1ULL << index);
+		sched->running++;
+		sched->applied++;
+		pthread_mutex_unlock(&sched->mut);
+
+		stop = sched->fn(index, sched->arg);
+
+		pthread_mutex_lock(&sched->mut);
+		sched->running--;
+		sched->done |= (1ULL << index);
+		if(stop)
+		{
+			WebcfgInfo("Apply stopped after doc index %d\n", index);
+			sched->pending = 0;
+		}
+		pthread_cond_broadcast(&sched->con);
+	}
+	pthread_mutex_unlock(&sched->mut);
+	return NULL;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBCFG_APPLY_H__
+#define __WEBCFG_APPLY_H__
+
+#include <stdint.h>
+#include "webcfg.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define WEBCFG_APPLY_DEFAULT_WORKERS	4
+#define WEBCFG_APPLY_MAX_WORKERS	16
+//docs of one sync tracked by the scheduler, larger syncs are applied in order
+#define WEBCFG_APPLY_MAX_DOCS		64
+#define WEBCFG_APPLY_MAX_RULES		32
+#define WEBCFG_APPLY_MAX_DEPS		8
+#define WEBCFG_APPLY_NAME_SIZE		64
+//used when webconfig.properties has no WEBCONFIG_APPLY_DEPS
+#define WEBCFG_APPLY_DEFAULT_DEPS	"aker:*"
+#define WEBCFG_APPLY_MAX_COMPONENTS	32
+#define WEBCFG_APPLY_PREFIX_SIZE	256
+//scalar docs sent in one setValues
+#define WEBCFG_APPLY_MAX_BATCH		8
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+//Applies the doc at index, returns non zero to stop dispatching the remaining docs.
+typedef int (*webcfgApplyFn)(int index, void *arg);
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+void loadApplyConfig(char *filename);
+WEBCFG_STATUS setApplyDependencies(const char *spec);
+void setApplyWorkers(int workers);
+int getApplyWorkers();
+int runApplySchedule(char **names, int count, webcfgApplyFn fn, void *arg);
+int hasApplyDependencies(const char *name);
+WEBCFG_STATUS setApplyBatchComponents(const char *spec);
+int isApplyBatchEnabled();
+int getApplyComponent(const char *param);
+const char* getApplyComponentName(int component);
+#endif
@@ -17,6 +17,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/random.h>
 #include <base64.h>
 #include <msgpack.h>
 
@@ -225,7 +226,7 @@ char * webcfg_appendeddoc(char * subdoc_name, uint32_t version, char * blob_data
 
         appenddata->subdoc_name = strdup(subdoc_name);
         appenddata->version = version;
-	*trans_id = generateRandomId();
+	*trans_id = allocateTransId();
 	WebcfgDebug("*trans_id generated is %hu\n", *trans_id);
         appenddata->transaction_id = *trans_id;
 	WebcfgInfo("subdoc_name: %s, version: %lu, transaction_id: %hu\n", subdoc_name, (unsigned long)version, appenddata->transaction_id);
@@ -248,23 +249,63 @@ char * webcfg_appendeddoc(char * subdoc_name, uint32_t version, char * blob_data
     return finaldocdata;
 }
 
+//Embedded doc of webcfg_appendeddoc up to the transaction_id value, which is packed last.
+size_t webcfg_appenddoc_prefix(char * subdoc_name, uint32_t version, char * blob_data, size_t blob_size, void **embeddeddoc)
+{
+    appenddoc_t appenddata;
+    ssize_t appenddocPackSize = -1;
+    void *appenddocdata = NULL;
+    size_t embeddeddocPackSize = 0;
+
+    memset(&appenddata, 0, sizeof(appenddoc_t));
+    appenddata.subdoc_name = subdoc_name;
+    appenddata.version = version;
+    //transaction_id 0 packs as a single fixint byte, dropped below
+    appenddocPackSize = webcfg_pack_appenddoc(&appenddata, &appenddocdata);
+    if(appenddocPackSize < 1 || appenddocdata == NULL)
+    {
+        WebcfgError("Failed to pack append doc of %s\n", subdoc_name);
+        return 0;
+    }
+    embeddeddocPackSize = appendWebcfgEncodedData(embeddeddoc, (void *)blob_data, blob_size, appenddocdata, appenddocPackSize - 1);
+    WEBCFG_FREE(appenddocdata);
+    if(embeddeddocPackSize == (size_t)-1)
+    {
+        WEBCFG_FREE(*embeddeddoc);
+        return 0;
+    }
+    return embeddeddocPackSize;
+}
+
+//Packs the transaction_id value closing an embedded doc, returns its length.
+size_t webcfg_pack_transid(uint16_t trans_id, unsigned char *buf, size_t len)
+{
+    msgpack_sbuffer sbuf;
+    msgpack_packer pk;
+    size_t rv = 0;
+
+    msgpack_sbuffer_init( &sbuf );
+    msgpack_packer_init( &pk, &sbuf, msgpack_sbuffer_write );
+    msgpack_pack_uint16(&pk, trans_id);
+    if( sbuf.data && sbuf.size <= len )
+    {
+        memcpy(buf, sbuf.data, sbuf.size);
+        rv = sbuf.size;
+    }
+    msgpack_sbuffer_destroy( &sbuf );
+    return rv;
+}
+
 uint16_t generateRandomId()
 {
-    FILE *fp;
-	uint16_t random_key,sz;
-	fp = fopen("/dev/urandom", "r");
-	if (fp == NULL){
-    		return 0;
-    	}    	
-	sz = fread(&random_key, sizeof(random_key), 1, fp);
-	if (!sz)
-	{	
-		fclose(fp);
-		WebcfgError("fread failed.\n");
+	uint16_t random_key = 0;
+
+	if (getrandom(&random_key, sizeof(random_key), GRND_NONBLOCK) != sizeof(random_key))
+	{
+		WebcfgError("getrandom failed.\n");
 		return 0;
 	}
 	WebcfgDebug("generateRandomId\n %d",random_key);
-	fclose(fp);		
 	return(random_key);
 }
 
@@ -54,6 +54,10 @@ size_t appendWebcfgEncodedData( void **appendData, void *encodedBuffer, size_t e
 
 char * webcfg_appendeddoc(char * subdoc_name, uint32_t version, char * blob_data, size_t blob_size, uint16_t *trans_id);
 
+size_t webcfg_appenddoc_prefix(char * subdoc_name, uint32_t version, char * blob_data, size_t blob_size, void **embeddeddoc);
+
+size_t webcfg_pack_transid(uint16_t trans_id, unsigned char *buf, size_t len);
+
 uint16_t generateRandomId();
 
 int writeToFileData(char *db_file_path, char *data, size_t size);
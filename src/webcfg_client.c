@@ -186,7 +186,7 @@ void* parodus_receive()
 				docNode = getTmpNode("aker");
 				if(docNode !=NULL)
 				{
-					updateTmpList(docNode, "aker", docNode->version, "failed", errmsg, err, 0, 0);
+					updateTmpList(docNode, "aker", docNode->version, DOC_STATE_FAILED, errmsg, err, 0, 0);
 					if(docNode->cloud_trans_id !=NULL)
 					{
 						addWebConfgNotifyMsg("aker", docNode->version, "failed", errmsg, docNode->cloud_trans_id,0, "status", err, NULL, 200);
@@ -195,6 +195,7 @@ void* parodus_receive()
 				WEBCFG_FREE(errmsg);
 				sleep_counter = 0;
 				set_send_aker_flag(false);
+				invalidateAkerStatus();
 			}
 			continue;
 		}
@@ -16,6 +16,10 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/random.h>
 #include <msgpack.h>
 #include <pthread.h>
 #include "webcfg_helpers.h"
@@ -28,7 +32,18 @@
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
-/* none */
+#define TMP_INDEX_BUCKETS	64
+#define TXID_TABLE_SIZE		65536
+//Marks an allocated txid which is not yet bound to a doc
+#define TXID_RESERVED		((webconfig_tmp_data_t *)&g_txid_state)
+
+/* DB file header, all fields little endian:
+ * magic[4] "WCDB", format version u16, header length u16,
+ * record count u32, payload length u32, CRC32C of payload u32.
+ * Files without the magic are read as the legacy bare msgpack format. */
+#define WEBCFG_DB_MAGIC		"WCDB"
+#define WEBCFG_DB_FORMAT_VERSION	1
+#define WEBCFG_DB_HEADER_LEN	20
 
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
@@ -53,13 +68,33 @@ enum {
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
 static webconfig_tmp_data_t * g_head = NULL;
+static webconfig_tmp_data_t * g_tail = NULL;
+static webconfig_tmp_data_t * g_tmp_index[TMP_INDEX_BUCKETS];
+static webconfig_tmp_data_t * g_txid_table[TXID_TABLE_SIZE];
+static uint32_t g_txid_state = 0;
+static int g_txid_reserved = 0;		//TXID_RESERVED entries of g_txid_table
+//fixed error_details vocabulary shared by all tmp nodes, anything else is a per node copy
+static const char * const g_interned[] = {
+	"none",
+	"pending",
+	"success",
+	"failed",
+	"failed_retrying",
+	"max_retry_reached",
+	"doc_rejected",
+	"aker_service_unavailable"
+};
 static blob_t * webcfgdb_blob = NULL;
+static char * webcfgdb_blob_base64 = NULL;
+static int webcfgdb_blob_dirty = 1;
 static webconfig_db_data_t* webcfgdb_data = NULL;
 pthread_mutex_t webconfig_db_mut=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t webconfig_tmp_data_mut=PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t webconfig_blob_mut=PTHREAD_MUTEX_INITIALIZER;
 static int numOfMpDocs = 0;
 static int success_doc_count = 0;
-static int doc_fail_flag = 0;
+//DB file found corrupt by initDB, it must not replace the good snapshot until rewritten
+static char db_snapshot_hold[256] = {'\0'};
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
@@ -68,72 +103,66 @@ int process_webcfgdb( webconfig_db_data_t *wd, msgpack_object *obj );
 
 int process_webcfgdbblob( blob_struct_t *bd, msgpack_object *obj );
 int process_webcfgdbblobparams( blob_data_t *e, msgpack_object_map *map );
+WEBCFG_STATUS generateBlobCache();
+unsigned int stringHash(const char *str);
+void tmpIndexRebuild();
+void tmpListAppend(webconfig_tmp_data_t *node);
+webconfig_tmp_data_t * tmpIndexFind(const char *docname);
+void tmpListUnlink(webconfig_tmp_data_t *node);
+void tmpNodeDestroy(webconfig_tmp_data_t *node);
+void tmpTransIdBind(webconfig_tmp_data_t *node, uint16_t trans_id);
+void tmpTransIdRelease(uint16_t trans_id);
+int isInternedString(const char *str);
+WEBCFG_STATUS loadDBFile(char *db_file_path);
+WEBCFG_STATUS validateDBFileHeader(char *data, size_t len, char **payload, size_t *payload_len);
+void deleteDBList();
+uint32_t crc32c(const char *data, size_t len);
+static uint64_t xxh64Round(uint64_t acc, uint64_t input);
+static uint64_t getLE64(const unsigned char *buf);
+void putLE16(unsigned char *buf, uint16_t val);
+int syncParentDir(const char *file_path);
+void putLE32(unsigned char *buf, uint32_t val);
+uint16_t getLE16(const unsigned char *buf);
+uint32_t getLE32(const unsigned char *buf);
+#ifdef WEBCFG_DB_BLOB_DEBUG
+void printBlobBase64(char *b64buffer);
+#endif
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
 
-//To initialize the DB when DB file is present
+//To initialize the DB when DB file is present, falls back to the last good snapshot
+//only when the DB file is corrupt. A missing DB file is a wiped DB, never restored.
 WEBCFG_STATUS initDB(char * db_file_path )
 {
-     FILE *fp = NULL;
-     size_t sz = 0;
-     char *data = NULL;
-     size_t len = 0;
-     int ch_count=0;
-     webconfig_db_data_t* dm = NULL;
+     char backup_path[256] = {'\0'};
 
      WebcfgDebug("DB file path is %s\n", db_file_path);
-     fp = fopen(db_file_path,"rb");
-
-     if (fp == NULL)
+     if(access(db_file_path, F_OK) != 0)
      {
-	WebcfgError("Failed to open file %s\n", db_file_path);
+	WebcfgInfo("DB file %s is not present\n", db_file_path);
 	return WEBCFG_FAILURE;
      }
-     
-     fseek(fp, 0, SEEK_END);
-     ch_count = ftell(fp);
-     if (ch_count == (int)-1)
+     if(strcmp(db_snapshot_hold, db_file_path) == 0)
      {
-         WebcfgError("fread failed.\n");
-	 fclose(fp);
-         return WEBCFG_FAILURE;
+	db_snapshot_hold[0] = '\0';
      }
-     fseek(fp, 0, SEEK_SET);
-     data = (char *) malloc(sizeof(char) * (ch_count + 1));
-     if(NULL == data)
+     if(loadDBFile(db_file_path) != WEBCFG_SUCCESS)
      {
-         WebcfgError("Memory allocation for data failed.\n");
-         fclose(fp);
-         return WEBCFG_FAILURE;
-     }
-     memset(data,0,(ch_count + 1));
-     sz = fread(data, 1, ch_count,fp);
-     if (sz == (size_t)-1) 
-	{	
-		fclose(fp);
-		WebcfgError("fread failed.\n");
-		WEBCFG_FREE(data);
+	deleteDBList();
+	snprintf(backup_path, sizeof(backup_path), "%s%s", db_file_path, WEBCFG_DB_BACKUP_SUFFIX);
+	WebcfgError("DB file %s is not usable, loading last good snapshot %s\n", db_file_path, backup_path);
+	if(loadDBFile(backup_path) != WEBCFG_SUCCESS)
+	{
+		deleteDBList();
 		return WEBCFG_FAILURE;
 	}
-     len = ch_count;
-     fclose(fp);
-
-     dm = decodeData((void *)data, len);
-     if(NULL == dm)
-     {
-	 WebcfgError("Msgpack decode failed\n");
-         return WEBCFG_FAILURE;
-     }
-     else
-     {
-         webcfgdb_destroy (dm );
+	WebcfgInfo("DB loaded from last good snapshot %s\n", backup_path);
+	snprintf(db_snapshot_hold, sizeof(db_snapshot_hold), "%s", db_file_path);
      }
-     WEBCFG_FREE(data);
      generateBlob();
      return WEBCFG_SUCCESS;
-     
 }
 
 //addNewDocEntry function will pack the DB blob and persist to a bin file
@@ -145,8 +174,8 @@ WEBCFG_STATUS addNewDocEntry(size_t count)
      WebcfgDebug("DB docs count %ld\n", (size_t)count);
      webcfgdbPackSize = webcfgdb_pack(webcfgdb_data, &data, count);
      WebcfgDebug("size of webcfgdbPackSize %ld\n", webcfgdbPackSize);
-     WebcfgDebug("writeToDBFile %s\n", WEBCFG_DB_FILE);
-     writeToDBFile(WEBCFG_DB_FILE,(char *)data,webcfgdbPackSize);
+     WebcfgDebug("writeDBFileWithHeader %s\n", WEBCFG_DB_FILE);
+     writeDBFileWithHeader(WEBCFG_DB_FILE, (char *)data, webcfgdbPackSize, count);
      if(data)
      {
 	WEBCFG_FREE(data);
@@ -157,42 +186,20 @@ WEBCFG_STATUS addNewDocEntry(size_t count)
 //generateBlob function is used to pack webconfig_tmp_data_t and webconfig_db_data_t
 WEBCFG_STATUS generateBlob()
 {
-    size_t webcfgdbBlobPackSize = -1;
-    void * data = NULL;
-
-    if(webcfgdb_blob)
-    {
-	WebcfgDebug("Delete existing webcfgdb_blob.\n");
-	WEBCFG_FREE(webcfgdb_blob->data);
-	WEBCFG_FREE(webcfgdb_blob);
-	webcfgdb_blob = NULL;
-    }
-    WebcfgDebug("Generate new blob\n");
-    if(webcfgdb_data != NULL || g_head != NULL)
-    {
-        webcfgdbBlobPackSize = webcfgdb_blob_pack(webcfgdb_data, g_head, &data);
-        webcfgdb_blob = (blob_t *)malloc(sizeof(blob_t));
-        if(webcfgdb_blob != NULL)
-        {
-            memset( webcfgdb_blob, 0, sizeof( blob_t ) );
+    WEBCFG_STATUS ret;
 
-            webcfgdb_blob->data = (char *)data;
-            webcfgdb_blob->len  = webcfgdbBlobPackSize;
+    pthread_mutex_lock (&webconfig_blob_mut);
+    ret = generateBlobCache();
+    pthread_mutex_unlock (&webconfig_blob_mut);
+    return ret;
+}
 
-            WebcfgDebug("The webcfgdbBlobPackSize is : %ld\n",webcfgdb_blob->len);
-            return WEBCFG_SUCCESS;
-        }
-        else
-        {
-            WebcfgError("Failed in memory allocation for webcfgdb_blob\n");
-            return WEBCFG_FAILURE;
-        }
-    }
-    else
-    {
-        WebcfgError("Failed in packing blob\n");
-        return WEBCFG_FAILURE;
-    }
+//Mark the cached DB blob as stale, it is regenerated on the next read
+void set_DB_BLOB_dirty()
+{
+    pthread_mutex_lock (&webconfig_blob_mut);
+    webcfgdb_blob_dirty = 1;
+    pthread_mutex_unlock (&webconfig_blob_mut);
 }
 
 int writeToDBFile(char *db_file_path, char *data, size_t size)
@@ -218,6 +225,87 @@ int writeToDBFile(char *db_file_path, char *data, size_t size)
 	}
 }
 
+/* Writes header and payload to a temp file which is synced and renamed over
+the DB file, the previous DB file is hard linked as the last good snapshot
+first. The DB file itself is never missing, a power cut at any point leaves
+either the old or the new one in place. A DB file initDB found corrupt is
+not snapshotted, the snapshot it was loaded from is kept. */
+int writeDBFileWithHeader(char *db_file_path, char *data, size_t size, size_t count)
+{
+	FILE *fp;
+	unsigned char header[WEBCFG_DB_HEADER_LEN];
+	char tmp_path[256] = {'\0'};
+	char backup_path[256] = {'\0'};
+
+	if(data == NULL)
+	{
+		WebcfgError("writeDBFileWithHeader failed, Data is NULL\n");
+		return 0;
+	}
+
+	memcpy(header, WEBCFG_DB_MAGIC, 4);
+	putLE16(header + 4, WEBCFG_DB_FORMAT_VERSION);
+	putLE16(header + 6, WEBCFG_DB_HEADER_LEN);
+	putLE32(header + 8, (uint32_t)count);
+	putLE32(header + 12, (uint32_t)size);
+	putLE32(header + 16, crc32c(data, size));
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s%s", db_file_path, WEBCFG_DB_TMP_SUFFIX);
+	snprintf(backup_path, sizeof(backup_path), "%s%s", db_file_path, WEBCFG_DB_BACKUP_SUFFIX);
+
+	fp = fopen(tmp_path, "wb");
+	if (fp == NULL)
+	{
+		WebcfgError("Failed to open file in db %s\n", tmp_path);
+		return 0;
+	}
+	if((fwrite(header, sizeof(header), 1, fp) != 1) || (size > 0 && fwrite(data, size, 1, fp) != 1) || (fflush(fp) != 0) || (fsync(fileno(fp)) != 0))
+	{
+		WebcfgError("Failed to write db file %s\n", tmp_path);
+		fclose(fp);
+		unlink(tmp_path);
+		return 0;
+	}
+	fclose(fp);
+
+	if(strcmp(db_snapshot_hold, db_file_path) == 0)
+	{
+		WebcfgInfo("DB file %s is corrupt, keeping snapshot %s\n", db_file_path, backup_path);
+	}
+	else if(access(db_file_path, F_OK) == 0)
+	{
+		unlink(backup_path);
+		if(link(db_file_path, backup_path) != 0)
+		{
+			WebcfgError("Failed to keep db snapshot %s, errno %d\n", backup_path, errno);
+		}
+	}
+	if(rename(tmp_path, db_file_path) != 0)
+	{
+		WebcfgError("Failed to rename %s to %s\n", tmp_path, db_file_path);
+		unlink(tmp_path);
+		return 0;
+	}
+	//a valid DB file is in place again, the next write may snapshot it
+	if(strcmp(db_snapshot_hold, db_file_path) == 0)
+	{
+		db_snapshot_hold[0] = '\0';
+	}
+	//the rename is only durable once the directory entry is synced
+	if(syncParentDir(db_file_path) != 0)
+	{
+		WebcfgError("Failed to sync directory of %s\n", db_file_path);
+	}
+	WebcfgDebug("DB file %s written with %zu docs, %zu bytes\n", db_file_path, count, size);
+	return 1;
+}
+
+//The snapshot alone does not count, a removed DB file means the DB was wiped.
+bool isDBFilePresent()
+{
+	return (access(WEBCFG_DB_FILE, F_OK) == 0);
+}
+
 //Used to decode the DB bin file 
 webconfig_db_data_t* decodeData(const void * buf, size_t len)
 {
@@ -344,7 +432,9 @@ void set_global_tmp_node(webconfig_tmp_data_t *new)
 {
     pthread_mutex_lock (&webconfig_tmp_data_mut);
     g_head = new;
+    tmpIndexRebuild();
     pthread_mutex_unlock (&webconfig_tmp_data_mut);
+    set_DB_BLOB_dirty();
 }
 
 int get_numOfMpDocs()
@@ -367,24 +457,22 @@ void reset_successDocCount()
     success_doc_count = 0;
 }
 
-int get_doc_fail()
-{
-    return doc_fail_flag;
-}
-
-void set_doc_fail( int value)
-{
-    doc_fail_flag = value;
-}
-
 blob_t * get_DB_BLOB()
 {
-     WebcfgDebug("Proceed to generateBlob\n");
-     if(generateBlob() != WEBCFG_SUCCESS)
+     blob_t * db_blob = NULL;
+
+     pthread_mutex_lock (&webconfig_blob_mut);
+     if(webcfgdb_blob_dirty || webcfgdb_blob == NULL)
      {
-	WebcfgError("Failed in Blob generation\n");
+	WebcfgDebug("Proceed to generateBlob\n");
+	if(generateBlobCache() != WEBCFG_SUCCESS)
+	{
+		WebcfgError("Failed in Blob generation\n");
+	}
      }
-     return webcfgdb_blob;
+     db_blob = webcfgdb_blob;
+     pthread_mutex_unlock (&webconfig_blob_mut);
+     return db_blob;
 }
 
 //new_node indicates the docs which need to be added to list
@@ -404,7 +492,7 @@ WEBCFG_STATUS addToTmpList()
 	WebcfgDebug("Deleted existing tmp list based on sync type, proceed to addToTmpList\n");
 
 	multipartdocs_t *mp_node = NULL;
-	mp_node = get_global_mp();
+	mp_node = acquire_global_mp();
 
 	WebcfgDebug("The numdocs is %d\n",numOfMpDocs);
 	cloud_transaction_id = get_global_transID();
@@ -428,11 +516,11 @@ WEBCFG_STATUS addToTmpList()
 					WebcfgInfo("Primary sync , update global root version to tmp list\n");
 					new_node->version = get_global_root();
 				}
-				new_node->status = strdup("pending");
+				new_node->state = DOC_STATE_PENDING;
 				//For root, isSupplementarySync is always 0 as root version is for primary sync.
 				new_node->isSupplementarySync = 0;
 				WebcfgDebug("new_node->isSupplementarySync is %d\n", new_node->isSupplementarySync);
-				new_node->error_details = strdup("none");
+				new_node->error_details = getInternedString("none");
 				new_node->error_code = 0;
 				new_node->trans_id = 0;
 				new_node->retry_count = 0;
@@ -453,18 +541,19 @@ WEBCFG_STATUS addToTmpList()
 					new_node->name = strdup(mp_node->name_space);
 					WebcfgDebug("mp_node->name_space is %s\n", mp_node->name_space);
 					new_node->version = mp_node->etag;
-					new_node->status = strdup("pending_apply");
+					new_node->state = DOC_STATE_PENDING_APPLY;
 					new_node->isSupplementarySync = mp_node->isSupplementarySync;
-					new_node->error_details = strdup("none");
+					new_node->error_details = getInternedString("none");
 					new_node->error_code = 0;
 					new_node->trans_id = 0;
 					new_node->retry_count = 0;
 					new_node->retry_timestamp = 0;
 					new_node->cloud_trans_id = strdup(cloud_transaction_id);
+					new_node->digest = xxhash64(mp_node->data, mp_node->data_size, 0);
 
 					WebcfgDebug("new_node->name is %s\n", new_node->name);
 					WebcfgDebug("new_node->version is %lu\n", (long)new_node->version);
-					WebcfgDebug("new_node->status is %s\n", new_node->status);
+					WebcfgDebug("new_node->state is %s\n", DOC_STATE_STRING(new_node->state));
 					WebcfgDebug("new_node->isSupplementarySync is %d\n", new_node->isSupplementarySync);
 					WebcfgDebug("new_node->error_details is %s\n", new_node->error_details);
 					WebcfgDebug("new_node->retry_count is %d\n", new_node->retry_count);
@@ -478,26 +567,11 @@ WEBCFG_STATUS addToTmpList()
 
 		if(new_node)
 		{
-			new_node->next=NULL;
 			pthread_mutex_lock (&webconfig_tmp_data_mut);
-			if (g_head == NULL)
-			{
-				g_head = new_node;
-				pthread_mutex_unlock (&webconfig_tmp_data_mut);
-			}
-			else
-			{
-				webconfig_tmp_data_t *temp = NULL;
-				WebcfgDebug("Adding docs to list\n");
-				temp = g_head;
-				while(temp->next !=NULL)
-				{
-					temp=temp->next;
-				}
-				temp->next=new_node;
-				pthread_mutex_unlock (&webconfig_tmp_data_mut);
-			}
+			tmpListAppend(new_node);
+			pthread_mutex_unlock (&webconfig_tmp_data_mut);
 
+			set_DB_BLOB_dirty();
 			WebcfgDebug("--->>doc %s with version %lu is added to list\n", new_node->name, (long)new_node->version);
 			numOfMpDocs = numOfMpDocs + 1;
 		}
@@ -506,6 +580,7 @@ WEBCFG_STATUS addToTmpList()
 			WebcfgDebug("addToTmpList success\n");
 			retStatus = WEBCFG_SUCCESS;
 	}
+	release_global_mp();
 	WebcfgDebug("addToList return %d\n", retStatus);
 	return retStatus;
 }
@@ -578,6 +653,7 @@ WEBCFG_STATUS updateDBlist(char *docname, uint32_t version, char* rootstr)
 			WebcfgDebug("webcfgdb %s is updated to version %lu webcfgdb->root_string %s\n", docname, (long)webcfgdb->version, webcfgdb->root_string);
 			pthread_mutex_unlock (&webconfig_db_mut);
 			WebcfgDebug("mutex_unlock if docname is webcfgdb name\n");
+			set_DB_BLOB_dirty();
 			return WEBCFG_SUCCESS;
 		}
 		webcfgdb= webcfgdb->next;
@@ -586,54 +662,186 @@ WEBCFG_STATUS updateDBlist(char *docname, uint32_t version, char* rootstr)
 	}
 	return WEBCFG_FAILURE;
 }
-//update version, status for each doc
-WEBCFG_STATUS updateTmpList(webconfig_tmp_data_t *temp, char *docname, uint32_t version, char *status, char *error_details, uint16_t error_code, uint16_t trans_id, int retry)
+WEBCFG_STATUS updateDBDigest(char *docname, uint64_t digest)
+{
+	webconfig_db_data_t *webcfgdb = NULL;
+	WEBCFG_STATUS rv = WEBCFG_FAILURE;
+
+	pthread_mutex_lock (&webconfig_db_mut);
+	for(webcfgdb = webcfgdb_data; webcfgdb != NULL; webcfgdb = webcfgdb->next)
+	{
+		if(strcmp(docname, webcfgdb->name) == 0)
+		{
+			webcfgdb->digest = digest;
+			rv = WEBCFG_SUCCESS;
+			break;
+		}
+	}
+	pthread_mutex_unlock (&webconfig_db_mut);
+	return rv;
+}
+
+uint64_t getDBDigest(char *docname)
+{
+	webconfig_db_data_t *webcfgdb = NULL;
+	uint64_t digest = 0;
+
+	pthread_mutex_lock (&webconfig_db_mut);
+	for(webcfgdb = webcfgdb_data; webcfgdb != NULL; webcfgdb = webcfgdb->next)
+	{
+		if(strcmp(docname, webcfgdb->name) == 0)
+		{
+			digest = webcfgdb->digest;
+			break;
+		}
+	}
+	pthread_mutex_unlock (&webconfig_db_mut);
+	return digest;
+}
+
+//update version, state for each doc
+//Called with webconfig_tmp_data_mut held, releases trans_id when the update is refused.
+static WEBCFG_STATUS updateTmpNodeLocked(webconfig_tmp_data_t *temp, char *docname, uint32_t version, WEBCFG_DOC_STATE state, const char *error_details, uint16_t error_code, uint16_t trans_id, int retry)
+{
+	if(!isValidDocStateTransition(temp->state, state))
+	{
+		WebcfgError("doc %s invalid state transition %s -> %s, not updated\n", docname, DOC_STATE_STRING(temp->state), DOC_STATE_STRING(state));
+		tmpTransIdRelease(trans_id);
+		return WEBCFG_FAILURE;
+	}
+	temp->version = version;
+	temp->state = state;
+	setTmpErrorDetails(temp, error_details);
+	temp->error_code = error_code;
+	tmpTransIdBind(temp, trans_id);
+	WebcfgDebug("updateTmpList: retry %d\n", retry);
+	if(!retry)
+	{
+		WebcfgDebug("updateTmpList: reset temp->retry_count\n");
+		temp->retry_count = 0;
+	}
+	WebcfgInfo("doc %s is updated to version %lu status %s error_details %s error_code %lu trans_id %lu temp->retry_count %d\n", docname, (long)temp->version, DOC_STATE_STRING(temp->state), temp->error_details, (long)temp->error_code, (long)temp->trans_id, temp->retry_count);
+	return WEBCFG_SUCCESS;
+}
+
+WEBCFG_STATUS updateTmpList(webconfig_tmp_data_t *temp, char *docname, uint32_t version, WEBCFG_DOC_STATE state, const char *error_details, uint16_t error_code, uint16_t trans_id, int retry)
 {
+	WEBCFG_STATUS rv = WEBCFG_FAILURE;
+
 	if (NULL != temp)
 	{
-		WebcfgDebug("updateTmpList: node is pointing to temp->name %s \n",temp->name);
 		pthread_mutex_lock (&webconfig_tmp_data_mut);
 		WebcfgDebug("mutex_lock in updateTmpList\n");
-		if( strcmp(docname, temp->name) == 0)
+		//temp may already be freed by a concurrent sync, it is only compared until found by name.
+		if( temp == tmpIndexFind(docname))
 		{
-			temp->version = version;
-			if(strcmp(temp->status, status) !=0)
-			{
-				WEBCFG_FREE(temp->status);
-				temp->status = NULL;
-				temp->status = strdup(status);
-			}
-			if(strcmp(temp->error_details, error_details) !=0)
-			{
-				WEBCFG_FREE(temp->error_details);
-				temp->error_details = NULL;
-				temp->error_details = strdup(error_details);
-			}
-			temp->error_code = error_code;
-			temp->trans_id = trans_id;
-			WebcfgDebug("updateTmpList: retry %d\n", retry);
-			if(!retry)
-			{
-				WebcfgDebug("updateTmpList: reset temp->retry_count\n");
-				temp->retry_count = 0;
-			}
-			WebcfgInfo("doc %s is updated to version %lu status %s error_details %s error_code %lu trans_id %lu temp->retry_count %d\n", docname, (long)temp->version, temp->status, temp->error_details, (long)temp->error_code, (long)temp->trans_id, temp->retry_count);
+			rv = updateTmpNodeLocked(temp, docname, version, state, error_details, error_code, trans_id, retry);
 			pthread_mutex_unlock (&webconfig_tmp_data_mut);
 			WebcfgDebug("mutex_unlock in current temp details\n");
-			return WEBCFG_SUCCESS;
+			if(rv == WEBCFG_SUCCESS)
+			{
+				set_DB_BLOB_dirty();
+			}
+			return rv;
 		}
+		tmpTransIdRelease(trans_id);
 		pthread_mutex_unlock (&webconfig_tmp_data_mut);
 		WebcfgDebug("mutex_unlock in updateTmpList\n");
 	}
+	else
+	{
+		releaseTransId(trans_id);
+	}
 	WebcfgError("updateTmpList failed as doc %s is not in tmp list\n", docname);
 	return WEBCFG_FAILURE;
 }
 
+//As updateTmpList for threads without a node, only while the doc is still at version.
+WEBCFG_STATUS updateTmpListByName(char *docname, uint32_t version, WEBCFG_DOC_STATE state, const char *error_details, uint16_t error_code, uint16_t trans_id, int retry)
+{
+	webconfig_tmp_data_t *temp = NULL;
+	WEBCFG_STATUS rv = WEBCFG_FAILURE;
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	temp = tmpIndexFind(docname);
+	if(NULL != temp && temp->version == version)
+	{
+		rv = updateTmpNodeLocked(temp, docname, version, state, error_details, error_code, trans_id, retry);
+	}
+	else
+	{
+		WebcfgError("doc %s version %lu is no longer in tmp list, not updated\n", docname, (long)version);
+		tmpTransIdRelease(trans_id);
+	}
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	if(rv == WEBCFG_SUCCESS)
+	{
+		set_DB_BLOB_dirty();
+	}
+	return rv;
+}
+
+/* pending_apply is only entered when a doc is added by a sync. A doc that
+reached success is only reopened by a new apply (pending), it can not fail
+without being applied again. */
+bool isValidDocStateTransition(WEBCFG_DOC_STATE from, WEBCFG_DOC_STATE to)
+{
+	switch(from)
+	{
+		case DOC_STATE_PENDING_APPLY:
+		case DOC_STATE_PENDING:
+		case DOC_STATE_FAILED:
+			return (to == DOC_STATE_PENDING || to == DOC_STATE_SUCCESS || to == DOC_STATE_FAILED);
+		case DOC_STATE_SUCCESS:
+			return (to == DOC_STATE_PENDING || to == DOC_STATE_SUCCESS);
+		default:
+			return false;
+	}
+}
+
+const char* getInternedString(const char *str)
+{
+	size_t i;
+
+	if(str == NULL)
+	{
+		str = "none";
+	}
+	for(i = 0; i < sizeof(g_interned)/sizeof(g_interned[0]); i++)
+	{
+		if(strcmp(g_interned[i], str) == 0)
+		{
+			return g_interned[i];
+		}
+	}
+	return NULL;
+}
+
+void setTmpErrorDetails(webconfig_tmp_data_t *node, const char *error_details)
+{
+	const char *details = NULL;
+
+	details = getInternedString(error_details);
+	if(details == NULL)
+	{
+		details = strdup(error_details);
+		if(details == NULL)
+		{
+			WebcfgError("Failed to copy error_details %s\n", error_details);
+			details = getInternedString("none");
+		}
+	}
+	if(node->error_details != NULL && !isInternedString(node->error_details))
+	{
+		free((char *)node->error_details);
+	}
+	node->error_details = details;
+}
 
 //delete doc from webcfg Tmp list
 WEBCFG_STATUS deleteFromTmpList(char* doc_name)
 {
-	webconfig_tmp_data_t *prev_node = NULL, *curr_node = NULL;
+	webconfig_tmp_data_t *curr_node = NULL;
 
 	if( NULL == doc_name )
 	{
@@ -642,42 +850,20 @@ WEBCFG_STATUS deleteFromTmpList(char* doc_name)
 	}
 	WebcfgDebug("doc to be deleted: %s\n", doc_name);
 
-	prev_node = NULL;
-	pthread_mutex_lock (&webconfig_tmp_data_mut);	
-	curr_node = g_head ;
-	// Traverse to get the doc to be deleted
-	while( NULL != curr_node )
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	curr_node = tmpIndexFind(doc_name);
+	if( NULL != curr_node )
 	{
-		if(strcmp(curr_node->name, doc_name) == 0)
-		{
-			WebcfgDebug("Found the node to delete\n");
-			if( NULL == prev_node )
-			{
-				WebcfgDebug("need to delete first doc\n");
-				g_head = curr_node->next;
-			}
-			else
-			{
-				WebcfgDebug("Traversing to find node\n");
-				prev_node->next = curr_node->next;
-			}
-
-			WebcfgDebug("Deleting the node entries\n");
-			WEBCFG_FREE( curr_node->name );
-			WEBCFG_FREE( curr_node->status );
-			WEBCFG_FREE( curr_node->error_details );
-			WEBCFG_FREE( curr_node->cloud_trans_id);
-			WEBCFG_FREE( curr_node );
-			curr_node = NULL;
-			WebcfgDebug("Deleted successfully and returning..\n");
-			numOfMpDocs =numOfMpDocs - 1;
-			WebcfgDebug("numOfMpDocs after delete is %d\n", numOfMpDocs);
-			pthread_mutex_unlock (&webconfig_tmp_data_mut);
-			return WEBCFG_SUCCESS;
-		}
-
-		prev_node = curr_node;
-		curr_node = curr_node->next;
+		WebcfgDebug("Found the node to delete\n");
+		tmpListUnlink(curr_node);
+		WebcfgDebug("Deleting the node entries\n");
+		tmpNodeDestroy(curr_node);
+		WebcfgDebug("Deleted successfully and returning..\n");
+		numOfMpDocs =numOfMpDocs - 1;
+		WebcfgDebug("numOfMpDocs after delete is %d\n", numOfMpDocs);
+		pthread_mutex_unlock (&webconfig_tmp_data_mut);
+		set_DB_BLOB_dirty();
+		return WEBCFG_SUCCESS;
 	}
 	pthread_mutex_unlock (&webconfig_tmp_data_mut);
 	WebcfgError("Could not find the entry to delete from list\n");
@@ -688,19 +874,22 @@ void delete_tmp_list()
 {
    webconfig_tmp_data_t *temp = NULL;
    webconfig_tmp_data_t *head = NULL;
-   head = get_global_tmp_node();
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	head = g_head;
+    	g_head = NULL;
+	tmpIndexRebuild();
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
 
     while(head != NULL)
     {
         temp = head;
 	head = head->next;
-	WebcfgDebug("Delete node--> temp->name %s temp->version %lu temp->status %s temp->isSupplementarySync %d temp->error_details %s temp->error_code %lu temp->trans_id %lu temp->retry_count %d temp->cloud_trans_id %s\n",temp->name, (long)temp->version, temp->status, temp->isSupplementarySync, temp->error_details, (long)temp->error_code, (long)temp->trans_id, temp->retry_count, temp->cloud_trans_id);
-	free(temp);
+	WebcfgDebug("Delete node--> temp->name %s temp->version %lu temp->state %s temp->isSupplementarySync %d temp->error_details %s temp->error_code %lu temp->trans_id %lu temp->retry_count %d temp->cloud_trans_id %s\n",temp->name, (long)temp->version, DOC_STATE_STRING(temp->state), temp->isSupplementarySync, temp->error_details, (long)temp->error_code, (long)temp->trans_id, temp->retry_count, temp->cloud_trans_id);
+	tmpNodeDestroy(temp);
 	temp = NULL;
     }
-	pthread_mutex_lock (&webconfig_tmp_data_mut);
-    	g_head = NULL;
-	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	set_DB_BLOB_dirty();
     	WebcfgDebug("mutex_unlock Deleted all docs from tmp list\n");
 }
 
@@ -708,18 +897,20 @@ void delete_tmp_list()
 void delete_tmp_docs_list()
 {
    webconfig_tmp_data_t *temp = NULL;
+   webconfig_tmp_data_t *next = NULL;
    temp = get_global_tmp_node();
 
     WebcfgDebug("Inside delete_tmp_docs_list()\n");
     while(temp != NULL)
     {
+	next = temp->next;
 	//skip root delete
 	if((strcmp(temp->name, "root") !=0) && (temp->isSupplementarySync == get_global_supplementarySync()))
 	{
-		WebcfgDebug("Delete node--> temp->name %s temp->version %lu temp->status %s temp->isSupplementarySync %d temp->error_details %s temp->error_code %lu temp->trans_id %lu temp->retry_count %d temp->cloud_trans_id %s\n",temp->name, (long)temp->version, temp->status, temp->isSupplementarySync, temp->error_details, (long)temp->error_code, (long)temp->trans_id, temp->retry_count, temp->cloud_trans_id);
+		WebcfgDebug("Delete node--> temp->name %s temp->version %lu temp->state %s temp->isSupplementarySync %d temp->error_details %s temp->error_code %lu temp->trans_id %lu temp->retry_count %d temp->cloud_trans_id %s\n",temp->name, (long)temp->version, DOC_STATE_STRING(temp->state), temp->isSupplementarySync, temp->error_details, (long)temp->error_code, (long)temp->trans_id, temp->retry_count, temp->cloud_trans_id);
 		deleteFromTmpList(temp->name);
 	}
-	temp = temp->next;
+	temp = next;
     }
 }
 
@@ -731,7 +922,7 @@ void checkTmpRootUpdate()
 	webconfig_tmp_data_t * root_node = NULL;
 	root_node = getTmpNode("root");
 	WebcfgDebug("Update root version %lu to tmp list.\n", (long)get_global_root());
-	updateTmpList(root_node, "root", get_global_root(), "pending", "none", 0, 0, 0);
+	updateTmpList(root_node, "root", get_global_root(), DOC_STATE_PENDING, "none", 0, 0, 0);
    }
    WebcfgDebug("root updateTmpList done\n");
 }
@@ -740,26 +931,591 @@ void checkTmpRootUpdate()
 /*                             Internal functions                             */
 /*----------------------------------------------------------------------------*/
 
-/**
- *  Convert the msgpack map into the webconfig_db_data_t structure.
- *
- *  @param e    the entry pointer
- *  @param map  the msgpack map pointer
- *
- *  @return 0 on success, error otherwise
- */
-int process_webcfgdbparams( webconfig_db_data_t *e, msgpack_object_map *map )
+//Rebuilds the cached blob from DB and tmp list, caller has to hold webconfig_blob_mut
+WEBCFG_STATUS generateBlobCache()
 {
-    int left = map->size;
-    uint8_t objects_left = 0x03;
-    msgpack_object_kv *p;
+    size_t webcfgdbBlobPackSize = -1;
+    void * data = NULL;
 
-    p = map->ptr;
-    while( (0 < objects_left) && (0 < left--) )
+    if(webcfgdb_blob)
     {
-        if( MSGPACK_OBJECT_STR == p->key.type )
+	WebcfgDebug("Delete existing webcfgdb_blob.\n");
+	WEBCFG_FREE(webcfgdb_blob->data);
+	WEBCFG_FREE(webcfgdb_blob);
+	webcfgdb_blob = NULL;
+    }
+    if(webcfgdb_blob_base64)
+    {
+	WEBCFG_FREE(webcfgdb_blob_base64);
+	webcfgdb_blob_base64 = NULL;
+    }
+    //Clear before packing so that a list update during pack marks it dirty again.
+    webcfgdb_blob_dirty = 0;
+
+    WebcfgDebug("Generate new blob\n");
+    if(webcfgdb_data != NULL || g_head != NULL)
+    {
+        webcfgdbBlobPackSize = webcfgdb_blob_pack(webcfgdb_data, g_head, &data);
+        webcfgdb_blob = (blob_t *)malloc(sizeof(blob_t));
+        if(webcfgdb_blob != NULL)
         {
-            if( MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type )
+            memset( webcfgdb_blob, 0, sizeof( blob_t ) );
+
+            webcfgdb_blob->data = (char *)data;
+            webcfgdb_blob->len  = webcfgdbBlobPackSize;
+
+            WebcfgDebug("The webcfgdbBlobPackSize is : %ld\n",webcfgdb_blob->len);
+            return WEBCFG_SUCCESS;
+        }
+        else
+        {
+            WebcfgError("Failed in memory allocation for webcfgdb_blob\n");
+            WEBCFG_FREE(data);
+            webcfgdb_blob_dirty = 1;
+            return WEBCFG_FAILURE;
+        }
+    }
+    else
+    {
+        WebcfgError("Failed in packing blob\n");
+        return WEBCFG_FAILURE;
+    }
+}
+
+//Reads, validates and decodes one DB file into the DB list.
+WEBCFG_STATUS loadDBFile(char *db_file_path)
+{
+     FILE *fp = NULL;
+     size_t sz = 0;
+     char *data = NULL;
+     char *payload = NULL;
+     size_t payload_len = 0;
+     int ch_count=0;
+     webconfig_db_data_t* dm = NULL;
+
+     fp = fopen(db_file_path,"rb");
+
+     if (fp == NULL)
+     {
+	WebcfgError("Failed to open file %s\n", db_file_path);
+	return WEBCFG_FAILURE;
+     }
+
+     fseek(fp, 0, SEEK_END);
+     ch_count = ftell(fp);
+     if (ch_count == (int)-1)
+     {
+         WebcfgError("fread failed.\n");
+	 fclose(fp);
+         return WEBCFG_FAILURE;
+     }
+     fseek(fp, 0, SEEK_SET);
+     data = (char *) malloc(sizeof(char) * (ch_count + 1));
+     if(NULL == data)
+     {
+         WebcfgError("Memory allocation for data failed.\n");
+         fclose(fp);
+         return WEBCFG_FAILURE;
+     }
+     memset(data,0,(ch_count + 1));
+     sz = fread(data, 1, ch_count,fp);
+     fclose(fp);
+     if (sz != (size_t)ch_count)
+     {
+	WebcfgError("fread failed.\n");
+	WEBCFG_FREE(data);
+	return WEBCFG_FAILURE;
+     }
+
+     if(validateDBFileHeader(data, sz, &payload, &payload_len) != WEBCFG_SUCCESS)
+     {
+	WebcfgError("DB file %s failed validation\n", db_file_path);
+	WEBCFG_FREE(data);
+	return WEBCFG_FAILURE;
+     }
+
+     dm = decodeData((void *)payload, payload_len);
+     WEBCFG_FREE(data);
+     if(NULL == dm)
+     {
+	 WebcfgError("Msgpack decode failed\n");
+         return WEBCFG_FAILURE;
+     }
+     webcfgdb_destroy (dm );
+     return WEBCFG_SUCCESS;
+}
+
+/* Fast check of the header and payload checksum before the msgpack decode.
+For legacy files without header the whole buffer is returned as payload. */
+WEBCFG_STATUS validateDBFileHeader(char *data, size_t len, char **payload, size_t *payload_len)
+{
+	const unsigned char *header = (const unsigned char *)data;
+	uint16_t version, header_len;
+	uint32_t size, crc;
+
+	if(len < WEBCFG_DB_HEADER_LEN || memcmp(data, WEBCFG_DB_MAGIC, 4) != 0)
+	{
+		WebcfgInfo("DB file has no header, reading legacy format\n");
+		*payload = data;
+		*payload_len = len;
+		return (len > 0) ? WEBCFG_SUCCESS : WEBCFG_FAILURE;
+	}
+
+	version = getLE16(header + 4);
+	header_len = getLE16(header + 6);
+	size = getLE32(header + 12);
+	crc = getLE32(header + 16);
+	if(version > WEBCFG_DB_FORMAT_VERSION || header_len < WEBCFG_DB_HEADER_LEN || header_len > len)
+	{
+		WebcfgError("Unsupported DB format version %hu header_len %hu\n", version, header_len);
+		return WEBCFG_FAILURE;
+	}
+	if((size_t)size != len - header_len)
+	{
+		WebcfgError("DB payload truncated, expected %lu bytes got %zu\n", (unsigned long)size, len - header_len);
+		return WEBCFG_FAILURE;
+	}
+	if(crc32c(data + header_len, size) != crc)
+	{
+		WebcfgError("DB payload checksum mismatch\n");
+		return WEBCFG_FAILURE;
+	}
+	WebcfgDebug("DB header valid, %lu docs %lu bytes\n", (unsigned long)getLE32(header + 8), (unsigned long)size);
+	*payload = data + header_len;
+	*payload_len = size;
+	return WEBCFG_SUCCESS;
+}
+
+//Drops whatever a failed decode has added to the DB list.
+void deleteDBList()
+{
+	webconfig_db_data_t *temp = NULL;
+
+	pthread_mutex_lock (&webconfig_db_mut);
+	while(webcfgdb_data != NULL)
+	{
+		temp = webcfgdb_data;
+		webcfgdb_data = webcfgdb_data->next;
+		WEBCFG_FREE(temp->name);
+		if(temp->root_string != NULL)
+		{
+			WEBCFG_FREE(temp->root_string);
+		}
+		WEBCFG_FREE(temp);
+	}
+	pthread_mutex_unlock (&webconfig_db_mut);
+	reset_successDocCount();
+	set_DB_BLOB_dirty();
+}
+
+//CRC32C (Castagnoli), reflected polynomial 0x82F63B78.
+uint32_t crc32c(const char *data, size_t len)
+{
+	static uint32_t table[256];
+	static int table_ready = 0;
+	uint32_t crc = 0xFFFFFFFF;
+	size_t i;
+	int k;
+
+	if(!table_ready)
+	{
+		for(i = 0; i < 256; i++)
+		{
+			uint32_t c = (uint32_t)i;
+			for(k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? ((c >> 1) ^ 0x82F63B78) : (c >> 1);
+			}
+			table[i] = c;
+		}
+		table_ready = 1;
+	}
+	for(i = 0; i < len; i++)
+	{
+		crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+//xxHash64 (XXH64), content digest of applied docs.
+#define XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+#define XXH_ROTL64(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+uint64_t xxhash64(const void *data, size_t len, uint64_t seed)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + len;
+	uint64_t h64 = 0;
+
+	if(len >= 32)
+	{
+		const unsigned char *limit = end - 32;
+		uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64_t v2 = seed + XXH_PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_PRIME64_1;
+
+		do
+		{
+			v1 = xxh64Round(v1, getLE64(p));
+			v2 = xxh64Round(v2, getLE64(p + 8));
+			v3 = xxh64Round(v3, getLE64(p + 16));
+			v4 = xxh64Round(v4, getLE64(p + 24));
+			p += 32;
+		} while(p <= limit);
+
+		h64 = XXH_ROTL64(v1, 1) + XXH_ROTL64(v2, 7) + XXH_ROTL64(v3, 12) + XXH_ROTL64(v4, 18);
+		h64 = (h64 ^ xxh64Round(0, v1)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		h64 = (h64 ^ xxh64Round(0, v2)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		h64 = (h64 ^ xxh64Round(0, v3)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		h64 = (h64 ^ xxh64Round(0, v4)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	else
+	{
+		h64 = seed + XXH_PRIME64_5;
+	}
+	h64 += (uint64_t)len;
+
+	while(p + 8 <= end)
+	{
+		h64 ^= xxh64Round(0, getLE64(p));
+		h64 = XXH_ROTL64(h64, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if(p + 4 <= end)
+	{
+		h64 ^= (uint64_t)getLE32(p) * XXH_PRIME64_1;
+		h64 = XXH_ROTL64(h64, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while(p < end)
+	{
+		h64 ^= (*p) * XXH_PRIME64_5;
+		h64 = XXH_ROTL64(h64, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	h64 ^= h64 >> 33;
+	h64 *= XXH_PRIME64_2;
+	h64 ^= h64 >> 29;
+	h64 *= XXH_PRIME64_3;
+	h64 ^= h64 >> 32;
+	return h64;
+}
+
+void putLE16(unsigned char *buf, uint16_t val)
+{
+	buf[0] = (unsigned char)(val & 0xFF);
+	buf[1] = (unsigned char)(val >> 8);
+}
+
+void putLE32(unsigned char *buf, uint32_t val)
+{
+	buf[0] = (unsigned char)(val & 0xFF);
+	buf[1] = (unsigned char)((val >> 8) & 0xFF);
+	buf[2] = (unsigned char)((val >> 16) & 0xFF);
+	buf[3] = (unsigned char)(val >> 24);
+}
+
+uint16_t getLE16(const unsigned char *buf)
+{
+	return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+uint32_t getLE32(const unsigned char *buf)
+{
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint64_t xxh64Round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = XXH_ROTL64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static uint64_t getLE64(const unsigned char *buf)
+{
+	return (uint64_t)getLE32(buf) | ((uint64_t)getLE32(buf + 4) << 32);
+}
+
+/* Tmp list helpers, all of them have to be called with webconfig_tmp_data_mut held.
+Docs are kept in a doubly linked list in arrival order, which is what callers
+iterate over, and are also chained in a small hash index keyed by doc name. */
+unsigned int stringHash(const char *str)
+{
+	unsigned int hash = 5381;
+
+	while(*str)
+	{
+		hash = ((hash << 5) + hash) + (unsigned char)*str++;
+	}
+	return hash;
+}
+
+/* Re-link prev pointers, tail and hash index from g_head, used when the list is
+replaced. Ids reserved by requests which are not bound to a doc yet are kept. */
+void tmpIndexRebuild()
+{
+	webconfig_tmp_data_t *temp = NULL;
+	webconfig_tmp_data_t *prev = NULL;
+	unsigned int bucket;
+	int txid;
+
+	memset(g_tmp_index, 0, sizeof(g_tmp_index));
+	for(txid = 0; txid < TXID_TABLE_SIZE; txid++)
+	{
+		if(g_txid_table[txid] != TXID_RESERVED)
+		{
+			g_txid_table[txid] = NULL;
+		}
+	}
+	for(temp = g_head; temp != NULL; temp = temp->next)
+	{
+		temp->prev = prev;
+		if(temp->trans_id != 0)
+		{
+			if(g_txid_table[temp->trans_id] == TXID_RESERVED)
+			{
+				g_txid_reserved--;
+			}
+			g_txid_table[temp->trans_id] = temp;
+		}
+		bucket = stringHash(temp->name) % TMP_INDEX_BUCKETS;
+		temp->hnext = g_tmp_index[bucket];
+		g_tmp_index[bucket] = temp;
+		prev = temp;
+	}
+	g_tail = prev;
+}
+
+void tmpListAppend(webconfig_tmp_data_t *node)
+{
+	unsigned int bucket = stringHash(node->name) % TMP_INDEX_BUCKETS;
+
+	node->next = NULL;
+	node->prev = g_tail;
+	if(g_tail == NULL)
+	{
+		g_head = node;
+	}
+	else
+	{
+		g_tail->next = node;
+	}
+	g_tail = node;
+	node->hnext = g_tmp_index[bucket];
+	g_tmp_index[bucket] = node;
+}
+
+webconfig_tmp_data_t * tmpIndexFind(const char *docname)
+{
+	webconfig_tmp_data_t *temp = NULL;
+
+	for(temp = g_tmp_index[stringHash(docname) % TMP_INDEX_BUCKETS]; temp != NULL; temp = temp->hnext)
+	{
+		if(strcmp(docname, temp->name) == 0)
+		{
+			return temp;
+		}
+	}
+	return NULL;
+}
+
+void tmpListUnlink(webconfig_tmp_data_t *node)
+{
+	webconfig_tmp_data_t **link = &g_tmp_index[stringHash(node->name) % TMP_INDEX_BUCKETS];
+
+	while(*link != NULL && *link != node)
+	{
+		link = &(*link)->hnext;
+	}
+	if(*link == node)
+	{
+		*link = node->hnext;
+	}
+	if(g_txid_table[node->trans_id] == node)
+	{
+		g_txid_table[node->trans_id] = NULL;
+	}
+	if(node->prev != NULL)
+	{
+		node->prev->next = node->next;
+	}
+	else
+	{
+		g_head = node->next;
+	}
+	if(node->next != NULL)
+	{
+		node->next->prev = node->prev;
+	}
+	else
+	{
+		g_tail = node->prev;
+	}
+}
+
+//Moves the doc to a new transaction id, releasing the previous one.
+void tmpTransIdBind(webconfig_tmp_data_t *node, uint16_t trans_id)
+{
+	if(g_txid_table[node->trans_id] == node)
+	{
+		g_txid_table[node->trans_id] = NULL;
+	}
+	node->trans_id = trans_id;
+	if(trans_id != 0)
+	{
+		if(g_txid_table[trans_id] == TXID_RESERVED)
+		{
+			g_txid_reserved--;
+		}
+		else if(g_txid_table[trans_id] != NULL && g_txid_table[trans_id] != node)
+		{
+			WebcfgError("trans_id %hu moved from doc %s to %s\n", trans_id, g_txid_table[trans_id]->name, node->name);
+		}
+		g_txid_table[trans_id] = node;
+	}
+}
+
+//Frees an id which was allocated but never bound, a bound id is left to its doc.
+void tmpTransIdRelease(uint16_t trans_id)
+{
+	if(trans_id != 0 && g_txid_table[trans_id] == TXID_RESERVED)
+	{
+		g_txid_table[trans_id] = NULL;
+		g_txid_reserved--;
+	}
+}
+
+void tmpNodeDestroy(webconfig_tmp_data_t *node)
+{
+	WEBCFG_FREE( node->name );
+	if(node->error_details != NULL && !isInternedString(node->error_details))
+	{
+		free((char *)node->error_details);
+	}
+	if(node->cloud_trans_id != NULL)
+	{
+		WEBCFG_FREE( node->cloud_trans_id );
+	}
+	WEBCFG_FREE( node );
+}
+
+int syncParentDir(const char *file_path)
+{
+	char dir_path[256] = {'\0'};
+	char *slash = NULL;
+	int fd = -1;
+	int ret = 0;
+
+	snprintf(dir_path, sizeof(dir_path), "%s", file_path);
+	slash = strrchr(dir_path, '/');
+	if(slash == NULL)
+	{
+		snprintf(dir_path, sizeof(dir_path), ".");
+	}
+	else if(slash == dir_path)
+	{
+		dir_path[1] = '\0';
+	}
+	else
+	{
+		*slash = '\0';
+	}
+	fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+	if(fd < 0)
+	{
+		return -1;
+	}
+	ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+//Pointer compare, only the vocabulary entries themselves are shared.
+int isInternedString(const char *str)
+{
+	size_t i;
+
+	for(i = 0; i < sizeof(g_interned)/sizeof(g_interned[0]); i++)
+	{
+		if(str == g_interned[i])
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#ifdef WEBCFG_DB_BLOB_DEBUG
+//Decodes the base64 blob back and logs each entry, for debug purpose only.
+void printBlobBase64(char *b64buffer)
+{
+    char * decodeMsg = NULL;
+    size_t k ;
+    size_t size =0;
+    size_t decodeMsgSize =0;
+
+    WebcfgDebug("----Start of b64 decoding----\n");
+    decodeMsgSize = b64_get_decoded_buffer_size(strlen(b64buffer));
+    WebcfgDebug("expected b64 decoded msg size : %ld bytes\n",decodeMsgSize);
+
+    decodeMsg = (char *) malloc(sizeof(char) * decodeMsgSize);
+    if(decodeMsg)
+    {
+	memset( decodeMsg, 0, sizeof(char) *  decodeMsgSize );
+	size = b64_decode( (const uint8_t *)b64buffer, strlen(b64buffer), (uint8_t *)decodeMsg );
+
+	WebcfgInfo("base64 decoded data containing %zu bytes\n",size);
+
+	blob_struct_t *bd = NULL;
+	bd = decodeBlobData((void *)decodeMsg, size);
+	if(bd != NULL)
+	{
+		for(k = 0;k< bd->entries_count ; k++)
+		{
+			if(bd->entries[k].root_string !=NULL)
+			{
+				WebcfgInfo("Blob bd->entries[%zu].name %s, version: %lu, status: %s, error_details: %s, error_code: %d root_string: %s\n", k, bd->entries[k].name, (long)bd->entries[k].version, bd->entries[k].status, bd->entries[k].error_details, bd->entries[k].error_code, bd->entries[k].root_string );
+			}
+			else
+			{
+				WebcfgInfo("Blob bd->entries[%zu].name %s, version: %lu, status: %s, error_details: %s, error_code: %d\n", k, bd->entries[k].name, (long)bd->entries[k].version, bd->entries[k].status, bd->entries[k].error_details, bd->entries[k].error_code );
+			}
+		}
+		webcfgdbblob_destroy(bd);
+	}
+	WEBCFG_FREE(decodeMsg);
+    }
+    WebcfgDebug("---------- End of Base64 decode -------------\n");
+}
+#endif
+
+/**
+ *  Convert the msgpack map into the webconfig_db_data_t structure.
+ *
+ *  @param e    the entry pointer
+ *  @param map  the msgpack map pointer
+ *
+ *  @return 0 on success, error otherwise
+ */
+int process_webcfgdbparams( webconfig_db_data_t *e, msgpack_object_map *map )
+{
+    int left = map->size;
+    uint8_t objects_left = 0x03;
+    msgpack_object_kv *p;
+
+    p = map->ptr;
+    while( (0 < objects_left) && (0 < left--) )
+    {
+        if( MSGPACK_OBJECT_STR == p->key.type )
+        {
+            if( MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type )
             {
                 if( 0 == match(p, "version") )
                 {
@@ -777,7 +1533,11 @@ int process_webcfgdbparams( webconfig_db_data_t *e, msgpack_object_map *map )
                     objects_left &= ~(1 << 1);
 		    //WebcfgDebug("objects_left after datatype %d\n", objects_left);
                 }
-                
+                else if( 0 == match(p, "digest") )
+                {
+                    //optional, packed ahead of root_string
+                    e->digest = p->val.via.u64;
+                }
             }
             else if( MSGPACK_OBJECT_STR == p->val.type )
             {
@@ -875,6 +1635,7 @@ void addToDBList(webconfig_db_data_t *webcfgdb)
       {
           webcfgdb_data = webcfgdb;
 	  pthread_mutex_unlock (&webconfig_db_mut);
+          set_DB_BLOB_dirty();
           success_doc_count++;
 	  WebcfgInfo("Producer added webcfgdb->name %s, webcfg->version %lu, success_doc_count %d\n",webcfgdb->name, (long)webcfgdb->version, success_doc_count);
       }
@@ -888,76 +1649,55 @@ void addToDBList(webconfig_db_data_t *webcfgdb)
           }
           temp->next = webcfgdb;
           pthread_mutex_unlock (&webconfig_db_mut);
+          set_DB_BLOB_dirty();
           success_doc_count++;
 	  WebcfgInfo("Producer added webcfgdb->name %s, webcfg->version %lu, success_doc_count %d\n",webcfgdb->name, (long)webcfgdb->version, success_doc_count);
       }
 }
 
+//Returns a copy of the cached base64 DB blob, caller has to free it.
 char * get_DB_BLOB_base64()
 {
     char* b64buffer =  NULL;
-    char * decodeMsg = NULL;
-    size_t k ;
-    blob_t * db_blob = get_DB_BLOB();
     size_t encodeSize = -1;
-    size_t size =0;
-    size_t decodeMsgSize =0;
 
-    if(db_blob != NULL)
+    pthread_mutex_lock (&webconfig_blob_mut);
+    if(webcfgdb_blob_dirty || webcfgdb_blob == NULL)
+    {
+        WebcfgDebug("Proceed to generateBlob\n");
+        if(generateBlobCache() != WEBCFG_SUCCESS)
+        {
+            WebcfgError("Failed in Blob generation\n");
+        }
+    }
+
+    if(webcfgdb_blob_base64 == NULL && webcfgdb_blob != NULL)
     {
         WebcfgDebug("-----------Start of Base64 Encode ------------\n");
-        encodeSize = b64_get_encoded_buffer_size( db_blob->len );
+        encodeSize = b64_get_encoded_buffer_size( webcfgdb_blob->len );
         WebcfgDebug("encodeSize is %zu\n", encodeSize);
-        b64buffer = malloc(encodeSize + 1);
-        if(b64buffer != NULL)
+        webcfgdb_blob_base64 = malloc(encodeSize + 1);
+        if(webcfgdb_blob_base64 != NULL)
         {
-            memset( b64buffer, 0, sizeof( encodeSize )+1 );
-
-            b64_encode((uint8_t *)db_blob->data, db_blob->len, (uint8_t *)b64buffer);
-            b64buffer[encodeSize] = '\0' ;
-
-	    //Start of b64 decoding for debug purpose
-	    WebcfgDebug("----Start of b64 decoding----\n");
-	    decodeMsgSize = b64_get_decoded_buffer_size(strlen(b64buffer));
-	    WebcfgDebug("expected b64 decoded msg size : %ld bytes\n",decodeMsgSize);
-
-	    decodeMsg = (char *) malloc(sizeof(char) * decodeMsgSize);
-	    if(decodeMsg)
-	    {
-		memset( decodeMsg, 0, sizeof(char) *  decodeMsgSize );
-		size = b64_decode( (const uint8_t *)b64buffer, strlen(b64buffer), (uint8_t *)decodeMsg );
-
-		WebcfgInfo("base64 decoded data containing %zu bytes\n",size);
-
-		blob_struct_t *bd = NULL;
-		bd = decodeBlobData((void *)decodeMsg, size);
-		WebcfgDebug("Size of webcfgdbblob %ld\n", (size_t)bd);
-		if(bd != NULL)
-		{
-			for(k = 0;k< bd->entries_count ; k++)
-			{
-				if(bd->entries[k].root_string !=NULL)
-				{
-					WebcfgInfo("Blob bd->entries[%zu].name %s, version: %lu, status: %s, error_details: %s, error_code: %d root_string: %s\n", k, bd->entries[k].name, (long)bd->entries[k].version, bd->entries[k].status, bd->entries[k].error_details, bd->entries[k].error_code, bd->entries[k].root_string );
-				}
-				else
-				{
-					WebcfgInfo("Blob bd->entries[%zu].name %s, version: %lu, status: %s, error_details: %s, error_code: %d\n", k, bd->entries[k].name, (long)bd->entries[k].version, bd->entries[k].status, bd->entries[k].error_details, bd->entries[k].error_code );
-				}
-			}
-
-		}
-		webcfgdbblob_destroy(bd);
-		WEBCFG_FREE(decodeMsg);
-	    }
+            memset( webcfgdb_blob_base64, 0, encodeSize + 1 );
 
-            WebcfgDebug("---------- End of Base64 decode -------------\n");
+            b64_encode((uint8_t *)webcfgdb_blob->data, webcfgdb_blob->len, (uint8_t *)webcfgdb_blob_base64);
+            webcfgdb_blob_base64[encodeSize] = '\0' ;
+#ifdef WEBCFG_DB_BLOB_DEBUG
+            printBlobBase64(webcfgdb_blob_base64);
+#endif
         }
-     }
-     else
-     {
+    }
+
+    if(webcfgdb_blob_base64 != NULL)
+    {
+        b64buffer = strdup(webcfgdb_blob_base64);
+    }
+    else
+    {
         WebcfgError("Blob is NULL\n");
-     }
+    }
+    pthread_mutex_unlock (&webconfig_blob_mut);
     return b64buffer;
 }
 
@@ -1127,25 +1867,201 @@ int writebase64ToDBFile(char *base64_file_path, char *data)
 	}
 }
 
+//Xorshift generator seeded once from getrandom, skips ids bound or reserved by pending docs.
+uint16_t allocateTransId()
+{
+	uint32_t seed = 0;
+	uint16_t txid = 0;
+	int attempt = 0;
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	if(g_txid_state == 0)
+	{
+		if(getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed))
+		{
+			WebcfgError("getrandom failed, seeding txid from time\n");
+			seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+		}
+		g_txid_state = (seed != 0) ? seed : 0x9E3779B9;
+	}
+	for(attempt = 0; attempt < TXID_TABLE_SIZE; attempt++)
+	{
+		g_txid_state ^= g_txid_state << 13;
+		g_txid_state ^= g_txid_state >> 17;
+		g_txid_state ^= g_txid_state << 5;
+		txid = (uint16_t)(g_txid_state >> 16);
+		if(txid != 0 && g_txid_table[txid] == NULL)
+		{
+			g_txid_table[txid] = TXID_RESERVED;
+			g_txid_reserved++;
+			pthread_mutex_unlock (&webconfig_tmp_data_mut);
+			WebcfgDebug("allocateTransId %hu\n", txid);
+			return txid;
+		}
+	}
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	WebcfgError("No free transaction id\n");
+	return 0;
+}
+
+void releaseTransId(uint16_t trans_id)
+{
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	tmpTransIdRelease(trans_id);
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+}
+
+int isCurrentTransId(uint16_t trans_id, const char *docname)
+{
+	webconfig_tmp_data_t *temp = NULL;
+	int current = 0;
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	temp = g_txid_table[trans_id];
+	if(trans_id != 0 && temp != NULL && temp != TXID_RESERVED && strcmp(temp->name, docname) == 0)
+	{
+		current = 1;
+	}
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	return current;
+}
+
+int getReservedTransIdCount()
+{
+	int count = 0;
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	count = g_txid_reserved;
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	return count;
+}
+
+webconfig_tmp_data_t * getTmpNodeByTransId(uint16_t trans_id)
+{
+	webconfig_tmp_data_t *temp = NULL;
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	temp = g_txid_table[trans_id];
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	return (temp == TXID_RESERVED) ? NULL : temp;
+}
+
 //To get individual subdoc details from tmp cached list.
 webconfig_tmp_data_t * getTmpNode(char *docname)
 {
 	webconfig_tmp_data_t *temp = NULL;
-	temp = get_global_tmp_node();
 
-	//Traverse through doc list & fetch required doc.
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	temp = tmpIndexFind(docname);
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	if(NULL != temp)
+	{
+		WebcfgDebug("subdoc node : name %s version %lu status %s error_details %s error_code %hu trans_id %hu temp->retry_count %d temp->cloud_trans_id %s\n", temp->name, (long)temp->version, DOC_STATE_STRING(temp->state), temp->error_details, temp->error_code, temp->trans_id, temp->retry_count, temp->cloud_trans_id);
+		return temp;
+	}
+	WebcfgDebug("getTmpNode failed for doc %s\n", docname);
+	return NULL;
+}
+
+//Copies a doc of the tmp list under the lock, for threads which use it while the doc may be deleted.
+WEBCFG_STATUS getTmpSnapshot(const char *docname, webconfig_tmp_snapshot_t *snap)
+{
+	webconfig_tmp_data_t *temp = NULL;
+
+	memset(snap, 0, sizeof(webconfig_tmp_snapshot_t));
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	temp = tmpIndexFind(docname);
+	if(NULL != temp)
+	{
+		snap->version = temp->version;
+		snap->state = temp->state;
+		snap->error_details = (temp->error_details != NULL) ? strdup(temp->error_details) : NULL;
+		snap->error_code = temp->error_code;
+		snap->trans_id = temp->trans_id;
+		snap->retry_count = temp->retry_count;
+		snap->isSupplementarySync = temp->isSupplementarySync;
+		snap->cloud_trans_id = (temp->cloud_trans_id != NULL) ? strdup(temp->cloud_trans_id) : NULL;
+		snap->digest = temp->digest;
+	}
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	if(NULL == temp)
+	{
+		WebcfgDebug("getTmpSnapshot failed for doc %s\n", docname);
+		return WEBCFG_FAILURE;
+	}
+	return WEBCFG_SUCCESS;
+}
+
+void freeTmpSnapshot(webconfig_tmp_snapshot_t *snap)
+{
+	if(snap->error_details != NULL)
+	{
+		WEBCFG_FREE(snap->error_details);
+	}
+	if(snap->cloud_trans_id != NULL)
+	{
+		WEBCFG_FREE(snap->cloud_trans_id);
+	}
+}
+
+int incrementTmpRetryCount(const char *docname)
+{
+	webconfig_tmp_data_t *temp = NULL;
+	int retry_count = -1;
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	temp = tmpIndexFind(docname);
+	if(NULL != temp)
+	{
+		temp->retry_count++;
+		retry_count = temp->retry_count;
+	}
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	return retry_count;
+}
+
+/* Walks the tmp list under the lock for the root checks, a count of 1 means
+only root is left. skip_unsupported skips supplementary and unsupported docs. */
+int getTmpRootCheckCount(int skip_unsupported)
+{
+	int count = 0;
+	webconfig_tmp_data_t *temp = NULL;
+
+	pthread_mutex_lock (&webconfig_tmp_data_mut);
+	temp = g_head;
 	while (NULL != temp)
 	{
-		WebcfgDebug("getTmpNode: temp->name %s, temp->version %lu\n",temp->name, (long)temp->version);
-		if( strcmp(docname, temp->name) == 0)
+		if(count > 1)
 		{
-			WebcfgDebug("subdoc node : name %s version %lu status %s error_details %s error_code %hu trans_id %hu temp->retry_count %d temp->cloud_trans_id %s\n", temp->name, (long)temp->version, temp->status, temp->error_details, temp->error_code, temp->trans_id, temp->retry_count, temp->cloud_trans_id);
-			return temp;
+			WebcfgDebug("tmp list count is %d\n", count);
+			break;
+		}
+		WebcfgDebug("Root check ====> temp->name %s\n", temp->name);
+		if(skip_unsupported && ((temp->error_code == 204 && (temp->error_details != NULL && strstr(temp->error_details, "doc_unsupported") != NULL)) || (temp->isSupplementarySync == 1)))
+		{
+			if(temp->isSupplementarySync)
+			{
+				WebcfgDebug("Skipping supplementary sub doc %s\n", temp->name);
+			}
+			else
+			{
+				WebcfgDebug("Skipping unsupported sub doc %s\n",temp->name);
+			}
+			WebcfgDebug("Error details: %s\n",temp->error_details);
+		}
+		else if( strcmp("root", temp->name) != 0)
+		{
+			WebcfgDebug("Found doc in tmp list\n");
+			count = count+1;
+		}
+		else
+		{
+			count = 1;
 		}
 		temp= temp->next;
 	}
-	WebcfgDebug("getTmpNode failed for doc %s\n", docname);
-	return NULL;
+	pthread_mutex_unlock (&webconfig_tmp_data_mut);
+	return count;
 }
 
 //update retry_timestamp for each doc
@@ -1153,10 +2069,9 @@ WEBCFG_STATUS updateFailureTimeStamp(webconfig_tmp_data_t *temp, char *docname,
 {
 	if (NULL != temp)
 	{
-		WebcfgDebug("updateFailureTimeStamp: node is pointing to temp->name %s \n",temp->name);
 		pthread_mutex_lock (&webconfig_tmp_data_mut);
 		WebcfgDebug("mutex_lock in updateFailureTimeStamp\n");
-		if( strcmp(docname, temp->name) == 0)
+		if( temp == tmpIndexFind(docname))
 		{
 			temp->retry_timestamp = timestamp;
 			WebcfgInfo("doc %s retry timestamp updated as %s\n", docname, printTime(timestamp));
@@ -35,30 +35,67 @@
 #define WEBCFG_DB_FILE 	    "/tmp/webconfig_db.bin"
 #endif
 
+//Last good DB snapshot and in-progress write, suffixed to the DB file path
+#define WEBCFG_DB_BACKUP_SUFFIX     ".bak"
+#define WEBCFG_DB_TMP_SUFFIX        ".tmp"
+
+//Status string of a tmp list doc state, as reported in Device.X_RDK_WebConfig.Data
+#define DOC_STATE_STRING(state) \
+	(((state) == DOC_STATE_PENDING_APPLY) ? "pending_apply" : \
+	 ((state) == DOC_STATE_PENDING) ? "pending" : \
+	 ((state) == DOC_STATE_SUCCESS) ? "success" : \
+	 ((state) == DOC_STATE_FAILED) ? "failed" : "unknown")
+
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
 
+typedef enum
+{
+	DOC_STATE_PENDING_APPLY = 0,	//added by the current sync, not yet applied
+	DOC_STATE_PENDING,		//apply in progress or waiting for ack/retry
+	DOC_STATE_SUCCESS,
+	DOC_STATE_FAILED
+} WEBCFG_DOC_STATE;
+
 typedef struct webconfig_tmp_data
 {
         char * name;
         uint32_t version;
-        char * status;
-	char * error_details;
+        WEBCFG_DOC_STATE state;
+	const char * error_details;	//shared for the fixed vocabulary, else owned by the node
 	int retry_count;
 	uint16_t error_code;
 	uint16_t trans_id;
 	int isSupplementarySync;
 	long long retry_timestamp;
 	char * cloud_trans_id;
+	uint64_t digest;		//xxhash64 of the doc msgpack body, 0 for root
         struct webconfig_tmp_data *next;
+        struct webconfig_tmp_data *prev;	//for O(1) unlink
+        struct webconfig_tmp_data *hnext;	//hash index bucket chain
 } webconfig_tmp_data_t;
 
+//Copy of a tmp list doc, strings are owned by the copy.
+typedef struct webconfig_tmp_snapshot
+{
+	uint32_t version;
+	WEBCFG_DOC_STATE state;
+	char * error_details;
+	uint16_t error_code;
+	uint16_t trans_id;
+	int retry_count;
+	int isSupplementarySync;
+	char * cloud_trans_id;
+	uint64_t digest;
+} webconfig_tmp_snapshot_t;
+
 typedef struct webconfig_db_data{
 	char * name;
 	uint32_t version;
 	char *root_string;
         struct webconfig_db_data *next;
+	uint64_t digest;		//content digest of the last successful apply, 0 when unknown
 }webconfig_db_data_t;
 
 typedef struct blob{
@@ -103,12 +140,20 @@ blob_struct_t* decodeBlobData(const void * buf, size_t len);
 
 WEBCFG_STATUS initDB(char * db_file_path);
 
+void deleteDBList();
+
 WEBCFG_STATUS addNewDocEntry(size_t count);
 
 int writeToDBFile(char * db_file_path, char * data, size_t size);
 
+int writeDBFileWithHeader(char *db_file_path, char *data, size_t size, size_t count);
+
+bool isDBFilePresent();
+
 WEBCFG_STATUS generateBlob();
 
+void set_DB_BLOB_dirty();
+
 blob_t * get_DB_BLOB();
 
 webconfig_db_data_t * get_global_db_node(void);
@@ -121,12 +166,108 @@ WEBCFG_STATUS addToTmpList();
 
 void addToDBList(webconfig_db_data_t *webcfgdb);
 
-WEBCFG_STATUS updateTmpList(webconfig_tmp_data_t *temp, char *docname, uint32_t version, char *status, char *error_details, uint16_t error_code, uint16_t trans_id, int retry);
+/**
+ *  Records the content digest of a doc which is already in the DB list.
+ *
+ *  @return WEBCFG_FAILURE when the doc is not in the DB list
+ */
+WEBCFG_STATUS updateDBDigest(char *docname, uint64_t digest);
+
+/**
+ *  @return content digest stored for the doc, 0 when unknown
+ */
+uint64_t getDBDigest(char *docname);
+
+/**
+ *  xxHash64 of the given buffer.
+ */
+uint64_t xxhash64(const void *data, size_t len, uint64_t seed);
+
+WEBCFG_STATUS updateTmpList(webconfig_tmp_data_t *temp, char *docname, uint32_t version, WEBCFG_DOC_STATE state, const char *error_details, uint16_t error_code, uint16_t trans_id, int retry);
+WEBCFG_STATUS updateTmpListByName(char *docname, uint32_t version, WEBCFG_DOC_STATE state, const char *error_details, uint16_t error_code, uint16_t trans_id, int retry);
+
+bool isValidDocStateTransition(WEBCFG_DOC_STATE from, WEBCFG_DOC_STATE to);
+
+/**
+ *  Returns the shared copy of a fixed error_details value such as "none",
+ *  "pending" or "failed_retrying", valid for the process lifetime.
+ *
+ *  @param str the error details
+ *
+ *  @return the interned string, "none" for NULL, NULL when str is not
+ *  part of the fixed vocabulary
+ */
+const char* getInternedString(const char *str);
+
+/**
+ *  Sets the error_details of a tmp node. Fixed values are shared, free form
+ *  details such as component NACK reasons are copied for the node.
+ */
+void setTmpErrorDetails(webconfig_tmp_data_t *node, const char *error_details);
 
 WEBCFG_STATUS deleteFromTmpList(char* doc_name);
 
 webconfig_tmp_data_t * getTmpNode(char *docname);
 
+/**
+ *  Copies a tmp list doc under the tmp list lock. Event workers use the copy
+ *  as a concurrent sync may delete the node itself.
+ *
+ *  @return WEBCFG_FAILURE when the doc is not in the tmp list
+ */
+WEBCFG_STATUS getTmpSnapshot(const char *docname, webconfig_tmp_snapshot_t *snap);
+
+void freeTmpSnapshot(webconfig_tmp_snapshot_t *snap);
+
+/**
+ *  Counts the tmp list docs for the root update and delete checks under the
+ *  tmp list lock.
+ *
+ *  @param skip_unsupported skip supplementary and unsupported docs
+ *
+ *  @return 1 when root is the only doc left
+ */
+int getTmpRootCheckCount(int skip_unsupported);
+
+/**
+ *  @return apply retry count of the doc after the increment, -1 when the
+ *  doc is not in the tmp list
+ */
+int incrementTmpRetryCount(const char *docname);
+
+/**
+ *  Allocates a blob transaction id which is not used by any pending doc.
+ *  The id stays reserved, also across tmp list resets, until updateTmpList
+ *  binds it to a doc or releaseTransId frees it. A bound id is freed when
+ *  the doc moves to another id or leaves the tmp list.
+ *
+ *  @return non zero transaction id, 0 when all ids are in use
+ */
+uint16_t allocateTransId();
+
+/**
+ *  Releases a transaction id from allocateTransId which is abandoned before
+ *  updateTmpList bound it to a doc. An id bound to a doc is not touched.
+ */
+void releaseTransId(uint16_t trans_id);
+
+/**
+ *  @return number of allocated transaction ids not yet bound to a doc
+ */
+int getReservedTransIdCount();
+
+/**
+ *  Direct lookup of the tmp list doc which the transaction id is bound to.
+ *
+ *  @return doc node or NULL when the id is not bound
+ */
+webconfig_tmp_data_t * getTmpNodeByTransId(uint16_t trans_id);
+
+/**
+ *  @return 1 when the transaction id is bound to the doc in the tmp list
+ */
+int isCurrentTransId(uint16_t trans_id, const char *docname);
+
 void delete_tmp_list();
 
 void delete_tmp_docs_list();
@@ -139,10 +280,6 @@ int get_successDocCount();
 
 void reset_successDocCount();
 
-int get_doc_fail();
-
-void set_doc_fail( int value);
-
 char * get_DB_BLOB_base64();
 
 void checkDBList(char *docname, uint32_t version,char *rootstr);
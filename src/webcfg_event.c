@@ -26,45 +26,95 @@
 #include "webcfg_param.h"
 #include "webcfg_blob.h"
 #include "webcfg_timer.h"
+#include "webcfg_latency.h"
+#include "webcfg_request.h"
+#include "webcfg_rollback.h"
+#include "webcfg_scheduler.h"
 #include <errno.h>
+#include <sys/eventfd.h>
+#include <sched.h>
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
+#define EVENT_QUEUE_MASK	(WEBCFG_EVENT_QUEUE_SIZE - 1)
+#define EVENT_MAX_FIELDS	8
 
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
+/* Slot of the bounded MPSC event ring. seq is kept relative to the slot index
+ * so a zeroed ring is a valid empty queue: the slot is free for the producer
+ * at position pos when seq + index == pos, and holds the event of pos when
+ * seq + index == pos + 1. */
+typedef struct event_slot
+{
+	size_t seq;
+	char data[WEBCFG_EVENT_SLOT_SIZE];
+} event_slot_t;
+
+/* Per worker FIFO of parsed events. The consumer only blocks on it when the
+ * worker is WEBCFG_EVENT_QUEUE_SIZE events behind. */
+typedef struct event_shard
+{
+	pthread_mutex_t mut;
+	pthread_cond_t con;
+	event_params_t events[WEBCFG_EVENT_QUEUE_SIZE];
+	int head;
+	int count;
+	int stop;
+	pthread_t tid;
+} event_shard_t;
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
 static pthread_t EventThreadId=0;
 static pthread_t processThreadId = 0;
 pthread_mutex_t event_mut=PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t event_con=PTHREAD_COND_INITIALIZER;
+pthread_cond_t event_handler_con=PTHREAD_COND_INITIALIZER;
 pthread_mutex_t expire_timer_mut=PTHREAD_MUTEX_INITIALIZER;
-event_data_t *eventDataQ = NULL;
+//Producers only touch the ring with atomics, the consumer sleeps on eventfd.
+static event_slot_t g_event_ring[WEBCFG_EVENT_QUEUE_SIZE];
+static size_t g_event_head = 0;		//next producer position
+static size_t g_event_tail = 0;		//next consumer position, consumer only
+static int g_event_consumer_waiting = 0;
+static int g_event_fd = -1;
+static int g_event_fd_users = 0;	//producers between loading and writing g_event_fd
+static event_queue_stats_t g_event_stats;
 static expire_timer_t * g_timer_head = NULL;
 static int numOfEvents = 0;
+static event_shard_t g_event_shards[WEBCFG_EVENT_WORKERS];
+//serializes the root version update and tmp root cleanup across workers
+pthread_mutex_t root_commit_mut=PTHREAD_MUTEX_INITIALIZER;
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
 void* blobEventHandler();
-int parseEventData();
+WEBCFG_EVENT_STATUS getEventStatusType(const char *status);
+void processSubdocEvent(event_params_t *eventParam);
+int isFinalEvent(event_params_t *param);
+int isPendingEvent(event_params_t *param);
+int startEventWorkers();
+void stopEventWorkers(int workers);
+void dispatchEvent(event_params_t *param);
+void* eventWorker(void *arg);
+void commitDocAndCheckRoot(char *docname, uint32_t version, int isSupplementarySync, uint64_t digest);
+void recordEventLatency(event_params_t *param);
+int copyEventField(char *dst, size_t size, const char *field, size_t len);
+void closeEventFd();
 void* processSubdocEvents();
 
 int checkWebcfgTimer();
-int addToEventQueue(char *buf);
-void sendSuccessNotification(webconfig_tmp_data_t *subdoc_node, char *name, uint32_t version, uint16_t txid);
-WEBCFG_STATUS startWebcfgTimer(expire_timer_t *timer_node, char *name, uint16_t transID, uint32_t timeout);
+void sendSuccessNotification(char *name, uint32_t version, uint16_t txid, char *cloud_trans_id);
 WEBCFG_STATUS stopWebcfgTimer(expire_timer_t *temp, char *name, uint16_t trans_id);
-int checkTimerExpired (char **exp_doc);
+void docTimerExpired(void *arg);
 void createTimerExpiryEvent(char *docName, uint16_t transid);
 WEBCFG_STATUS updateTimerList(expire_timer_t *temp, int status, char *docname, uint16_t transid, uint32_t timeout);
-WEBCFG_STATUS deleteFromTimerList(char* doc_name);
 WEBCFG_STATUS checkDBVersion(char *docname, uint32_t version);
-WEBCFG_STATUS validateEvent(webconfig_tmp_data_t *temp, char *docname, uint16_t txid);
+WEBCFG_STATUS validateEvent(webconfig_tmp_snapshot_t *temp, char *docname, uint16_t txid);
+int setRetryFailed(char *docname, uint32_t version);
 expire_timer_t * getTimerNode(char *docname);
 void handleConnectedClientNotify(char *status);
+static void saveAppliedPayload(char *docname, uint32_t version);
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -78,9 +128,9 @@ pthread_t get_global_process_threadid()
     return processThreadId;
 }
 
-pthread_cond_t *get_global_event_con(void)
+pthread_cond_t *get_global_event_handler_con(void)
 {
-    return &event_con;
+    return &event_handler_con;
 }
 
 pthread_mutex_t *get_global_event_mut(void)
@@ -96,18 +146,6 @@ expire_timer_t * get_global_timer_node(void)
     return tmp;
 }	
 
-void free_event_params_struct(event_params_t *param)
-{
-	if(param != NULL)
-	{
-		WEBCFG_FREE(param->subdoc_name);
-		WEBCFG_FREE(param->status);
-		WEBCFG_FREE(param->process_name);
-		WEBCFG_FREE(param->failure_reason);
-		WEBCFG_FREE(param);
-	}
-}
-
 //Webcfg thread listens for blob events from respective components.
 void initEventHandlingTask()
 {
@@ -128,9 +166,6 @@ void* blobEventHandler()
 {
 
 	int ret = 0;
-	char *expired_doc= NULL;
-	uint16_t tx_id = 0;
-	expire_timer_t *expired_node = NULL;
 
 	ret = registerWebcfgEvent(webcfgCallback);
 	if(ret)
@@ -142,38 +177,15 @@ void* blobEventHandler()
 		WebcfgError("registerWebcfgEvent failed\n");
 	}
 
-	/* Loop to check timer expiry. When timer is not running, loop is active but wont check expiry until next timer starts. */
-	while(FOREVER())
+	/* Doc expiry is driven by the timer service, this thread only keeps the
+	event registration alive until shutdown. */
+	pthread_mutex_lock (&event_mut);
+	while(!get_global_shutdown())
 	{
-		if (checkTimerExpired (&expired_doc))
-		{
-			if(expired_doc !=NULL)
-			{
-				WebcfgError("Timer expired_doc %s. No event received within timeout period\n", expired_doc);
-				//reset timer. Generate internal EXPIRE event with new trans_id and retry.
-				tx_id = generateRandomId(1001,3000);
-				WebcfgDebug("EXPIRE event tx_id generated is %lu\n", (long)tx_id);
-				expired_node = getTimerNode(expired_doc);
-				updateTimerList(expired_node, false, expired_doc, tx_id, 0);
-				createTimerExpiryEvent(expired_doc, tx_id);
-				WebcfgDebug("After createTimerExpiryEvent\n");
-			}
-			else
-			{
-				WebcfgError("Failed to get expired_doc\n");
-			}
-		}
-		else
-		{
-			WebcfgDebug("Waiting at timer loop of 5s\n");
-			sleep(5);
-			if (get_global_shutdown())
-			{
-				WebcfgDebug("g_shutdown true, break timer expire events\n");
-				break;
-			}
-		}
+		pthread_cond_wait(&event_handler_con, &event_mut);
 	}
+	pthread_mutex_unlock (&event_mut);
+	WebcfgDebug("g_shutdown true, unregister webcfg events\n");
 	ret = unregisterWebcfgEvent();
 	if(ret)
 	{
@@ -189,60 +201,120 @@ void* blobEventHandler()
 //Call back function to be executed when webconfigSignal signal is received from component.
 void webcfgCallback(char *Info, void* user_data)
 {
-	char *buff = NULL;
 	WebcfgInfo("Received webconfig event signal Info %s\n", Info);
 	WebcfgDebug("user_data %s\n", (char*) user_data);
 
-	buff = strdup(Info);
-	addToEventQueue(buff);
+	addToEventQueue(Info);
 }
 
-//Producer adds event data to queue
-int addToEventQueue(char *buf)
+/* Producer adds event data to queue. Lock free and never blocks, component
+callbacks run on IPC threads which must not wait behind the consumer. Event
+is dropped and counted when the queue is full. */
+int addToEventQueue(const char *buf)
 {
-	event_data_t *Data;
-
-	WebcfgDebug ("Add data to event queue\n");
-        Data = (event_data_t *)malloc(sizeof(event_data_t));
-
-	if(Data)
-        {
-            Data->data =buf;
-            Data->next=NULL;
-            pthread_mutex_lock (&event_mut);
-            if(eventDataQ == NULL)
-            {
-                eventDataQ = Data;
-
-                WebcfgInfo("Producer added Data\n");
-                pthread_cond_signal(&event_con);
-                pthread_mutex_unlock (&event_mut);
-                WebcfgDebug("mutex unlock in producer event thread\n");
-            }
-            else
-            {
-                event_data_t *temp = eventDataQ;
-                while(temp->next)
-                {
-                    temp = temp->next;
-                }
-                temp->next = Data;
-                pthread_mutex_unlock (&event_mut);
-            }
-        }
-        else
-        {
-            WebcfgError("failure in allocation for event data\n");
-        }
+	event_slot_t *slot = NULL;
+	size_t pos = 0, seq = 0, len = 0;
+	size_t pending = 0;
+	uint32_t watermark = 0;
+	intptr_t dif = 0;
+
+	if(buf == NULL)
+	{
+		return 1;
+	}
+	len = strlen(buf);
+	if(len >= WEBCFG_EVENT_SLOT_SIZE)
+	{
+		__atomic_add_fetch(&g_event_stats.dropped_oversize, 1, __ATOMIC_RELAXED);
+		WebcfgError("Event of %zu bytes exceeds event slot, dropped\n", len);
+		return 1;
+	}
+
+	pos = __atomic_load_n(&g_event_head, __ATOMIC_RELAXED);
+	while(1)
+	{
+		slot = &g_event_ring[pos & EVENT_QUEUE_MASK];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) + (pos & EVENT_QUEUE_MASK);
+		dif = (intptr_t)seq - (intptr_t)pos;
+		if(dif == 0)
+		{
+			if(__atomic_compare_exchange_n(&g_event_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if(dif < 0)
+		{
+			__atomic_add_fetch(&g_event_stats.dropped_full, 1, __ATOMIC_RELAXED);
+			WebcfgError("Event queue full, dropped event %s\n", buf);
+			return 1;
+		}
+		else
+		{
+			pos = __atomic_load_n(&g_event_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(slot->data, buf, len + 1);
+	__atomic_store_n(&slot->seq, pos + 1 - (pos & EVENT_QUEUE_MASK), __ATOMIC_RELEASE);
 
+	__atomic_add_fetch(&g_event_stats.enqueued, 1, __ATOMIC_RELAXED);
+	pending = pos + 1 - __atomic_load_n(&g_event_tail, __ATOMIC_RELAXED);
+	watermark = __atomic_load_n(&g_event_stats.high_watermark, __ATOMIC_RELAXED);
+	while(pending > watermark && !__atomic_compare_exchange_n(&g_event_stats.high_watermark, &watermark, (uint32_t)pending, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	WebcfgDebug("Producer added Data\n");
+	//syscall only when the consumer is about to sleep or sleeping
+	if(__atomic_exchange_n(&g_event_consumer_waiting, 0, __ATOMIC_SEQ_CST))
+	{
+		wakeEventConsumer();
+	}
 	return 0;
 }
 
+//Wakes the event consumer, also used at shutdown. No-op once the consumer closed the eventfd.
+void wakeEventConsumer()
+{
+	uint64_t one = 1;
+	int fd = -1;
+
+	__atomic_add_fetch(&g_event_fd_users, 1, __ATOMIC_SEQ_CST);
+	fd = __atomic_load_n(&g_event_fd, __ATOMIC_SEQ_CST);
+	if(fd >= 0 && write(fd, &one, sizeof(one)) != sizeof(one))
+	{
+		WebcfgError("Failed to wake event consumer: %s\n", strerror(errno));
+	}
+	__atomic_sub_fetch(&g_event_fd_users, 1, __ATOMIC_SEQ_CST);
+}
+
+void getEventQueueStats(event_queue_stats_t *stats)
+{
+	if(stats != NULL)
+	{
+		stats->enqueued = __atomic_load_n(&g_event_stats.enqueued, __ATOMIC_RELAXED);
+		stats->dropped_full = __atomic_load_n(&g_event_stats.dropped_full, __ATOMIC_RELAXED);
+		stats->dropped_oversize = __atomic_load_n(&g_event_stats.dropped_oversize, __ATOMIC_RELAXED);
+		stats->high_watermark = __atomic_load_n(&g_event_stats.high_watermark, __ATOMIC_RELAXED);
+		stats->coalesced_duplicates = __atomic_load_n(&g_event_stats.coalesced_duplicates, __ATOMIC_RELAXED);
+		stats->coalesced_superseded = __atomic_load_n(&g_event_stats.coalesced_superseded, __ATOMIC_RELAXED);
+	}
+}
 
 //Webcfg consumer thread to process the events.
 void processWebcfgEvents()
 {
 	int err = 0;
+
+	if(g_event_fd < 0)
+	{
+		int fd = eventfd(0, EFD_CLOEXEC);
+		if(fd < 0)
+		{
+			WebcfgError("Failed to create event queue eventfd: %s\n", strerror(errno));
+			return;
+		}
+		__atomic_store_n(&g_event_fd, fd, __ATOMIC_SEQ_CST);
+	}
 	err = pthread_create(&processThreadId, NULL, processSubdocEvents, NULL);
 	if (err != 0)
 	{
@@ -255,430 +327,757 @@ void processWebcfgEvents()
 
 }
 
-//Parse and process sub doc event data.
+//Drain, parse and coalesce queued sub doc events, then process them in order.
 void* processSubdocEvents()
 {
-	event_params_t *eventParam = NULL;
-	int rv = WEBCFG_FAILURE;
-	WEBCFG_STATUS rs = WEBCFG_FAILURE;
-	uint32_t docVersion = 0;
-	char err_details[512] = {0};
-	webconfig_tmp_data_t * subdoc_node = NULL;
-	expire_timer_t * doctimer_node = NULL;
-	char * cloud_trans_id = NULL;
+	//consumer only, kept off the thread stack
+	static event_params_t batch[WEBCFG_EVENT_QUEUE_SIZE];
+	static int keep[WEBCFG_EVENT_QUEUE_SIZE];
+	char data[WEBCFG_EVENT_SLOT_SIZE];
+	uint64_t wakeups = 0;
 	uint16_t err = 0;
 	char* errmsg = NULL;
+	int count = 0, i = 0;
+	int workers = 0;
 
+	workers = startEventWorkers();
 	while(FOREVER())
 	{
-		pthread_mutex_lock (&event_mut);
-		WebcfgDebug("mutex lock in event consumer thread\n");
-		if(eventDataQ != NULL)
+		count = 0;
+		while(count < WEBCFG_EVENT_QUEUE_SIZE && eventQueuePop(data, sizeof(data)))
 		{
-			event_data_t *Data = eventDataQ;
-			eventDataQ = eventDataQ->next;
-			pthread_mutex_unlock (&event_mut);
-			WebcfgDebug("mutex unlock in event consumer thread\n");
-
-			WebcfgInfo("Data->data is %s\n", Data->data);
-			rv = parseEventData(Data->data, &eventParam);
-			if(rv == WEBCFG_SUCCESS)
+			WebcfgInfo("Data->data is %s\n", data);
+			if(parseEventData(data, &batch[count]) == WEBCFG_SUCCESS)
+			{
+				count++;
+			}
+			else
 			{
-				subdoc_node = getTmpNode(eventParam->subdoc_name);
-				doctimer_node = getTimerNode(eventParam->subdoc_name);
+				WebcfgError("Failed to parse event Data\n");
+				err = getStatusErrorCodeAndMessage(COMPONENT_EVENT_PARSE_FAILURE, &errmsg);
+				WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
+				addWebConfgNotifyMsg(NULL, 0, "failed", errmsg, NULL ,0, "status", err, NULL, 200);
+				WEBCFG_FREE(errmsg);
+			}
+		}
 
-				WebcfgInfo("Event detection\n");
-				if (((eventParam->status !=NULL) && (strcmp(eventParam->status, "ACK")==0 || (strcmp(eventParam->status, "ACK;enabled")==0) || (strcmp(eventParam->status, "ACK;disabled")==0))) && (eventParam->timeout == 0))
+		if(count > 0)
+		{
+			coalesceEvents(batch, keep, count);
+			for(i = 0; i < count; i++)
+			{
+				if(keep[i])
 				{
-					//Based on ACK event if mesh/cujo is enabled then connected client notification need to be turned OFF
-					if ((eventParam->subdoc_name !=NULL) &&((strcmp(eventParam->subdoc_name, "mesh") ==0) || (strcmp(eventParam->subdoc_name, "advsecurity") ==0)))
+					if(workers > 0)
 					{
-						WebcfgInfo("ACK for mesh/cujo received: %s,%lu,%lu,%s,%lu\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, eventParam->status, (long)eventParam->timeout);
-						handleConnectedClientNotify(eventParam->status);
+						dispatchEvent(&batch[i]);
 					}
-				
-					WebcfgInfo("ACK EVENT: %s,%lu,%lu,ACK,%lu %s\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout, "(doc apply success)");
-					WebcfgInfo("doc apply success, proceed to add to DB\n");
-					if( validateEvent(subdoc_node, eventParam->subdoc_name, eventParam->trans_id) == WEBCFG_SUCCESS)
+					else
 					{
-						//version in event &tmp are not same indicates latest doc is not yet applied
-						if((getDocVersionFromTmpList(subdoc_node, eventParam->subdoc_name))== eventParam->version)
-						{
-							stopWebcfgTimer(doctimer_node, eventParam->subdoc_name, eventParam->trans_id);
-
-							//add to DB, update tmp list and notification based on success ack.
-							sendSuccessNotification(subdoc_node, eventParam->subdoc_name, eventParam->version, eventParam->trans_id);
-							//No DB update for supplementary sync as version is not required to be stored.
-							if(subdoc_node->isSupplementarySync == 0)
-							{
-								WebcfgDebug("AddToDB subdoc_name %s version %lu\n", eventParam->subdoc_name, (long)eventParam->version);
-								checkDBList(eventParam->subdoc_name,eventParam->version, NULL);
-								WebcfgDebug("checkRootUpdate\n");
-								if(checkRootUpdate() == WEBCFG_SUCCESS)
-								{
-									WebcfgDebug("updateRootVersionToDB\n");
-									updateRootVersionToDB();
-								}
-								addNewDocEntry(get_successDocCount());
-							}
-							else
-							{
-								WebcfgInfo("No DB update for supplementary sync as version is not required to be stored.\n");
-							}
-							//root doc delete from tmp list and mp docs destroy can be done irrespective of primary/supplementary checks as all docs success can be reached during any sync.
-							WebcfgDebug("check for deleteRootAndMultipartDocs\n");
-							deleteRootAndMultipartDocs();
-						}
-						else
-						{
-							WebcfgError("ACK event version and tmp cache version are not same\n");
-						}
+						processSubdocEvent(&batch[i]);
 					}
 				}
-				else if (((eventParam->status !=NULL)&&(strcmp(eventParam->status, "NACK")==0)) && (eventParam->timeout == 0))
+			}
+		}
+		else
+		{
+			if (get_global_shutdown())
+			{
+				WebcfgDebug("g_shutdown in event consumer thread\n");
+				break;
+			}
+			//announce the sleep, then re-check so a concurrent producer is not missed
+			__atomic_store_n(&g_event_consumer_waiting, 1, __ATOMIC_SEQ_CST);
+			if(eventQueuePop(NULL, 0))
+			{
+				__atomic_store_n(&g_event_consumer_waiting, 0, __ATOMIC_SEQ_CST);
+				continue;
+			}
+			WebcfgDebug("Before eventfd wait in event consumer thread\n");
+			if(read(g_event_fd, &wakeups, sizeof(wakeups)) < 0 && errno != EINTR)
+			{
+				WebcfgError("event consumer wait failed: %s\n", strerror(errno));
+				break;
+			}
+		}
+	}
+	__atomic_store_n(&g_event_consumer_waiting, 0, __ATOMIC_SEQ_CST);
+	stopEventWorkers(workers);
+	closeEventFd();
+	return NULL;
+}
+
+//Starts the event workers, returns the number started. 0 falls back to processing in the consumer.
+int startEventWorkers()
+{
+	int i = 0, err = 0;
+
+	for(i = 0; i < WEBCFG_EVENT_WORKERS; i++)
+	{
+		event_shard_t *shard = &g_event_shards[i];
+
+		pthread_mutex_init(&shard->mut, NULL);
+		pthread_cond_init(&shard->con, NULL);
+		shard->head = 0;
+		shard->count = 0;
+		shard->stop = 0;
+		err = pthread_create(&shard->tid, NULL, eventWorker, shard);
+		if(err != 0)
+		{
+			WebcfgError("Error creating event worker %d :[%s]\n", i, strerror(err));
+			pthread_cond_destroy(&shard->con);
+			pthread_mutex_destroy(&shard->mut);
+			break;
+		}
+	}
+	if(i != WEBCFG_EVENT_WORKERS)
+	{
+		//shard mapping needs the full set, process inline instead
+		stopEventWorkers(i);
+		return 0;
+	}
+	WebcfgInfo("%d event workers started\n", i);
+	return i;
+}
+
+//Lets the workers drain their pending events, then joins them.
+void stopEventWorkers(int workers)
+{
+	int i = 0;
+
+	for(i = 0; i < workers; i++)
+	{
+		pthread_mutex_lock(&g_event_shards[i].mut);
+		g_event_shards[i].stop = 1;
+		pthread_cond_broadcast(&g_event_shards[i].con);
+		pthread_mutex_unlock(&g_event_shards[i].mut);
+	}
+	for(i = 0; i < workers; i++)
+	{
+		pthread_join(g_event_shards[i].tid, NULL);
+		pthread_cond_destroy(&g_event_shards[i].con);
+		pthread_mutex_destroy(&g_event_shards[i].mut);
+	}
+}
+
+//FNV-1a of the doc name, all events of a doc map to the same worker.
+int getEventShard(const char *subdoc_name)
+{
+	uint32_t hash = 2166136261u;
+
+	while(subdoc_name != NULL && *subdoc_name != '\0')
+	{
+		hash ^= (unsigned char)*subdoc_name++;
+		hash *= 16777619u;
+	}
+	return (int)(hash % WEBCFG_EVENT_WORKERS);
+}
+
+//Queues the event to its doc worker, waits while that worker is full.
+void dispatchEvent(event_params_t *param)
+{
+	event_shard_t *shard = &g_event_shards[getEventShard(param->subdoc_name)];
+
+	pthread_mutex_lock(&shard->mut);
+	while(shard->count == WEBCFG_EVENT_QUEUE_SIZE)
+	{
+		WebcfgDebug("event worker full, waiting to queue %s\n", param->subdoc_name);
+		pthread_cond_wait(&shard->con, &shard->mut);
+	}
+	shard->events[(shard->head + shard->count) % WEBCFG_EVENT_QUEUE_SIZE] = *param;
+	shard->count++;
+	pthread_cond_broadcast(&shard->con);
+	pthread_mutex_unlock(&shard->mut);
+}
+
+//Processes the events of its shard in queued order, a blocking retry only stalls docs of this shard.
+void* eventWorker(void *arg)
+{
+	event_shard_t *shard = (event_shard_t *)arg;
+	event_params_t eventRecord;
+
+	//not FOREVER(), the worker runs until the consumer stops it
+	pthread_mutex_lock(&shard->mut);
+	while(1)
+	{
+		if(shard->count == 0)
+		{
+			if(shard->stop)
+			{
+				break;
+			}
+			pthread_cond_wait(&shard->con, &shard->mut);
+			continue;
+		}
+		eventRecord = shard->events[shard->head];
+		shard->head = (shard->head + 1) % WEBCFG_EVENT_QUEUE_SIZE;
+		shard->count--;
+		//wake the consumer if it waits for space
+		pthread_cond_broadcast(&shard->con);
+		pthread_mutex_unlock(&shard->mut);
+
+		processSubdocEvent(&eventRecord);
+
+		pthread_mutex_lock(&shard->mut);
+	}
+	pthread_mutex_unlock(&shard->mut);
+	return NULL;
+}
+
+/* Adds the applied doc and its content digest to DB, then updates the root version and releases the
+root tmp entry once all docs are applied. Workers finish docs concurrently, so
+the root check and cleanup must only run for one of them at a time. */
+void commitDocAndCheckRoot(char *docname, uint32_t version, int isSupplementarySync, uint64_t digest)
+{
+	pthread_mutex_lock(&root_commit_mut);
+	//mp cache is released below once all docs are applied
+	saveAppliedPayload(docname, version);
+	clearDocRetry(docname);
+	//No DB update for supplementary sync as version is not required to be stored.
+	if(isSupplementarySync == 0)
+	{
+		WebcfgDebug("AddToDB subdoc_name %s version %lu\n", docname, (long)version);
+		checkDBList(docname, version, NULL);
+		updateDBDigest(docname, digest);
+		WebcfgDebug("checkRootUpdate\n");
+		if(checkRootUpdate() == WEBCFG_SUCCESS)
+		{
+			WebcfgDebug("updateRootVersionToDB\n");
+			updateRootVersionToDB();
+		}
+		addNewDocEntry(get_successDocCount());
+	}
+	else
+	{
+		WebcfgInfo("No DB update for supplementary sync as version is not required to be stored.\n");
+	}
+	//root doc delete from tmp list and mp docs destroy can be done irrespective of primary/supplementary checks as all docs success can be reached during any sync.
+	WebcfgDebug("check for deleteRootAndMultipartDocs\n");
+	deleteRootAndMultipartDocs();
+	pthread_mutex_unlock(&root_commit_mut);
+}
+
+/* Merges a drained batch per (subdoc, txid) into its effective events, keep[i]
+is cleared for suppressed ones:
+ - exact duplicates of an earlier event are dropped,
+ - pending (timeout) ACKs are replaced by a later final ACK/NACK or a later
+   pending ACK of the same txid, a final after the first final is dropped,
+ - EXPIRE of a doc which has a final ACK/NACK in the batch is dropped, the
+   late final resolves the doc and the retry would only re-apply it. */
+void coalesceEvents(event_params_t *batch, int *keep, int count)
+{
+	int i = 0, j = 0;
+	int final_i = 0, final_j = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		keep[i] = 1;
+	}
+	for(i = 0; i < count; i++)
+	{
+		if(!keep[i])
+		{
+			continue;
+		}
+		final_i = isFinalEvent(&batch[i]);
+		for(j = i + 1; j < count && keep[i]; j++)
+		{
+			if(!keep[j] || strcmp(batch[i].subdoc_name, batch[j].subdoc_name) != 0)
+			{
+				continue;
+			}
+			if(memcmp(&batch[i], &batch[j], sizeof(event_params_t)) == 0)
+			{
+				keep[j] = 0;
+				__atomic_add_fetch(&g_event_stats.coalesced_duplicates, 1, __ATOMIC_RELAXED);
+				WebcfgInfo("Dropped duplicate %s event for doc %s txid %hu\n", batch[j].status, batch[j].subdoc_name, batch[j].trans_id);
+				continue;
+			}
+			final_j = isFinalEvent(&batch[j]);
+			if(batch[i].trans_id == batch[j].trans_id && (final_i || isPendingEvent(&batch[i])) && (final_j || isPendingEvent(&batch[j])))
+			{
+				//first final wins, a pending ACK is superseded by anything later
+				if(final_i)
 				{
-					WebcfgInfo("NACK EVENT: %s,%lu,%lu,NACK,%lu %s\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout, "(doc apply failed)");
-					WebcfgError("doc apply failed for %s\n", eventParam->subdoc_name);
-					if( validateEvent(subdoc_node, eventParam->subdoc_name, eventParam->trans_id) == WEBCFG_SUCCESS)
-					{
-						if((getDocVersionFromTmpList(subdoc_node, eventParam->subdoc_name))== eventParam->version)
-						{
-							stopWebcfgTimer(doctimer_node, eventParam->subdoc_name, eventParam->trans_id);
-							snprintf(err_details, sizeof(err_details),"NACK:%s,%s",((NULL != eventParam->process_name) ? eventParam->process_name : "unknown"), ((NULL != eventParam->failure_reason) ? eventParam->failure_reason : "unknown"));
-							WebcfgDebug("err_details : %s, err_code : %lu\n", err_details, (long) eventParam->err_code);
-							WebcfgInfo("subdoc_name and err_code : %s %lu\n", eventParam->subdoc_name, (long) eventParam->err_code);
-							WebcfgInfo("failure_reason %s\n", err_details);
-							updateTmpList(subdoc_node, eventParam->subdoc_name, eventParam->version, "failed", err_details, eventParam->err_code, eventParam->trans_id, 0);
-							WebcfgDebug("get_global_transID is %s\n", get_global_transID());
-							if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
-							{
-								cloud_trans_id = subdoc_node->cloud_trans_id;
-							}
-							else
-							{
-								WebcfgInfo("subdoc_node is NULL, cloud_trans_id is unknown\n");
-								cloud_trans_id = "unknown";
-							}
-							WebcfgDebug("cloud_trans_id is %s\n", cloud_trans_id);
-							addWebConfgNotifyMsg(eventParam->subdoc_name, eventParam->version, "failed", err_details, cloud_trans_id, eventParam->timeout, "status", eventParam->err_code, NULL, 200);
-						}
-						else
-						{
-							WebcfgError("NACK event version and tmp cache version are not same\n");
-						}
-					}
+					keep[j] = 0;
 				}
-				else if ((eventParam->status !=NULL)&&(strcmp(eventParam->status, "EXPIRE")==0))
+				else
 				{
-					WebcfgInfo("EXPIRE EVENT: %s,%lu,%lu,EXPIRE,%lu\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout);
-					WebcfgInfo("doc apply timeout expired, need to retry\n");
-					WebcfgDebug("get_global_transID is %s\n", get_global_transID());
-					if(eventParam->version !=0)
-					{
-						docVersion = eventParam->version;
-					}
-					else
-					{
-						docVersion = getDocVersionFromTmpList(subdoc_node, eventParam->subdoc_name);
-					}
-					WebcfgDebug("docVersion %lu\n", (long) docVersion);
-					if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
-					{
-						addWebConfgNotifyMsg(eventParam->subdoc_name, docVersion, "pending", "timer_expired", subdoc_node->cloud_trans_id, eventParam->timeout, "status", 0, NULL, 200);
-					}
-					WebcfgDebug("retryMultipartSubdoc for EXPIRE case\n");
-					rs = retryMultipartSubdoc(subdoc_node, eventParam->subdoc_name);
-					if(rs == WEBCFG_SUCCESS)
-					{
-						WebcfgDebug("retryMultipartSubdoc success\n");
-					}
-					else
-					{
-						WebcfgError("retryMultipartSubdoc failed\n");
-						if(subdoc_node !=NULL)
-						{
-							if(subdoc_node->retry_count < 3)
-							{
-								err = getStatusErrorCodeAndMessage(SUBDOC_RETRY_FAILED, &errmsg);
-								WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
-								updateTmpList(subdoc_node, eventParam->subdoc_name, docVersion, "failed", errmsg, err, subdoc_node->trans_id, subdoc_node->retry_count);
-								if(subdoc_node->cloud_trans_id !=NULL)
-								{
-									addWebConfgNotifyMsg(eventParam->subdoc_name, docVersion, "failed", errmsg, subdoc_node->cloud_trans_id ,0, "status", err, NULL, 200);
-								}
-								WEBCFG_FREE(errmsg);
-							}
-						}
-					}
+					keep[i] = 0;
 				}
-				else if (eventParam->timeout != 0)
+				__atomic_add_fetch(&g_event_stats.coalesced_superseded, 1, __ATOMIC_RELAXED);
+				WebcfgInfo("Coalesced %s event for doc %s txid %hu\n", (final_i ? batch[j].status : batch[i].status), batch[i].subdoc_name, batch[i].trans_id);
+			}
+			/* EXPIRE is only redundant when the final event resolves the current
+			apply. A stale final is rejected later and the EXPIRE is the retry. */
+			else if((final_i && batch[j].status_type == EVENT_STATUS_EXPIRE && isCurrentTransId(batch[i].trans_id, batch[i].subdoc_name)) ||
+				(final_j && batch[i].status_type == EVENT_STATUS_EXPIRE && isCurrentTransId(batch[j].trans_id, batch[j].subdoc_name)))
+			{
+				if(final_i)
 				{
-					WebcfgInfo("TIMEOUT EVENT: %s,%lu,%lu,ACK,%lu %s\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout,"(doc apply need time)");
-					WebcfgInfo("doc apply need time, start timer.\n");
-					if( validateEvent(subdoc_node, eventParam->subdoc_name, eventParam->trans_id) == WEBCFG_SUCCESS)
-					{
-						if((getDocVersionFromTmpList(subdoc_node, eventParam->subdoc_name))== eventParam->version)
-						{
-							startWebcfgTimer(doctimer_node, eventParam->subdoc_name, eventParam->trans_id, eventParam->timeout);
-							if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
-							{
-								cloud_trans_id = subdoc_node->cloud_trans_id;
-							}
-							else
-							{
-								WebcfgInfo("subdoc_node is NULL, cloud_trans_id is unknown\n");
-								cloud_trans_id = "unknown";
-							}
-							WebcfgDebug("cloud_trans_id is %s\n", cloud_trans_id);
-							addWebConfgNotifyMsg(eventParam->subdoc_name, eventParam->version, "pending", NULL, cloud_trans_id,eventParam->timeout, "ack", 0, NULL, 200);
-						}
-						else
-						{
-							WebcfgError("Timeout event version and tmp cache version are not same\n");
-						}
-					}
+					keep[j] = 0;
 				}
 				else
 				{
-					if ((eventParam->status !=NULL)&&(strcmp(eventParam->status, "COMP_INIT")==0))
-					{
-						WebcfgInfo("COMP_INIT EVENT: %s,%d,%lu\n", eventParam->subdoc_name,0, (long)eventParam->version);
-						WebcfgInfo("Component initialized, check and re-send blob.\n");
-					}
-					else
-					{
-						WebcfgInfo("Crash EVENT: %s,%d,%lu\n", eventParam->subdoc_name,0, (long)eventParam->version);
-						WebcfgInfo("Component restarted after crash, re-send blob.\n");
-					}
-					uint32_t tmpVersion = 0;
+					keep[i] = 0;
+				}
+				__atomic_add_fetch(&g_event_stats.coalesced_superseded, 1, __ATOMIC_RELAXED);
+				WebcfgInfo("Dropped EXPIRE for doc %s resolved by final event\n", batch[i].subdoc_name);
+			}
+		}
+	}
+}
 
-					//If version in event and tmp are not matching, re-send blob to retry.
-					if(checkDBVersion(eventParam->subdoc_name, eventParam->version) !=WEBCFG_SUCCESS)
-					{
-						WebcfgInfo("DB and event version are not same, check tmp list\n");
-						tmpVersion = getDocVersionFromTmpList(subdoc_node, eventParam->subdoc_name);
-						if (tmpVersion == 0)
-						{
-							//tmpVersion=0 indicate already doc is applied & doc is not available in tmp list
-							WebcfgInfo("tmpVersion is 0, DB already in latest version\n");
-						}
-						else if(tmpVersion != eventParam->version)
-						{
-							WebcfgInfo("tmp list has new version %lu for doc %s, retry\n", (long)tmpVersion, eventParam->subdoc_name);
-							rs = retryMultipartSubdoc(subdoc_node, eventParam->subdoc_name);
-							if(rs == WEBCFG_SUCCESS)
-							{
-								WebcfgDebug("retryMultipartSubdoc success\n");
-							}
-							else
-							{
-								WebcfgError("retryMultipartSubdoc failed\n");
-								if(subdoc_node != NULL)
-								{
-									if(subdoc_node->retry_count < 3)
-									{
-										err = getStatusErrorCodeAndMessage(SUBDOC_RETRY_FAILED, &errmsg);
-										WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
-										updateTmpList(subdoc_node, eventParam->subdoc_name, tmpVersion, "failed", errmsg, err, subdoc_node->trans_id, subdoc_node->retry_count);
-									        if(subdoc_node->cloud_trans_id != NULL)
-										{
-											addWebConfgNotifyMsg(eventParam->subdoc_name, tmpVersion, "failed", errmsg, subdoc_node->cloud_trans_id ,0, "status", err, NULL, 200);
-										}
-										WEBCFG_FREE(errmsg);
-									}
-								}
-							}
-						}
-						else
-						{
-							//already in tmp latest version,send success notify, updateDB
-							WebcfgInfo("tmp version %lu same as event version %lu\n",(long)tmpVersion, (long)eventParam->version); 
-							sendSuccessNotification(subdoc_node, eventParam->subdoc_name, eventParam->version, eventParam->trans_id);
-							//No DB update for supplementary docs
-							if(subdoc_node->isSupplementarySync == 0)
-							{
-								WebcfgInfo("AddToDB subdoc_name %s version %lu\n", eventParam->subdoc_name, (long)eventParam->version);
-								checkDBList(eventParam->subdoc_name,eventParam->version, NULL);
-								WebcfgDebug("checkRootUpdate\n");
-								if(checkRootUpdate() == WEBCFG_SUCCESS)
-								{
-									WebcfgDebug("updateRootVersionToDB\n");
-									updateRootVersionToDB();
-								}
-								addNewDocEntry(get_successDocCount());
-							}
-							WebcfgDebug("check for deleteRootAndMultipartDocs\n");
-							deleteRootAndMultipartDocs();
-						}
-					}
-					else
-					{
-						WebcfgInfo("DB and event version are same, check tmp list\n");
-						tmpVersion = getDocVersionFromTmpList(subdoc_node, eventParam->subdoc_name);
-						//tmpVersion=0 indicate already doc is applied & deleted frm tmp list
-						if((tmpVersion !=0) && (tmpVersion != eventParam->version))
-						{
-							WebcfgInfo("tmp list has new version %lu for doc %s, retry\n", (long)tmpVersion, eventParam->subdoc_name);
-							//retry with latest tmp version
-							rs = retryMultipartSubdoc(subdoc_node, eventParam->subdoc_name);
-							//wait for ACK to send success notification and Update DB
-							if(rs == WEBCFG_SUCCESS)
-							{
-								WebcfgDebug("retryMultipartSubdoc success\n");
-							}
-							else
-							{
-								WebcfgError("retryMultipartSubdoc failed\n");
-								if(subdoc_node != NULL)
-								{
-									if(subdoc_node->retry_count < 3)
-									{
-										err = getStatusErrorCodeAndMessage(SUBDOC_RETRY_FAILED, &errmsg);
-										WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
-										updateTmpList(subdoc_node, eventParam->subdoc_name, tmpVersion, "failed", errmsg, err, subdoc_node->trans_id, subdoc_node->retry_count);
-										if(subdoc_node->cloud_trans_id != NULL)
-										{
-											addWebConfgNotifyMsg(eventParam->subdoc_name, tmpVersion, "failed", errmsg, subdoc_node->cloud_trans_id ,0, "status", err, NULL, 200);
-										}
-										WEBCFG_FREE(errmsg);
-									}
-								}
-							}
-						}
-						else
-						{
-							WebcfgInfo("Already in latest version, no need to retry\n");
-						}
-					}
+//ACK or NACK without timeout, ends the apply of the doc
+int isFinalEvent(event_params_t *param)
+{
+	return (param->timeout == 0) && ((param->status_type == EVENT_STATUS_ACK) || (param->status_type == EVENT_STATUS_ACK_ENABLED) || (param->status_type == EVENT_STATUS_ACK_DISABLED) || (param->status_type == EVENT_STATUS_NACK));
+}
+
+//ACK with timeout, component needs more time
+int isPendingEvent(event_params_t *param)
+{
+	return (param->timeout != 0) && (param->status_type != EVENT_STATUS_EXPIRE);
+}
+
+//Feeds apply latency stats, crash and COMP_INIT events carry no apply result.
+void recordEventLatency(event_params_t *param)
+{
+	if(param->status_type == EVENT_STATUS_EXPIRE)
+	{
+		latencyRecordEvent(param->subdoc_name, param->trans_id, LATENCY_EVENT_EXPIRE);
+	}
+	else if(isPendingEvent(param))
+	{
+		latencyRecordEvent(param->subdoc_name, param->trans_id, LATENCY_EVENT_TIMEOUT);
+	}
+	else if(isFinalEvent(param))
+	{
+		latencyRecordEvent(param->subdoc_name, param->trans_id, (param->status_type == EVENT_STATUS_NACK) ? LATENCY_EVENT_NACK : LATENCY_EVENT_ACK);
+	}
+}
+
+//Process one parsed sub doc event.
+void processSubdocEvent(event_params_t *eventParam)
+{
+	WEBCFG_STATUS rs = WEBCFG_FAILURE;
+	uint32_t docVersion = 0;
+	char err_details[512] = {0};
+	webconfig_tmp_data_t * subdoc_node = NULL;
+	webconfig_tmp_snapshot_t snap;
+	webconfig_tmp_snapshot_t *tmp_doc = NULL;
+	expire_timer_t * doctimer_node = NULL;
+	char * cloud_trans_id = NULL;
+
+	recordEventLatency(eventParam);
+	//subdoc_node only identifies the doc for retryMultipartSubdoc, it is never dereferenced here
+	subdoc_node = getTmpNode(eventParam->subdoc_name);
+	//other event workers and syncs update the doc concurrently, fields are read from the copy
+	if(getTmpSnapshot(eventParam->subdoc_name, &snap) == WEBCFG_SUCCESS)
+	{
+		tmp_doc = &snap;
+	}
+	doctimer_node = getTimerNode(eventParam->subdoc_name);
+
+	WebcfgInfo("Event detection\n");
+	if (((eventParam->status_type == EVENT_STATUS_ACK) || (eventParam->status_type == EVENT_STATUS_ACK_ENABLED) || (eventParam->status_type == EVENT_STATUS_ACK_DISABLED)) && (eventParam->timeout == 0))
+	{
+		//Based on ACK event if mesh/cujo is enabled then connected client notification need to be turned OFF
+		if (((strcmp(eventParam->subdoc_name, "mesh") ==0) || (strcmp(eventParam->subdoc_name, "advsecurity") ==0)))
+		{
+			WebcfgInfo("ACK for mesh/cujo received: %s,%lu,%lu,%s,%lu\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, eventParam->status, (long)eventParam->timeout);
+			handleConnectedClientNotify(eventParam->status);
+		}
+	
+		WebcfgInfo("ACK EVENT: %s,%lu,%lu,ACK,%lu %s\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout, "(doc apply success)");
+		WebcfgInfo("doc apply success, proceed to add to DB\n");
+		if( validateEvent(tmp_doc, eventParam->subdoc_name, eventParam->trans_id) == WEBCFG_SUCCESS)
+		{
+			//version in event &tmp are not same indicates latest doc is not yet applied
+			if(tmp_doc->version == eventParam->version)
+			{
+				stopWebcfgTimer(doctimer_node, eventParam->subdoc_name, eventParam->trans_id);
+
+				//add to DB, update tmp list and notification based on success ack.
+				sendSuccessNotification(eventParam->subdoc_name, eventParam->version, eventParam->trans_id, tmp_doc->cloud_trans_id);
+				commitDocAndCheckRoot(eventParam->subdoc_name, eventParam->version, tmp_doc->isSupplementarySync, tmp_doc->digest);
+			}
+			else
+			{
+				WebcfgError("ACK event version and tmp cache version are not same\n");
+			}
+		}
+	}
+	else if ((eventParam->status_type == EVENT_STATUS_NACK) && (eventParam->timeout == 0))
+	{
+		WebcfgInfo("NACK EVENT: %s,%lu,%lu,NACK,%lu %s\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout, "(doc apply failed)");
+		WebcfgError("doc apply failed for %s\n", eventParam->subdoc_name);
+		if( validateEvent(tmp_doc, eventParam->subdoc_name, eventParam->trans_id) == WEBCFG_SUCCESS)
+		{
+			if(tmp_doc->version == eventParam->version)
+			{
+				stopWebcfgTimer(doctimer_node, eventParam->subdoc_name, eventParam->trans_id);
+				snprintf(err_details, sizeof(err_details),"NACK:%s,%s",(('\0' != eventParam->process_name[0]) ? eventParam->process_name : "unknown"), (('\0' != eventParam->failure_reason[0]) ? eventParam->failure_reason : "unknown"));
+				WebcfgDebug("err_details : %s, err_code : %lu\n", err_details, (long) eventParam->err_code);
+				WebcfgInfo("subdoc_name and err_code : %s %lu\n", eventParam->subdoc_name, (long) eventParam->err_code);
+				WebcfgInfo("failure_reason %s\n", err_details);
+				updateTmpListByName(eventParam->subdoc_name, eventParam->version, DOC_STATE_FAILED, err_details, eventParam->err_code, eventParam->trans_id, 0);
+				WebcfgDebug("get_global_transID is %s\n", get_global_transID());
+				if(tmp_doc->cloud_trans_id !=NULL)
+				{
+					cloud_trans_id = tmp_doc->cloud_trans_id;
+				}
+				else
+				{
+					WebcfgInfo("subdoc_node is NULL, cloud_trans_id is unknown\n");
+					cloud_trans_id = "unknown";
 				}
-				free_event_params_struct(eventParam);
+				WebcfgDebug("cloud_trans_id is %s\n", cloud_trans_id);
+				addWebConfgNotifyMsg(eventParam->subdoc_name, eventParam->version, "failed", err_details, cloud_trans_id, eventParam->timeout, "status", eventParam->err_code, NULL, 200);
+				rollbackSubdoc(eventParam->subdoc_name, eventParam->version);
 			}
 			else
 			{
-				WebcfgError("Failed to parse event Data\n");
-				err = getStatusErrorCodeAndMessage(COMPONENT_EVENT_PARSE_FAILURE, &errmsg);
-				WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
-				addWebConfgNotifyMsg(NULL, 0, "failed", errmsg, NULL ,0, "status", err, NULL, 200);
-				WEBCFG_FREE(errmsg);
+				WebcfgError("NACK event version and tmp cache version are not same\n");
 			}
-			WEBCFG_FREE(Data);
+		}
+	}
+	else if (eventParam->status_type == EVENT_STATUS_EXPIRE)
+	{
+		WebcfgInfo("EXPIRE EVENT: %s,%lu,%lu,EXPIRE,%lu\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout);
+		WebcfgInfo("doc apply timeout expired, need to retry\n");
+		WebcfgDebug("get_global_transID is %s\n", get_global_transID());
+		if(eventParam->version !=0)
+		{
+			docVersion = eventParam->version;
+		}
+		else if(tmp_doc != NULL)
+		{
+			docVersion = tmp_doc->version;
+		}
+		WebcfgDebug("docVersion %lu\n", (long) docVersion);
+		if(tmp_doc !=NULL && tmp_doc->cloud_trans_id !=NULL)
+		{
+			addWebConfgNotifyMsg(eventParam->subdoc_name, docVersion, "pending", "timer_expired", tmp_doc->cloud_trans_id, eventParam->timeout, "status", 0, NULL, 200);
+		}
+		WebcfgDebug("retryMultipartSubdoc for EXPIRE case\n");
+		rs = retryMultipartSubdoc(subdoc_node, eventParam->subdoc_name);
+		if(rs == WEBCFG_SUCCESS)
+		{
+			WebcfgDebug("retryMultipartSubdoc success\n");
 		}
 		else
 		{
-			if (get_global_shutdown())
+			WebcfgError("retryMultipartSubdoc failed\n");
+			if(setRetryFailed(eventParam->subdoc_name, docVersion) == 1)
 			{
-				WebcfgDebug("g_shutdown in event consumer thread\n");
-				pthread_mutex_unlock (&event_mut);
-				break;
+				//retries are exhausted, the doc is left failed until the next sync
+				rollbackSubdoc(eventParam->subdoc_name, docVersion);
 			}
-			WebcfgDebug("Before pthread cond wait in event consumer thread\n");
-			pthread_cond_wait(&event_con, &event_mut);
-			pthread_mutex_unlock (&event_mut);
-			WebcfgDebug("mutex unlock in event consumer thread after cond wait\n");
 		}
 	}
-	return NULL;
-}
-
-//Extract values from comma separated string and add to event_params_t structure.
-int parseEventData(char* str, event_params_t **val)
-{
-	event_params_t *param = NULL;
-	char *tmpStr, *token =  NULL;
-	char * trans_id = NULL;
-	char *version = NULL;
-	char * timeout = NULL;
-	char *err_code = NULL;
-	char *subdoc_name = NULL, *status = NULL;
-	char *process_name = NULL, *failure_reason = NULL;
-
-	if(str !=NULL)
-	{
-		param = (event_params_t *)malloc(sizeof(event_params_t));
-		if(param)
+	else if (eventParam->timeout != 0)
+	{
+		WebcfgInfo("TIMEOUT EVENT: %s,%lu,%lu,ACK,%lu %s\n", eventParam->subdoc_name,(long)eventParam->trans_id, (long)eventParam->version, (long)eventParam->timeout,"(doc apply need time)");
+		WebcfgInfo("doc apply need time, start timer.\n");
+		if( validateEvent(tmp_doc, eventParam->subdoc_name, eventParam->trans_id) == WEBCFG_SUCCESS)
 		{
-			memset(param, 0, sizeof(event_params_t));
-		        token = strdup(str);
-				tmpStr = token;
-			WEBCFG_FREE(str);
-
-		        subdoc_name = strsep(&tmpStr, ",");
-				if(subdoc_name != NULL)
+			if(tmp_doc->version == eventParam->version)
+			{
+				startWebcfgTimer(doctimer_node, eventParam->subdoc_name, eventParam->trans_id, eventParam->timeout);
+				if(tmp_doc->cloud_trans_id !=NULL)
 				{
-					param->subdoc_name = strdup(subdoc_name);
+					cloud_trans_id = tmp_doc->cloud_trans_id;
 				}
-		        trans_id = strsep(&tmpStr,",");
-		        version = strsep(&tmpStr,",");
-				status = strsep(&tmpStr,",");
-				if(status != NULL)
+				else
 				{
-		        	param->status = strdup(status);
+					WebcfgInfo("subdoc_node is NULL, cloud_trans_id is unknown\n");
+					cloud_trans_id = "unknown";
 				}
-		        timeout = strsep(&tmpStr, ",");
+				WebcfgDebug("cloud_trans_id is %s\n", cloud_trans_id);
+				addWebConfgNotifyMsg(eventParam->subdoc_name, eventParam->version, "pending", NULL, cloud_trans_id,eventParam->timeout, "ack", 0, NULL, 200);
+			}
+			else
+			{
+				WebcfgError("Timeout event version and tmp cache version are not same\n");
+			}
+		}
+	}
+	else
+	{
+		if (eventParam->status_type == EVENT_STATUS_COMP_INIT)
+		{
+			WebcfgInfo("COMP_INIT EVENT: %s,%d,%lu\n", eventParam->subdoc_name,0, (long)eventParam->version);
+			WebcfgInfo("Component initialized, check and re-send blob.\n");
+		}
+		else
+		{
+			WebcfgInfo("Crash EVENT: %s,%d,%lu\n", eventParam->subdoc_name,0, (long)eventParam->version);
+			WebcfgInfo("Component restarted after crash, re-send blob.\n");
+		}
+		uint32_t tmpVersion = (tmp_doc != NULL) ? tmp_doc->version : 0;
 
-			if(tmpStr !=NULL)
+		//If version in event and tmp are not matching, re-send blob to retry.
+		if(checkDBVersion(eventParam->subdoc_name, eventParam->version) !=WEBCFG_SUCCESS)
+		{
+			WebcfgInfo("DB and event version are not same, check tmp list\n");
+			if (tmpVersion == 0)
 			{
-				WebcfgInfo("For NACK event: tmpStr with error_details is %s\n", tmpStr);
-				process_name = strsep(&tmpStr, ",");
-				if(process_name != NULL)
+				//tmpVersion=0 indicate already doc is applied & doc is not available in tmp list
+				WebcfgInfo("tmpVersion is 0, DB already in latest version\n");
+			}
+			else if(tmpVersion != eventParam->version)
+			{
+				WebcfgInfo("tmp list has new version %lu for doc %s, retry\n", (long)tmpVersion, eventParam->subdoc_name);
+				rs = retryMultipartSubdoc(subdoc_node, eventParam->subdoc_name);
+				if(rs == WEBCFG_SUCCESS)
 				{
-					param->process_name = strdup(process_name);
+					WebcfgDebug("retryMultipartSubdoc success\n");
 				}
-				err_code = strsep(&tmpStr, ",");
-				failure_reason = strsep(&tmpStr, ",");
-				if(failure_reason != NULL)
+				else
 				{
-					param->failure_reason = strdup(failure_reason);
+					WebcfgError("retryMultipartSubdoc failed\n");
+					setRetryFailed(eventParam->subdoc_name, tmpVersion);
 				}
-				WebcfgInfo("process_name %s err_code %s failure_reason %s\n", param->process_name, err_code, param->failure_reason);
 			}
-
-			WebcfgDebug("convert string to uint type\n");
-			if(trans_id !=NULL)
+			else
 			{
-				param->trans_id = strtoul(trans_id,NULL,0);
+				//already in tmp latest version,send success notify, updateDB
+				WebcfgInfo("tmp version %lu same as event version %lu\n",(long)tmpVersion, (long)eventParam->version); 
+				sendSuccessNotification(eventParam->subdoc_name, eventParam->version, eventParam->trans_id, tmp_doc->cloud_trans_id);
+				commitDocAndCheckRoot(eventParam->subdoc_name, eventParam->version, tmp_doc->isSupplementarySync, tmp_doc->digest);
 			}
-
-			if(version !=NULL)
+		}
+		else
+		{
+			WebcfgInfo("DB and event version are same, check tmp list\n");
+			//tmpVersion=0 indicate already doc is applied & deleted frm tmp list
+			if((tmpVersion !=0) && (tmpVersion != eventParam->version))
 			{
-				param->version = strtoul(version,NULL,0);
+				WebcfgInfo("tmp list has new version %lu for doc %s, retry\n", (long)tmpVersion, eventParam->subdoc_name);
+				//retry with latest tmp version
+				rs = retryMultipartSubdoc(subdoc_node, eventParam->subdoc_name);
+				//wait for ACK to send success notification and Update DB
+				if(rs == WEBCFG_SUCCESS)
+				{
+					WebcfgDebug("retryMultipartSubdoc success\n");
+				}
+				else
+				{
+					WebcfgError("retryMultipartSubdoc failed\n");
+					setRetryFailed(eventParam->subdoc_name, tmpVersion);
+				}
 			}
-
-			if(timeout !=NULL)
+			else
 			{
-				param->timeout = strtoul(timeout,NULL,0);
+				WebcfgInfo("Already in latest version, no need to retry\n");
 			}
+		}
+	}
+	if(tmp_doc != NULL)
+	{
+		freeTmpSnapshot(tmp_doc);
+	}
+}
 
-			if(err_code !=NULL)
-			{
-				param->err_code = strtoul(err_code,NULL,0);
-				WebcfgDebug("param->err_code %lu\n", (long)param->err_code);
-			}
+/* Marks the doc failed after a failed retry while retries are left. The retry
+updated the doc, so it is read again under the tmp list lock.
+Returns 1 when the retries are exhausted, 0 otherwise. */
+int setRetryFailed(char *docname, uint32_t version)
+{
+	webconfig_tmp_snapshot_t snap;
+	uint16_t err = 0;
+	char* errmsg = NULL;
+	int exhausted = 0;
 
-			WebcfgInfo("param->subdoc_name %s param->trans_id %lu param->version %lu param->status %s param->timeout %lu\n", param->subdoc_name, (long)param->trans_id, (long)param->version, param->status, (long)param->timeout);
-			*val = param;
-			WEBCFG_FREE(token);
-			return WEBCFG_SUCCESS;
-		}		
+	if(getTmpSnapshot(docname, &snap) != WEBCFG_SUCCESS)
+	{
+		return 0;
+	}
+	if(snap.retry_count < 3)
+	{
+		err = getStatusErrorCodeAndMessage(SUBDOC_RETRY_FAILED, &errmsg);
+		WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
+		if(updateTmpListByName(docname, version, DOC_STATE_FAILED, errmsg, err, snap.trans_id, snap.retry_count) == WEBCFG_SUCCESS && snap.cloud_trans_id != NULL)
+		{
+			addWebConfgNotifyMsg(docname, version, "failed", errmsg, snap.cloud_trans_id ,0, "status", err, NULL, 200);
+		}
+		WEBCFG_FREE(errmsg);
+	}
+	else
+	{
+		exhausted = 1;
 	}
+	freeTmpSnapshot(&snap);
+	return exhausted;
+}
 
-	return WEBCFG_FAILURE;
+/* Marks the eventfd closed before closing it. A producer which loaded the fd
+before that may still be writing to it, so the close waits for those. Events
+queued later stay in the ring for the next consumer. */
+void closeEventFd()
+{
+	int fd = __atomic_exchange_n(&g_event_fd, -1, __ATOMIC_SEQ_CST);
 
+	while(__atomic_load_n(&g_event_fd_users, __ATOMIC_SEQ_CST) > 0)
+	{
+		sched_yield();
+	}
+	if(fd >= 0)
+	{
+		close(fd);
+	}
+}
+
+/* Single consumer dequeue, copies the oldest event to buf. With a NULL buf it
+only reports whether an event is pending. */
+int eventQueuePop(char *buf, size_t len)
+{
+	event_slot_t *slot = &g_event_ring[g_event_tail & EVENT_QUEUE_MASK];
+	size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) + (g_event_tail & EVENT_QUEUE_MASK);
+
+	if(seq != g_event_tail + 1)
+	{
+		return 0;
+	}
+	if(buf == NULL)
+	{
+		return 1;
+	}
+	strncpy(buf, slot->data, len - 1);
+	buf[len - 1] = '\0';
+	//slot becomes free for the producer one lap ahead
+	__atomic_store_n(&slot->seq, g_event_tail + WEBCFG_EVENT_QUEUE_SIZE - (g_event_tail & EVENT_QUEUE_MASK), __ATOMIC_RELEASE);
+	__atomic_store_n(&g_event_tail, g_event_tail + 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/* Extract values from comma separated string into the fixed event record:
+name,trans_id,version,status,timeout[,process_name,err_code,failure_reason]
+Fields are located in place and copied bounded, nothing is allocated. */
+int parseEventData(const char* str, event_params_t *param)
+{
+	const char *field[EVENT_MAX_FIELDS] = {NULL};
+	size_t flen[EVENT_MAX_FIELDS] = {0};
+	const char *p = str;
+	const char *end = NULL;
+	int count = 0;
+
+	if(str == NULL || param == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	memset(param, 0, sizeof(event_params_t));
+
+	while(p != NULL && count < EVENT_MAX_FIELDS)
+	{
+		end = strchr(p, ',');
+		field[count] = p;
+		flen[count] = (end != NULL) ? (size_t)(end - p) : strlen(p);
+		p = (end != NULL) ? end + 1 : NULL;
+		count++;
+	}
+
+	if(copyEventField(param->subdoc_name, sizeof(param->subdoc_name), field[0], flen[0]) != WEBCFG_SUCCESS)
+	{
+		WebcfgError("Invalid subdoc name in event\n");
+		return WEBCFG_FAILURE;
+	}
+	//numeric fields end at the next comma, strtoul stops there
+	if(count > 1)
+	{
+		param->trans_id = strtoul(field[1],NULL,0);
+	}
+	if(count > 2)
+	{
+		param->version = strtoul(field[2],NULL,0);
+	}
+	if(count > 3)
+	{
+		if(copyEventField(param->status, sizeof(param->status), field[3], flen[3]) != WEBCFG_SUCCESS)
+		{
+			WebcfgError("Invalid status in event\n");
+			return WEBCFG_FAILURE;
+		}
+		param->status_type = getEventStatusType(param->status);
+	}
+	if(count > 4)
+	{
+		param->timeout = strtoul(field[4],NULL,0);
+	}
+	if(count > 5)
+	{
+		WebcfgInfo("For NACK event: tmpStr with error_details is %s\n", field[5]);
+		if(copyEventField(param->process_name, sizeof(param->process_name), field[5], flen[5]) != WEBCFG_SUCCESS)
+		{
+			WebcfgError("Invalid process name in event\n");
+			return WEBCFG_FAILURE;
+		}
+		if(count > 6)
+		{
+			param->err_code = strtoul(field[6],NULL,0);
+		}
+		if(count > 7)
+		{
+			//failure reason is informational only, keep what fits
+			flen[7] = (flen[7] < sizeof(param->failure_reason)) ? flen[7] : sizeof(param->failure_reason) - 1;
+			copyEventField(param->failure_reason, sizeof(param->failure_reason), field[7], flen[7]);
+		}
+		WebcfgInfo("process_name %s err_code %lu failure_reason %s\n", param->process_name, (long)param->err_code, param->failure_reason);
+	}
+
+	WebcfgInfo("param->subdoc_name %s param->trans_id %lu param->version %lu param->status %s param->timeout %lu\n", param->subdoc_name, (long)param->trans_id, (long)param->version, param->status, (long)param->timeout);
+	return WEBCFG_SUCCESS;
+}
+
+//Maps the event status string to its type, unknown status is handled as crash
+WEBCFG_EVENT_STATUS getEventStatusType(const char *status)
+{
+	static const struct
+	{
+		const char *name;
+		WEBCFG_EVENT_STATUS type;
+	} status_map[] = {
+		{"ACK", EVENT_STATUS_ACK},
+		{"ACK;enabled", EVENT_STATUS_ACK_ENABLED},
+		{"ACK;disabled", EVENT_STATUS_ACK_DISABLED},
+		{"NACK", EVENT_STATUS_NACK},
+		{"EXPIRE", EVENT_STATUS_EXPIRE},
+		{"COMP_INIT", EVENT_STATUS_COMP_INIT}
+	};
+	size_t i = 0;
+
+	for(i = 0; i < sizeof(status_map)/sizeof(status_map[0]); i++)
+	{
+		if(strcmp(status, status_map[i].name) == 0)
+		{
+			return status_map[i].type;
+		}
+	}
+	return EVENT_STATUS_NONE;
+}
+
+int copyEventField(char *dst, size_t size, const char *field, size_t len)
+{
+	if(len >= size)
+	{
+		return WEBCFG_FAILURE;
+	}
+	memcpy(dst, field, len);
+	dst[len] = '\0';
+	return WEBCFG_SUCCESS;
 }
 
 
 //To generate custom timer EXPIRE event for expired doc and add to event queue.
 void createTimerExpiryEvent(char *docName, uint16_t transid)
 {
-	char *expiry_event_data = NULL;
 	char data[128] = {0};
 
 	snprintf(data,sizeof(data),"%s,%hu,%u,EXPIRE,%u",docName,transid,0,0);
-	expiry_event_data = strdup(data);
-	WebcfgDebug("expiry_event_data formed %s\n", expiry_event_data);
-	if(expiry_event_data)
+	WebcfgDebug("expiry_event_data formed %s\n", data);
+	if(addToEventQueue(data) == 0)
 	{
-		addToEventQueue(expiry_event_data);
 		WebcfgDebug("Added EXPIRE event queue\n");
 	}
 	else
@@ -688,15 +1087,10 @@ void createTimerExpiryEvent(char *docName, uint16_t transid)
 }
 
 //Update Tmp list and send success notification to cloud .
-void sendSuccessNotification(webconfig_tmp_data_t *subdoc_node, char *name, uint32_t version, uint16_t txid)
+void sendSuccessNotification(char *name, uint32_t version, uint16_t txid, char *cloud_trans_id)
 {
-	char *cloud_trans_id = NULL;
-	updateTmpList(subdoc_node, name, version, "success", "none", 0, txid, 0);
-	if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
-	{
-		cloud_trans_id = subdoc_node->cloud_trans_id;
-	}
-	else
+	updateTmpListByName(name, version, DOC_STATE_SUCCESS, "none", 0, txid, 0);
+	if(cloud_trans_id == NULL)
 	{
 		WebcfgInfo("subdoc_node is NULL, cloud_trans_id is unknown\n");
 		cloud_trans_id = "unknown";
@@ -727,6 +1121,8 @@ WEBCFG_STATUS startWebcfgTimer(expire_timer_t *timer_node, char *name, uint16_t
 			new_node->next=NULL;
 
 			pthread_mutex_lock (&expire_timer_mut);
+			webcfgTimerArm(&new_node->timer, timeout * 1000, docTimerExpired, new_node);
+			numOfEvents = numOfEvents + 1;
 			if (g_timer_head == NULL)
 			{
 				g_timer_head = new_node;
@@ -746,7 +1142,6 @@ WEBCFG_STATUS startWebcfgTimer(expire_timer_t *timer_node, char *name, uint16_t
 			}
 
 			WebcfgInfo("new_node->subdoc_name %s new_node->txid %lu new_node->timeout %lu status %d added to list\n", new_node->subdoc_name, (long)new_node->txid, (long)new_node->timeout, new_node->running);
-			numOfEvents = numOfEvents + 1;
 		}
 		else
 		{
@@ -770,6 +1165,14 @@ WEBCFG_STATUS updateTimerList(expire_timer_t *temp, int status, char *docname, u
 			temp->running = status;
 			temp->txid = transid;
 			temp->timeout = timeout;
+			if(status)
+			{
+				webcfgTimerArm(&temp->timer, timeout * 1000, docTimerExpired, temp);
+			}
+			else
+			{
+				webcfgTimerDisarm(&temp->timer);
+			}
 			if(strcmp(temp->subdoc_name, docname) !=0)
 			{
 				WEBCFG_FREE(temp->subdoc_name);
@@ -820,6 +1223,7 @@ WEBCFG_STATUS deleteFromTimerList(char* doc_name)
 			}
 
 			WebcfgDebug("Deleting the node entries\n");
+			webcfgTimerDisarm(&curr_node->timer);
 			curr_node->running = false;
 			curr_node->txid = 0;
 			curr_node->timeout = 0;
@@ -880,64 +1284,81 @@ WEBCFG_STATUS stopWebcfgTimer(expire_timer_t *temp, char *name, uint16_t trans_i
 	return WEBCFG_FAILURE;
 }
 
-//check timer expiry by decrementing timeout by 5 for 5s sleep.
-int checkTimerExpired (char **exp_doc)
+/* Timer service callback for doc apply timeout. The node is only trusted when
+it is still in the timer list, running and not re-armed since it fired, which
+are all changed under expire_timer_mut. */
+void docTimerExpired(void *arg)
 {
 	expire_timer_t *temp = NULL;
-	temp = get_global_timer_node();
+	char *expired_doc = NULL;
+	uint16_t tx_id = 0;
 
-	//Traverse through all docs in list, decrement timer and check if any doc expired.
-	while (NULL != temp)
+	pthread_mutex_lock (&expire_timer_mut);
+	temp = g_timer_head;
+	while (NULL != temp && temp != (expire_timer_t *)arg)
 	{
-		WebcfgDebug("checking expiry for temp->subdoc_name %s\n",temp->subdoc_name);
-		if (temp->running)
-		{
-			WebcfgDebug("timer running for doc %s temp->timeout: %d\n",temp->subdoc_name, (int)temp->timeout);
-			if((int)temp->timeout <= 0)
-			{
-				WebcfgInfo("Timer Expired for doc %s, doc apply failed\n", temp->subdoc_name);
-				*exp_doc = strdup(temp->subdoc_name);
-				WebcfgDebug("*exp_doc is %s\n", *exp_doc);
-				return true;
-			}
-			pthread_mutex_lock (&expire_timer_mut);
-			temp->timeout = temp->timeout - 5;
-			pthread_mutex_unlock (&expire_timer_mut);
-			WebcfgDebug("temp->timeout %d for doc %s\n", temp->timeout, temp->subdoc_name);
-		}
-		temp= temp->next;
+		temp = temp->next;
+	}
+	if (NULL != temp && temp->running && !webcfgTimerIsArmed(&temp->timer))
+	{
+		WebcfgInfo("Timer Expired for doc %s, doc apply failed\n", temp->subdoc_name);
+		expired_doc = strdup(temp->subdoc_name);
+		//reset timer. Generate internal EXPIRE event with new trans_id and retry.
+		tx_id = generateRandomId(1001,3000);
+		temp->running = false;
+		temp->txid = tx_id;
+		temp->timeout = 0;
+	}
+	pthread_mutex_unlock (&expire_timer_mut);
+
+	if(expired_doc != NULL)
+	{
+		WebcfgError("Timer expired_doc %s. No event received within timeout period\n", expired_doc);
+		WebcfgDebug("EXPIRE event tx_id generated is %lu\n", (long)tx_id);
+		createTimerExpiryEvent(expired_doc, tx_id);
+		WebcfgDebug("After createTimerExpiryEvent\n");
+		WEBCFG_FREE(expired_doc);
 	}
-	return false;
 }
 
 WEBCFG_STATUS retryMultipartSubdoc(webconfig_tmp_data_t *docNode, char *docName)
 {
-	int i =0;
 	WEBCFG_STATUS rv = WEBCFG_FAILURE;
-	param_t *reqParam = NULL;
+	webcfg_request_t *req = NULL;
+	REQUEST_BUILD_STATUS buildStatus = REQUEST_BUILD_SUCCESS;
 	WDMP_STATUS ret = WDMP_FAILURE;
 	WDMP_STATUS errd = WDMP_FAILURE;
 	char errDetails[MAX_VALUE_LEN]={0};
 	char result[MAX_VALUE_LEN]={0};
 	int ccspStatus=0;
-	int paramCount = 0;
 	uint16_t doc_transId = 0;
-	webcfgparam_t *pm = NULL;
 	multipartdocs_t *gmp = NULL;
 	uint16_t err = 0;
 	char * errmsg = NULL;
+	webconfig_tmp_snapshot_t snap;
 
-	gmp = get_global_mp();
+	//pinned, a commit on another event worker may delete the mp cache
+	gmp = acquire_global_mp();
 
 	if(gmp ==NULL)
 	{
 		WebcfgError("Multipart mp cache is NULL\n");
+		release_global_mp();
 		return rv;
 	}
 
 	if(checkAndUpdateTmpRetryCount(docNode, docName) !=WEBCFG_SUCCESS)
 	{
 		WebcfgError("checkAndUpdateTmpRetryCount failed\n");
+		release_global_mp();
+		return rv;
+	}
+
+	//docNode is only used to identify the doc, its fields are read from the copy
+	if(getTmpSnapshot(docName, &snap) != WEBCFG_SUCCESS)
+	{
+		WebcfgError("doc %s is not in tmp list\n", docName);
+		release_global_mp();
 		return rv;
 	}
 
@@ -950,136 +1371,83 @@ WEBCFG_STATUS retryMultipartSubdoc(webconfig_tmp_data_t *docNode, char *docName)
 			WebcfgDebug("gmp->data %s\n" , gmp->data);
 			WebcfgDebug("gmp->data_size is %zu\n", gmp->data_size);
 
-			WebcfgDebug("--------------decode root doc-------------\n");
-			pm = webcfgparam_convert( gmp->data, gmp->data_size+1 );
+			buildStatus = buildWebcfgRequest(gmp->name_space, gmp->etag, gmp->data, gmp->data_size, &req);
 			err = errno;
-			if ( NULL != pm)
+			if(buildStatus == REQUEST_BUILD_SUCCESS)
 			{
-				paramCount = (int)pm->entries_count;
-
-				reqParam = (param_t *) malloc(sizeof(param_t) * paramCount);
-				memset(reqParam,0,(sizeof(param_t) * paramCount));
-
-				WebcfgDebug("paramCount is %d\n", paramCount);
-				for (i = 0; i < paramCount; i++)
+				if(req->blob)
 				{
-			                if(pm->entries[i].value != NULL)
-			                {
-						if(pm->entries[i].type == WDMP_BLOB)
-						{
-							char *appended_doc = NULL;
-							WebcfgDebug("B4 webcfg_appendeddoc\n");
-							appended_doc = webcfg_appendeddoc( gmp->name_space, gmp->etag, pm->entries[i].value, pm->entries[i].value_size, &doc_transId);
-							WebcfgDebug("webcfg_appendeddoc doc_transId is %hu\n", doc_transId);
-							reqParam[i].name = strdup(pm->entries[i].name);
-							WebcfgDebug("appended_doc length: %zu\n", strlen(appended_doc));
-							reqParam[i].value = strdup(appended_doc);
-							reqParam[i].type = WDMP_BASE64;
-							WEBCFG_FREE(appended_doc);
-							//update doc_transId only for blob docs, not for scalars.
-							updateTmpList(docNode, gmp->name_space, gmp->etag, "pending", "failed_retrying", ccspStatus, doc_transId, 1);
-						}
-						else
-						{
-							if(pm->entries[i].name !=NULL)
-							{
-								reqParam[i].name = strdup(pm->entries[i].name);
-							}
-							if(pm->entries[i].value !=NULL)
-							{
-								reqParam[i].value = strdup(pm->entries[i].value);
-							}
-							reqParam[i].type = pm->entries[i].type;
-						}
-			                }
-					WebcfgInfo("Request:> param[%d].name = %s, type = %d\n",i,reqParam[i].name,reqParam[i].type);
-					WebcfgDebug("Request:> param[%d].value = %s\n",i,reqParam[i].value);
+					doc_transId = req->trans_id;
+					//update doc_transId only for blob docs, not for scalars.
+					updateTmpList(docNode, gmp->name_space, gmp->etag, DOC_STATE_PENDING, "failed_retrying", ccspStatus, doc_transId, 1);
 				}
-
-				if(reqParam !=NULL && validate_request_param(reqParam, paramCount) == WEBCFG_SUCCESS)
+				WebcfgDebug("Proceed to setValues..\n");
+				WebcfgDebug("retryMultipartSubdoc WebConfig SET Request\n");
+				if(req->params[0].type == WDMP_BASE64)
+				{
+					latencyRecordApply(gmp->name_space, doc_transId);
+				}
+				setValues(req->params, req->count, ATOMIC_SET_WEBCONFIG, NULL, NULL, &ret, &ccspStatus);
+				if(ret == WDMP_SUCCESS)
 				{
-					WebcfgDebug("Proceed to setValues..\n");
-					WebcfgDebug("retryMultipartSubdoc WebConfig SET Request\n");
-					setValues(reqParam, paramCount, ATOMIC_SET_WEBCONFIG, NULL, NULL, &ret, &ccspStatus);
-					if(ret == WDMP_SUCCESS)
+					WebcfgInfo("retryMultipartSubdoc setValues success. ccspStatus : %d\n", ccspStatus);
+					if(req->params[0].type  != WDMP_BASE64)
 					{
-						WebcfgInfo("retryMultipartSubdoc setValues success. ccspStatus : %d\n", ccspStatus);
-						if(reqParam[0].type  != WDMP_BASE64)
+						WebcfgDebug("For scalar docs, update trans_id as 0\n");
+						updateTmpList(docNode, gmp->name_space, gmp->etag, DOC_STATE_SUCCESS, "none", 0, 0, 0);
+						//send scalar success notification, delete tmp, updateDB
+						if(snap.cloud_trans_id !=NULL)
 						{
-							WebcfgDebug("For scalar docs, update trans_id as 0\n");
-							updateTmpList(docNode, gmp->name_space, gmp->etag, "success", "none", 0, 0, 0);
-							//send scalar success notification, delete tmp, updateDB
-							if(docNode !=NULL && docNode->cloud_trans_id !=NULL)
-							{
-								addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "success", "none", docNode->cloud_trans_id, 0, "status", 0, NULL, 200);
-							}
-							WebcfgDebug("deleteFromTmpList as scalar doc is applied\n");
-							deleteFromTmpList(gmp->name_space);
-							WebcfgDebug("docNode->isSupplementarySync is %d\n", docNode->isSupplementarySync);
-							if(docNode->isSupplementarySync == 0)
-							{
-								checkDBList(gmp->name_space,gmp->etag, NULL);
-								WebcfgInfo("checkRootUpdate scalar doc case\n");
-								if(checkRootUpdate() == WEBCFG_SUCCESS)
-								{
-									WebcfgDebug("updateRootVersionToDB\n");
-									updateRootVersionToDB();
-								}
-								addNewDocEntry(get_successDocCount());
-							}
-							else
-							{
-								WebcfgInfo("retryMultipartSubdoc. No DB update is required for supplementary sync\n");
-							}
-							WebcfgDebug("check for deleteRootAndMultipartDocs\n");
-							deleteRootAndMultipartDocs();
+							addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "success", "none", snap.cloud_trans_id, 0, "status", 0, NULL, 200);
 						}
-						rv = WEBCFG_SUCCESS;
+						WebcfgDebug("deleteFromTmpList as scalar doc is applied\n");
+						deleteFromTmpList(gmp->name_space);
+						WebcfgDebug("isSupplementarySync is %d\n", snap.isSupplementarySync);
+						commitDocAndCheckRoot(gmp->name_space, gmp->etag, snap.isSupplementarySync, snap.digest);
 					}
-					else
-					{
+					rv = WEBCFG_SUCCESS;
+				}
+				else
+				{
 
-						WebcfgError("retryMultipartSubdoc setValues Failed. ccspStatus : %d\n", ccspStatus);
-						errd = mapStatus(ccspStatus);
-						WebcfgDebug("The errd value is %d\n",errd);
+					WebcfgError("retryMultipartSubdoc setValues Failed. ccspStatus : %d\n", ccspStatus);
+					errd = mapStatus(ccspStatus);
+					WebcfgDebug("The errd value is %d\n",errd);
 
-						mapWdmpStatusToStatusMessage(errd, errDetails);
-						WebcfgDebug("The errDetails value is %s\n",errDetails);
+					mapWdmpStatusToStatusMessage(errd, errDetails);
+					WebcfgDebug("The errDetails value is %s\n",errDetails);
 
-						if((ccspStatus == 192) || (ccspStatus == 204) || (ccspStatus == 191) || (ccspStatus == 193) || (ccspStatus == 190))
+					if((ccspStatus == 192) || (ccspStatus == 204) || (ccspStatus == 191) || (ccspStatus == 193) || (ccspStatus == 190))
+					{
+						long long expiry_time = 0;
+						WebcfgDebug("ccspStatus is crash %d\n", ccspStatus);
+						snprintf(result,MAX_VALUE_LEN,"failed_retrying:%s", errDetails);
+						WebcfgDebug("The result is %s\n",result);
+						updateTmpList(docNode, gmp->name_space, gmp->etag, DOC_STATE_PENDING, result, ccspStatus, 0, 1);
+						if(snap.cloud_trans_id !=NULL)
 						{
-							long long expiry_time = 0;
-							WebcfgDebug("ccspStatus is crash %d\n", ccspStatus);
-							snprintf(result,MAX_VALUE_LEN,"failed_retrying:%s", errDetails);
-							WebcfgDebug("The result is %s\n",result);
-							updateTmpList(docNode, gmp->name_space, gmp->etag, "pending", result, ccspStatus, 0, 1);
-							if(docNode !=NULL && docNode->cloud_trans_id !=NULL)
-							{
-								addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "pending", result, docNode->cloud_trans_id, 0,"status",ccspStatus, NULL, 200);
-							}
-							expiry_time = getRetryExpiryTimeout();
-							set_doc_fail(1);
-							updateFailureTimeStamp(docNode, gmp->name_space, expiry_time);
-
-							//To get the exact time diff for retry from present time do the below
-							updateRetryTimeDiff(expiry_time);
-
-							WebcfgDebug("the retry flag value is %d\n", get_doc_fail());
+							addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "pending", result, snap.cloud_trans_id, 0,"status",ccspStatus, NULL, 200);
 						}
-						else
+						//the doc is retried again on its next backoff
+						expiry_time = scheduleDocRetry(gmp->name_space, gmp->etag);
+						updateFailureTimeStamp(docNode, gmp->name_space, expiry_time);
+					}
+					else
+					{
+						snprintf(result,MAX_VALUE_LEN,"doc_rejected:%s", errDetails);
+						WebcfgDebug("The result is %s\n",result);
+						updateTmpList(docNode, gmp->name_space, gmp->etag, DOC_STATE_FAILED, result, ccspStatus, 0, 0);
+						if(snap.cloud_trans_id !=NULL)
 						{
-							snprintf(result,MAX_VALUE_LEN,"doc_rejected:%s", errDetails);
-							WebcfgDebug("The result is %s\n",result);
-							updateTmpList(docNode, gmp->name_space, gmp->etag, "failed", result, ccspStatus, 0, 0);
-							if(docNode !=NULL && docNode->cloud_trans_id !=NULL)
-							{
-								addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", result, docNode->cloud_trans_id, 0, "status", ccspStatus, NULL, 200);
-							}
+							addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", result, snap.cloud_trans_id, 0, "status", ccspStatus, NULL, 200);
 						}
 					}
-					reqParam_destroy(paramCount, reqParam);
 				}
-				webcfgparam_destroy( pm );
+				releaseWebcfgRequest(req);
+			}
+			else if(buildStatus == REQUEST_INVALID_PARAM)
+			{
+				WebcfgError("Invalid params in retry of %s\n", gmp->name_space);
 			}
 			else
 			{
@@ -1088,10 +1456,10 @@ WEBCFG_STATUS retryMultipartSubdoc(webconfig_tmp_data_t *docNode, char *docName)
 				msg = (char *)webcfgparam_strerror(err);
 				err = getStatusErrorCodeAndMessage(DECODE_ROOT_FAILURE, &errmsg);
 				snprintf(result,MAX_VALUE_LEN,"%s:%s", errmsg, msg);
-				updateTmpList(docNode, gmp->name_space, gmp->etag, "failed", result, err, 0, 0);
-				if(docNode !=NULL && docNode->cloud_trans_id !=NULL)
+				updateTmpList(docNode, gmp->name_space, gmp->etag, DOC_STATE_FAILED, result, err, 0, 0);
+				if(snap.cloud_trans_id !=NULL)
 				{
-					addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", result, docNode->cloud_trans_id,0, "status", err, NULL, 200);
+					addWebConfgNotifyMsg(gmp->name_space, gmp->etag, "failed", result, snap.cloud_trans_id,0, "status", err, NULL, 200);
 				}
 				WEBCFG_FREE(errmsg);
 			}
@@ -1103,6 +1471,8 @@ WEBCFG_STATUS retryMultipartSubdoc(webconfig_tmp_data_t *docNode, char *docName)
 			gmp = gmp->next;
 		}
 	}
+	freeTmpSnapshot(&snap);
+	release_global_mp();
 	return rv;
 }
 
@@ -1130,25 +1500,31 @@ WEBCFG_STATUS checkDBVersion(char *docname, uint32_t version)
 
 WEBCFG_STATUS checkAndUpdateTmpRetryCount(webconfig_tmp_data_t *temp, char *docname)
 {
-	if (NULL != temp)
+	webconfig_tmp_snapshot_t snap;
+	int retry_count = 0;
+
+	//temp is not dereferenced, a concurrent sync may have freed it
+	if ((NULL != temp) && (getTmpSnapshot(docname, &snap) == WEBCFG_SUCCESS))
 	{
-		WebcfgDebug("checkAndUpdateTmpRetryCount: temp->name %s, temp->version %lu, temp->retry_count %d\n",temp->name, (long)temp->version, temp->retry_count);
-		if( strcmp(docname, temp->name) == 0)
+		WebcfgDebug("checkAndUpdateTmpRetryCount: docname %s, version %lu, retry_count %d\n", docname, (long)snap.version, snap.retry_count);
+		if(snap.retry_count >= MAX_APPLY_RETRY_COUNT)
 		{
-			if(temp->retry_count >= MAX_APPLY_RETRY_COUNT)
+			WebcfgInfo("Apply retry_count %d has reached max limit for doc %s\n", snap.retry_count, docname);
+			//send max retry notification to cloud only one time on the max retry attempt.
+			if((snap.retry_count == MAX_APPLY_RETRY_COUNT) && (snap.error_details == NULL || strcmp(snap.error_details, "max_retry_reached") !=0))
 			{
-				WebcfgInfo("Apply retry_count %d has reached max limit for doc %s\n", temp->retry_count, docname);
-				//send max retry notification to cloud only one time on the max retry attempt.
-				if((temp->retry_count == MAX_APPLY_RETRY_COUNT) && (strcmp(temp->error_details, "max_retry_reached") !=0))
-				{
-					addWebConfgNotifyMsg(temp->name, temp->version, "failed", "max_retry_reached", temp->cloud_trans_id, 0,"status",0, NULL, 200);
-					WebcfgDebug("update max_retry_reached to tmp list: ccsp error code %hu\n", temp->error_code);
-					updateTmpList(temp, temp->name, temp->version, "failed", "max_retry_reached", temp->error_code, 0, 1);
-				}
-				return WEBCFG_FAILURE;
+				addWebConfgNotifyMsg(docname, snap.version, "failed", "max_retry_reached", snap.cloud_trans_id, 0,"status",0, NULL, 200);
+				WebcfgDebug("update max_retry_reached to tmp list: ccsp error code %hu\n", snap.error_code);
+				updateTmpList(temp, docname, snap.version, DOC_STATE_FAILED, "max_retry_reached", snap.error_code, 0, 1);
 			}
-			temp->retry_count++;
-			WebcfgDebug("temp->retry_count updated to %d for docname %s\n",temp->retry_count, docname);
+			freeTmpSnapshot(&snap);
+			return WEBCFG_FAILURE;
+		}
+		freeTmpSnapshot(&snap);
+		retry_count = incrementTmpRetryCount(docname);
+		if(retry_count > 0)
+		{
+			WebcfgDebug("temp->retry_count updated to %d for docname %s\n", retry_count, docname);
 			return WEBCFG_SUCCESS;
 		}
 	}
@@ -1157,38 +1533,38 @@ WEBCFG_STATUS checkAndUpdateTmpRetryCount(webconfig_tmp_data_t *temp, char *docn
 	return WEBCFG_FAILURE;
 }
 
-uint32_t getDocVersionFromTmpList(webconfig_tmp_data_t *temp, char *docname)
+uint32_t getDocVersionFromTmpList(char *docname)
 {
-	if (NULL != temp)
+	webconfig_tmp_snapshot_t snap;
+	uint32_t version = 0;
+
+	if(getTmpSnapshot(docname, &snap) == WEBCFG_SUCCESS)
 	{
-		WebcfgDebug("getDocVersionFromTmpList: temp->name %s, temp->version %lu\n",temp->name, (long)temp->version);
-		if( strcmp(docname, temp->name) == 0)
-		{
-			WebcfgDebug("return temp->version %lu for docname %s\n", (long)temp->version, docname);
-			return temp->version;
-		}
+		version = snap.version;
+		WebcfgDebug("return temp->version %lu for docname %s\n", (long)version, docname);
+		freeTmpSnapshot(&snap);
+		return version;
 	}
 	WebcfgDebug("getDocVersionFromTmpList failed for doc %s\n", docname);
 	return 0;
 }
 
-//validate each event based on exact doc txid in tmp list.
-WEBCFG_STATUS validateEvent(webconfig_tmp_data_t *temp, char *docname, uint16_t txid)
+//validate each event based on exact doc txid in tmp list, temp is the doc copy or NULL.
+WEBCFG_STATUS validateEvent(webconfig_tmp_snapshot_t *temp, char *docname, uint16_t txid)
 {
 	if ((NULL != temp) && (docname != NULL))
 	{
-		WebcfgDebug("validateEvent: temp->name %s, temp->trans_id %hu\n",temp->name, temp->trans_id);
-		if( strcmp(docname, temp->name) == 0)
+		WebcfgDebug("validateEvent: docname %s, temp->trans_id %hu\n", docname, temp->trans_id);
+		//txid is bound to exactly one pending doc, stale or foreign txids miss here
+		//txid 0 is never allocated, it is only valid for docs without blob txid
+		if((txid != 0 && isCurrentTransId(txid, docname)) || (txid == 0 && temp->trans_id == 0))
 		{
-			if(txid == temp->trans_id)
-			{
-				WebcfgInfo("Valid event. Event txid %hu matches with temp trans_id %hu doc %s\n", txid, temp->trans_id, temp->name);
-				return WEBCFG_SUCCESS;
-			}
-			else
-			{
-				WebcfgError("Not a valid event. Event txid %hu does not match with temp trans_id %hu doc %s\n", txid, temp->trans_id, temp->name);
-			}
+			WebcfgInfo("Valid event. Event txid %hu matches with temp trans_id %hu doc %s\n", txid, temp->trans_id, docname);
+			return WEBCFG_SUCCESS;
+		}
+		else
+		{
+			WebcfgError("Not a valid event. Event txid %hu does not match with temp trans_id %hu doc %s\n", txid, temp->trans_id, docname);
 		}
 	}
 	WebcfgError("validateEvent failed for doc %s\n", docname);
@@ -1199,7 +1575,10 @@ WEBCFG_STATUS validateEvent(webconfig_tmp_data_t *temp, char *docname, uint16_t
 expire_timer_t * getTimerNode(char *docname)
 {
 	expire_timer_t *temp = NULL;
-	temp = get_global_timer_node();
+
+	//other event workers add and delete nodes concurrently
+	pthread_mutex_lock (&expire_timer_mut);
+	temp = g_timer_head;
 
 	//Traverse through timer list & fetch required doc timer node.
 	while (NULL != temp)
@@ -1207,10 +1586,12 @@ expire_timer_t * getTimerNode(char *docname)
 		WebcfgDebug("getTimerNode: subdoc_name %s txid %hu timeout %lu running %d\n",temp->subdoc_name, temp->txid, (long)temp->timeout, temp->running);
 		if( strcmp(docname, temp->subdoc_name) == 0)
 		{
+			pthread_mutex_unlock (&expire_timer_mut);
 			return temp;
 		}
 		temp= temp->next;
 	}
+	pthread_mutex_unlock (&expire_timer_mut);
 	WebcfgDebug("getTimerNode failed for doc %s\n", docname);
 	return NULL;
 }
@@ -1285,3 +1666,19 @@ void handleConnectedClientNotify(char *status)
 	}
 	return;
 }
+
+//Caches the payload of a blob doc acknowledged by its component for local rollback.
+static void saveAppliedPayload(char *docname, uint32_t version)
+{
+	multipartdocs_t *mp = NULL;
+
+	for(mp = acquire_global_mp(); mp != NULL; mp = mp->next)
+	{
+		if(strcmp(mp->name_space, docname) == 0 && mp->etag == version)
+		{
+			saveLastGoodPayload(mp->name_space, mp->etag, mp->data, mp->data_size);
+			break;
+		}
+	}
+	release_global_mp();
+}
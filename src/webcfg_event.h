@@ -19,25 +19,55 @@
 #include <stdint.h>
 #include "webcfg.h"
 #include "webcfg_db.h"
+#include "webcfg_timer.h"
 
 #define MAX_APPLY_RETRY_COUNT 3
 
-typedef struct _event_data
+//Bounded event queue, size has to be a power of 2
+#define WEBCFG_EVENT_QUEUE_SIZE		64
+#define WEBCFG_EVENT_SLOT_SIZE		512
+//Event workers, a doc is always handled by the same worker to keep its order
+#define WEBCFG_EVENT_WORKERS		4
+
+typedef struct event_queue_stats
+{
+	uint64_t enqueued;
+	uint64_t dropped_full;		//queue was full, event dropped
+	uint64_t dropped_oversize;	//event longer than a slot, event dropped
+	uint32_t high_watermark;	//max events pending at once
+	uint64_t coalesced_duplicates;	//exact duplicate events suppressed
+	uint64_t coalesced_superseded;	//events replaced by a later effective event
+} event_queue_stats_t;
+
+//Inline field sizes of a parsed event, longer name/status/process fields fail the parse
+#define EVENT_SUBDOC_NAME_SIZE		64
+#define EVENT_STATUS_SIZE		32
+#define EVENT_PROCESS_NAME_SIZE		64
+#define EVENT_FAILURE_REASON_SIZE	256
+
+typedef enum
 {
-	char * data;
-	struct _event_data *next;
-} event_data_t;
+    EVENT_STATUS_NONE = 0,	//no or unknown status, component crash
+    EVENT_STATUS_ACK,
+    EVENT_STATUS_ACK_ENABLED,
+    EVENT_STATUS_ACK_DISABLED,
+    EVENT_STATUS_NACK,
+    EVENT_STATUS_EXPIRE,
+    EVENT_STATUS_COMP_INIT
+} WEBCFG_EVENT_STATUS;
 
+//Fixed size event record filled by parseEventData without allocation
 typedef struct _event_params
 {
-	char *subdoc_name;
+	char subdoc_name[EVENT_SUBDOC_NAME_SIZE];
 	uint16_t trans_id;
 	uint32_t version;
-	char* status;
+	WEBCFG_EVENT_STATUS status_type;
+	char status[EVENT_STATUS_SIZE];
 	uint32_t timeout;
-	char *process_name;
+	char process_name[EVENT_PROCESS_NAME_SIZE];
 	uint16_t err_code;
-	char *failure_reason;
+	char failure_reason[EVENT_FAILURE_REASON_SIZE];
 } event_params_t;
 
 
@@ -47,6 +77,7 @@ typedef struct expire_timer_list
 	uint32_t timeout;
 	char *subdoc_name;
 	uint16_t txid;
+	webcfg_timer_t timer;
 	struct expire_timer_list *next;
 } expire_timer_t;
 
@@ -56,13 +87,21 @@ void processWebcfgEvents();
 void webcfgCallback(char *Info, void* user_data);
 WEBCFG_STATUS retryMultipartSubdoc(webconfig_tmp_data_t *docNode, char *docName);
 WEBCFG_STATUS checkAndUpdateTmpRetryCount(webconfig_tmp_data_t *temp, char *docname);
-uint32_t getDocVersionFromTmpList(webconfig_tmp_data_t *temp, char *docname);
-void free_event_params_struct(event_params_t *param);
-pthread_cond_t *get_global_event_con(void);
+uint32_t getDocVersionFromTmpList(char *docname);
+int parseEventData(const char* str, event_params_t *param);
+void coalesceEvents(event_params_t *batch, int *keep, int count);
 pthread_mutex_t *get_global_event_mut(void);
 pthread_t get_global_event_threadid();
 pthread_t get_global_process_threadid();
-pthread_cond_t *get_global_event_con(void);
-pthread_mutex_t *get_global_event_mut(void);
+pthread_cond_t *get_global_event_handler_con(void);
+void wakeEventConsumer();
+int addToEventQueue(const char *buf);
+//Single consumer only, a NULL buf just reports whether an event is pending.
+int eventQueuePop(char *buf, size_t len);
+void getEventQueueStats(event_queue_stats_t *stats);
+int getEventShard(const char *subdoc_name);
+//Doc apply timer, an EXPIRE event is queued when no final event arrives within timeout seconds.
+WEBCFG_STATUS startWebcfgTimer(expire_timer_t *timer_node, char *name, uint16_t transID, uint32_t timeout);
+WEBCFG_STATUS deleteFromTimerList(char* doc_name);
 
 #endif
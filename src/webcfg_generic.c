@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <wdmp-c.h>
 #include "webcfg_generic.h"
+#include "webcfg_scheduler.h"
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
@@ -120,12 +121,15 @@ char *get_global_systemReadyTime(void)
     return NULL;
 }
 
+//Pokes go straight to the sync queue, so pokes during a sync are merged instead of overwritten.
 int setForceSync(char* pString, char *transactionId,int *session_status)
 {
-    UNUSED(pString);
-    UNUSED(transactionId);
     UNUSED(session_status);
-    return 0;
+    if(pString == NULL || strlen(pString) == 0)
+    {
+        return 0;
+    }
+    return (requestForceSync(pString, transactionId) == WEBCFG_SUCCESS) ? 0 : 1;
 }
 
 int getForceSync(char** pString, char **transactionId)
@@ -50,7 +50,9 @@ char * getFirmwareUpgradeEndTime();
 /* Getter function to return systemReadyTime in UTC format */
 char *get_global_systemReadyTime();
 
-/* Function that gets the values from TR181 dml layer */
+/* Function that gets the values from TR181 dml layer. A platform poke handler
+should call requestForceSync, the single slot of setForceSync/getForceSync
+keeps only the last poke until the sync thread collects it. */
 int setForceSync(char* pString, char *transactionId,int *session_status);
 int getForceSync(char** pString, char **transactionId);
 int Get_Webconfig_URL( char *pString);
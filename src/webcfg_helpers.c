@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 #include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 #include <msgpack.h>
 
@@ -23,7 +25,7 @@
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
-/* none */
+#define STRBUF_DEFAULT_SIZE 128
 
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
@@ -104,6 +106,173 @@ void* helper_convert( const void *buf, size_t len,
     return p;
 }
 
+/* Makes room for len more bytes plus the NUL, at least doubling. */
+static int strbuf_reserve( strbuf_t *sb, size_t len )
+{
+    size_t need, size;
+    char *tmp;
+
+    if( NULL == sb->str ) {
+        return HELPERS_OUT_OF_MEMORY;
+    }
+    need = sb->len + len + 1;
+    if( need <= sb->size ) {
+        return HELPERS_OK;
+    }
+    size = sb->size * 2;
+    if( size < need ) {
+        size = need;
+    }
+    tmp = (char *) realloc( sb->str, size );
+    if( NULL == tmp ) {
+        WebcfgError("strbuf failed to grow to %zu bytes\n", size);
+        return HELPERS_OUT_OF_MEMORY;
+    }
+    sb->str = tmp;
+    sb->size = size;
+    return HELPERS_OK;
+}
+
+int strbuf_init( strbuf_t *sb, size_t initial )
+{
+    if( 0 == initial ) {
+        initial = STRBUF_DEFAULT_SIZE;
+    }
+    sb->str = (char *) malloc( initial );
+    if( NULL == sb->str ) {
+        sb->len = 0;
+        sb->size = 0;
+        WebcfgError("strbuf_init failed to allocate %zu bytes\n", initial);
+        return HELPERS_OUT_OF_MEMORY;
+    }
+    sb->str[0] = '\0';
+    sb->len = 0;
+    sb->size = initial;
+    return HELPERS_OK;
+}
+
+int strbuf_appendf( strbuf_t *sb, const char *fmt, ... )
+{
+    va_list args;
+    int n;
+
+    if( NULL == sb->str ) {
+        return HELPERS_OUT_OF_MEMORY;
+    }
+
+    va_start( args, fmt );
+    n = vsnprintf( sb->str + sb->len, sb->size - sb->len, fmt, args );
+    va_end( args );
+    if( n < 0 ) {
+        sb->str[sb->len] = '\0';
+        return HELPERS_OUT_OF_MEMORY;
+    }
+
+    if( (size_t) n >= sb->size - sb->len ) {
+        /* Did not fit, grow once to the exact need (at least double) and
+         * format again. */
+        if( HELPERS_OK != strbuf_reserve(sb, (size_t) n) ) {
+            sb->str[sb->len] = '\0';
+            return HELPERS_OUT_OF_MEMORY;
+        }
+
+        va_start( args, fmt );
+        vsnprintf( sb->str + sb->len, sb->size - sb->len, fmt, args );
+        va_end( args );
+    }
+    sb->len += (size_t) n;
+    return HELPERS_OK;
+}
+
+int strbuf_append( strbuf_t *sb, const char *data, size_t len )
+{
+    if( HELPERS_OK != strbuf_reserve(sb, len) ) {
+        return HELPERS_OUT_OF_MEMORY;
+    }
+    memcpy( sb->str + sb->len, data, len );
+    sb->len += len;
+    sb->str[sb->len] = '\0';
+    return HELPERS_OK;
+}
+
+int strbuf_append_json_string( strbuf_t *sb, const char *str )
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char *) str;
+    const unsigned char *run;
+    char esc[6];
+
+    if( NULL == str ) {
+        return strbuf_append( sb, "null", 4 );
+    }
+    if( HELPERS_OK != strbuf_append(sb, "\"", 1) ) {
+        return HELPERS_OUT_OF_MEMORY;
+    }
+    while( '\0' != *p ) {
+        /* Copy the longest run that needs no escaping in one go. */
+        run = p;
+        while( '\0' != *p && '"' != *p && '\\' != *p && 0x20 <= *p ) {
+            p++;
+        }
+        if( p > run && HELPERS_OK != strbuf_append(sb, (const char *) run, (size_t) (p - run)) ) {
+            return HELPERS_OUT_OF_MEMORY;
+        }
+        if( '\0' == *p ) {
+            break;
+        }
+        esc[0] = '\\';
+        switch( *p ) {
+            case '"':  esc[1] = '"';  break;
+            case '\\': esc[1] = '\\'; break;
+            case '\b': esc[1] = 'b';  break;
+            case '\f': esc[1] = 'f';  break;
+            case '\n': esc[1] = 'n';  break;
+            case '\r': esc[1] = 'r';  break;
+            case '\t': esc[1] = 't';  break;
+            default:   esc[1] = 'u';  break;
+        }
+        if( 'u' == esc[1] ) {
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[*p >> 4];
+            esc[5] = hex[*p & 0xf];
+        }
+        if( HELPERS_OK != strbuf_append(sb, esc, ('u' == esc[1]) ? 6 : 2) ) {
+            return HELPERS_OUT_OF_MEMORY;
+        }
+        p++;
+    }
+    return strbuf_append( sb, "\"", 1 );
+}
+
+void strbuf_reset( strbuf_t *sb )
+{
+    if( NULL != sb->str ) {
+        sb->str[0] = '\0';
+    }
+    sb->len = 0;
+}
+
+char* strbuf_detach( strbuf_t *sb )
+{
+    char *str = sb->str;
+
+    sb->str = NULL;
+    sb->len = 0;
+    sb->size = 0;
+    return str;
+}
+
+void strbuf_free( strbuf_t *sb )
+{
+    if( NULL != sb->str ) {
+        free( sb->str );
+    }
+    sb->str = NULL;
+    sb->len = 0;
+    sb->size = 0;
+}
+
 
 /*----------------------------------------------------------------------------*/
 /*                             Internal functions                             */
@@ -40,6 +40,12 @@ enum {
 typedef int (*process_fn_t)(void *, msgpack_object *);
 typedef void (*destroy_fn_t)(void *);
 
+typedef struct {
+    char *str;
+    size_t len;
+    size_t size;
+} strbuf_t;
+
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -67,5 +73,75 @@ void* helper_convert( const void *buf, size_t len,
                       process_fn_t process,
                       destroy_fn_t destroy );
 
+/**
+ *  Initializes a growable string buffer, the buffer always holds a valid
+ *  NUL terminated string once initialized.
+ *
+ *  @param sb       the string buffer
+ *  @param initial  initial capacity in bytes, 0 picks a default
+ *
+ *  @returns HELPERS_OK on success, HELPERS_OUT_OF_MEMORY otherwise
+ */
+int strbuf_init( strbuf_t *sb, size_t initial );
+
+/**
+ *  Appends printf style formatted text to the string buffer, growing it as
+ *  required so that the output is never truncated.
+ *
+ *  @param sb   the string buffer
+ *  @param fmt  the printf style format
+ *
+ *  @returns HELPERS_OK on success, HELPERS_OUT_OF_MEMORY otherwise
+ */
+int strbuf_appendf( strbuf_t *sb, const char *fmt, ... )
+    __attribute__ ((format (printf, 2, 3)));
+
+/**
+ *  Appends len bytes of data to the string buffer, growing it as required.
+ *
+ *  @param sb    the string buffer
+ *  @param data  the bytes to append
+ *  @param len   the number of bytes
+ *
+ *  @returns HELPERS_OK on success, HELPERS_OUT_OF_MEMORY otherwise
+ */
+int strbuf_append( strbuf_t *sb, const char *data, size_t len );
+
+/**
+ *  Appends str as a quoted JSON string, escaping quotes, backslashes and
+ *  control characters. Other bytes are copied as is, so UTF-8 passes through.
+ *  A NULL str is written as null.
+ *
+ *  @param sb   the string buffer
+ *  @param str  the NUL terminated string
+ *
+ *  @returns HELPERS_OK on success, HELPERS_OUT_OF_MEMORY otherwise
+ */
+int strbuf_append_json_string( strbuf_t *sb, const char *str );
+
+/**
+ *  Empties the string buffer while keeping the allocated memory for reuse.
+ *
+ *  @param sb   the string buffer
+ */
+void strbuf_reset( strbuf_t *sb );
+
+/**
+ *  Hands the string over to the caller, who has to free it. The buffer is
+ *  left empty and has to be initialized again before reuse.
+ *
+ *  @param sb   the string buffer
+ *
+ *  @returns the string, NULL if the buffer was never initialized
+ */
+char* strbuf_detach( strbuf_t *sb );
+
+/**
+ *  Frees the memory held by the string buffer.
+ *
+ *  @param sb   the string buffer
+ */
+void strbuf_free( strbuf_t *sb );
+
 
 #endif
@@ -0,0 +1,361 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <cJSON.h>
+#include "webcfg.h"
+#include "webcfg_log.h"
+#include "webcfg_latency.h"
+#include "webcfg_timer.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define LATENCY_TMP_SUFFIX	".tmp"
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+//Stats of a subdoc and its outstanding apply, keyed by (doc, txid)
+typedef struct latency_doc
+{
+	char name[LATENCY_DOC_NAME_SIZE];
+	uint16_t txid;			//txid of the pending apply
+	int pending;			//apply sent, no ACK/NACK/EXPIRE yet
+	int timeout_seen;		//first TIMEOUT already recorded
+	uint64_t apply_ms;		//monotonic time of setValues
+	latency_stats_t stats;
+} latency_doc_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static latency_doc_t g_latency_docs[LATENCY_MAX_DOCS];
+static int g_latency_doc_count = 0;
+static uint32_t g_latency_overflow = 0;	//records dropped for docs beyond LATENCY_MAX_DOCS
+static webcfg_timer_t g_latency_dump_timer;
+static int g_latency_dump_armed = 0;
+pthread_mutex_t latency_mut=PTHREAD_MUTEX_INITIALIZER;
+//workers finishing docs together share the tmp file
+pthread_mutex_t latency_file_mut=PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static uint64_t latencyNowMs();
+static latency_doc_t* getLatencyDoc(const char *docname, int create);
+static cJSON* histToJson(const uint32_t *hist);
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+//Marks the start of a blob apply, called right before setValues/aker send.
+void latencyRecordApply(const char *docname, uint16_t txid)
+{
+	latency_doc_t *doc = NULL;
+
+	if(docname == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&latency_mut);
+	doc = getLatencyDoc(docname, 1);
+	if(doc != NULL)
+	{
+		//a new apply replaces any outstanding one of the same doc
+		doc->txid = txid;
+		doc->pending = 1;
+		doc->timeout_seen = 0;
+		doc->apply_ms = latencyNowMs();
+		doc->stats.applies++;
+	}
+	pthread_mutex_unlock(&latency_mut);
+}
+
+/* Records a component event against the pending apply of the same (doc, txid).
+EXPIRE comes from the doc timer with a txid of its own, it closes whatever
+apply of the doc is pending. */
+void latencyRecordEvent(const char *docname, uint16_t txid, WEBCFG_LATENCY_EVENT event)
+{
+	latency_doc_t *doc = NULL;
+	uint64_t elapsed = 0;
+	int bucket = 0;
+	int arm = 0;
+
+	if(docname == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&latency_mut);
+	doc = getLatencyDoc(docname, 1);
+	if(doc == NULL)
+	{
+		pthread_mutex_unlock(&latency_mut);
+		return;
+	}
+	if(!doc->pending || (doc->txid != txid && event != LATENCY_EVENT_EXPIRE))
+	{
+		doc->stats.unmatched++;
+		pthread_mutex_unlock(&latency_mut);
+		WebcfgDebug("latency: no pending apply for doc %s txid %hu\n", docname, txid);
+		return;
+	}
+	elapsed = latencyNowMs() - doc->apply_ms;
+	bucket = getLatencyBucket(elapsed);
+	switch(event)
+	{
+		case LATENCY_EVENT_TIMEOUT:
+			if(!doc->timeout_seen)
+			{
+				doc->timeout_seen = 1;
+				doc->stats.timeouts++;
+				doc->stats.timeout_hist[bucket]++;
+			}
+			break;
+		case LATENCY_EVENT_ACK:
+			doc->stats.acks++;
+			doc->stats.ack_hist[bucket]++;
+			if(elapsed > doc->stats.ack_max_ms)
+			{
+				doc->stats.ack_max_ms = (uint32_t)elapsed;
+			}
+			doc->pending = 0;
+			arm = !g_latency_dump_armed;
+			break;
+		case LATENCY_EVENT_NACK:
+			doc->stats.nacks++;
+			doc->stats.nack_hist[bucket]++;
+			doc->pending = 0;
+			arm = !g_latency_dump_armed;
+			break;
+		case LATENCY_EVENT_EXPIRE:
+			//the retry, if any, records a fresh apply
+			doc->stats.expires++;
+			doc->pending = 0;
+			arm = !g_latency_dump_armed;
+			break;
+	}
+	if(arm)
+	{
+		g_latency_dump_armed = 1;
+	}
+	pthread_mutex_unlock(&latency_mut);
+	WebcfgDebug("latency: doc %s txid %hu event %d after %lu ms\n", docname, txid, event, (long)elapsed);
+
+	//results of the interval are written once by the dump timer
+	if(arm)
+	{
+		webcfgTimerArm(&g_latency_dump_timer, LATENCY_DUMP_INTERVAL_MS, latencyDumpTimerExpired, NULL);
+	}
+}
+
+//Timer service callback, writes the stats recorded since the last dump.
+void latencyDumpTimerExpired(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&latency_mut);
+	g_latency_dump_armed = 0;
+	pthread_mutex_unlock(&latency_mut);
+	writeLatencyStatsFile(WEBCFG_LATENCY_FILE);
+}
+
+WEBCFG_STATUS getLatencyStats(const char *docname, latency_stats_t *stats)
+{
+	latency_doc_t *doc = NULL;
+	WEBCFG_STATUS rv = WEBCFG_FAILURE;
+
+	if(docname == NULL || stats == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	pthread_mutex_lock(&latency_mut);
+	doc = getLatencyDoc(docname, 0);
+	if(doc != NULL)
+	{
+		*stats = doc->stats;
+		rv = WEBCFG_SUCCESS;
+	}
+	pthread_mutex_unlock(&latency_mut);
+	return rv;
+}
+
+int getLatencyBucket(uint64_t latency_ms)
+{
+	int bucket = 0;
+
+	while(latency_ms > 0 && bucket < LATENCY_HIST_BUCKETS - 1)
+	{
+		latency_ms >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+//Returns the per doc stats as JSON, caller frees.
+char* getLatencyStatsDump()
+{
+	cJSON *root = NULL, *docs = NULL, *item = NULL;
+	latency_stats_t *st = NULL;
+	char *out = NULL;
+	int i = 0;
+
+	root = cJSON_CreateObject();
+	if(root == NULL)
+	{
+		return NULL;
+	}
+	cJSON_AddStringToObject(root, "hist_buckets", "0:<1ms,i:[2^(i-1),2^i)ms");
+	docs = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "docs", docs);
+
+	pthread_mutex_lock(&latency_mut);
+	cJSON_AddNumberToObject(root, "untracked_records", g_latency_overflow);
+	for(i = 0; i < g_latency_doc_count; i++)
+	{
+		st = &g_latency_docs[i].stats;
+		item = cJSON_CreateObject();
+		cJSON_AddNumberToObject(item, "applies", st->applies);
+		cJSON_AddNumberToObject(item, "timeouts", st->timeouts);
+		cJSON_AddNumberToObject(item, "acks", st->acks);
+		cJSON_AddNumberToObject(item, "nacks", st->nacks);
+		cJSON_AddNumberToObject(item, "expires", st->expires);
+		cJSON_AddNumberToObject(item, "unmatched", st->unmatched);
+		cJSON_AddNumberToObject(item, "ack_max_ms", st->ack_max_ms);
+		cJSON_AddItemToObject(item, "ack_hist", histToJson(st->ack_hist));
+		cJSON_AddItemToObject(item, "nack_hist", histToJson(st->nack_hist));
+		cJSON_AddItemToObject(item, "timeout_hist", histToJson(st->timeout_hist));
+		cJSON_AddItemToObject(docs, g_latency_docs[i].name, item);
+	}
+	pthread_mutex_unlock(&latency_mut);
+
+	out = cJSON_PrintUnformatted(root);
+	cJSON_Delete(root);
+	return out;
+}
+
+//Writes the dump to a tmp file first so readers never see a partial file.
+WEBCFG_STATUS writeLatencyStatsFile(const char *path)
+{
+	char tmp_path[256] = {0};
+	char *dump = NULL;
+	FILE *fp = NULL;
+	size_t len = 0;
+
+	if(path == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	dump = getLatencyStatsDump();
+	if(dump == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, LATENCY_TMP_SUFFIX);
+	pthread_mutex_lock(&latency_file_mut);
+	fp = fopen(tmp_path, "w");
+	if(fp == NULL)
+	{
+		WebcfgError("Failed to open %s: %s\n", tmp_path, strerror(errno));
+		pthread_mutex_unlock(&latency_file_mut);
+		WEBCFG_FREE(dump);
+		return WEBCFG_FAILURE;
+	}
+	len = strlen(dump);
+	if(fwrite(dump, 1, len, fp) != len)
+	{
+		WebcfgError("Failed to write latency stats to %s\n", tmp_path);
+		fclose(fp);
+		pthread_mutex_unlock(&latency_file_mut);
+		WEBCFG_FREE(dump);
+		return WEBCFG_FAILURE;
+	}
+	fclose(fp);
+	WEBCFG_FREE(dump);
+	if(rename(tmp_path, path) != 0)
+	{
+		WebcfgError("Failed to rename %s: %s\n", tmp_path, strerror(errno));
+		pthread_mutex_unlock(&latency_file_mut);
+		return WEBCFG_FAILURE;
+	}
+	pthread_mutex_unlock(&latency_file_mut);
+	return WEBCFG_SUCCESS;
+}
+
+void resetLatencyStats()
+{
+	webcfgTimerDisarm(&g_latency_dump_timer);
+	pthread_mutex_lock(&latency_mut);
+	g_latency_dump_armed = 0;
+	memset(g_latency_docs, 0, sizeof(g_latency_docs));
+	g_latency_doc_count = 0;
+	g_latency_overflow = 0;
+	pthread_mutex_unlock(&latency_mut);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+static uint64_t latencyNowMs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//Called with latency_mut held.
+static latency_doc_t* getLatencyDoc(const char *docname, int create)
+{
+	latency_doc_t *doc = NULL;
+	int i = 0;
+
+	for(i = 0; i < g_latency_doc_count; i++)
+	{
+		if(strcmp(g_latency_docs[i].name, docname) == 0)
+		{
+			return &g_latency_docs[i];
+		}
+	}
+	if(!create)
+	{
+		return NULL;
+	}
+	if(g_latency_doc_count == LATENCY_MAX_DOCS || strlen(docname) >= LATENCY_DOC_NAME_SIZE)
+	{
+		g_latency_overflow++;
+		return NULL;
+	}
+	doc = &g_latency_docs[g_latency_doc_count++];
+	memset(doc, 0, sizeof(latency_doc_t));
+	strncpy(doc->name, docname, LATENCY_DOC_NAME_SIZE - 1);
+	return doc;
+}
+
+static cJSON* histToJson(const uint32_t *hist)
+{
+	cJSON *arr = cJSON_CreateArray();
+	int i = 0;
+
+	for(i = 0; i < LATENCY_HIST_BUCKETS; i++)
+	{
+		cJSON_AddItemToArray(arr, cJSON_CreateNumber(hist[i]));
+	}
+	return arr;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBCFG_LATENCY_H__
+#define __WEBCFG_LATENCY_H__
+
+#include <stdint.h>
+#include "webcfg.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define WEBCFG_LATENCY_FILE		"/tmp/webcfg_latency.json"
+#define LATENCY_MAX_DOCS		64
+#define LATENCY_DOC_NAME_SIZE		64
+//bucket 0 is < 1ms, bucket i is [2^(i-1), 2^i) ms, the last one is open ended
+#define LATENCY_HIST_BUCKETS		20
+//ACK/NACK/EXPIRE results are written to WEBCFG_LATENCY_FILE at most once per interval
+#define LATENCY_DUMP_INTERVAL_MS	60000
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef enum
+{
+    LATENCY_EVENT_TIMEOUT = 0,	//component asked for more time
+    LATENCY_EVENT_ACK,
+    LATENCY_EVENT_NACK,
+    LATENCY_EVENT_EXPIRE
+} WEBCFG_LATENCY_EVENT;
+
+//Apply to event latency counters of one subdoc
+typedef struct latency_stats
+{
+	uint32_t applies;		//blob sets sent to the component
+	uint32_t timeouts;		//first TIMEOUT event of an apply
+	uint32_t acks;
+	uint32_t nacks;
+	uint32_t expires;
+	uint32_t unmatched;		//event without a pending apply of the same txid
+	uint32_t ack_max_ms;
+	uint32_t ack_hist[LATENCY_HIST_BUCKETS];	//setValues to ACK
+	uint32_t nack_hist[LATENCY_HIST_BUCKETS];	//setValues to NACK
+	uint32_t timeout_hist[LATENCY_HIST_BUCKETS];	//setValues to first TIMEOUT
+} latency_stats_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+void latencyRecordApply(const char *docname, uint16_t txid);
+void latencyRecordEvent(const char *docname, uint16_t txid, WEBCFG_LATENCY_EVENT event);
+WEBCFG_STATUS getLatencyStats(const char *docname, latency_stats_t *stats);
+int getLatencyBucket(uint64_t latency_ms);
+char* getLatencyStatsDump();
+WEBCFG_STATUS writeLatencyStatsFile(const char *path);
+void latencyDumpTimerExpired(void *arg);
+void resetLatencyStats();
+#endif
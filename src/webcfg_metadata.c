@@ -17,6 +17,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "webcfg_log.h"
 #include "webcfg_metadata.h"
 #include "webcfg_multipart.h"
@@ -25,6 +26,12 @@
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
 #define MAXCHAR 1024
+//bitmaps below hold one bit per doc
+#define DOC_TABLE_MAX		64
+#define DOC_TABLE_SLOTS		(DOC_TABLE_MAX * 2)
+#define SUPPORTED_VERSION_HEADER	"X-System-Schema-Version: "
+#define SUPPORTED_DOCS_HEADER		"X-System-Supported-Docs: "
+#define SUPPLEMENTARY_DOCS_HEADER	"X-System-SupplementaryService-Sync: "
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
@@ -45,6 +52,18 @@ SubDocSupportMap_t *g_sdInfoHead = NULL;
 SubDocSupportMap_t *g_sdInfoTail = NULL;
 SupplementaryDocs_t *g_spInfoHead = NULL;
 SupplementaryDocs_t *g_spInfoTail = NULL;
+//exact lookup of doc names compiled from the lists, rebuilt under the write lock
+static pthread_rwlock_t doc_table_lock = PTHREAD_RWLOCK_INITIALIZER;
+static char *g_doc_names[DOC_TABLE_MAX];
+static int g_doc_count = 0;
+static int16_t g_doc_slots[DOC_TABLE_SLOTS];	//doc index + 1, 0 for an empty slot
+static uint64_t g_mapped_docs = 0;		//listed in WEBCONFIG_SUBDOC_MAP
+static uint64_t g_supported_docs = 0;
+static uint64_t g_supplementary_docs = 0;
+//curl headers prebuilt from the properties
+static char *supportedVersion_header = NULL;
+static char *supportedDocs_header = NULL;
+static char *supplementaryDocs_header = NULL;
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
@@ -52,6 +71,11 @@ void displaystruct();
 SubDocSupportMap_t * get_global_sdInfoHead(void);
 SubDocSupportMap_t * get_global_sdInfoTail(void);
 SupplementaryDocs_t * get_global_spInfoTail(void);
+static void compileDocTables();
+static int addDocName(const char *name);
+static int findDocName(const char *name);
+static uint32_t hashDocName(const char *name);
+static void buildHeader(char **header, const char *prefix, const char *value);
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -170,6 +194,7 @@ void initWebcfgProperties(char * filename)
 	{
 		displaystruct();
 	}
+	compileDocTables();
 }
 
 void setsupplementaryDocs( char * value)
@@ -182,6 +207,7 @@ void setsupplementaryDocs( char * value)
 	{
 		supplementary_docs = NULL;
 	}
+	buildHeader(&supplementaryDocs_header, SUPPLEMENTARY_DOCS_HEADER, supplementary_docs);
 }
 
 void setsupportedDocs( char * value)
@@ -194,6 +220,7 @@ void setsupportedDocs( char * value)
 	{
 		supported_bits = NULL;
 	}
+	buildHeader(&supportedDocs_header, SUPPORTED_DOCS_HEADER, supported_bits);
 }
 
 void setsupportedVersion( char * value)
@@ -206,6 +233,7 @@ void setsupportedVersion( char * value)
 	{
 		supported_version = NULL;
 	}
+	buildHeader(&supportedVersion_header, SUPPORTED_VERSION_HEADER, supported_version);
 }
 
 char * getsupportedDocs()
@@ -226,63 +254,79 @@ char * getsupplementaryDocs()
       return supplementary_docs;
 }
 
+const char * getSupportedVersionHeader()
+{
+	return supportedVersion_header;
+}
+
+const char * getSupportedDocsHeader()
+{
+	return supportedDocs_header;
+}
+
+const char * getSupplementaryDocsHeader()
+{
+	return supplementaryDocs_header;
+}
+
 WEBCFG_STATUS isSubDocSupported(char *subDoc)
 {
+	int index = 0;
+	int mapped = 0;
+	int supported = 0;
 
-	SubDocSupportMap_t *sd = NULL;
-	
-	sd = get_global_sdInfoHead();
+	pthread_rwlock_rdlock(&doc_table_lock);
+	index = findDocName(subDoc);
+	if(index >= 0)
+	{
+		mapped = ((g_mapped_docs & (1ULL << index)) != 0);
+		supported = ((g_supported_docs & (1ULL << index)) != 0);
+	}
+	pthread_rwlock_unlock(&doc_table_lock);
 
-	while(sd != NULL)
+	if(mapped)
 	{
-		if(strncmp(sd->name, subDoc, strlen(subDoc)) == 0)
+		if(supported)
 		{
-			WebcfgDebug("The subdoc %s is present\n",sd->name);
-			if(strncmp(sd->support, "true", strlen("true")) == 0)
-			{
-				WebcfgInfo("%s is supported\n",subDoc);
-				return WEBCFG_SUCCESS;
-				
-			}
-			else
-			{
-				WebcfgInfo("%s is not supported\n",subDoc);
-				return WEBCFG_FAILURE;
-			}
+			WebcfgInfo("%s is supported\n",subDoc);
+			return WEBCFG_SUCCESS;
 		}
-		sd = sd->next;
-		
+		WebcfgInfo("%s is not supported\n",subDoc);
+		return WEBCFG_FAILURE;
 	}
 	WebcfgError("Supported doc bit not found for %s\n",subDoc);
 	return WEBCFG_FAILURE;
 }
 
+//Supported list is empty when the properties file has no WEBCONFIG_SUBDOC_MAP.
+int isSupportedDocsLoaded()
+{
+	int loaded = 0;
+
+	pthread_rwlock_rdlock(&doc_table_lock);
+	loaded = (g_mapped_docs != 0);
+	pthread_rwlock_unlock(&doc_table_lock);
+	return loaded;
+}
+
 //To check if the doc received during poke is supplementary or not.
 WEBCFG_STATUS isSupplementaryDoc(char *subDoc)
 {
-	SupplementaryDocs_t *sp = NULL;
-	sp = get_global_spInfoHead();
+	int index = 0;
+	int supplementary = 0;
 
-	while(sp != NULL)
+	pthread_rwlock_rdlock(&doc_table_lock);
+	index = findDocName(subDoc);
+	if(index >= 0)
 	{
-		WebcfgDebug("Supplementary check for docname %s, subDoc received is %s\n", sp->name, subDoc);
-		if(strncmp(sp->name, subDoc, strlen(subDoc)) == 0)
-		{
-			WebcfgDebug("The subdoc %s is present\n",sp->name);
-			if(strncmp(sp->name, subDoc, strlen(subDoc)) == 0)
-			{
-				WebcfgDebug("subDoc %s is supplementary\n",subDoc);
-				return WEBCFG_SUCCESS;
-
-			}
-			else
-			{
-				WebcfgDebug("subDoc %s is not supplementary\n",subDoc);
-				return WEBCFG_FAILURE;
-			}
-		}
-		sp = sp->next;
+		supplementary = ((g_supplementary_docs & (1ULL << index)) != 0);
+	}
+	pthread_rwlock_unlock(&doc_table_lock);
 
+	if(supplementary)
+	{
+		WebcfgDebug("subDoc %s is supplementary\n",subDoc);
+		return WEBCFG_SUCCESS;
 	}
 	return WEBCFG_FAILURE;
 }
@@ -366,6 +410,7 @@ void supplementaryDocs()
 		}
 		WEBCFG_FREE(docs_var);
 	}
+	compileDocTables();
 }
 
 void displaystruct()
@@ -395,4 +440,140 @@ void delete_supplementary_list()
 	}
 	g_spInfoHead = NULL;
 	g_spInfoTail = NULL;
+	compileDocTables();
+}
+
+/* Rebuilds the doc lookup from the subdoc map and supplementary lists, the first
+entry of a doc wins. Lookups on other threads wait for the rebuild, a shutdown may
+rebuild the tables while they run. */
+static void compileDocTables()
+{
+	SubDocSupportMap_t *sd = NULL;
+	SupplementaryDocs_t *sp = NULL;
+	int index = 0;
+	int i = 0;
+
+	pthread_rwlock_wrlock(&doc_table_lock);
+	for(i = 0; i < g_doc_count; i++)
+	{
+		WEBCFG_FREE(g_doc_names[i]);
+	}
+	g_doc_count = 0;
+	memset(g_doc_slots, 0, sizeof(g_doc_slots));
+	g_mapped_docs = 0;
+	g_supported_docs = 0;
+	g_supplementary_docs = 0;
+
+	for(sd = get_global_sdInfoHead(); sd != NULL; sd = sd->next)
+	{
+		index = addDocName(sd->name);
+		if(index < 0 || (g_mapped_docs & (1ULL << index)))
+		{
+			continue;
+		}
+		g_mapped_docs |= (1ULL << index);
+		if(strncmp(sd->support, "true", strlen("true")) == 0)
+		{
+			g_supported_docs |= (1ULL << index);
+		}
+	}
+	for(sp = get_global_spInfoHead(); sp != NULL; sp = sp->next)
+	{
+		index = addDocName(sp->name);
+		if(index >= 0)
+		{
+			g_supplementary_docs |= (1ULL << index);
+		}
+	}
+	WebcfgDebug("doc table compiled with %d docs\n", g_doc_count);
+	pthread_rwlock_unlock(&doc_table_lock);
+}
+
+//Returns the index of name, adding it when new, or -1 when the table is full. Called with the write lock held.
+static int addDocName(const char *name)
+{
+	uint32_t slot = 0;
+	int index = 0;
+
+	if(name == NULL)
+	{
+		return -1;
+	}
+	index = findDocName(name);
+	if(index >= 0)
+	{
+		return index;
+	}
+	if(g_doc_count == DOC_TABLE_MAX)
+	{
+		WebcfgError("Doc table full, %s is not added\n", name);
+		return -1;
+	}
+	g_doc_names[g_doc_count] = strdup(name);
+	if(g_doc_names[g_doc_count] == NULL)
+	{
+		return -1;
+	}
+	slot = hashDocName(name) & (DOC_TABLE_SLOTS - 1);
+	while(g_doc_slots[slot] != 0)
+	{
+		slot = (slot + 1) & (DOC_TABLE_SLOTS - 1);
+	}
+	g_doc_slots[slot] = g_doc_count + 1;
+	return g_doc_count++;
+}
+
+//Exact match, the table is never more than half full so probing ends at an empty slot. Called with doc_table_lock held.
+static int findDocName(const char *name)
+{
+	uint32_t slot = 0;
+	int16_t entry = 0;
+
+	if(name == NULL)
+	{
+		return -1;
+	}
+	slot = hashDocName(name) & (DOC_TABLE_SLOTS - 1);
+	while((entry = g_doc_slots[slot]) != 0)
+	{
+		if(strcmp(g_doc_names[entry - 1], name) == 0)
+		{
+			return entry - 1;
+		}
+		slot = (slot + 1) & (DOC_TABLE_SLOTS - 1);
+	}
+	return -1;
+}
+
+//FNV-1a
+static uint32_t hashDocName(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while(*name != '\0')
+	{
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void buildHeader(char **header, const char *prefix, const char *value)
+{
+	size_t size = 0;
+
+	if(*header != NULL)
+	{
+		WEBCFG_FREE(*header);
+	}
+	if(value == NULL)
+	{
+		return;
+	}
+	size = strlen(prefix) + strlen(value) + 1;
+	*header = (char *) malloc(size);
+	if(*header != NULL)
+	{
+		snprintf(*header, size, "%s%s", prefix, value);
+	}
 }
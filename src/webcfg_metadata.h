@@ -40,6 +40,7 @@ typedef struct SupplementaryDocs
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
 WEBCFG_STATUS isSubDocSupported(char *subDoc);
+int isSupportedDocsLoaded();
 void initWebcfgProperties(char * filename);
 void setsupportedDocs( char * value);
 void setsupportedVersion( char * value);
@@ -51,4 +52,8 @@ void supplementaryDocs();
 void delete_supplementary_list();
 SupplementaryDocs_t * get_global_spInfoHead(void);
 WEBCFG_STATUS isSupplementaryDoc(char *subDoc);
+//Curl headers built when the properties are set, NULL when the property is missing
+const char * getSupportedVersionHeader();
+const char * getSupportedDocsHeader();
+const char * getSupplementaryDocsHeader();
 #endif
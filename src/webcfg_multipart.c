@@ -29,6 +29,13 @@
 #include "webcfg_aker.h"
 #include "webcfg_metadata.h"
 #include "webcfg_timer.h"
+#include "webcfg_latency.h"
+#include "webcfg_apply.h"
+#include "webcfg_request.h"
+#include "webcfg_validate.h"
+#include "webcfg_rollback.h"
+#include "webcfg_scheduler.h"
+#include "webcfg_helpers.h"
 #include <pthread.h>
 #include <uuid/uuid.h>
 #include <math.h>
@@ -44,7 +51,6 @@
 #define WEBPA_READ_HEADER          "/etc/parodus/parodus_read_file.sh"
 #define WEBPA_CREATE_HEADER        "/etc/parodus/parodus_create_file.sh"
 #define CCSP_CRASH_STATUS_CODE      192
-#define MAX_PARAMETERNAME_LEN		4096
 #define SUBDOC_TAG_COUNT            4
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
@@ -54,6 +60,19 @@ struct token_data {
     char* data;
 };
 
+//Shared by the apply workers of one processMsgpackSubdoc run
+typedef struct apply_ctx
+{
+	multipartdocs_t **docs;
+	char **names;
+	int mp_count;
+	int current_doc_count;
+	int success_count;
+	int unsupported_count;	//primary docs rejected as unsupported by the dry run
+	WEBCFG_STATUS rv;
+	pthread_mutex_t mut;
+} apply_ctx_t;
+
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
@@ -70,12 +89,12 @@ static char g_AccountID[64]={'\0'};
 char g_RebootReason[64]={'\0'};
 static char g_transID[64]={'\0'};
 static char * g_contentLen = NULL;
-static char *supportedVersion_header=NULL;
-static char *supportedDocs_header=NULL;
-static char *supplementaryDocs_header=NULL;
 static multipartdocs_t *g_mp_head = NULL;
+static multipartdocs_t *g_mp_retired = NULL;
+static int g_mp_refs = 0;
 pthread_mutex_t multipart_t_mut =PTHREAD_MUTEX_INITIALIZER;
 static int eventFlag = 0;
+pthread_mutex_t event_init_mut=PTHREAD_MUTEX_INITIALIZER;
 char * get_global_transID(void)
 {
     return g_transID;
@@ -137,12 +156,58 @@ void subdoc_parser(char *ptr, int no_of_bytes);
 void addToDBList(webconfig_db_data_t *webcfgdb);
 char* generate_trans_uuid();
 WEBCFG_STATUS processMsgpackSubdoc(char *transaction_id);
+static int applyMultipartSubdoc(int index, void *arg);
+static void recordSubdocSuccess(apply_ctx_t *ctx, multipartdocs_t *mp, webconfig_tmp_data_t *subdoc_node);
+static void checkApplyComplete(apply_ctx_t *ctx);
+static int isSubdocUnchanged(multipartdocs_t *mp, webconfig_tmp_data_t *subdoc_node);
+static void validateSubdocs(apply_ctx_t *ctx, int *count);
+static void rejectSubdoc(multipartdocs_t *mp, webconfig_tmp_data_t *subdoc_node, doc_verdict_t *v);
+static void applyScalarBatches(apply_ctx_t *ctx, int *count);
+static int getBatchComponent(multipartdocs_t *mp, webcfg_request_t **req);
+static WEBCFG_STATUS applyScalarBatch(apply_ctx_t *ctx, int first, int n, webcfg_request_t **reqs, int component);
+static void retireMpNode(multipartdocs_t *node, int free_data);
+static void freeMpNode(multipartdocs_t *node);
 void loadInitURLFromFile(char **url);
 static void get_webCfg_interface(char **interface);
 WEBCFG_STATUS checkAkerDoc();
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
+multipartdocs_t * acquire_global_mp(void)
+{
+	multipartdocs_t *tmp = NULL;
+	pthread_mutex_lock (&multipart_t_mut);
+	g_mp_refs++;
+	tmp = g_mp_head;
+	pthread_mutex_unlock (&multipart_t_mut);
+	return tmp;
+}
+
+void release_global_mp(void)
+{
+	multipartdocs_t *retired = NULL;
+	multipartdocs_t *next = NULL;
+
+	pthread_mutex_lock (&multipart_t_mut);
+	if(g_mp_refs > 0)
+	{
+		g_mp_refs--;
+	}
+	if(g_mp_refs == 0)
+	{
+		retired = g_mp_retired;
+		g_mp_retired = NULL;
+	}
+	pthread_mutex_unlock (&multipart_t_mut);
+
+	while(retired != NULL)
+	{
+		next = retired->retired_next;
+		freeMpNode(retired);
+		retired = next;
+	}
+}
+
 /*
 * @brief Initialize curl object with required options. create configData using libcurl.
 * @param[out] configData
@@ -167,7 +232,7 @@ WEBCFG_STATUS webcfg_http_request(char **configData, int r_count, int status, lo
 	char *ct = NULL;
 	char *webConfigURL = NULL;
 	char *transID = NULL;
-	char docList[512] = {'\0'};
+	char *docList = NULL;
 	char configURL[256] = { 0 };
 	char c[] = "{mac}";
 	int rv = 0;
@@ -176,7 +241,7 @@ WEBCFG_STATUS webcfg_http_request(char **configData, int r_count, int status, lo
 	struct token_data data;
 	data.size = 0;
 	void * dataVal = NULL;
-	char syncURL[256]={'\0'};
+	strbuf_t syncURL;
 	char docname_upper[64]={'\0'};
 
 	curl = curl_easy_init();
@@ -250,16 +315,20 @@ WEBCFG_STATUS webcfg_http_request(char **configData, int r_count, int status, lo
 		if(!get_global_supplementarySync())
 		{
 			//Update query param in the URL based on the existing doc names from db
-			getConfigDocList(docList);
+			getConfigDocList(&docList);
 		}
 
-		if(strlen(docList) > 0)
+		if(docList != NULL)
 		{
 			WebcfgInfo("docList is %s\n", docList);
-			snprintf(syncURL, MAX_BUF_SIZE, "%s?group_id=%s", webConfigURL, docList);
-			WEBCFG_FREE(webConfigURL);
-			WebcfgDebug("syncURL is %s\n", syncURL);
-			webConfigURL =strdup( syncURL);
+			if(strbuf_init(&syncURL, strlen(webConfigURL) + strlen(docList) + sizeof("?group_id=")) == HELPERS_OK)
+			{
+				strbuf_appendf(&syncURL, "%s?group_id=%s", webConfigURL, docList);
+				WEBCFG_FREE(webConfigURL);
+				WebcfgDebug("syncURL is %s\n", syncURL.str);
+				webConfigURL = strbuf_detach(&syncURL);
+			}
+			WEBCFG_FREE(docList);
 		}
 
 		if(webConfigURL !=NULL)
@@ -528,33 +597,20 @@ WEBCFG_STATUS parseMultipartDocument(void *config_data, char *ct , size_t data_s
 
 WEBCFG_STATUS processMsgpackSubdoc(char *transaction_id)
 {
-	int i =0;
-	WEBCFG_STATUS rv = WEBCFG_FAILURE;
-	param_t *reqParam = NULL;
-	WDMP_STATUS ret = WDMP_FAILURE;
-	WDMP_STATUS errd = WDMP_FAILURE;
-	char errDetails[MAX_VALUE_LEN]={0};
-	char result[MAX_VALUE_LEN]={0};
-	int ccspStatus=0;
-	int paramCount = 0;
-	webcfgparam_t *pm = NULL;
-	int success_count = 0;
+	apply_ctx_t ctx;
 	WEBCFG_STATUS addStatus =0;
-	WEBCFG_STATUS subdocStatus = 0;
-	uint16_t doc_transId = 0;
-	int backoffRetryTime = 0;
-	int max_retry_sleep = 0;
-	int backoff_max_time = 6;
-	int c=4;
-	multipartdocs_t *akerIndex = NULL;
-	int akerSet = 0;
-	int mp_count = 0;
-	int current_doc_count = 0;
+	int count = 0;
 	int err = 0;
 	char * errmsg = NULL;
-	
-
-	mp_count = get_multipartdoc_count();
+	multipartdocs_t *mp = NULL;
+	multipartdocs_t *mp_head = NULL;
+	webconfig_tmp_data_t * subdoc_node = NULL;
+	int root_updated = 0;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.rv = WEBCFG_FAILURE;
+	pthread_mutex_init(&ctx.mut, NULL);
+	ctx.mp_count = get_multipartdoc_count();
 	if(transaction_id !=NULL)
 	{
 		strncpy(g_transID, transaction_id, sizeof(g_transID)-1);
@@ -567,7 +623,7 @@ WEBCFG_STATUS processMsgpackSubdoc(char *transaction_id)
 	if(addStatus == WEBCFG_SUCCESS)
 	{
 		WebcfgInfo("Added %d mp entries To tmp List\n", get_numOfMpDocs());
-		print_tmp_doc_list(mp_count+1);
+		print_tmp_doc_list(ctx.mp_count+1);
 	}
 	else
 	{
@@ -580,17 +636,25 @@ WEBCFG_STATUS processMsgpackSubdoc(char *transaction_id)
 		err = 0;
 	}
 
-	WebcfgDebug("mp->entries_count is %d\n",mp_count);
-
-	multipartdocs_t *mp = NULL;
-	mp = get_global_mp();
+	WebcfgDebug("mp->entries_count is %d\n",ctx.mp_count);
 
-	while(mp != NULL)
+	//pinned until the docs of this sync are applied, event workers may delete the mp cache meanwhile
+	mp_head = acquire_global_mp();
+	for(mp = mp_head; mp != NULL; mp = mp->next)
 	{
-		ret = WDMP_FAILURE;
-		err = 0;
+		count++;
+	}
+	if(count > 0)
+	{
+		ctx.docs = (multipartdocs_t **)malloc(sizeof(multipartdocs_t *) * count);
+		ctx.names = (char **)malloc(sizeof(char *) * count);
+	}
+	count = 0;
 
-		webconfig_tmp_data_t * subdoc_node = NULL;
+	//Collect the docs of the current sync, the apply scheduler decides their order.
+	mp = mp_head;
+	while(mp != NULL && ctx.docs != NULL && ctx.names != NULL)
+	{
 		subdoc_node = getTmpNode(mp->name_space);
 
 		if(subdoc_node == NULL)
@@ -602,377 +666,665 @@ WEBCFG_STATUS processMsgpackSubdoc(char *transaction_id)
 
 		WebcfgDebug("check for current docs\n");
 		//Process subdocs with status "pending_apply" which indicates docs from current sync, skip all others.
-		if(strcmp(subdoc_node->status, "pending_apply") != 0)
+		if(subdoc_node->state != DOC_STATE_PENDING_APPLY)
 		{
 			WebcfgDebug("skipped setValues for doc %s as it is already processed\n", mp->name_space);
 			mp = mp->next;
 			continue;
 		}
+		//current_doc_count indicates current primary docs count.
+		if(subdoc_node->isSupplementarySync == 0)
+		{
+			ctx.current_doc_count++;
+			WebcfgDebug("current_doc_count incremented to %d\n", ctx.current_doc_count);
+		}
+		ctx.docs[count] = mp;
+		ctx.names[count] = mp->name_space;
+		count++;
+		mp = mp->next;
+	}
+
+	validateSubdocs(&ctx, &count);
+	applyScalarBatches(&ctx, &count);
+	runApplySchedule(ctx.names, count, applyMultipartSubdoc, &ctx);
+	WebcfgDebug("The current_doc_count is %d\n",ctx.current_doc_count);
+	WEBCFG_FREE(ctx.docs);
+	WEBCFG_FREE(ctx.names);
+	pthread_mutex_destroy(&ctx.mut);
+	release_global_mp();
+
+	//Root moves on when only unsupported docs are left, checked once all docs are applied.
+	if(ctx.unsupported_count && !get_global_supplementarySync() && checkRootUpdate() == WEBCFG_SUCCESS)
+	{
+		WebcfgDebug("updateRootVersionToDB\n");
+		updateRootVersionToDB();
+		WebcfgDebug("check deleteRootAndMultipartDocs\n");
+		deleteRootAndMultipartDocs();
+		root_updated = 1;
+	}
+
+	if(ctx.success_count || root_updated) //No DB update when all docs failed.
+	{
+
+		webconfig_db_data_t* temp1 = NULL;
+		temp1 = get_global_db_node();
+
+		while(temp1 )
+		{
+			WebcfgInfo("DB wd->name: %s, version: %lu\n",  temp1->name, (long)temp1->version);
+			temp1 = temp1->next;
+		}
+		WebcfgDebug("addNewDocEntry\n");
+		addNewDocEntry(get_successDocCount());
+	}
+
+	/*WebcfgDebug("Proceed to generateBlob\n");
+	if(generateBlob() == WEBCFG_SUCCESS)
+	{
+		blob_data = get_DB_BLOB_base64(&blob_len);
+		if(blob_data !=NULL)
+		{
+			WebcfgDebug("The b64 encoded blob is : %s\n",blob_data);
+			WebcfgInfo("The b64 encoded blob_length is : %zu\n",strlen(blob_data));
+			WEBCFG_FREE(blob_data);
+		}
 		else
 		{
-			updateTmpList(subdoc_node, mp->name_space, subdoc_node->version, "pending", "none", 0, 0, 0);
-			//current_doc_count indicates current primary docs count.
-			if(subdoc_node->isSupplementarySync == 0)
+			WebcfgError("Failed in blob base64 encode\n");
+		}
+	}
+	else
+	{
+		WebcfgError("Failed in Blob generation\n");
+	}*/
+
+	return ctx.rv;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+//Called with multipart_t_mut held, the node is already unlinked from the mp cache.
+static void retireMpNode(multipartdocs_t *node, int free_data)
+{
+	node->free_data = free_data;
+	if(g_mp_refs > 0)
+	{
+		node->retired_next = g_mp_retired;
+		g_mp_retired = node;
+		return;
+	}
+	freeMpNode(node);
+}
+
+static void freeMpNode(multipartdocs_t *node)
+{
+	if(node->free_data)
+	{
+		WEBCFG_FREE(node->name_space);
+		WEBCFG_FREE(node->data);
+	}
+	WEBCFG_FREE(node);
+}
+
+/* Called with ctx->mut held, the doc is applied or its content is unchanged.
+The caller saves the last good payload once ctx->mut is released, mp is pinned
+for the whole sync so its data stays valid without a copy. */
+static void recordSubdocSuccess(apply_ctx_t *ctx, multipartdocs_t *mp, webconfig_tmp_data_t *subdoc_node)
+{
+	//the tmp node is gone once the doc is deleted from tmp list
+	uint64_t digest = subdoc_node->digest;
+
+	WebcfgDebug("update doc status for %s\n", mp->name_space);
+	updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_SUCCESS, "none", 0, 0, 0);
+	clearDocRetry(mp->name_space);
+	//send success notification to cloud
+	WebcfgDebug("send notify for mp->name_space %s\n", mp->name_space);
+	if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
+	{
+		addWebConfgNotifyMsg(mp->name_space, mp->etag, "success", "none", subdoc_node->cloud_trans_id,0, "status",0, NULL, 200);
+	}
+	WebcfgDebug("deleteFromTmpList as doc is applied\n");
+	deleteFromTmpList(mp->name_space);
+	if(mp->isSupplementarySync == 0)
+	{
+		checkDBList(mp->name_space,mp->etag, NULL);
+		updateDBDigest(mp->name_space, digest);
+		ctx->success_count++;
+	}
+}
+
+//Called with ctx->mut held, records root once all primary docs of this sync are applied.
+static void checkApplyComplete(apply_ctx_t *ctx)
+{
+	WebcfgDebug("The mp->entries_count %d\n",ctx->mp_count);
+	WebcfgDebug("The current doc  count in primary sync is %d\n",ctx->current_doc_count);
+	WebcfgDebug("The count %d\n",ctx->success_count);
+	if(ctx->success_count == ctx->current_doc_count && get_global_supplementarySync() == 0)
+	{
+		char * temp = strdup(g_ETAG);
+		uint32_t version=0;
+		if(temp)
+		{
+			version = strtoul(temp,NULL,0);
+			WEBCFG_FREE(temp);
+		}
+		if(version != 0)
+		{
+			checkDBList("root",version, NULL);
+			ctx->success_count++;
+		}
+
+		WebcfgInfo("The Etag is %lu\n",(long)version );
+
+		if(checkRootDelete() == WEBCFG_SUCCESS)
+		{
+			//Delete tmp queue root as all docs are applied
+			WebcfgInfo("Delete tmp queue root as all docs are applied\n");
+			WebcfgDebug("root version to delete is %lu\n", (long)version);
+			deleteFromTmpList("root");
+		}
+		WebcfgDebug("processMsgpackSubdoc is success as all the docs are applied\n");
+		ctx->rv = WEBCFG_SUCCESS;
+	}
+}
+
+//Content digest matches the last successful apply of the doc.
+static int isSubdocUnchanged(multipartdocs_t *mp, webconfig_tmp_data_t *subdoc_node)
+{
+	return (mp->isSupplementarySync == 0 && subdoc_node->digest != 0 && getDBDigest(mp->name_space) == subdoc_node->digest);
+}
+
+/* Dry run of the docs of this sync before any of them is applied. Decode, param
+types, support and size are checked without touching components, rejected docs
+are reported right away and removed from ctx so the apply never sees them. */
+static void validateSubdocs(apply_ctx_t *ctx, int *count)
+{
+	doc_verdict_t *verdicts = NULL;
+	webconfig_tmp_data_t * subdoc_node = NULL;
+	multipartdocs_t *mp = NULL;
+	int i = 0, kept = 0;
+
+	if(*count == 0)
+	{
+		return;
+	}
+	verdicts = (doc_verdict_t *) malloc(sizeof(doc_verdict_t) * (*count));
+	if(verdicts == NULL)
+	{
+		WebcfgError("Failed to allocate verdicts, docs are validated on apply\n");
+		return;
+	}
+	for(i = 0; i < *count; i++)
+	{
+		mp = ctx->docs[i];
+		subdoc_node = getTmpNode(mp->name_space);
+		memset(&verdicts[i], 0, sizeof(doc_verdict_t));
+		//unchanged docs are not applied
+		if(subdoc_node != NULL && !isSubdocUnchanged(mp, subdoc_node))
+		{
+			validateSubdoc(mp->name_space, mp->etag, mp->data, mp->data_size, mp->isSupplementarySync, &verdicts[i]);
+		}
+	}
+
+	for(i = 0; i < *count; i++)
+	{
+		mp = ctx->docs[i];
+		if(verdicts[i].verdict == VERDICT_ACCEPT)
+		{
+			WebcfgDebug("verdict %s version %lu: %s\n", mp->name_space, (long)mp->etag, getVerdictString(verdicts[i].verdict));
+			ctx->docs[kept] = mp;
+			ctx->names[kept] = mp->name_space;
+			kept++;
+			continue;
+		}
+		WebcfgError("verdict %s version %lu: %s\n", mp->name_space, (long)mp->etag, getVerdictString(verdicts[i].verdict));
+		rejectSubdoc(mp, getTmpNode(mp->name_space), &verdicts[i]);
+		if(verdicts[i].verdict == VERDICT_UNSUPPORTED && mp->isSupplementarySync == 0)
+		{
+			ctx->unsupported_count++;
+		}
+	}
+	WebcfgInfo("Validated %d docs, %d rejected before apply\n", *count, *count - kept);
+	*count = kept;
+	WEBCFG_FREE(verdicts);
+}
+
+//Failure status of a doc rejected by the dry run, same as the apply failures it replaces.
+static void rejectSubdoc(multipartdocs_t *mp, webconfig_tmp_data_t *subdoc_node, doc_verdict_t *v)
+{
+	char errDetails[MAX_VALUE_LEN]={0};
+	char result[MAX_VALUE_LEN]={0};
+	char * errmsg = NULL;
+	WDMP_STATUS errd = WDMP_FAILURE;
+	int err = 0;
+
+	switch(v->verdict)
+	{
+		case VERDICT_UNSUPPORTED:
+			err = 204;
+			errd = mapStatus(err);
+			mapWdmpStatusToStatusMessage(errd, errDetails);
+			snprintf(result, MAX_VALUE_LEN, "doc_unsupported:%s", errDetails);
+			break;
+		case VERDICT_EMPTY:
+			err = getStatusErrorCodeAndMessage(WEBCONFIG_DATA_EMPTY, &errmsg);
+			snprintf(result, MAX_VALUE_LEN, "%s", errmsg);
+			break;
+		case VERDICT_DECODE_FAILURE:
+			err = getStatusErrorCodeAndMessage(DECODE_ROOT_FAILURE, &errmsg);
+			snprintf(result, MAX_VALUE_LEN, "%s:%s", errmsg, webcfgparam_strerror(v->decode_err));
+			break;
+		case VERDICT_INVALID_PARAM:
+			err = getStatusErrorCodeAndMessage(BLOB_PARAM_VALIDATION_FAILURE, &errmsg);
+			snprintf(result, MAX_VALUE_LEN, "%s", errmsg);
+			break;
+		default:
+			err = getStatusErrorCodeAndMessage(BLOB_PARAM_VALIDATION_FAILURE, &errmsg);
+			snprintf(result, MAX_VALUE_LEN, "%s:%s", errmsg, getVerdictString(v->verdict));
+			break;
+	}
+	if(errmsg != NULL)
+	{
+		WEBCFG_FREE(errmsg);
+	}
+	WebcfgInfo("subdoc_name and err_code : %s %d\n", mp->name_space, err);
+	updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_FAILED, result, err, 0, 0);
+	if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
+	{
+		addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", result, subdoc_node->cloud_trans_id, 0, "status", err, NULL, 200);
+	}
+}
+
+/* Sets runs of consecutive scalar docs of one component with a single setValues.
+Docs of a batch that succeeds are removed from ctx, the scheduler applies the rest
+one by one, which also attributes the status of a failed batch to its docs. */
+static void applyScalarBatches(apply_ctx_t *ctx, int *count)
+{
+	webcfg_request_t *reqs[WEBCFG_APPLY_MAX_BATCH];
+	webcfg_request_t *req = NULL;
+	int component = -1;
+	int doc_component = -1;
+	int first = 0, n = 0, i = 0;
+
+	if(!isApplyBatchEnabled())
+	{
+		return;
+	}
+	while(first < *count)
+	{
+		n = 0;
+		component = -1;
+		while(first + n < *count && n < WEBCFG_APPLY_MAX_BATCH)
+		{
+			doc_component = getBatchComponent(ctx->docs[first + n], &req);
+			if(doc_component < 0 || (n > 0 && doc_component != component))
 			{
-				current_doc_count++;
-				WebcfgDebug("current_doc_count incremented to %d\n", current_doc_count);
+				releaseWebcfgRequest(req);
+				break;
 			}
+			component = doc_component;
+			reqs[n++] = req;
 		}
-		WebcfgInfo("mp->name_space %s\n", mp->name_space);
-		WebcfgInfo("mp->etag %lu\n" , (long)mp->etag);
-		WebcfgDebug("mp->data %s\n" , mp->data);
+		if(n > 1 && applyScalarBatch(ctx, first, n, reqs, component) == WEBCFG_SUCCESS)
+		{
+			for(i = 0; i < n; i++)
+			{
+				releaseWebcfgRequest(reqs[i]);
+			}
+			memmove(&ctx->docs[first], &ctx->docs[first + n], sizeof(multipartdocs_t *) * (*count - first - n));
+			memmove(&ctx->names[first], &ctx->names[first + n], sizeof(char *) * (*count - first - n));
+			*count -= n;
+			continue;
+		}
+		for(i = 0; i < n; i++)
+		{
+			releaseWebcfgRequest(reqs[i]);
+		}
+		first += (n > 0) ? n : 1;
+	}
+}
 
-		WebcfgDebug("mp->data_size is %zu\n", mp->data_size);
+//Component of a scalar doc that can join a batch, -1 when it is applied on its own.
+static int getBatchComponent(multipartdocs_t *mp, webcfg_request_t **req)
+{
+	webconfig_tmp_data_t * subdoc_node = NULL;
+	int component = -1;
+	int param_component = -1;
+	int i = 0;
 
-		if(strcmp(mp->name_space, "aker") == 0)
+	*req = NULL;
+	if(strcmp(mp->name_space, "aker") == 0 || hasApplyDependencies(mp->name_space))
+	{
+		return -1;
+	}
+	subdoc_node = getTmpNode(mp->name_space);
+	//unchanged docs are skipped by applyMultipartSubdoc
+	if(subdoc_node == NULL || isSubdocUnchanged(mp, subdoc_node))
+	{
+		return -1;
+	}
+	//only scalar docs join, they are set without a transaction_id
+	if(buildWebcfgProbeRequest(mp->name_space, mp->etag, mp->data, mp->data_size, req) != REQUEST_BUILD_SUCCESS)
+	{
+		return -1;
+	}
+	for(i = 0; i < (*req)->count && !(*req)->blob; i++)
+	{
+		param_component = getApplyComponent((*req)->params[i].name);
+		if(param_component < 0 || (i > 0 && param_component != component))
 		{
-			akerIndex = mp;
-			akerSet = 1;
-			WebcfgDebug("skip aker doc and process at the end\n");
-			mp = mp->next;
-			continue;
+			component = -1;
+			break;
+		}
+		component = param_component;
+	}
+	if(component < 0)
+	{
+		releaseWebcfgRequest(*req);
+		*req = NULL;
+	}
+	return component;
+}
+
+static WEBCFG_STATUS applyScalarBatch(apply_ctx_t *ctx, int first, int n, webcfg_request_t **reqs, int component)
+{
+	webconfig_tmp_data_t * subdoc_node = NULL;
+	webconfig_tmp_snapshot_t snap;
+	multipartdocs_t *mp = NULL;
+	param_t *params = NULL;
+	WDMP_STATUS ret = WDMP_FAILURE;
+	int ccspStatus = 0;
+	int total = 0;
+	int at_limit = 0;
+	int i = 0;
+
+	/* same per doc bookkeeping as applyMultipartSubdoc, a doc at its retry limit
+	is left to it. The retry is only charged there, a failed batch falls back
+	to it and would charge the docs twice. */
+	for(i = 0; i < n; i++)
+	{
+		mp = ctx->docs[first + i];
+		if(getTmpSnapshot(mp->name_space, &snap) != WEBCFG_SUCCESS)
+		{
+			return WEBCFG_FAILURE;
+		}
+		updateTmpListByName(mp->name_space, snap.version, DOC_STATE_PENDING, "none", 0, 0, 0);
+		freeTmpSnapshot(&snap);
+		if(getTmpSnapshot(mp->name_space, &snap) != WEBCFG_SUCCESS)
+		{
+			return WEBCFG_FAILURE;
 		}
+		at_limit = (snap.retry_count >= MAX_APPLY_RETRY_COUNT);
+		freeTmpSnapshot(&snap);
+		if(at_limit)
+		{
+			return WEBCFG_FAILURE;
+		}
+		total += reqs[i]->count;
+	}
+	params = (param_t *) malloc(sizeof(param_t) * total);
+	if(params == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	total = 0;
+	for(i = 0; i < n; i++)
+	{
+		memcpy(&params[total], reqs[i]->params, sizeof(param_t) * reqs[i]->count);
+		total += reqs[i]->count;
+		WebcfgInfo("Batching %s version %lu\n", ctx->docs[first + i]->name_space, (long)ctx->docs[first + i]->etag);
+	}
+	WebcfgInfo("WebConfig SET Request of %d docs for %s\n", n, getApplyComponentName(component));
+	setValues(params, total, ATOMIC_SET_WEBCONFIG, NULL, NULL, &ret, &ccspStatus);
+	WEBCFG_FREE(params);
+	if(ret != WDMP_SUCCESS)
+	{
+		WebcfgError("Batch setValues Failed. ccspStatus : %d, applying the %d docs one by one\n", ccspStatus, n);
+		return WEBCFG_FAILURE;
+	}
+
+	pthread_mutex_lock(&ctx->mut);
+	for(i = 0; i < n; i++)
+	{
+		mp = ctx->docs[first + i];
+		subdoc_node = getTmpNode(mp->name_space);
+		if(subdoc_node != NULL)
+		{
+			recordSubdocSuccess(ctx, mp, subdoc_node);
+		}
+	}
+	checkApplyComplete(ctx);
+	pthread_mutex_unlock(&ctx->mut);
+	for(i = 0; i < n; i++)
+	{
+		mp = ctx->docs[first + i];
+		saveLastGoodPayload(mp->name_space, mp->etag, mp->data, mp->data_size);
+	}
+	return WEBCFG_SUCCESS;
+}
+
+/* Applies one doc of the current sync, called by the apply scheduler workers.
+Returns 1 when the sync is finished early and the remaining docs must not be applied. */
+static int applyMultipartSubdoc(int index, void *arg)
+{
+	apply_ctx_t *ctx = (apply_ctx_t *)arg;
+	multipartdocs_t *mp = ctx->docs[index];
+	webconfig_tmp_data_t * subdoc_node = NULL;
+	webcfg_request_t *req = NULL;
+	REQUEST_BUILD_STATUS buildStatus = REQUEST_BUILD_SUCCESS;
+	WDMP_STATUS ret = WDMP_FAILURE;
+	WDMP_STATUS errd = WDMP_FAILURE;
+	char errDetails[MAX_VALUE_LEN]={0};
+	char result[MAX_VALUE_LEN]={0};
+	int ccspStatus=0;
+	WEBCFG_STATUS subdocStatus = 0;
+	uint16_t doc_transId = 0;
+	int err = 0;
+	char * errmsg = NULL;
+	int save_payload = 0;
+
+	subdoc_node = getTmpNode(mp->name_space);
+	if(subdoc_node == NULL)
+	{
+		WebcfgDebug("Failed to get subdoc_node from tmp list\n");
+		return 0;
+	}
+	updateTmpList(subdoc_node, mp->name_space, subdoc_node->version, DOC_STATE_PENDING, "none", 0, 0, 0);
+
+	WebcfgInfo("mp->name_space %s\n", mp->name_space);
+	WebcfgInfo("mp->etag %lu\n" , (long)mp->etag);
+	WebcfgDebug("mp->data %s\n" , mp->data);
+
+	WebcfgDebug("mp->data_size is %zu\n", mp->data_size);
 
-		WebcfgDebug("--------------decode root doc-------------\n");
-		pm = webcfgparam_convert( mp->data, mp->data_size+1 );
-		err = errno;
-		if ( NULL != pm)
+	//Same content as the last successful apply, only the version moves on.
+	if(isSubdocUnchanged(mp, subdoc_node))
+	{
+		WebcfgInfo("%s content is unchanged, skipping apply of version %lu\n", mp->name_space, (long)mp->etag);
+		pthread_mutex_lock(&ctx->mut);
+		recordSubdocSuccess(ctx, mp, subdoc_node);
+		checkApplyComplete(ctx);
+		pthread_mutex_unlock(&ctx->mut);
+		saveLastGoodPayload(mp->name_space, mp->etag, mp->data, mp->data_size);
+		return 0;
+	}
+
+	//Aker readiness is awaited by the aker worker so that this sync is not held up.
+	if(strcmp(mp->name_space, "aker") == 0)
+	{
+		if(deferAkerSubdoc(mp) != WEBCFG_SUCCESS)
 		{
-			paramCount = (int)pm->entries_count;
+			updateAkerMaxRetry(subdoc_node, "aker");
+		}
+		return 0;
+	}
 
-			reqParam = (param_t *) malloc(sizeof(param_t) * paramCount);
-			memset(reqParam,0,(sizeof(param_t) * paramCount));
+	buildStatus = buildWebcfgRequest(mp->name_space, mp->etag, mp->data, mp->data_size, &req);
+	err = errno;
+	if(buildStatus == REQUEST_BUILD_SUCCESS)
+	{
+		if(req->blob)
+		{
+			doc_transId = req->trans_id;
+			//Update doc trans_id to validate events.
+			WebcfgDebug("Update doc trans_id to validate events.\n");
+			updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_PENDING, "none", 0, doc_transId, 0);
+			//If request type is BLOB, start event handler thread to process various error handling operations based on the events received from components.
+			pthread_mutex_lock(&event_init_mut);
+			if(eventFlag == 0)
+			{
+				WebcfgInfo("starting initEventHandlingTask\n");
+				initEventHandlingTask();
+				processWebcfgEvents();
+				eventFlag = 1;
+			}
+			pthread_mutex_unlock(&event_init_mut);
+		}
 
-			WebcfgDebug("paramCount is %d\n", paramCount);
-			
-			for (i = 0; i < paramCount; i++) 
+		WebcfgDebug("Proceed to setValues..\n");
+		if((checkAndUpdateTmpRetryCount(subdoc_node, mp->name_space))== WEBCFG_SUCCESS)
+		{
+			WebcfgInfo("WebConfig SET Request\n");
+			if(req->params[0].type == WDMP_BASE64)
 			{
-                                if(pm->entries[i].value != NULL)
-                                {
-					if(pm->entries[i].type == WDMP_BLOB)
-					{
-						char *appended_doc = NULL;
-						appended_doc = webcfg_appendeddoc( mp->name_space, mp->etag, pm->entries[i].value, pm->entries[i].value_size, &doc_transId);
-						if(appended_doc != NULL)
-						{
-							WebcfgDebug("webcfg_appendeddoc doc_transId : %hu\n", doc_transId);
-							if(pm->entries[i].name !=NULL)
-							{
-								reqParam[i].name = strdup(pm->entries[i].name);
-							}
-							WebcfgDebug("appended_doc length: %zu\n", strlen(appended_doc));
-							reqParam[i].value = strdup(appended_doc);
-							reqParam[i].type = WDMP_BASE64;
-							WEBCFG_FREE(appended_doc);
-						}
-						//Update doc trans_id to validate events.
-						WebcfgDebug("Update doc trans_id to validate events.\n");
-						updateTmpList(subdoc_node, mp->name_space, mp->etag, "pending", "none", 0, doc_transId, 0);
-						//If request type is BLOB, start event handler thread to process various error handling operations based on the events received from components.
-						if(eventFlag == 0)
-						{
-							WebcfgInfo("starting initEventHandlingTask\n");
-							initEventHandlingTask();
-							processWebcfgEvents();
-							eventFlag = 1;
-						}
-					}
-					else
+				latencyRecordApply(mp->name_space, doc_transId);
+			}
+			setValues(req->params, req->count, ATOMIC_SET_WEBCONFIG, NULL, NULL, &ret, &ccspStatus);
+			//setValues runs concurrently, the result bookkeeping does not
+			pthread_mutex_lock(&ctx->mut);
+			if(ret == WDMP_SUCCESS)
+			{
+				WebcfgInfo("setValues success. ccspStatus : %d\n", ccspStatus);
+				WebcfgDebug("req->params[0].type is %d WDMP_BASE64 %d\n", req->params[0].type, WDMP_BASE64);
+				if(req->params[0].type  == WDMP_BASE64)
+				{
+					WebcfgDebug("blob subdoc set is success\n");
+				}
+				else
+				{
+					recordSubdocSuccess(ctx, mp, subdoc_node);
+					save_payload = 1;
+				}
+				checkApplyComplete(ctx);
+			}
+			else
+			{
+				if(ccspStatus == 9005)
+				{
+					subdocStatus = isSubDocSupported(mp->name_space);
+					if(subdocStatus != WEBCFG_SUCCESS)
 					{
-						if(pm->entries[i].name !=NULL)
-						{
-							reqParam[i].name = strdup(pm->entries[i].name);
-						}
-						if(pm->entries[i].value !=NULL)
-						{
-							reqParam[i].value = strdup(pm->entries[i].value);
-						}
-						reqParam[i].type = pm->entries[i].type;
+						WebcfgDebug("The ccspstatus is %d\n",ccspStatus);
+						ccspStatus = 204;
 					}
-                                }
-				WebcfgInfo("Request:> param[%d].name = %s, type = %d\n",i,reqParam[i].name,reqParam[i].type);
-				WebcfgDebug("Request:> param[%d].value = %s\n",i,reqParam[i].value);
-				WebcfgDebug("Request:> param[%d].type = %d\n",i,reqParam[i].type);
-			}
+				}
+				WebcfgError("setValues Failed. ccspStatus : %d\n", ccspStatus);
+				errd = mapStatus(ccspStatus);
+				WebcfgDebug("The errd value is %d\n",errd);
 
-			if(reqParam !=NULL && validate_request_param(reqParam, paramCount) == WEBCFG_SUCCESS)
-			{
-				WebcfgDebug("Proceed to setValues..\n");
-				if((checkAndUpdateTmpRetryCount(subdoc_node, mp->name_space))== WEBCFG_SUCCESS)
+				mapWdmpStatusToStatusMessage(errd, errDetails);
+				WebcfgDebug("The errDetails value is %s\n",errDetails);
+
+				WebcfgInfo("subdoc_name and err_code : %s %d\n",mp->name_space,ccspStatus);
+				WebcfgInfo("failure_reason %s\n",errDetails);
+				//Update error_details to tmp list and send failure notification to cloud.
+				if((ccspStatus == CCSP_CRASH_STATUS_CODE) || (ccspStatus == 204) || (ccspStatus == 191) || (ccspStatus == 193) || (ccspStatus == 190))
 				{
-					WebcfgInfo("WebConfig SET Request\n");
-					setValues(reqParam, paramCount, ATOMIC_SET_WEBCONFIG, NULL, NULL, &ret, &ccspStatus);
-					if(ret == WDMP_SUCCESS)
+					subdocStatus = isSubDocSupported(mp->name_space);
+					WebcfgDebug("ccspStatus is %d\n", ccspStatus);
+					if(ccspStatus == 204 && subdocStatus != WEBCFG_SUCCESS)
 					{
-						WebcfgInfo("setValues success. ccspStatus : %d\n", ccspStatus);
-						WebcfgDebug("reqParam[0].type is %d WDMP_BASE64 %d\n", reqParam[0].type, WDMP_BASE64);
-						if(reqParam[0].type  == WDMP_BASE64)
-						{
-							WebcfgDebug("blob subdoc set is success\n");
-						}
-						else
-						{
-							WebcfgDebug("update doc status for %s\n", mp->name_space);
-							updateTmpList(subdoc_node, mp->name_space, mp->etag, "success", "none", 0, 0, 0);
-							//send success notification to cloud
-							WebcfgDebug("send notify for mp->name_space %s\n", mp->name_space);
-							if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
-							{
-								addWebConfgNotifyMsg(mp->name_space, mp->etag, "success", "none", subdoc_node->cloud_trans_id,0, "status",0, NULL, 200);
-							}
-							WebcfgDebug("deleteFromTmpList as doc is applied\n");
-							deleteFromTmpList(mp->name_space);
-							if(mp->isSupplementarySync == 0)
-							{
-								checkDBList(mp->name_space,mp->etag, NULL);
-								success_count++;
-							}
-						}
-
-						WebcfgDebug("The mp->entries_count %d\n",mp_count);
-						WebcfgDebug("The current doc  count in primary sync is %d\n",current_doc_count);
-						WebcfgDebug("The count %d\n",success_count);
-						if(success_count == current_doc_count && get_global_supplementarySync() == 0)
-						{
-							char * temp = strdup(g_ETAG);
-							uint32_t version=0;
-							if(temp)
-							{
-								version = strtoul(temp,NULL,0);
-								WEBCFG_FREE(temp);
-							}
-							if(version != 0)
-							{
-								checkDBList("root",version, NULL);
-								success_count++;
-							}
-
-							WebcfgInfo("The Etag is %lu\n",(long)version );
-
-							if(checkRootDelete() == WEBCFG_SUCCESS)
-							{
-								//Delete tmp queue root as all docs are applied
-								WebcfgInfo("Delete tmp queue root as all docs are applied\n");
-								WebcfgDebug("root version to delete is %lu\n", (long)version);
-								deleteFromTmpList("root");
-							}
-							WebcfgDebug("processMsgpackSubdoc is success as all the docs are applied\n");
-							rv = WEBCFG_SUCCESS;
-						}
+						snprintf(result,MAX_VALUE_LEN,"doc_unsupported:%s", errDetails);
 					}
 					else
 					{
-						if(ccspStatus == 9005)
-						{
-							subdocStatus = isSubDocSupported(mp->name_space);
-							if(subdocStatus != WEBCFG_SUCCESS)
-							{
-								WebcfgDebug("The ccspstatus is %d\n",ccspStatus);
-								ccspStatus = 204;
-							}
-						}
-						WebcfgError("setValues Failed. ccspStatus : %d\n", ccspStatus);
-						errd = mapStatus(ccspStatus);
-						WebcfgDebug("The errd value is %d\n",errd);
-
-						mapWdmpStatusToStatusMessage(errd, errDetails);
-						WebcfgDebug("The errDetails value is %s\n",errDetails);
-
-						WebcfgInfo("subdoc_name and err_code : %s %d\n",mp->name_space,ccspStatus);
-						WebcfgInfo("failure_reason %s\n",errDetails);
-						//Update error_details to tmp list and send failure notification to cloud.
-						if((ccspStatus == CCSP_CRASH_STATUS_CODE) || (ccspStatus == 204) || (ccspStatus == 191) || (ccspStatus == 193) || (ccspStatus == 190))
-						{
-							subdocStatus = isSubDocSupported(mp->name_space);
-							WebcfgDebug("ccspStatus is %d\n", ccspStatus);
-							if(ccspStatus == 204 && subdocStatus != WEBCFG_SUCCESS)
-							{
-								snprintf(result,MAX_VALUE_LEN,"doc_unsupported:%s", errDetails);
-							}
-							else
-							{
-								long long expiry_time = 0;
-								expiry_time = getRetryExpiryTimeout();
-								set_doc_fail(1);
-
-								updateFailureTimeStamp(subdoc_node, mp->name_space, expiry_time);
-								WebcfgDebug("The retry_timer is %d and timeout generated is %lld\n", get_retry_timer(), expiry_time);
-								//To get the exact time diff for retry from present time.
-								updateRetryTimeDiff(expiry_time);
-								snprintf(result,MAX_VALUE_LEN,"failed_retrying:%s", errDetails);
-							}
-							WebcfgDebug("The result is %s\n",result);
-							updateTmpList(subdoc_node, mp->name_space, mp->etag, "failed", result, ccspStatus, 0, 1);
-							if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
-							{
-								addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", result, subdoc_node->cloud_trans_id, 0,"status",ccspStatus, NULL, 200);
-							}
-							WebcfgDebug("checkRootUpdate\n");
-							//No root update for supplementary sync
-							if(!get_global_supplementarySync() && (ccspStatus == 204 && subdocStatus != WEBCFG_SUCCESS) && (checkRootUpdate() == WEBCFG_SUCCESS))
-							{
-								WebcfgDebug("updateRootVersionToDB\n");
-								updateRootVersionToDB();
-								WebcfgDebug("check deleteRootAndMultipartDocs\n");
-								deleteRootAndMultipartDocs();
-								addNewDocEntry(get_successDocCount());
-								if(NULL != reqParam)
-								{
-									reqParam_destroy(paramCount, reqParam);
-								}
-								webcfgparam_destroy( pm );
-								break;
-							}
-
-							WebcfgDebug("the retry flag value is %d\n", get_doc_fail());
-						}
-						else
-						{
-							snprintf(result,MAX_VALUE_LEN,"doc_rejected:%s", errDetails);
-							WebcfgDebug("The result is %s\n",result);
-							updateTmpList(subdoc_node, mp->name_space, mp->etag, "failed", result, ccspStatus, 0, 0);
-							if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
-							{
-								addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", result, subdoc_node->cloud_trans_id,0, "status", ccspStatus, NULL, 200);
-							}
-						}
-						//print_tmp_doc_list(mp_count);
+						long long expiry_time = 0;
+						//each failed doc is retried on its own backoff
+						expiry_time = scheduleDocRetry(mp->name_space, mp->etag);
+						updateFailureTimeStamp(subdoc_node, mp->name_space, expiry_time);
+						snprintf(result,MAX_VALUE_LEN,"failed_retrying:%s", errDetails);
+					}
+					WebcfgDebug("The result is %s\n",result);
+					updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_FAILED, result, ccspStatus, 0, 1);
+					if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
+					{
+						addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", result, subdoc_node->cloud_trans_id, 0,"status",ccspStatus, NULL, 200);
+					}
+					WebcfgDebug("checkRootUpdate\n");
+					//No root update for supplementary sync
+					if(!get_global_supplementarySync() && (ccspStatus == 204 && subdocStatus != WEBCFG_SUCCESS) && (checkRootUpdate() == WEBCFG_SUCCESS))
+					{
+						WebcfgDebug("updateRootVersionToDB\n");
+						updateRootVersionToDB();
+						WebcfgDebug("check deleteRootAndMultipartDocs\n");
+						deleteRootAndMultipartDocs();
+						addNewDocEntry(get_successDocCount());
+						pthread_mutex_unlock(&ctx->mut);
+						releaseWebcfgRequest(req);
+						return 1;
 					}
 				}
 				else
 				{
-					WebcfgError("Update retry count failed for doc %s\n", mp->name_space);
-					err = getStatusErrorCodeAndMessage(FAILED_TO_SET_BLOB, &errmsg);
-					WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
-					updateTmpList(subdoc_node, mp->name_space, mp->etag, "failed", errmsg, err, 0, 0);
+					snprintf(result,MAX_VALUE_LEN,"doc_rejected:%s", errDetails);
+					WebcfgDebug("The result is %s\n",result);
+					updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_FAILED, result, ccspStatus, 0, 0);
 					if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
 					{
-						addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", errmsg,  subdoc_node->cloud_trans_id ,0, "status", err, NULL, 200);
+						addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", result, subdoc_node->cloud_trans_id,0, "status", ccspStatus, NULL, 200);
 					}
-					WEBCFG_FREE(errmsg);
-				}
-
-				if(NULL != reqParam)
-				{
-					reqParam_destroy(paramCount, reqParam);
 				}
+				//print_tmp_doc_list(ctx->mp_count);
 			}
-			else
+			pthread_mutex_unlock(&ctx->mut);
+			//compressed and written without holding up the other apply workers
+			if(save_payload)
 			{
-				err = getStatusErrorCodeAndMessage(BLOB_PARAM_VALIDATION_FAILURE, &errmsg);
-				WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
-				updateTmpList(subdoc_node, mp->name_space, mp->etag, "failed", errmsg, err, 0, 0);
-				addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", errmsg, get_global_transID() ,0, "status", err, NULL, 200);
-				WEBCFG_FREE(errmsg);
+				saveLastGoodPayload(mp->name_space, mp->etag, mp->data, mp->data_size);
 			}
-			webcfgparam_destroy( pm );
 		}
 		else
 		{
-			WebcfgError("--------------decode root doc failed-------------\n");
-			char * msg = NULL;
-			msg = (char *)webcfgparam_strerror(err);
-			err = getStatusErrorCodeAndMessage(DECODE_ROOT_FAILURE, &errmsg);
-			snprintf(result,MAX_VALUE_LEN,"%s:%s", errmsg, msg);
-
-			updateTmpList(subdoc_node, mp->name_space, mp->etag, "failed", result, err, 0, 0);
+			WebcfgError("Update retry count failed for doc %s\n", mp->name_space);
+			err = getStatusErrorCodeAndMessage(FAILED_TO_SET_BLOB, &errmsg);
+			WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
+			updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_FAILED, errmsg, err, 0, 0);
 			if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
 			{
-				addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", result, subdoc_node->cloud_trans_id,0, "status", err, NULL, 200);
+				addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", errmsg,  subdoc_node->cloud_trans_id ,0, "status", err, NULL, 200);
 			}
 			WEBCFG_FREE(errmsg);
 		}
-		mp = mp->next;
-	}
-	WebcfgDebug("The current_doc_count is %d\n",current_doc_count);
 
-	//Apply aker doc at the end when all other docs are processed.
-	if(akerSet)
-	{
-		AKER_STATUS akerStatus = AKER_FAILURE;
-		webconfig_tmp_data_t * subdoc_node = NULL;
-		subdoc_node = getTmpNode(akerIndex->name_space);
-		max_retry_sleep = (int) pow(2, backoff_max_time) -1;
-		WebcfgDebug("max_retry_sleep is %d\n", max_retry_sleep );
-
-		while(1)
-		{
-			//check aker ready and is registered to parodus using RETRIEVE request to parodus.
-			WebcfgDebug("AkerStatus to check service ready\n");
-			if(checkAkerStatus() != WEBCFG_SUCCESS)
-			{
-				WebcfgError("Aker is not ready to process requests, retry is required\n");
-				updateTmpList(subdoc_node, akerIndex->name_space, akerIndex->etag, "pending", "aker_service_unavailable", 0, 0, 0);
-				if(backoffRetryTime >= max_retry_sleep)
-				{
-					WebcfgError("aker doc max retry reached\n");
-					updateAkerMaxRetry(subdoc_node, "aker");
-					break;
-				}
-
-				if(backoffRetryTime < max_retry_sleep)
-				{
-					backoffRetryTime = (int) pow(2, c) -1;
-				}
-				WebcfgError("aker doc is pending, retrying in backoff interval %dsec\n", backoffRetryTime);
-				if (akerwait__ (backoffRetryTime))
-				{
-					WebcfgInfo("g_shutdown true, break checkAkerStatus\n");
-					break;
-				}
-				c++;
-			}
-			else
-			{
-				WebcfgInfo("process aker sub doc\n");
-				akerStatus = processAkerSubdoc(subdoc_node, akerIndex);
-				WebcfgInfo("Aker doc processed. akerStatus %d\n", akerStatus);
-				break;
-			}
-		}
-		akerSet= 0;
+		releaseWebcfgRequest(req);
 	}
-
-	if(success_count) //No DB update when all docs failed.
+	else if(buildStatus == REQUEST_INVALID_PARAM)
 	{
-
-		webconfig_db_data_t* temp1 = NULL;
-		temp1 = get_global_db_node();
-
-		while(temp1 )
-		{
-			WebcfgInfo("DB wd->name: %s, version: %lu\n",  temp1->name, (long)temp1->version);
-			temp1 = temp1->next;
-		}
-		WebcfgDebug("addNewDocEntry\n");
-		addNewDocEntry(get_successDocCount());
+		err = getStatusErrorCodeAndMessage(BLOB_PARAM_VALIDATION_FAILURE, &errmsg);
+		WebcfgDebug("The error_details is %s and err_code is %d\n", errmsg, err);
+		updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_FAILED, errmsg, err, 0, 0);
+		addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", errmsg, get_global_transID() ,0, "status", err, NULL, 200);
+		WEBCFG_FREE(errmsg);
 	}
-
-	/*WebcfgDebug("Proceed to generateBlob\n");
-	if(generateBlob() == WEBCFG_SUCCESS)
+	else
 	{
-		blob_data = get_DB_BLOB_base64(&blob_len);
-		if(blob_data !=NULL)
-		{
-			WebcfgDebug("The b64 encoded blob is : %s\n",blob_data);
-			WebcfgInfo("The b64 encoded blob_length is : %zu\n",strlen(blob_data));
-			WEBCFG_FREE(blob_data);
-		}
-		else
+		WebcfgError("--------------decode root doc failed-------------\n");
+		char * msg = NULL;
+		msg = (char *)webcfgparam_strerror(err);
+		err = getStatusErrorCodeAndMessage(DECODE_ROOT_FAILURE, &errmsg);
+		snprintf(result,MAX_VALUE_LEN,"%s:%s", errmsg, msg);
+
+		updateTmpList(subdoc_node, mp->name_space, mp->etag, DOC_STATE_FAILED, result, err, 0, 0);
+		if(subdoc_node !=NULL && subdoc_node->cloud_trans_id !=NULL)
 		{
-			WebcfgError("Failed in blob base64 encode\n");
+			addWebConfgNotifyMsg(mp->name_space, mp->etag, "failed", result, subdoc_node->cloud_trans_id,0, "status", err, NULL, 200);
 		}
+		WEBCFG_FREE(errmsg);
 	}
-	else
-	{
-		WebcfgError("Failed in Blob generation\n");
-	}*/
-
-	return rv;
+	return 0;
 }
-/*----------------------------------------------------------------------------*/
-/*                             Internal functions                             */
-/*----------------------------------------------------------------------------*/
+
 
 /* @brief callback function for writing libcurl received data
  * @param[in] buffer curl delivered data which need to be saved.
@@ -1209,17 +1561,21 @@ int readFromFile(char *filename, char **data, int *len)
 }
 
 /* Traverse through db list to get docnames of all docs with root.
-e.g. root,ble,lan,mesh,moca. */
-void getConfigDocList(char *docList)
+e.g. root,ble,lan,mesh,moca. docList is allocated here and left NULL
+when the db is empty, caller has to free it. */
+void getConfigDocList(char **docList)
 {
-	char *docList_tmp = NULL;
+	strbuf_t sb;
 	webconfig_db_data_t *temp = NULL;
 	temp = get_global_db_node();
 
 	if( NULL != temp)
 	{
-		sprintf(docList, "%s", "root");
-		WebcfgDebug("docList is %s\n", docList);
+		if(strbuf_init(&sb, 0) != HELPERS_OK)
+		{
+			return;
+		}
+		strbuf_appendf(&sb, "%s", "root");
 
 		while (NULL != temp)
 		{
@@ -1227,14 +1583,13 @@ void getConfigDocList(char *docList)
 			{
 				if( strcmp(temp->name,"root") !=0 )
 				{
-					docList_tmp = strdup(docList);
-					sprintf(docList, "%s,%s",docList_tmp, temp->name);
-					WEBCFG_FREE(docList_tmp);
+					strbuf_appendf(&sb, ",%s", temp->name);
 				}
 			}
 			temp= temp->next;
 		}
-		WebcfgDebug("Final docList is %s len %lu\n", docList, strlen(docList));
+		WebcfgDebug("Final docList is %s len %zu\n", sb.str, sb.len);
+		*docList = strbuf_detach(&sb);
 	}
 }
 
@@ -1262,7 +1617,6 @@ void getRootDocVersionFromDBCache(uint32_t *rt_version, char **rt_string, int *s
 
 void derive_root_doc_version_string(char **rootVersion, uint32_t *root_ver, int status)
 {
-	FILE *fp = NULL;
 	char *reason = NULL;
 	uint32_t db_root_version = 0;
 	char *db_root_string = NULL;
@@ -1287,8 +1641,7 @@ void derive_root_doc_version_string(char **rootVersion, uint32_t *root_ver, int
 	{
 		WebcfgInfo("reboot reason is %s\n", g_RebootReason);
 
-		fp = fopen(WEBCFG_DB_FILE,"rb");
-		if (fp == NULL)
+		if (!isDBFilePresent())
 		{
 			if(strncmp(g_RebootReason,"factory-reset",strlen("factory-reset"))==0)
 			{
@@ -1305,7 +1658,6 @@ void derive_root_doc_version_string(char **rootVersion, uint32_t *root_ver, int
 		}
 		else
 		{
-			fclose(fp);
 			//get existing root version from DB
 			getRootDocVersionFromDBCache(&db_root_version, &db_root_string, &subdocList);
 			WebcfgDebug("db_root_version %lu db_root_string %s subdocList %d\n", (long)db_root_version, db_root_string, subdocList);
@@ -1362,23 +1714,29 @@ void derive_root_doc_version_string(char **rootVersion, uint32_t *root_ver, int
 
 /* Traverse through db list to get versions of all docs with root.
 e.g. IF-NONE-MATCH: 123,44317,66317,77317 where 123 is root version.
-Currently versionsList length is fixed to 512 which can support up to 45 docs.
-This can be increased if required. */
-void refreshConfigVersionList(char *versionsList, int http_status)
+versionsList is allocated here and grows with the number of docs,
+caller has to free it. */
+void refreshConfigVersionList(char **versionsList, int http_status)
 {
-	char *versionsList_tmp = NULL;
+	strbuf_t sb;
 	char *root_str = NULL;
 	uint32_t root_version = 0;
 
-	//initialize to default value "0".
-	snprintf(versionsList, 512, "%s", "0");
-
 	derive_root_doc_version_string(&root_str, &root_version, http_status);
 	WebcfgDebug("update root_version %lu rootString %s to DB\n", (long)root_version, root_str);
 	checkDBList("root", root_version, root_str);
 	WebcfgDebug("addNewDocEntry. get_successDocCount %d\n", get_successDocCount());
 	addNewDocEntry(get_successDocCount());
 
+	if(strbuf_init(&sb, 0) != HELPERS_OK)
+	{
+		if(root_str != NULL)
+		{
+			WEBCFG_FREE(root_str);
+		}
+		return;
+	}
+
 	webconfig_db_data_t *temp = NULL;
 	temp = get_global_db_node();
 
@@ -1387,15 +1745,14 @@ void refreshConfigVersionList(char *versionsList, int http_status)
 		if(root_str!=NULL && strlen(root_str) >0)
 		{
 			WebcfgDebug("update root_str %s to versionsList\n", root_str);
-			snprintf(versionsList, 512, "%s", root_str);
-			WEBCFG_FREE(root_str);
+			strbuf_appendf(&sb, "%s", root_str);
 		}
 		else
 		{
 			WebcfgDebug("update root_version %lu to versionsList\n", (long)root_version);
-			sprintf(versionsList, "%lu", (long)root_version);
+			strbuf_appendf(&sb, "%lu", (long)root_version);
 		}
-		WebcfgInfo("versionsList is %s\n", versionsList);
+		WebcfgInfo("versionsList is %s\n", sb.str);
 
 		while (NULL != temp)
 		{
@@ -1403,15 +1760,23 @@ void refreshConfigVersionList(char *versionsList, int http_status)
 			{
 				if( strcmp(temp->name,"root") !=0 )
 				{
-					versionsList_tmp = strdup(versionsList);
-					sprintf(versionsList, "%s,%lu",versionsList_tmp,(long)temp->version);
-					WEBCFG_FREE(versionsList_tmp);
+					strbuf_appendf(&sb, ",%lu", (long)temp->version);
 				}
 			}
 			temp= temp->next;
 		}
-		WebcfgDebug("Final versionsList is %s len %lu\n", versionsList, strlen(versionsList));
+		WebcfgDebug("Final versionsList is %s len %zu\n", sb.str, sb.len);
 	}
+	else
+	{
+		//initialize to default value "0".
+		strbuf_appendf(&sb, "%s", "0");
+	}
+	if(root_str != NULL)
+	{
+		WEBCFG_FREE(root_str);
+	}
+	*versionsList = strbuf_detach(&sb);
 }
 
 /* @brief Function to create curl header options
@@ -1422,147 +1787,96 @@ void refreshConfigVersionList(char *versionsList, int http_status)
 */
 void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list, int status, char ** trans_uuid)
 {
-	char *version_header = NULL;
-	char *auth_header = NULL;
-	char *status_header=NULL;
-	char *schema_header=NULL;
-	char *bootTime = NULL, *bootTime_header = NULL;
-	char *FwVersion = NULL, *FwVersion_header=NULL;
-	char *supportedDocs = NULL;
-	char *supportedVersion = NULL;
-	char *supplementaryDocs = NULL;
-        char *productClass = NULL, *productClass_header = NULL;
-	char *ModelName = NULL, *ModelName_header = NULL;
-	char *systemReadyTime = NULL, *systemReadyTime_header=NULL;
-	char *telemetryVersion_header = NULL;
-	char *PartnerID = NULL, *PartnerID_header = NULL;
-	char *AccountID = NULL, *AccountID_header = NULL;
+	//single growable buffer reused for every header, curl_slist_append keeps its own copy
+	strbuf_t header;
+	char *bootTime = NULL;
+	char *FwVersion = NULL;
+	const char *supportedDocs_header = NULL;
+	const char *supportedVersion_header = NULL;
+	const char *supplementaryDocs_header = NULL;
+        char *productClass = NULL;
+	char *ModelName = NULL;
+	char *systemReadyTime = NULL;
+	char *PartnerID = NULL;
+	char *AccountID = NULL;
 	struct timespec cTime;
 	char currentTime[32];
-	char *currentTime_header=NULL;
-	char *uuid_header = NULL;
 	char *transaction_uuid = NULL;
-	char version[512]={'\0'};
+	char *version = NULL;
 	char* syncTransID = NULL;
-	char* ForceSyncDoc = NULL;
-	size_t supported_doc_size = 0;
-	size_t supported_version_size = 0;
-	size_t supplementary_docs_size = 0;
 
 	WebcfgInfo("Start of createCurlheader\n");
+	strbuf_init(&header, MAX_BUF_SIZE);
 	//Fetch auth JWT token from cloud.
 	getAuthToken();
 
 	WebcfgDebug("get_global_auth_token() is %s\n", get_global_auth_token());
 
-	auth_header = (char *) malloc(sizeof(char)*MAX_HEADER_LEN);
-	if(auth_header !=NULL)
+	strbuf_reset(&header);
+	if(strbuf_appendf(&header, "Authorization:Bearer %s", (0 < strlen(get_global_auth_token()) ? get_global_auth_token() : NULL)) == HELPERS_OK)
 	{
-		snprintf(auth_header, MAX_HEADER_LEN, "Authorization:Bearer %s", (0 < strlen(get_global_auth_token()) ? get_global_auth_token() : NULL));
-		list = curl_slist_append(list, auth_header);
-		WEBCFG_FREE(auth_header);
+		list = curl_slist_append(list, header.str);
 	}
 
 	if(!get_global_supplementarySync())
 	{
-		version_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-		if(version_header !=NULL)
+		refreshConfigVersionList(&version, 0);
+		strbuf_reset(&header);
+		if(strbuf_appendf(&header, "IF-NONE-MATCH:%s", ((version != NULL && strlen(version)!=0) ? version : "0")) == HELPERS_OK)
+		{
+			WebcfgInfo("version_header formed %s\n", header.str);
+			list = curl_slist_append(list, header.str);
+		}
+		if(version != NULL)
 		{
-			refreshConfigVersionList(version, 0);
-			snprintf(version_header, MAX_BUF_SIZE, "IF-NONE-MATCH:%s", ((strlen(version)!=0) ? version : "0"));
-			WebcfgInfo("version_header formed %s\n", version_header);
-			list = curl_slist_append(list, version_header);
-			WEBCFG_FREE(version_header);
+			WEBCFG_FREE(version);
 		}
 	}
 	list = curl_slist_append(list, "Accept: application/msgpack");
 
-	schema_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-	if(schema_header !=NULL)
+	strbuf_reset(&header);
+	if(strbuf_appendf(&header, "Schema-Version: %s", "v1.0") == HELPERS_OK)
 	{
-		snprintf(schema_header, MAX_BUF_SIZE, "Schema-Version: %s", "v1.0");
-		WebcfgInfo("schema_header formed %s\n", schema_header);
-		list = curl_slist_append(list, schema_header);
-		WEBCFG_FREE(schema_header);
+		WebcfgInfo("schema_header formed %s\n", header.str);
+		list = curl_slist_append(list, header.str);
 	}
 
+	//headers are prebuilt when the properties are loaded
 	if(!get_global_supplementarySync())
 	{
-		if(supportedVersion_header == NULL)
+		supportedVersion_header = getSupportedVersionHeader();
+		if(supportedVersion_header != NULL)
 		{
-			supportedVersion = getsupportedVersion();
-
-			if(supportedVersion !=NULL)
-			{
-				supported_version_size = strlen(supportedVersion)+strlen("X-System-Schema-Version: ");
-				supportedVersion_header = (char *) malloc(supported_version_size+1);
-				memset(supportedVersion_header,0,supported_version_size+1);
-				WebcfgDebug("supportedVersion fetched is %s\n", supportedVersion);
-				snprintf(supportedVersion_header, supported_version_size+1, "X-System-Schema-Version: %s", supportedVersion);
-				WebcfgInfo("supportedVersion_header formed %s\n", supportedVersion_header);
-				list = curl_slist_append(list, supportedVersion_header);
-			}
-			else
-			{
-				WebcfgInfo("supportedVersion fetched is NULL\n");
-			}
+			WebcfgInfo("supportedVersion_header formed %s\n", supportedVersion_header);
+			list = curl_slist_append(list, supportedVersion_header);
 		}
 		else
 		{
-			WebcfgInfo("supportedVersion_header formed %s\n", supportedVersion_header);
-			list = curl_slist_append(list, supportedVersion_header);
+			WebcfgInfo("supportedVersion fetched is NULL\n");
 		}
 
-		if(supportedDocs_header == NULL)
+		supportedDocs_header = getSupportedDocsHeader();
+		if(supportedDocs_header != NULL)
 		{
-			supportedDocs = getsupportedDocs();
-
-			if(supportedDocs !=NULL)
-			{
-				supported_doc_size = strlen(supportedDocs)+strlen("X-System-Supported-Docs: ");
-				supportedDocs_header = (char *) malloc(supported_doc_size+1);
-				memset(supportedDocs_header,0,supported_doc_size+1);
-				WebcfgDebug("supportedDocs fetched is %s\n", supportedDocs);
-				snprintf(supportedDocs_header, supported_doc_size+1, "X-System-Supported-Docs: %s", supportedDocs);
-				WebcfgInfo("supportedDocs_header formed %s\n", supportedDocs_header);
-				list = curl_slist_append(list, supportedDocs_header);
-			}
-			else
-			{
-				WebcfgInfo("SupportedDocs fetched is NULL\n");
-			}
+			WebcfgInfo("supportedDocs_header formed %s\n", supportedDocs_header);
+			list = curl_slist_append(list, supportedDocs_header);
 		}
 		else
 		{
-			WebcfgInfo("supportedDocs_header formed %s\n", supportedDocs_header);
-			list = curl_slist_append(list, supportedDocs_header);
+			WebcfgInfo("SupportedDocs fetched is NULL\n");
 		}
 	}
 	else
 	{
-		if(supplementaryDocs_header == NULL)
+		supplementaryDocs_header = getSupplementaryDocsHeader();
+		if(supplementaryDocs_header != NULL)
 		{
-			supplementaryDocs = getsupplementaryDocs();
-
-			if(supplementaryDocs !=NULL)
-			{
-				supplementary_docs_size = strlen(supplementaryDocs)+strlen("X-System-SupplementaryService-Sync: ");
-				supplementaryDocs_header = (char *) malloc(supplementary_docs_size+1);
-				memset(supplementaryDocs_header,0,supplementary_docs_size+1);
-				WebcfgDebug("supplementaryDocs fetched is %s\n", supplementaryDocs);
-				snprintf(supplementaryDocs_header, supplementary_docs_size+1, "X-System-SupplementaryService-Sync: %s", supplementaryDocs);
-				WebcfgInfo("supplementaryDocs_header formed %s\n", supplementaryDocs_header);
-				list = curl_slist_append(list, supplementaryDocs_header);
-			}
-			else
-			{
-				WebcfgInfo("supplementaryDocs fetched is NULL\n");
-			}
+			WebcfgInfo("supplementaryDocs_header formed %s\n", supplementaryDocs_header);
+			list = curl_slist_append(list, supplementaryDocs_header);
 		}
 		else
 		{
-			WebcfgInfo("supplementaryDocs_header formed %s\n", supplementaryDocs_header);
-			list = curl_slist_append(list, supplementaryDocs_header);
+			WebcfgInfo("supplementaryDocs fetched is NULL\n");
 		}
 	}
 
@@ -1579,13 +1893,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
 	if(strlen(g_bootTime))
 	{
-		bootTime_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-		if(bootTime_header !=NULL)
+		strbuf_reset(&header);
+		if(strbuf_appendf(&header, "X-System-Boot-Time: %s", g_bootTime) == HELPERS_OK)
 		{
-			snprintf(bootTime_header, MAX_BUF_SIZE, "X-System-Boot-Time: %s", g_bootTime);
-			WebcfgInfo("bootTime_header formed %s\n", bootTime_header);
-			list = curl_slist_append(list, bootTime_header);
-			WEBCFG_FREE(bootTime_header);
+			WebcfgInfo("bootTime_header formed %s\n", header.str);
+			list = curl_slist_append(list, header.str);
 		}
 	}
 	else
@@ -1606,13 +1918,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
 	if(strlen(g_FirmwareVersion))
 	{
-		FwVersion_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-		if(FwVersion_header !=NULL)
+		strbuf_reset(&header);
+		if(strbuf_appendf(&header, "X-System-Firmware-Version: %s", g_FirmwareVersion) == HELPERS_OK)
 		{
-			snprintf(FwVersion_header, MAX_BUF_SIZE, "X-System-Firmware-Version: %s", g_FirmwareVersion);
-			WebcfgInfo("FwVersion_header formed %s\n", FwVersion_header);
-			list = curl_slist_append(list, FwVersion_header);
-			WEBCFG_FREE(FwVersion_header);
+			WebcfgInfo("FwVersion_header formed %s\n", header.str);
+			list = curl_slist_append(list, header.str);
 		}
 	}
 	else
@@ -1620,32 +1930,21 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 		WebcfgError("Failed to get FwVersion\n");
 	}
 
-	status_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-	if(status_header !=NULL)
+	strbuf_reset(&header);
+	if(strbuf_appendf(&header, "X-System-Status: %s", (status !=0) ? "Non-Operational" : "Operational") == HELPERS_OK)
 	{
-		if(status !=0)
-		{
-			snprintf(status_header, MAX_BUF_SIZE, "X-System-Status: %s", "Non-Operational");
-		}
-		else
-		{
-			snprintf(status_header, MAX_BUF_SIZE, "X-System-Status: %s", "Operational");
-		}
-		WebcfgInfo("status_header formed %s\n", status_header);
-		list = curl_slist_append(list, status_header);
-		WEBCFG_FREE(status_header);
+		WebcfgInfo("status_header formed %s\n", header.str);
+		list = curl_slist_append(list, header.str);
 	}
 
 	memset(currentTime, 0, sizeof(currentTime));
 	getCurrent_Time(&cTime);
 	snprintf(currentTime,sizeof(currentTime),"%d",(int)cTime.tv_sec);
-	currentTime_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-	if(currentTime_header !=NULL)
+	strbuf_reset(&header);
+	if(strbuf_appendf(&header, "X-System-Current-Time: %s", currentTime) == HELPERS_OK)
 	{
-		snprintf(currentTime_header, MAX_BUF_SIZE, "X-System-Current-Time: %s", currentTime);
-		WebcfgInfo("currentTime_header formed %s\n", currentTime_header);
-		list = curl_slist_append(list, currentTime_header);
-		WEBCFG_FREE(currentTime_header);
+		WebcfgInfo("currentTime_header formed %s\n", header.str);
+		list = curl_slist_append(list, header.str);
 	}
 
         if(strlen(g_systemReadyTime) ==0)
@@ -1661,13 +1960,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
         if(strlen(g_systemReadyTime))
         {
-                systemReadyTime_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-                if(systemReadyTime_header !=NULL)
+                strbuf_reset(&header);
+                if(strbuf_appendf(&header, "X-System-Ready-Time: %s", g_systemReadyTime) == HELPERS_OK)
                 {
-	                snprintf(systemReadyTime_header, MAX_BUF_SIZE, "X-System-Ready-Time: %s", g_systemReadyTime);
-	                WebcfgInfo("systemReadyTime_header formed %s\n", systemReadyTime_header);
-	                list = curl_slist_append(list, systemReadyTime_header);
-	                WEBCFG_FREE(systemReadyTime_header);
+	                WebcfgInfo("systemReadyTime_header formed %s\n", header.str);
+	                list = curl_slist_append(list, header.str);
                 }
         }
         else
@@ -1675,20 +1972,13 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
                 WebcfgError("Failed to get systemReadyTime\n");
         }
 
-	getForceSync(&ForceSyncDoc, &syncTransID);
+	//poke transaction of the sync job being served, merged pokes share the first one
+	syncTransID = getForceSyncTransID();
 
 	if(syncTransID !=NULL)
 	{
-		if(ForceSyncDoc !=NULL)
-		{
-			if (strlen(syncTransID)>0)
-			{
-				WebcfgInfo("updating transaction_uuid with force syncTransID\n");
-				transaction_uuid = strdup(syncTransID);
-			}
-			WEBCFG_FREE(ForceSyncDoc);
-		}
-		WEBCFG_FREE(syncTransID);
+		WebcfgInfo("updating transaction_uuid with force syncTransID\n");
+		transaction_uuid = syncTransID;
 	}
 
 	if(transaction_uuid == NULL)
@@ -1698,15 +1988,13 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
 	if(transaction_uuid !=NULL)
 	{
-		uuid_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-		if(uuid_header !=NULL)
+		strbuf_reset(&header);
+		if(strbuf_appendf(&header, "Transaction-ID: %s", transaction_uuid) == HELPERS_OK)
 		{
-			snprintf(uuid_header, MAX_BUF_SIZE, "Transaction-ID: %s", transaction_uuid);
-			WebcfgInfo("uuid_header formed %s\n", uuid_header);
-			list = curl_slist_append(list, uuid_header);
+			WebcfgInfo("uuid_header formed %s\n", header.str);
+			list = curl_slist_append(list, header.str);
 			*trans_uuid = strdup(transaction_uuid);
 			WEBCFG_FREE(transaction_uuid);
-			WEBCFG_FREE(uuid_header);
 		}
 	}
 	else
@@ -1727,13 +2015,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
 	if(strlen(g_productClass))
 	{
-		productClass_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-		if(productClass_header !=NULL)
+		strbuf_reset(&header);
+		if(strbuf_appendf(&header, "X-System-Product-Class: %s", g_productClass) == HELPERS_OK)
 		{
-			snprintf(productClass_header, MAX_BUF_SIZE, "X-System-Product-Class: %s", g_productClass);
-			WebcfgInfo("productClass_header formed %s\n", productClass_header);
-			list = curl_slist_append(list, productClass_header);
-			WEBCFG_FREE(productClass_header);
+			WebcfgInfo("productClass_header formed %s\n", header.str);
+			list = curl_slist_append(list, header.str);
 		}
 	}
 	else
@@ -1754,13 +2040,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
 	if(strlen(g_ModelName))
 	{
-		ModelName_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-		if(ModelName_header !=NULL)
+		strbuf_reset(&header);
+		if(strbuf_appendf(&header, "X-System-Model-Name: %s", g_ModelName) == HELPERS_OK)
 		{
-			snprintf(ModelName_header, MAX_BUF_SIZE, "X-System-Model-Name: %s", g_ModelName);
-			WebcfgInfo("ModelName_header formed %s\n", ModelName_header);
-			list = curl_slist_append(list, ModelName_header);
-			WEBCFG_FREE(ModelName_header);
+			WebcfgInfo("ModelName_header formed %s\n", header.str);
+			list = curl_slist_append(list, header.str);
 		}
 	}
 	else
@@ -1771,13 +2055,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 	//Addtional headers for telemetry sync
 	if(get_global_supplementarySync())
 	{
-		telemetryVersion_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-		if(telemetryVersion_header !=NULL)
+		strbuf_reset(&header);
+		if(strbuf_appendf(&header, "X-System-Telemetry-Profile-Version: %s", "2.0") == HELPERS_OK)
 		{
-			snprintf(telemetryVersion_header, MAX_BUF_SIZE, "X-System-Telemetry-Profile-Version: %s", "2.0");
-			WebcfgInfo("telemetryVersion_header formed %s\n", telemetryVersion_header);
-			list = curl_slist_append(list, telemetryVersion_header);
-			WEBCFG_FREE(telemetryVersion_header);
+			WebcfgInfo("telemetryVersion_header formed %s\n", header.str);
+			list = curl_slist_append(list, header.str);
 		}
 
 		if(strlen(g_PartnerID) ==0)
@@ -1793,13 +2075,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
 		if(strlen(g_PartnerID))
 		{
-			PartnerID_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-			if(PartnerID_header !=NULL)
+			strbuf_reset(&header);
+			if(strbuf_appendf(&header, "X-System-PartnerID: %s", g_PartnerID) == HELPERS_OK)
 			{
-				snprintf(PartnerID_header, MAX_BUF_SIZE, "X-System-PartnerID: %s", g_PartnerID);
-				WebcfgInfo("PartnerID_header formed %s\n", PartnerID_header);
-				list = curl_slist_append(list, PartnerID_header);
-				WEBCFG_FREE(PartnerID_header);
+				WebcfgInfo("PartnerID_header formed %s\n", header.str);
+				list = curl_slist_append(list, header.str);
 			}
 		}
 		else
@@ -1820,13 +2100,11 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 
 		if(strlen(g_AccountID))
 		{
-			AccountID_header = (char *) malloc(sizeof(char)*MAX_BUF_SIZE);
-			if(AccountID_header !=NULL)
+			strbuf_reset(&header);
+			if(strbuf_appendf(&header, "X-System-AccountID: %s", g_AccountID) == HELPERS_OK)
 			{
-				snprintf(AccountID_header, MAX_BUF_SIZE, "X-System-AccountID: %s", g_AccountID);
-				WebcfgInfo("AccountID_header formed %s\n", AccountID_header);
-				list = curl_slist_append(list, AccountID_header);
-				WEBCFG_FREE(AccountID_header);
+				WebcfgInfo("AccountID_header formed %s\n", header.str);
+				list = curl_slist_append(list, header.str);
 			}
 		}
 		else
@@ -1834,6 +2112,7 @@ void createCurlHeader( struct curl_slist *list, struct curl_slist **header_list,
 			WebcfgError("Failed to get AccountID\n");
 		}
 	}
+	strbuf_free(&header);
 	*header_list = list;
 }
 
@@ -1857,19 +2136,19 @@ void delete_multipart()
 {
 	multipartdocs_t *temp = NULL;
 	multipartdocs_t *head = NULL;
-	head = get_global_mp();
 
+	pthread_mutex_lock (&multipart_t_mut);
+	head = g_mp_head;
+	g_mp_head = NULL;
 	while(head != NULL)
 	{
 		temp = head;
 		head = head->next;
 		WebcfgDebug("Deleted mp node: temp->name_space:%s\n", temp->name_space);
-		free(temp);
-		temp = NULL;
+		retireMpNode(temp, 0);
 	}
-	pthread_mutex_lock (&multipart_t_mut);
-	g_mp_head = NULL;
 	pthread_mutex_unlock (&multipart_t_mut);
+	clearWebcfgRequestCache();
 }
 
 //Segregation of each subdoc elements line by line
@@ -2003,14 +2282,15 @@ void addToMpList(uint32_t etag, char *name_space, char *data, size_t data_size)
 		WebcfgDebug("mp_node->data_size is %zu\n", mp_node->data_size);
 		WebcfgDebug("mp_node->isSupplementarySync is %d\n", mp_node->isSupplementarySync);
 
-		if(get_global_mp() == NULL)
+		pthread_mutex_lock (&multipart_t_mut);
+		if(g_mp_head == NULL)
 		{
-			set_global_mp(mp_node);
+			g_mp_head = mp_node;
 		}
 		else
 		{
 			multipartdocs_t *temp = NULL;
-			temp = get_global_mp();
+			temp = g_mp_head;
 			while( temp->next != NULL)
 			{
 				WebcfgDebug("The temp->name_space is %s\n", temp->name_space);
@@ -2018,6 +2298,7 @@ void addToMpList(uint32_t etag, char *name_space, char *data, size_t data_size)
 			}
 			temp->next = mp_node;
 		}
+		pthread_mutex_unlock (&multipart_t_mut);
 	}
 
 }
@@ -2025,7 +2306,8 @@ void addToMpList(uint32_t etag, char *name_space, char *data, size_t data_size)
 void delete_mp_doc()
 {
 	multipartdocs_t *temp = NULL;
-	temp = get_global_mp();
+	//pinned, the deleted nodes stay valid for the walk
+	temp = acquire_global_mp();
 
 	while(temp != NULL)
 	{
@@ -2036,6 +2318,7 @@ void delete_mp_doc()
 		}
 		temp = temp->next;
 	}
+	release_global_mp();
 
 }
 
@@ -2050,6 +2333,8 @@ WEBCFG_STATUS deleteFromMpList(char* doc_name)
 		return WEBCFG_FAILURE;
 	}
 	WebcfgDebug("mp doc to be deleted: %s\n", doc_name);
+	//doc_name may be the name_space freed below
+	dropWebcfgRequestCache(doc_name);
 
 	prev_node = NULL;
 	pthread_mutex_lock (&multipart_t_mut);	
@@ -2073,9 +2358,7 @@ WEBCFG_STATUS deleteFromMpList(char* doc_name)
 			}
 
 			WebcfgDebug("Deleting the node entries\n");
-			WEBCFG_FREE( curr_node->name_space );
-			WEBCFG_FREE( curr_node->data );
-			WEBCFG_FREE( curr_node );
+			retireMpNode(curr_node, 1);
 			curr_node = NULL;
 			WebcfgDebug("Deleted successfully and returning..\n");
 			pthread_mutex_unlock (&multipart_t_mut);
@@ -2098,7 +2381,7 @@ void print_tmp_doc_list(size_t mp_count)
 	while (NULL != temp)
 	{
 		count = count+1;
-		WebcfgInfo("node is pointing to temp->name %s temp->version %lu temp->status %s temp->error_details %s\n",temp->name, (long)temp->version, temp->status, temp->error_details);
+		WebcfgInfo("node is pointing to temp->name %s temp->version %lu temp->status %s temp->error_details %s\n",temp->name, (long)temp->version, DOC_STATE_STRING(temp->state), temp->error_details);
 		temp= temp->next;
 		WebcfgDebug("count %d mp_count %zu\n", count, mp_count);
 		if(count == (int)mp_count)
@@ -2171,30 +2454,9 @@ void reqParam_destroy( int paramCnt, param_t *reqObj )
 //Root will be the first doc always in tmp list and will be deleted when all the docs are success. Delete root doc from tmp list when tmp list has one element root.
 WEBCFG_STATUS checkRootDelete()
 {
-	int count =0;
-	webconfig_tmp_data_t *temp = NULL;
-	temp = get_global_tmp_node();
-
-	while (NULL != temp)
-	{
-		if(count > 1)
-		{
-			WebcfgDebug("tmp list count is %d\n", count);
-			break;
-		}
-		WebcfgDebug("Root check ====> temp->name %s\n", temp->name);
-		if( strcmp("root", temp->name) != 0)
-		{
-			WebcfgDebug("Found doc in tmp list\n");
-			count = count+1;
-		}
-		else
-		{
-			count = 1;
-		}
-		temp= temp->next;
-	}
+	int count = 0;
 
+	count = getTmpRootCheckCount(0);
 	if(count == 1)
 	{
 		WebcfgInfo("Tmp list root doc delete is required\n");
@@ -2210,42 +2472,10 @@ WEBCFG_STATUS checkRootDelete()
 //Update root version to DB when tmp list has one element root.
 WEBCFG_STATUS checkRootUpdate()
 {
-	int count =0;
-	webconfig_tmp_data_t *temp = NULL;
-	temp = get_global_tmp_node();
-
-	while (NULL != temp)
-	{
-		if(count > 1)
-		{
-			WebcfgDebug("tmp list count is %d\n", count);
-			break;
-		}
-		WebcfgDebug("Root check ====> temp->name %s\n", temp->name);
-		if((temp->error_code == 204 && (temp->error_details != NULL && strstr(temp->error_details, "doc_unsupported") != NULL)) || (temp->isSupplementarySync == 1)) //skip supplementary docs
-		{
-			if(temp->isSupplementarySync)
-			{
-				WebcfgDebug("Skipping supplementary sub doc %s\n", temp->name);
-			}
-			else
-			{
-				WebcfgDebug("Skipping unsupported sub doc %s\n",temp->name);
-			}
-			WebcfgDebug("Error details: %s\n",temp->error_details);
-		}
-		else if( strcmp("root", temp->name) != 0)
-		{
-			WebcfgDebug("Found doc in tmp list\n");
-			count = count+1;
-		}
-		else
-		{
-			count = 1;
-		}
-		temp= temp->next;
-	}
+	int count = 0;
 
+	//skip supplementary and unsupported docs
+	count = getTmpRootCheckCount(1);
 	if(count == 1)
 	{
 		WebcfgInfo("root DB update is required\n");
@@ -2277,7 +2507,7 @@ void updateRootVersionToDB()
 		webconfig_tmp_data_t * root_node = NULL;
 		root_node = getTmpNode("root");
 		WebcfgDebug("Updating root version to tmp list\n");
-		updateTmpList(root_node, "root", version, "success", "none", 0, 0, 0);
+		updateTmpList(root_node, "root", version, DOC_STATE_SUCCESS, "none", 0, 0, 0);
 	}
 
 	WebcfgDebug("The Etag is %lu\n",(long)version );
@@ -2308,67 +2538,40 @@ void deleteRootAndMultipartDocs()
 	}
 }
 
-void failedDocsRetry()
+//Retries one failed doc when its retry job is due.
+WEBCFG_STATUS retryFailedDoc(char *docname)
 {
 	webconfig_tmp_data_t *temp = NULL;
-	temp = get_global_tmp_node();
+	temp = getTmpNode(docname);
 
-	while (NULL != temp)
+	if(temp == NULL)
 	{
-		if((temp->error_code == CCSP_CRASH_STATUS_CODE) || (temp->error_code == 204 && (temp->error_details != NULL && strstr(temp->error_details, "doc_unsupported") == NULL)) || (temp->error_code == 191) || (temp->error_code == 193) || (temp->error_code == 190))
-		{
-			if(checkRetryTimer(temp->retry_timestamp))
-			{
-				WebcfgInfo("Retrying for subdoc %s error_code %lu\n", temp->name, (long)temp->error_code);
-				if(retryMultipartSubdoc(temp, temp->name) == WEBCFG_SUCCESS)
-				{
-					WebcfgDebug("The subdoc %s set is success\n", temp->name);
-				}
-				else
-				{
-					WebcfgDebug("The subdoc %s set is failed\n", temp->name);
-				}
-			}
-			else
-			{
-				int time_diff = 0;
-
-				//To get the exact time diff for retry from present time do the below
-				time_diff = updateRetryTimeDiff(temp->retry_timestamp);
-				WebcfgDebug("The docname is %s and diff is %d retry time stamp is %s\n", temp->name, time_diff, printTime(temp->retry_timestamp));
-				set_doc_fail(1);
-			}
-		}
-		else
+		WebcfgDebug("Retry skipped for %s, doc is not pending\n", docname);
+		clearDocRetry(docname);
+		return WEBCFG_FAILURE;
+	}
+	if((temp->error_code == CCSP_CRASH_STATUS_CODE) || (temp->error_code == 204 && (temp->error_details != NULL && strstr(temp->error_details, "doc_unsupported") == NULL)) || (temp->error_code == 191) || (temp->error_code == 193) || (temp->error_code == 190))
+	{
+		WebcfgInfo("Retrying for subdoc %s error_code %lu attempt %d\n", temp->name, (long)temp->error_code, getDocRetryAttempts(docname));
+		//a doc failing again here is queued on its next backoff, not in this pass
+		if(retryMultipartSubdoc(temp, temp->name) == WEBCFG_SUCCESS)
 		{
-			WebcfgDebug("Retry skipped for %s (%s)\n",temp->name,temp->error_details);
+			WebcfgDebug("The subdoc %s set is success\n", docname);
+			return WEBCFG_SUCCESS;
 		}
-		temp= temp->next;
+		WebcfgDebug("The subdoc %s set is failed\n", docname);
+		return WEBCFG_FAILURE;
 	}
+	WebcfgDebug("Retry skipped for %s (%s)\n",temp->name,temp->error_details);
+	clearDocRetry(docname);
+	return WEBCFG_FAILURE;
 }
 
 WEBCFG_STATUS validate_request_param(param_t *reqParam, int paramCount)
 {
-	int i = 0;
 	WEBCFG_STATUS ret = WEBCFG_SUCCESS;
 	WebcfgDebug("------------ validate_request_param ----------\n");
-	for (i = 0; i < paramCount; i++)
-	{
-		WebcfgDebug("reqParam[%d].name: %s\n",i,reqParam[i].name);
-		if(reqParam[i].name == NULL || strcmp(reqParam[i].name, "") == 0 || reqParam[i].value == NULL || strcmp(reqParam[i].value, "") == 0)
-		{
-			WebcfgError("Parameter name/value is null\n");
-			ret = WEBCFG_FAILURE;
-			break;
-		}
-
-		if(strlen(reqParam[i].name) >= MAX_PARAMETERNAME_LEN)
-		{
-			ret = WEBCFG_FAILURE;
-			break;
-		}
-
-	}
+	ret = checkRequestParams(reqParam, paramCount);
 	if(ret != WEBCFG_SUCCESS)
 	{
 		reqParam_destroy(paramCount, reqParam);
@@ -2380,12 +2583,13 @@ int get_multipartdoc_count()
 {
 	int count = 0;
 	multipartdocs_t *temp = NULL;
-	temp = get_global_mp();
+	temp = acquire_global_mp();
 
 	while(temp != NULL)
 	{
 		count++;
 		temp = temp->next;
 	}
+	release_global_mp();
 	return count;
 }
@@ -34,11 +34,13 @@ typedef struct multipartdocs
     size_t data_size;
     int isSupplementarySync; 
     struct multipartdocs *next;
+    struct multipartdocs *retired_next;	//deferred free while the cache is pinned
+    int free_data;
 } multipartdocs_t;
 
 int readFromFile(char *filename, char **data, int *len);
 WEBCFG_STATUS parseMultipartDocument(void *config_data, char *ct , size_t data_size, char* trans_uuid);
-void getConfigDocList(char *docList);
+void getConfigDocList(char **docList);
 void print_tmp_doc_list(size_t mp_count);
 void loadInitURLFromFile(char **url);
 uint32_t get_global_root();
@@ -51,10 +53,20 @@ char* generate_trans_uuid();
 void set_global_transID(char *id);
 multipartdocs_t * get_global_mp(void);
 void set_global_mp(multipartdocs_t *new);
+
+/**
+ *  Pins the mp cache for a walk. Nodes deleted while the cache is pinned
+ *  keep their next pointers and are freed once the last walker releases it.
+ *
+ *  @return head of the mp cache, release_global_mp must be called also when NULL
+ */
+multipartdocs_t * acquire_global_mp(void);
+
+void release_global_mp(void);
 void reqParam_destroy( int paramCnt, param_t *reqObj );
-void failedDocsRetry();
+WEBCFG_STATUS retryFailedDoc(char *docname);
 WEBCFG_STATUS validate_request_param(param_t *reqParam, int paramCount);
-void refreshConfigVersionList(char *versionsList, int http_status);
+void refreshConfigVersionList(char **versionsList, int http_status);
 char * get_global_contentLen(void);
 void set_global_contentLen(char * value);
 void getRootDocVersionFromDBCache(uint32_t *rt_version, char **rt_string, int *subdoclist);
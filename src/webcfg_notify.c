@@ -19,11 +19,19 @@
 #include "webcfg_generic.h"
 #include "webcfg.h"
 #include <pthread.h>
-#include <cJSON.h>
 #include <unistd.h>
+#include "webcfg_helpers.h"
+#include "webcfg_metadata.h"
+#include "webcfg_timer.h"
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
+#define NOTIFY_BATCH_DEFAULT_MAX	16
+#define NOTIFY_QUEUE_DEFAULT_MAX	128
+#define NOTIFY_QUEUE_HARD_FACTOR	2	//finals may exceed the capacity up to this many times
+#define NOTIFY_PAYLOAD_SIZE		512
+#define NOTIFY_APPEND(sb, lit)		strbuf_append((sb), (lit), sizeof(lit) - 1)
+#define NOTIFY_STR(x)			((x) != NULL ? (x) : "")
 
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
@@ -35,11 +43,39 @@ static pthread_t NotificationThreadId=0;
 pthread_mutex_t notify_mut=PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t notify_con=PTHREAD_COND_INITIALIZER;
 notify_params_t *notifyMsgQ = NULL;
+static notify_params_t *notifyMsgQTail = NULL;
+static uint32_t g_notify_q_max = NOTIFY_QUEUE_DEFAULT_MAX;
+static notify_queue_stats_t g_notify_q_stats;	//under notify_mut
+//Batching is off while the window is 0, see loadNotifyBatchConfig
+static uint32_t g_notify_batch_window_ms = 0;
+static uint32_t g_notify_batch_max = NOTIFY_BATCH_DEFAULT_MAX;
+//Pending batch, consumer thread only
+static notify_params_t *g_notify_batch_head = NULL;
+static notify_params_t *g_notify_batch_tail = NULL;
+static uint32_t g_notify_batch_count = 0;
+static webcfg_timer_t g_notify_batch_timer;
+static int g_notify_flush_due = 0;	//under notify_mut
+static int g_notify_threads = 0;	//under notify_mut
+//Cached once the MAC is known, notify thread only
+static char g_notify_device_id[32] = {'\0'};
+static size_t g_notify_device_id_len = 0;
+static char g_notify_root_dest[96] = {'\0'};
+static char g_notify_batch_dest[96] = {'\0'};
+static strbuf_t g_notify_payload;
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
 void* processWebConfgNotification();
-void free_notify_params_struct(notify_params_t *param);
+void sendNotifyMsg(notify_params_t *msg);
+int addNotifyFields(strbuf_t *sb, int first, notify_params_t *msg);
+int appendNotifyKey(strbuf_t *sb, int *first, const char *key);
+int isImmediateNotify(notify_params_t *msg);
+int cacheNotifyDeviceId();
+int initNotifyPayload();
+void sendNotifyPayload(char *dest);
+void notifyBatchTimerExpired(void *arg);
+int isFinalNotify(notify_params_t *msg);
+void unlinkNotifyMsg(notify_params_t *prev, notify_params_t *msg);
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -62,10 +98,23 @@ pthread_mutex_t *get_global_notify_mut(void)
     return &notify_mut;
 }
 
+//Number of running notify consumer threads.
+int get_notify_thread_count()
+{
+	int count = 0;
+
+	pthread_mutex_lock (&notify_mut);
+	count = g_notify_threads;
+	pthread_mutex_unlock (&notify_mut);
+	return count;
+}
+
 //To handle webconfig notification tasks
 void initWebConfigNotifyTask()
 {
 	int err = 0;
+	loadNotifyConfig(WEBCFG_PROPERTIES_FILE);
+	cacheNotifyDeviceId();
 	err = pthread_create(&NotificationThreadId, NULL, processWebConfgNotification, NULL);
 	if (err != 0)
 	{
@@ -139,24 +188,16 @@ void addWebConfgNotifyMsg(char *docname, uint32_t version, char *status, char *e
 
 		pthread_mutex_lock (&notify_mut);
 		//Producer adds the notifyMsg into queue
-		if(notifyMsgQ == NULL)
-		{
-			notifyMsgQ = args;
-			WebcfgDebug("Producer added notify message\n");
-			pthread_cond_signal(&notify_con);
-			pthread_mutex_unlock (&notify_mut);
-			WebcfgDebug("mutex unlock in notify producer thread\n");
-		}
-		else
+		if(enqueueNotifyMsg(args) != 0)
 		{
-			notify_params_t *temp = notifyMsgQ;
-			while(temp->next)
-			{
-			    temp = temp->next;
-			}
-			temp->next = args;
 			pthread_mutex_unlock (&notify_mut);
+			free_notify_params_struct(args);
+			return;
 		}
+		WebcfgDebug("Producer added notify message\n");
+		pthread_cond_signal(&notify_con);
+		pthread_mutex_unlock (&notify_mut);
+		WebcfgDebug("mutex unlock in notify producer thread\n");
 	}
 	else
 	{
@@ -167,12 +208,9 @@ void addWebConfgNotifyMsg(char *docname, uint32_t version, char *status, char *e
 //Notify thread function waiting for notify msgs
 void* processWebConfgNotification()
 {
-	char device_id[32] = { '\0' };
-	cJSON *notifyPayload = NULL;
-	char  * stringifiedNotifyPayload = NULL;
-	char dest[512] = {'\0'};
-	char *source = NULL;
-
+	pthread_mutex_lock (&notify_mut);
+	g_notify_threads++;
+	pthread_mutex_unlock (&notify_mut);
 	while(1)
 	{
 		pthread_mutex_lock (&notify_mut);
@@ -181,82 +219,21 @@ void* processWebConfgNotification()
 		{
 			notify_params_t *msg = notifyMsgQ;
 			notifyMsgQ = notifyMsgQ->next;
-			pthread_mutex_unlock (&notify_mut);
-			WebcfgDebug("mutex unlock in notify consumer thread\n");
-
-			if((get_deviceMAC() !=NULL) && (strlen(get_deviceMAC()) == 0))
+			if(notifyMsgQ == NULL)
 			{
-				WebcfgError("deviceMAC is NULL, failed to send Webconfig Notification\n");
+				notifyMsgQTail = NULL;
 			}
-			else
-			{
-				snprintf(device_id, sizeof(device_id), "mac:%s", get_deviceMAC());
-				WebcfgDebug("webconfig Device_id %s\n", device_id);
-
-				notifyPayload = cJSON_CreateObject();
-
-				if(notifyPayload != NULL)
-				{
-					cJSON_AddStringToObject(notifyPayload,"device_id", device_id);
-
-					if(msg)
-					{
-						if(msg->name !=NULL)
-						{
-							cJSON_AddStringToObject(notifyPayload,"namespace", (NULL != msg->name && (strlen(msg->name)!=0)) ? msg->name : "unknown");
-						}
-						if(msg->application_status !=NULL)
-						{
-							cJSON_AddStringToObject(notifyPayload,"application_status", msg->application_status);
-						}
-						WebcfgDebug("msg->timeout is %lu\n", (long)msg->timeout);
-						if(msg->timeout !=0)
-						{
-							cJSON_AddNumberToObject(notifyPayload,"timeout", msg->timeout);
-						}
-						WebcfgDebug("msg->error_code is %lu\n", (long)msg->error_code);
-						if(msg->error_code !=0)
-						{
-							cJSON_AddNumberToObject(notifyPayload,"error_code", msg->error_code);
-						}
-						if((msg->error_details !=NULL) && (strcmp(msg->error_details, "none")!=0))
-						{
-							cJSON_AddStringToObject(notifyPayload,"error_details", (NULL != msg->error_details) ? msg->error_details : "unknown");
-						}
-						if( msg->response_code != 200 )
-						{
-							cJSON_AddNumberToObject(notifyPayload,"http_status_code", msg->response_code);
-						}
-						cJSON_AddStringToObject(notifyPayload,"transaction_uuid", (NULL != msg->transaction_uuid && (strlen(msg->transaction_uuid)!=0)) ? msg->transaction_uuid : "unknown");
-						cJSON_AddStringToObject(notifyPayload,"version", (NULL != msg->version && (strlen(msg->version)!=0)) ? msg->version : "0");
-					
-					}
-					stringifiedNotifyPayload = cJSON_PrintUnformatted(notifyPayload);
-					cJSON_Delete(notifyPayload);
-				}
-
-				if(msg->response_code == 200)
-				{
-					snprintf(dest,sizeof(dest),"event:subdoc-report/%s/%s/%s",msg->name,device_id,msg->type);
-				}
-				else
-				{
-					snprintf(dest,sizeof(dest),"event:rootdoc-report/%s/%s",device_id,msg->type);
-				}
-				WebcfgInfo("dest is %s\n", dest);
-
-				if (stringifiedNotifyPayload != NULL && strlen(device_id) != 0)
-				{
-					source = (char*) malloc(sizeof(char) * sizeof(device_id));
-					strncpy(source, device_id, sizeof(device_id));
-					WebcfgDebug("source is %s\n", source);
-					WebcfgInfo("stringifiedNotifyPayload is %s\n", stringifiedNotifyPayload);
-					//stringifiedNotifyPayload, source to be freed by sendNotification
-					sendNotification(stringifiedNotifyPayload, source, dest);
-				}
-					free_notify_params_struct(msg);
-					msg = NULL;				
-			}			
+			g_notify_q_stats.depth--;
+			pthread_mutex_unlock (&notify_mut);
+			WebcfgDebug("mutex unlock in notify consumer thread\n");
+			msg->next = NULL;
+			handleNotifyMsg(msg);
+		}
+		else if(g_notify_flush_due && g_notify_batch_count > 0)
+		{
+			pthread_mutex_unlock (&notify_mut);
+			WebcfgDebug("notify batch window elapsed\n");
+			flushNotifyBatch();
 		}
 		else
 		{
@@ -264,6 +241,10 @@ void* processWebConfgNotification()
 			{
 				WebcfgDebug("g_shutdown in notify consumer thread\n");
 				pthread_mutex_unlock (&notify_mut);
+				flushNotifyBatch();
+				pthread_mutex_lock (&notify_mut);
+				g_notify_threads--;
+				pthread_mutex_unlock (&notify_mut);
 				break;
 			}
 			WebcfgDebug("Before pthread cond wait in notify thread\n");
@@ -275,6 +256,459 @@ void* processWebConfgNotification()
 	return NULL;
 }
 
+/* Reads the notify knobs from webconfig.properties:
+ * WEBCONFIG_NOTIFY_BATCH_WINDOW_MS=<ms>, 0 or absent sends every message on its own
+ * WEBCONFIG_NOTIFY_BATCH_MAX=<entries>, flushes a batch early once reached
+ * WEBCONFIG_NOTIFY_QUEUE_MAX=<messages>, queue capacity before the drop policy applies */
+void loadNotifyConfig(char *filename)
+{
+	FILE *fp = NULL;
+	char str[255] = {'\0'};
+	char *value = NULL;
+
+	fp = fopen(filename, "r");
+	if(fp == NULL)
+	{
+		WebcfgDebug("Failed to open %s, notify defaults used\n", filename);
+		return;
+	}
+	while(fgets(str, sizeof(str), fp) != NULL)
+	{
+		if(NULL != (value = strstr(str, "WEBCONFIG_NOTIFY_BATCH_WINDOW_MS=")))
+		{
+			value = value + strlen("WEBCONFIG_NOTIFY_BATCH_WINDOW_MS=");
+			setNotifyBatchConfig((uint32_t)strtoul(value, NULL, 10), g_notify_batch_max);
+		}
+		else if(NULL != (value = strstr(str, "WEBCONFIG_NOTIFY_BATCH_MAX=")))
+		{
+			value = value + strlen("WEBCONFIG_NOTIFY_BATCH_MAX=");
+			setNotifyBatchConfig(g_notify_batch_window_ms, (uint32_t)strtoul(value, NULL, 10));
+		}
+		else if(NULL != (value = strstr(str, "WEBCONFIG_NOTIFY_QUEUE_MAX=")))
+		{
+			value = value + strlen("WEBCONFIG_NOTIFY_QUEUE_MAX=");
+			setNotifyQueueMax((uint32_t)strtoul(value, NULL, 10));
+		}
+	}
+	fclose(fp);
+	WebcfgInfo("notify batch window %lu ms, max %lu, queue max %lu\n", (long)g_notify_batch_window_ms, (long)g_notify_batch_max, (long)g_notify_q_max);
+}
+
+void setNotifyBatchConfig(uint32_t window_ms, uint32_t max_entries)
+{
+	g_notify_batch_window_ms = window_ms;
+	g_notify_batch_max = (max_entries > 0) ? max_entries : NOTIFY_BATCH_DEFAULT_MAX;
+}
+
+void setNotifyQueueMax(uint32_t max_msgs)
+{
+	pthread_mutex_lock (&notify_mut);
+	g_notify_q_max = (max_msgs > 0) ? max_msgs : NOTIFY_QUEUE_DEFAULT_MAX;
+	pthread_mutex_unlock (&notify_mut);
+}
+
+void getNotifyQueueStats(notify_queue_stats_t *stats)
+{
+	pthread_mutex_lock (&notify_mut);
+	*stats = g_notify_q_stats;
+	pthread_mutex_unlock (&notify_mut);
+}
+
+//Success/failure of a doc or any root doc report, the rest are progress updates.
+int isFinalNotify(notify_params_t *msg)
+{
+	if(msg->response_code != 200 || msg->name == NULL || msg->application_status == NULL)
+	{
+		return 1;
+	}
+	return (strcmp(msg->application_status, "success") == 0) || (strcmp(msg->application_status, "failed") == 0);
+}
+
+//Same report of the same transaction: a doc final, or the root report when name is NULL.
+static int isSameNotifyReport(notify_params_t *a, notify_params_t *b)
+{
+	if((a->transaction_uuid == NULL) != (b->transaction_uuid == NULL))
+	{
+		return 0;
+	}
+	if(a->transaction_uuid != NULL && strcmp(a->transaction_uuid, b->transaction_uuid) != 0)
+	{
+		return 0;
+	}
+	if(a->name == NULL || b->name == NULL)
+	{
+		return (a->name == NULL && b->name == NULL);
+	}
+	return (a->response_code == 200 && b->response_code == 200 && strcmp(a->name, b->name) == 0);
+}
+
+//Called with notify_mut held.
+void unlinkNotifyMsg(notify_params_t *prev, notify_params_t *msg)
+{
+	if(prev == NULL)
+	{
+		notifyMsgQ = msg->next;
+	}
+	else
+	{
+		prev->next = msg->next;
+	}
+	if(notifyMsgQTail == msg)
+	{
+		notifyMsgQTail = prev;
+	}
+	g_notify_q_stats.depth--;
+	free_notify_params_struct(msg);
+}
+
+/* Appends msg at the tail, called with notify_mut held. When the queue is full
+the oldest progress update is dropped to make room. A progress update that
+finds no such victim is dropped itself. A final status or root report replaces
+an older one of the same doc and transaction, else it may exceed the capacity
+up to NOTIFY_QUEUE_HARD_FACTOR times, beyond that it is dropped too.
+Returns non zero when msg was dropped. */
+int enqueueNotifyMsg(notify_params_t *msg)
+{
+	notify_params_t *temp = NULL, *prev = NULL;
+	int final = 0;
+
+	if(g_notify_q_stats.depth >= g_notify_q_max)
+	{
+		final = isFinalNotify(msg);
+		for(temp = notifyMsgQ; temp != NULL; prev = temp, temp = temp->next)
+		{
+			if(!isFinalNotify(temp))
+			{
+				break;
+			}
+		}
+		if(temp != NULL)
+		{
+			WebcfgError("notify queue full, dropping %s status of %s\n", NOTIFY_STR(temp->application_status), NOTIFY_STR(temp->name));
+			unlinkNotifyMsg(prev, temp);
+			g_notify_q_stats.dropped_nonfinal++;
+		}
+		else if(!final)
+		{
+			WebcfgError("notify queue full, dropping %s status of %s\n", NOTIFY_STR(msg->application_status), NOTIFY_STR(msg->name));
+			g_notify_q_stats.dropped_nonfinal++;
+			return 1;
+		}
+		else
+		{
+			for(prev = NULL, temp = notifyMsgQ; temp != NULL; prev = temp, temp = temp->next)
+			{
+				if(isSameNotifyReport(temp, msg))
+				{
+					break;
+				}
+			}
+			if(temp != NULL)
+			{
+				WebcfgError("notify queue full, newer final status replaces the one of %s\n", (temp->name != NULL) ? temp->name : "root");
+				unlinkNotifyMsg(prev, temp);
+				g_notify_q_stats.dropped_superseded++;
+			}
+			else if(g_notify_q_stats.depth >= g_notify_q_max * NOTIFY_QUEUE_HARD_FACTOR)
+			{
+				WebcfgError("notify queue at hard limit, dropping final status of %s\n", (msg->name != NULL) ? msg->name : "root");
+				g_notify_q_stats.dropped_final++;
+				return 1;
+			}
+			else
+			{
+				g_notify_q_stats.over_capacity++;
+			}
+		}
+	}
+	msg->next = NULL;
+	if(notifyMsgQTail == NULL)
+	{
+		notifyMsgQ = msg;
+	}
+	else
+	{
+		notifyMsgQTail->next = msg;
+	}
+	notifyMsgQTail = msg;
+	g_notify_q_stats.enqueued++;
+	g_notify_q_stats.depth++;
+	if(g_notify_q_stats.depth > g_notify_q_stats.high_watermark)
+	{
+		g_notify_q_stats.high_watermark = g_notify_q_stats.depth;
+	}
+	return 0;
+}
+
+//Root doc reports and failures are not held back by the batch window.
+int isImmediateNotify(notify_params_t *msg)
+{
+	if(msg->response_code != 200 || msg->name == NULL)
+	{
+		return 1;
+	}
+	if(msg->application_status != NULL && strcmp(msg->application_status, "failed") == 0)
+	{
+		return 1;
+	}
+	return (msg->error_code != 0);
+}
+
+/* Appends the message to the pending batch of its transaction. A message of
+another transaction or type, or one that must go out now, first flushes the
+batch so the cloud still sees the reports in queued order. */
+void handleNotifyMsg(notify_params_t *msg)
+{
+	if(g_notify_batch_window_ms == 0)
+	{
+		sendNotifyMsg(msg);
+		free_notify_params_struct(msg);
+		return;
+	}
+	if(isImmediateNotify(msg))
+	{
+		flushNotifyBatch();
+		sendNotifyMsg(msg);
+		free_notify_params_struct(msg);
+		return;
+	}
+	if(g_notify_batch_head != NULL && (strcmp(NOTIFY_STR(g_notify_batch_head->transaction_uuid), NOTIFY_STR(msg->transaction_uuid)) != 0 || strcmp(NOTIFY_STR(g_notify_batch_head->type), NOTIFY_STR(msg->type)) != 0))
+	{
+		flushNotifyBatch();
+	}
+	if(g_notify_batch_head == NULL)
+	{
+		g_notify_batch_head = msg;
+		webcfgTimerArm(&g_notify_batch_timer, g_notify_batch_window_ms, notifyBatchTimerExpired, NULL);
+	}
+	else
+	{
+		g_notify_batch_tail->next = msg;
+	}
+	g_notify_batch_tail = msg;
+	g_notify_batch_count++;
+	if(g_notify_batch_count >= g_notify_batch_max)
+	{
+		flushNotifyBatch();
+	}
+}
+
+//Timer service callback, hands the flush to the notify thread.
+void notifyBatchTimerExpired(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock (&notify_mut);
+	g_notify_flush_due = 1;
+	pthread_cond_signal(&notify_con);
+	pthread_mutex_unlock (&notify_mut);
+}
+
+/* Sends the pending batch as one message, a single entry keeps the per doc
+format. Batched entries share one transaction and go to
+event:subdoc-report/multiple/<device_id>/<type> as a "notifications" array. */
+void flushNotifyBatch()
+{
+	char dest[512] = {'\0'};
+	notify_params_t *msg = NULL, *next = NULL;
+	int rv = HELPERS_OK;
+
+	webcfgTimerDisarm(&g_notify_batch_timer);
+	pthread_mutex_lock (&notify_mut);
+	g_notify_flush_due = 0;
+	pthread_mutex_unlock (&notify_mut);
+	if(g_notify_batch_head == NULL)
+	{
+		return;
+	}
+	if(g_notify_batch_count == 1)
+	{
+		sendNotifyMsg(g_notify_batch_head);
+	}
+	else if(initNotifyPayload() == 0)
+	{
+		rv |= NOTIFY_APPEND(&g_notify_payload, ",\"transaction_uuid\":");
+		rv |= strbuf_append_json_string(&g_notify_payload, (strlen(NOTIFY_STR(g_notify_batch_head->transaction_uuid)) != 0) ? g_notify_batch_head->transaction_uuid : "unknown");
+		rv |= NOTIFY_APPEND(&g_notify_payload, ",\"notifications\":[");
+		for(msg = g_notify_batch_head; msg != NULL; msg = msg->next)
+		{
+			rv |= (msg == g_notify_batch_head) ? NOTIFY_APPEND(&g_notify_payload, "{") : NOTIFY_APPEND(&g_notify_payload, ",{");
+			rv |= addNotifyFields(&g_notify_payload, 1, msg);
+			rv |= NOTIFY_APPEND(&g_notify_payload, "}");
+		}
+		rv |= NOTIFY_APPEND(&g_notify_payload, "]}");
+		snprintf(dest,sizeof(dest),"%s%s",g_notify_batch_dest,NOTIFY_STR(g_notify_batch_head->type));
+		WebcfgInfo("dest is %s, %lu notifications batched\n", dest, (long)g_notify_batch_count);
+		if(rv == HELPERS_OK)
+		{
+			sendNotifyPayload(dest);
+		}
+	}
+	for(msg = g_notify_batch_head; msg != NULL; msg = next)
+	{
+		next = msg->next;
+		free_notify_params_struct(msg);
+	}
+	g_notify_batch_head = NULL;
+	g_notify_batch_tail = NULL;
+	g_notify_batch_count = 0;
+}
+
+/* Caches device_id and the destination prefixes derived from it. The MAC may
+not be known when the notify task starts, so this is retried per message
+until it is. Returns non zero while the MAC is unknown. */
+int cacheNotifyDeviceId()
+{
+	char *mac = NULL;
+
+	if(g_notify_device_id[0] != '\0')
+	{
+		return 0;
+	}
+	mac = get_deviceMAC();
+	if((mac == NULL) || (strlen(mac) == 0))
+	{
+		WebcfgError("deviceMAC is NULL, failed to send Webconfig Notification\n");
+		return 1;
+	}
+	snprintf(g_notify_device_id, sizeof(g_notify_device_id), "mac:%s", mac);
+	snprintf(g_notify_root_dest, sizeof(g_notify_root_dest), "event:rootdoc-report/%s/", g_notify_device_id);
+	snprintf(g_notify_batch_dest, sizeof(g_notify_batch_dest), "event:subdoc-report/multiple/%s/", g_notify_device_id);
+	g_notify_device_id_len = strlen(g_notify_device_id);
+	WebcfgDebug("webconfig Device_id %s\n", g_notify_device_id);
+	return 0;
+}
+
+//Starts the reusable payload buffer with {"device_id":"<id>".
+int initNotifyPayload()
+{
+	int rv = HELPERS_OK;
+
+	if(cacheNotifyDeviceId() != 0)
+	{
+		return 1;
+	}
+	if(g_notify_payload.str == NULL && strbuf_init(&g_notify_payload, NOTIFY_PAYLOAD_SIZE) != HELPERS_OK)
+	{
+		return 1;
+	}
+	strbuf_reset(&g_notify_payload);
+	rv |= NOTIFY_APPEND(&g_notify_payload, "{\"device_id\":");
+	rv |= strbuf_append_json_string(&g_notify_payload, g_notify_device_id);
+	return (rv == HELPERS_OK) ? 0 : 1;
+}
+
+//Hands a copy of the payload over to sendNotification, which frees payload and source.
+void sendNotifyPayload(char *dest)
+{
+	char *payload = NULL;
+	char *source = NULL;
+
+	payload = (char *) malloc(g_notify_payload.len + 1);
+	source = (char *) malloc(g_notify_device_id_len + 1);
+	if(payload == NULL || source == NULL)
+	{
+		WebcfgError("failure in allocation for notify payload\n");
+		WEBCFG_FREE(payload);
+		WEBCFG_FREE(source);
+		return;
+	}
+	memcpy(payload, g_notify_payload.str, g_notify_payload.len + 1);
+	memcpy(source, g_notify_device_id, g_notify_device_id_len + 1);
+	WebcfgDebug("source is %s\n", source);
+	WebcfgInfo("stringifiedNotifyPayload is %s\n", payload);
+	sendNotification(payload, source, dest);
+}
+
+//Appends "key": with a separating comma unless it is the first member.
+int appendNotifyKey(strbuf_t *sb, int *first, const char *key)
+{
+	int rv = HELPERS_OK;
+
+	if(!*first)
+	{
+		rv |= NOTIFY_APPEND(sb, ",");
+	}
+	*first = 0;
+	rv |= NOTIFY_APPEND(sb, "\"");
+	rv |= strbuf_append(sb, key, strlen(key));
+	rv |= NOTIFY_APPEND(sb, "\":");
+	return rv;
+}
+
+/* Appends the per doc status fields of a notification, first tells whether
+the object has no member yet. */
+int addNotifyFields(strbuf_t *sb, int first, notify_params_t *msg)
+{
+	int rv = HELPERS_OK;
+
+	if(msg->name !=NULL)
+	{
+		rv |= appendNotifyKey(sb, &first, "namespace");
+		rv |= strbuf_append_json_string(sb, (strlen(msg->name)!=0) ? msg->name : "unknown");
+	}
+	if(msg->application_status !=NULL)
+	{
+		rv |= appendNotifyKey(sb, &first, "application_status");
+		rv |= strbuf_append_json_string(sb, msg->application_status);
+	}
+	WebcfgDebug("msg->timeout is %lu\n", (long)msg->timeout);
+	if(msg->timeout !=0)
+	{
+		rv |= appendNotifyKey(sb, &first, "timeout");
+		rv |= strbuf_appendf(sb, "%lu", (unsigned long)msg->timeout);
+	}
+	WebcfgDebug("msg->error_code is %lu\n", (long)msg->error_code);
+	if(msg->error_code !=0)
+	{
+		rv |= appendNotifyKey(sb, &first, "error_code");
+		rv |= strbuf_appendf(sb, "%u", (unsigned int)msg->error_code);
+	}
+	if((msg->error_details !=NULL) && (strcmp(msg->error_details, "none")!=0))
+	{
+		rv |= appendNotifyKey(sb, &first, "error_details");
+		rv |= strbuf_append_json_string(sb, msg->error_details);
+	}
+	if( msg->response_code != 200 )
+	{
+		rv |= appendNotifyKey(sb, &first, "http_status_code");
+		rv |= strbuf_appendf(sb, "%ld", msg->response_code);
+	}
+	rv |= appendNotifyKey(sb, &first, "transaction_uuid");
+	rv |= strbuf_append_json_string(sb, (NULL != msg->transaction_uuid && (strlen(msg->transaction_uuid)!=0)) ? msg->transaction_uuid : "unknown");
+	rv |= appendNotifyKey(sb, &first, "version");
+	rv |= strbuf_append_json_string(sb, (NULL != msg->version && (strlen(msg->version)!=0)) ? msg->version : "0");
+	return rv;
+}
+
+//Sends one notification in the per doc format, msg stays owned by the caller.
+void sendNotifyMsg(notify_params_t *msg)
+{
+	char dest[512] = {'\0'};
+	int rv = HELPERS_OK;
+
+	if(initNotifyPayload() != 0)
+	{
+		return;
+	}
+	rv |= addNotifyFields(&g_notify_payload, 0, msg);
+	rv |= NOTIFY_APPEND(&g_notify_payload, "}");
+
+	if(msg->response_code == 200)
+	{
+		snprintf(dest,sizeof(dest),"event:subdoc-report/%s/%s/%s",msg->name,g_notify_device_id,msg->type);
+	}
+	else
+	{
+		snprintf(dest,sizeof(dest),"%s%s",g_notify_root_dest,msg->type);
+	}
+	WebcfgInfo("dest is %s\n", dest);
+
+	if (rv == HELPERS_OK)
+	{
+		sendNotifyPayload(dest);
+	}
+}
+
 void free_notify_params_struct(notify_params_t *param)
 {
     if(param != NULL)
@@ -36,10 +36,30 @@ typedef struct _notify_params
 	struct _notify_params *next;
 } notify_params_t;
 
+typedef struct notify_queue_stats
+{
+	uint32_t depth;			//messages waiting for the notify thread
+	uint32_t high_watermark;
+	uint64_t enqueued;
+	uint64_t dropped_nonfinal;	//progress updates dropped while full
+	uint64_t dropped_superseded;	//final status replaced by a newer one of the doc while full
+	uint64_t over_capacity;		//final status queued beyond the capacity
+	uint64_t dropped_final;		//final status dropped at the hard limit
+} notify_queue_stats_t;
+
 void initWebConfigNotifyTask();
 pthread_t get_global_notify_threadid();
 void addWebConfgNotifyMsg(char *docname, uint32_t version, char *status, char *error_details, char *transaction_uuid, uint32_t timeout,char* type, uint16_t error_code, char *root_string, long response_code);
 pthread_cond_t *get_global_notify_con(void);
 pthread_mutex_t *get_global_notify_mut(void);
+int get_notify_thread_count();
 uint16_t getStatusErrorCodeAndMessage(WEBCFG_ERROR_CODE status, char** result);
+void loadNotifyConfig(char *filename);
+void setNotifyQueueMax(uint32_t max_msgs);
+void getNotifyQueueStats(notify_queue_stats_t *stats);
+int enqueueNotifyMsg(notify_params_t *msg);
+void free_notify_params_struct(notify_params_t *param);
+void setNotifyBatchConfig(uint32_t window_ms, uint32_t max_entries);
+void handleNotifyMsg(notify_params_t *msg);
+void flushNotifyBatch();
 #endif
@@ -205,8 +205,8 @@ ssize_t webcfgdb_blob_pack(webconfig_db_data_t *webcfgdb, webconfig_tmp_data_t *
 
                 WEBCFG_MAP_TEMP_STATUS.name = "status";
                 WEBCFG_MAP_TEMP_STATUS.length = strlen( "status" );
-                WebcfgDebug("The tmp status is %s\n",temp_data->status);
-                __msgpack_pack_string_nvp( &pk, &WEBCFG_MAP_TEMP_STATUS, temp_data->status );
+                WebcfgDebug("The tmp status is %s\n",DOC_STATE_STRING(temp_data->state));
+                __msgpack_pack_string_nvp( &pk, &WEBCFG_MAP_TEMP_STATUS, DOC_STATE_STRING(temp_data->state) );
 
 		struct webcfg_token WEBCFG_MAP_TEMP_ERROR_DETAILS;
 
@@ -266,14 +266,8 @@ ssize_t webcfgdb_pack( webconfig_db_data_t *packData, void **data, size_t count
 
 	while(temp != NULL) //1 element
 	{
-	    if(temp->root_string !=NULL)
-	    {
-		msgpack_pack_map( &pk, 3); //name, version, root_string
-	    }
-	    else
-	    {
-		msgpack_pack_map( &pk, 2);
-            }
+	    //name, version, digest, root_string
+	    msgpack_pack_map( &pk, 2 + ((temp->digest != 0) ? 1 : 0) + ((temp->root_string != NULL) ? 1 : 0));
 
 	    struct webcfg_token WEBCFG_MAP_NAME;
 
@@ -289,6 +283,17 @@ ssize_t webcfgdb_pack( webconfig_db_data_t *packData, void **data, size_t count
             //WebcfgDebug("The version is %ld\n",(long)temp->version);
             msgpack_pack_uint64(&pk,(uint32_t) temp->version);
 
+	    //ahead of root_string, the decoder stops once root_string is read
+	    if(temp->digest != 0)
+	    {
+	    struct webcfg_token WEBCFG_MAP_DIGEST;
+
+            WEBCFG_MAP_DIGEST.name = "digest";
+            WEBCFG_MAP_DIGEST.length = strlen( "digest" );
+	    __msgpack_pack_string( &pk, WEBCFG_MAP_DIGEST.name, WEBCFG_MAP_DIGEST.length);
+            msgpack_pack_uint64(&pk, temp->digest);
+            }
+
 	    if(temp->root_string !=NULL)
 	    {
 	    struct webcfg_token WEBCFG_MAP_ROOTSTRING;
@@ -0,0 +1,523 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <base64.h>
+#include "webcfg.h"
+#include "webcfg_log.h"
+#include "webcfg_param.h"
+#include "webcfg_blob.h"
+#include "webcfg_db.h"
+#include "webcfg_request.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+//longest msgpack encoding of a uint16
+#define REQUEST_TRANSID_MAX	3
+//embedded doc bytes encoded per attempt, the unaligned tail plus the transaction_id
+#define REQUEST_TAIL_MAX	(2 + REQUEST_TRANSID_MAX)
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+//Decoded param of a doc version
+typedef struct request_param
+{
+	char *name;
+	char *value;			//scalar value, NULL for blobs
+	DATA_TYPE type;
+	char *blob;			//blob as received, NULL for scalars
+	size_t blob_size;
+	char *b64;			//base64 of the 3 byte aligned prefix of the embedded doc
+	size_t b64_len;
+	unsigned char tail[2];		//embedded doc bytes past the aligned prefix
+	size_t tail_size;
+} request_param_t;
+
+//Cached request of a doc version, shared by the requests built from it
+typedef struct request_tmpl
+{
+	char *docname;
+	uint32_t version;
+	int count;
+	int blob;
+	request_param_t *params;
+	int refs;			//requests built from it and not yet released
+	int cached;			//still reachable from the cache
+} request_tmpl_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static request_tmpl_t *g_request_cache[WEBCFG_REQUEST_CACHE_DOCS];
+static int g_request_cache_count = 0;
+static webcfg_request_t g_request_pool[WEBCFG_REQUEST_POOL_SIZE];
+static int g_request_pool_busy[WEBCFG_REQUEST_POOL_SIZE];
+pthread_mutex_t request_mut=PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static request_tmpl_t* createRequestTmpl(char *docname, uint32_t version, webcfgparam_t *pm);
+static void destroyRequestTmpl(request_tmpl_t *tmpl);
+static void cacheRequestTmpl(request_tmpl_t *tmpl);
+static void uncacheRequestTmpl(int index);
+static webcfg_request_t* acquireRequest();
+static WEBCFG_STATUS reserveRequest(webcfg_request_t *req, int count, size_t arena_size);
+static WEBCFG_STATUS fillRequest(webcfg_request_t *req, request_tmpl_t *tmpl, int with_trans_id);
+static REQUEST_BUILD_STATUS buildRequest(char *docname, uint32_t version, char *data, size_t data_size, webcfg_request_t **req, int with_trans_id);
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+REQUEST_BUILD_STATUS buildWebcfgRequest(char *docname, uint32_t version, char *data, size_t data_size, webcfg_request_t **req)
+{
+	return buildRequest(docname, version, data, data_size, req, 1);
+}
+
+REQUEST_BUILD_STATUS buildWebcfgProbeRequest(char *docname, uint32_t version, char *data, size_t data_size, webcfg_request_t **req)
+{
+	return buildRequest(docname, version, data, data_size, req, 0);
+}
+
+void releaseWebcfgRequest(webcfg_request_t *req)
+{
+	if(req == NULL)
+	{
+		return;
+	}
+	//a trans_id bound to its doc by updateTmpList stays with the doc
+	if(req->trans_id != 0)
+	{
+		releaseTransId(req->trans_id);
+	}
+	pthread_mutex_lock(&request_mut);
+	if(req->tmpl != NULL)
+	{
+		req->tmpl->refs--;
+		if(!req->tmpl->cached && req->tmpl->refs == 0)
+		{
+			destroyRequestTmpl(req->tmpl);
+		}
+		req->tmpl = NULL;
+	}
+	req->count = 0;
+	req->blob = 0;
+	req->trans_id = 0;
+	req->blob_name = NULL;
+	req->blob_data = NULL;
+	req->blob_size = 0;
+	if(req->pool_index >= 0)
+	{
+		if(req->arena_size > WEBCFG_REQUEST_ARENA_KEEP)
+		{
+			//keep the slot, drop the storage of a large blob
+			free(req->arena);
+			req->arena = NULL;
+			req->arena_size = 0;
+		}
+		g_request_pool_busy[req->pool_index] = 0;
+		pthread_mutex_unlock(&request_mut);
+		return;
+	}
+	pthread_mutex_unlock(&request_mut);
+	free(req->params);
+	free(req->arena);
+	free(req);
+}
+
+WEBCFG_STATUS checkRequestParams(const param_t *reqParam, int paramCount)
+{
+	int i = 0;
+
+	for (i = 0; i < paramCount; i++)
+	{
+		WebcfgDebug("reqParam[%d].name: %s\n",i,reqParam[i].name);
+		if(reqParam[i].name == NULL || strcmp(reqParam[i].name, "") == 0 || reqParam[i].value == NULL || strcmp(reqParam[i].value, "") == 0)
+		{
+			WebcfgError("Parameter name/value is null\n");
+			return WEBCFG_FAILURE;
+		}
+
+		if(strlen(reqParam[i].name) >= MAX_PARAMETERNAME_LEN)
+		{
+			return WEBCFG_FAILURE;
+		}
+	}
+	return WEBCFG_SUCCESS;
+}
+
+//Called when the doc leaves the mp cache, no retry can reuse it anymore.
+void dropWebcfgRequestCache(char *docname)
+{
+	int i = 0;
+
+	pthread_mutex_lock(&request_mut);
+	for(i = 0; i < g_request_cache_count; i++)
+	{
+		if(strcmp(g_request_cache[i]->docname, docname) == 0)
+		{
+			uncacheRequestTmpl(i);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&request_mut);
+}
+
+void clearWebcfgRequestCache()
+{
+	pthread_mutex_lock(&request_mut);
+	while(g_request_cache_count > 0)
+	{
+		uncacheRequestTmpl(g_request_cache_count - 1);
+	}
+	pthread_mutex_unlock(&request_mut);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+static request_tmpl_t* createRequestTmpl(char *docname, uint32_t version, webcfgparam_t *pm)
+{
+	request_tmpl_t *tmpl = NULL;
+	request_param_t *p = NULL;
+	wparam_t *e = NULL;
+	void *embedded = NULL;
+	size_t embedded_size = 0;
+	size_t aligned = 0;
+	int i = 0;
+
+	tmpl = (request_tmpl_t *) malloc(sizeof(request_tmpl_t));
+	if(tmpl == NULL)
+	{
+		return NULL;
+	}
+	memset(tmpl, 0, sizeof(request_tmpl_t));
+	tmpl->docname = strdup(docname);
+	tmpl->version = version;
+	tmpl->count = (int)pm->entries_count;
+	tmpl->params = (request_param_t *) calloc(pm->entries_count ? pm->entries_count : 1, sizeof(request_param_t));
+	if(tmpl->docname == NULL || tmpl->params == NULL)
+	{
+		destroyRequestTmpl(tmpl);
+		return NULL;
+	}
+	WebcfgDebug("paramCount is %d\n", tmpl->count);
+
+	for(i = 0; i < tmpl->count; i++)
+	{
+		e = &pm->entries[i];
+		p = &tmpl->params[i];
+		if(e->name == NULL || e->value == NULL || strcmp(e->name, "") == 0 || strlen(e->name) >= MAX_PARAMETERNAME_LEN)
+		{
+			WebcfgError("Parameter name/value is null\n");
+			destroyRequestTmpl(tmpl);
+			return NULL;
+		}
+		p->name = strdup(e->name);
+		p->type = e->type;
+		if(e->type == WDMP_BLOB)
+		{
+			embedded_size = webcfg_appenddoc_prefix(docname, version, e->value, e->value_size, &embedded);
+			if(embedded_size == 0)
+			{
+				destroyRequestTmpl(tmpl);
+				return NULL;
+			}
+			//the prefix is encoded once, only the tail changes with the transaction_id
+			aligned = embedded_size - (embedded_size % 3);
+			p->tail_size = embedded_size - aligned;
+			memcpy(p->tail, (char *)embedded + aligned, p->tail_size);
+			p->b64 = base64blobencoder((char *)embedded, aligned);
+			p->b64_len = (p->b64 != NULL) ? strlen(p->b64) : 0;
+			free(embedded);
+			embedded = NULL;
+			p->blob = malloc(e->value_size);
+			if(p->b64 == NULL || p->blob == NULL)
+			{
+				destroyRequestTmpl(tmpl);
+				return NULL;
+			}
+			memcpy(p->blob, e->value, e->value_size);
+			p->blob_size = e->value_size;
+			tmpl->blob = 1;
+		}
+		else
+		{
+			if(strcmp(e->value, "") == 0)
+			{
+				WebcfgError("Parameter name/value is null\n");
+				destroyRequestTmpl(tmpl);
+				return NULL;
+			}
+			p->value = strdup(e->value);
+		}
+	}
+	return tmpl;
+}
+
+static void destroyRequestTmpl(request_tmpl_t *tmpl)
+{
+	int i = 0;
+
+	if(tmpl->params != NULL)
+	{
+		for(i = 0; i < tmpl->count; i++)
+		{
+			free(tmpl->params[i].name);
+			free(tmpl->params[i].value);
+			free(tmpl->params[i].blob);
+			free(tmpl->params[i].b64);
+		}
+		free(tmpl->params);
+	}
+	free(tmpl->docname);
+	free(tmpl);
+}
+
+//Called with request_mut held, a doc keeps only its latest version.
+static void cacheRequestTmpl(request_tmpl_t *tmpl)
+{
+	int i = 0;
+
+	for(i = 0; i < g_request_cache_count; i++)
+	{
+		if(strcmp(g_request_cache[i]->docname, tmpl->docname) == 0)
+		{
+			uncacheRequestTmpl(i);
+			break;
+		}
+	}
+	if(g_request_cache_count == WEBCFG_REQUEST_CACHE_DOCS)
+	{
+		uncacheRequestTmpl(0);
+	}
+	tmpl->cached = 1;
+	g_request_cache[g_request_cache_count++] = tmpl;
+}
+
+//Called with request_mut held.
+static void uncacheRequestTmpl(int index)
+{
+	request_tmpl_t *tmpl = g_request_cache[index];
+
+	memmove(&g_request_cache[index], &g_request_cache[index + 1], sizeof(request_tmpl_t *) * (g_request_cache_count - index - 1));
+	g_request_cache_count--;
+	tmpl->cached = 0;
+	if(tmpl->refs == 0)
+	{
+		destroyRequestTmpl(tmpl);
+	}
+}
+
+static webcfg_request_t* acquireRequest()
+{
+	webcfg_request_t *req = NULL;
+	int i = 0;
+
+	pthread_mutex_lock(&request_mut);
+	for(i = 0; i < WEBCFG_REQUEST_POOL_SIZE; i++)
+	{
+		if(!g_request_pool_busy[i])
+		{
+			g_request_pool_busy[i] = 1;
+			req = &g_request_pool[i];
+			req->pool_index = i;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&request_mut);
+	if(req == NULL)
+	{
+		req = (webcfg_request_t *) malloc(sizeof(webcfg_request_t));
+		if(req != NULL)
+		{
+			memset(req, 0, sizeof(webcfg_request_t));
+			req->pool_index = -1;
+		}
+	}
+	return req;
+}
+
+static WEBCFG_STATUS reserveRequest(webcfg_request_t *req, int count, size_t arena_size)
+{
+	param_t *params = NULL;
+	char *arena = NULL;
+
+	if(count > req->capacity)
+	{
+		params = (param_t *) realloc(req->params, sizeof(param_t) * count);
+		if(params == NULL)
+		{
+			return WEBCFG_FAILURE;
+		}
+		req->params = params;
+		req->capacity = count;
+	}
+	if(arena_size > req->arena_size)
+	{
+		arena = (char *) realloc(req->arena, arena_size);
+		if(arena == NULL)
+		{
+			return WEBCFG_FAILURE;
+		}
+		req->arena = arena;
+		req->arena_size = arena_size;
+	}
+	return WEBCFG_SUCCESS;
+}
+
+static REQUEST_BUILD_STATUS buildRequest(char *docname, uint32_t version, char *data, size_t data_size, webcfg_request_t **req, int with_trans_id)
+{
+	request_tmpl_t *tmpl = NULL;
+	webcfgparam_t *pm = NULL;
+	webcfg_request_t *r = NULL;
+	int i = 0;
+
+	*req = NULL;
+	pthread_mutex_lock(&request_mut);
+	for(i = 0; i < g_request_cache_count; i++)
+	{
+		if(strcmp(g_request_cache[i]->docname, docname) == 0 && g_request_cache[i]->version == version)
+		{
+			tmpl = g_request_cache[i];
+			tmpl->refs++;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&request_mut);
+
+	if(tmpl == NULL)
+	{
+		WebcfgDebug("--------------decode root doc-------------\n");
+		pm = webcfgparam_convert( data, data_size+1 );
+		if(pm == NULL)
+		{
+			return REQUEST_DECODE_FAILURE;
+		}
+		tmpl = createRequestTmpl(docname, version, pm);
+		webcfgparam_destroy( pm );
+		if(tmpl == NULL)
+		{
+			return REQUEST_INVALID_PARAM;
+		}
+		pthread_mutex_lock(&request_mut);
+		tmpl->refs = 1;
+		cacheRequestTmpl(tmpl);
+		pthread_mutex_unlock(&request_mut);
+	}
+	else
+	{
+		WebcfgDebug("Reusing prepared request of %s version %lu\n", docname, (long)version);
+	}
+
+	r = acquireRequest();
+	if(r == NULL || fillRequest(r, tmpl, with_trans_id) != WEBCFG_SUCCESS)
+	{
+		WebcfgError("Failed to build request of %s\n", docname);
+		if(r != NULL)
+		{
+			r->tmpl = tmpl;
+			releaseWebcfgRequest(r);
+		}
+		else
+		{
+			pthread_mutex_lock(&request_mut);
+			tmpl->refs--;
+			if(!tmpl->cached && tmpl->refs == 0)
+			{
+				destroyRequestTmpl(tmpl);
+			}
+			pthread_mutex_unlock(&request_mut);
+		}
+		return REQUEST_INVALID_PARAM;
+	}
+	*req = r;
+	return REQUEST_BUILD_SUCCESS;
+}
+
+static WEBCFG_STATUS fillRequest(webcfg_request_t *req, request_tmpl_t *tmpl, int with_trans_id)
+{
+	request_param_t *p = NULL;
+	unsigned char tail[REQUEST_TAIL_MAX];
+	size_t tail_size = 0;
+	size_t need = 0;
+	char *dst = NULL;
+	int i = 0;
+
+	req->tmpl = tmpl;
+	for(i = 0; i < tmpl->count; i++)
+	{
+		p = &tmpl->params[i];
+		need += strlen(p->name) + 1;
+		if(p->blob != NULL)
+		{
+			need += p->b64_len + b64_get_encoded_buffer_size(REQUEST_TAIL_MAX) + 1;
+		}
+		else
+		{
+			need += strlen(p->value) + 1;
+		}
+	}
+	if(reserveRequest(req, tmpl->count, need) != WEBCFG_SUCCESS)
+	{
+		return WEBCFG_FAILURE;
+	}
+	//one transaction_id per attempt, events are matched against it
+	req->trans_id = (tmpl->blob && with_trans_id) ? allocateTransId() : 0;
+	req->blob = tmpl->blob;
+	req->count = tmpl->count;
+
+	dst = req->arena;
+	for(i = 0; i < tmpl->count; i++)
+	{
+		p = &tmpl->params[i];
+		req->params[i].name = dst;
+		strcpy(dst, p->name);
+		dst += strlen(p->name) + 1;
+		req->params[i].value = dst;
+		if(p->blob != NULL)
+		{
+			memcpy(tail, p->tail, p->tail_size);
+			tail_size = p->tail_size + webcfg_pack_transid(req->trans_id, tail + p->tail_size, REQUEST_TRANSID_MAX);
+			memcpy(dst, p->b64, p->b64_len);
+			dst += p->b64_len;
+			b64_encode(tail, tail_size, (uint8_t *)dst);
+			dst += b64_get_encoded_buffer_size(tail_size);
+			*dst++ = '\0';
+			req->params[i].type = WDMP_BASE64;
+			if(req->blob_data == NULL)
+			{
+				req->blob_name = p->name;
+				req->blob_data = p->blob;
+				req->blob_size = p->blob_size;
+			}
+		}
+		else
+		{
+			strcpy(dst, p->value);
+			dst += strlen(p->value) + 1;
+			req->params[i].type = p->type;
+		}
+		WebcfgInfo("Request:> param[%d].name = %s, type = %d\n",i,req->params[i].name,req->params[i].type);
+		WebcfgDebug("Request:> param[%d].value = %s\n",i,req->params[i].value);
+	}
+	return WEBCFG_SUCCESS;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBCFG_REQUEST_H__
+#define __WEBCFG_REQUEST_H__
+
+#include <stdint.h>
+#include <wdmp-c.h>
+#include "webcfg.h"
+#include "webcfg_apply.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define MAX_PARAMETERNAME_LEN		4096
+//apply workers plus the retry and aker paths
+#define WEBCFG_REQUEST_POOL_SIZE	(WEBCFG_APPLY_MAX_WORKERS + 2)
+#define WEBCFG_REQUEST_CACHE_DOCS	64
+//larger string storage is freed on release instead of kept in the pool
+#define WEBCFG_REQUEST_ARENA_KEEP	(64 * 1024)
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef enum
+{
+    REQUEST_BUILD_SUCCESS = 0,
+    REQUEST_DECODE_FAILURE,	//errno holds the webcfgparam error
+    REQUEST_INVALID_PARAM
+} REQUEST_BUILD_STATUS;
+
+struct request_tmpl;
+
+//setValues request of one doc version, owned by the builder until released
+typedef struct webcfg_request
+{
+	param_t *params;
+	int count;
+	int blob;			//params carry appended blobs
+	uint16_t trans_id;		//allocated for this attempt, 0 for scalar docs
+	char *blob_name;		//first blob param as received, for aker
+	char *blob_data;
+	size_t blob_size;
+	int capacity;
+	char *arena;			//name and value storage of params
+	size_t arena_size;
+	int pool_index;			//-1 when allocated outside the pool
+	struct request_tmpl *tmpl;
+} webcfg_request_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/**
+ *  Builds the setValues request of a doc version. The decoded params and the
+ *  base64 of blobs are cached per (doc, version), so a retry only encodes the
+ *  new transaction_id.
+ *
+ *  @param docname   the subdoc name
+ *  @param version   the subdoc version
+ *  @param data      msgpack of the subdoc, not read on a cache hit
+ *  @param data_size size of data
+ *  @param req       the built request, release with releaseWebcfgRequest
+ *
+ *  @return REQUEST_BUILD_SUCCESS or the failure reason
+ */
+REQUEST_BUILD_STATUS buildWebcfgRequest(char *docname, uint32_t version, char *data, size_t data_size, webcfg_request_t **req);
+
+/**
+ *  As buildWebcfgRequest without reserving a transaction_id, trans_id is 0.
+ *  For requests which are only inspected, never sent.
+ */
+REQUEST_BUILD_STATUS buildWebcfgProbeRequest(char *docname, uint32_t version, char *data, size_t data_size, webcfg_request_t **req);
+
+/**
+ *  Returns the request to the pool. Its trans_id is released unless
+ *  updateTmpList has bound it to the doc meanwhile.
+ */
+void releaseWebcfgRequest(webcfg_request_t *req);
+WEBCFG_STATUS checkRequestParams(const param_t *reqParam, int paramCount);
+void dropWebcfgRequestCache(char *docname);
+void clearWebcfgRequestCache();
+#endif
@@ -0,0 +1,639 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <wdmp-c.h>
+#include "webcfg.h"
+#include "webcfg_log.h"
+#include "webcfg_db.h"
+#include "webcfg_generic.h"
+#include "webcfg_request.h"
+#include "webcfg_rollback.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define LASTGOOD_MAGIC		"WLG1"
+#define LASTGOOD_TMP_SUFFIX	".tmp"
+#define LZ_HASH_LOG		12
+#define LZ_HASH_SIZE		(1 << LZ_HASH_LOG)
+#define LZ_MAX_LIT		32
+#define LZ_MAX_OFF		(1 << 13)
+#define LZ_MAX_REF		((1 << 8) + (1 << 3))
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+//File header, the payload follows compressed unless comp_size is 0
+typedef struct lastgood_hdr
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t raw_size;
+	uint32_t comp_size;
+	uint64_t digest;		//xxhash64 of the raw payload
+} lastgood_hdr_t;
+
+typedef struct lastgood_entry
+{
+	char name[WEBCFG_LASTGOOD_NAME_SIZE];
+	uint32_t version;
+	uint64_t digest;
+	size_t file_size;
+	uint64_t seq;			//save order, the lowest is evicted first
+	uint32_t rollback_from;		//failed version already rolled back
+} lastgood_entry_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static lastgood_entry_t g_lastgood[WEBCFG_LASTGOOD_MAX_DOCS];
+static int g_lastgood_count = 0;
+static int g_lastgood_loaded = 0;
+static size_t g_lastgood_bytes = 0;
+static uint64_t g_lastgood_seq = 0;
+static int g_local_rollback = 0;
+pthread_mutex_t lastgood_mut=PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static void loadLastGoodIndex();
+static lastgood_entry_t* getLastGoodEntry(const char *docname);
+static void dropLastGoodEntry(lastgood_entry_t *entry);
+static void getLastGoodPath(const char *docname, char *path, size_t len);
+static WEBCFG_STATUS writeLastGoodFile(const char *docname, lastgood_hdr_t *hdr, const void *body, size_t body_size);
+static uint32_t lzHash(const uint8_t *p);
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+WEBCFG_STATUS saveLastGoodPayload(char *docname, uint32_t version, const char *data, size_t size)
+{
+	lastgood_entry_t *entry = NULL;
+	lastgood_entry_t *oldest = NULL;
+	lastgood_hdr_t hdr;
+	uint8_t *comp = NULL;
+	size_t comp_size = 0;
+	size_t file_size = 0;
+	uint64_t digest = 0;
+	int i = 0;
+
+	if(docname == NULL || data == NULL || size == 0 || size > UINT32_MAX || strlen(docname) >= WEBCFG_LASTGOOD_NAME_SIZE)
+	{
+		return WEBCFG_FAILURE;
+	}
+	digest = xxhash64(data, size, 0);
+	pthread_mutex_lock(&lastgood_mut);
+	loadLastGoodIndex();
+	entry = getLastGoodEntry(docname);
+	if(entry != NULL && entry->version == version && entry->digest == digest)
+	{
+		pthread_mutex_unlock(&lastgood_mut);
+		return WEBCFG_SUCCESS;
+	}
+	pthread_mutex_unlock(&lastgood_mut);
+
+	comp = (uint8_t *) malloc(size);
+	if(comp != NULL)
+	{
+		//stored as is when compression does not shrink it
+		comp_size = compressPayload((const uint8_t *)data, size, comp, size);
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LASTGOOD_MAGIC, sizeof(hdr.magic));
+	hdr.version = version;
+	hdr.raw_size = (uint32_t)size;
+	hdr.comp_size = (uint32_t)comp_size;
+	hdr.digest = digest;
+	file_size = sizeof(hdr) + (comp_size ? comp_size : size);
+
+	pthread_mutex_lock(&lastgood_mut);
+	entry = getLastGoodEntry(docname);
+	if(file_size > WEBCFG_LASTGOOD_MAX_BYTES)
+	{
+		//an older payload is not the last good one anymore
+		WebcfgError("%s version %lu of %zu bytes exceeds the last good cache\n", docname, (long)version, file_size);
+		dropLastGoodEntry(entry);
+		pthread_mutex_unlock(&lastgood_mut);
+		if(comp != NULL)
+		{
+			WEBCFG_FREE(comp);
+		}
+		return WEBCFG_FAILURE;
+	}
+	if(entry != NULL)
+	{
+		g_lastgood_bytes -= entry->file_size;
+		entry->file_size = 0;
+	}
+	while((entry == NULL && g_lastgood_count == WEBCFG_LASTGOOD_MAX_DOCS) || g_lastgood_bytes + file_size > WEBCFG_LASTGOOD_MAX_BYTES)
+	{
+		oldest = NULL;
+		for(i = 0; i < g_lastgood_count; i++)
+		{
+			if(&g_lastgood[i] != entry && (oldest == NULL || g_lastgood[i].seq < oldest->seq))
+			{
+				oldest = &g_lastgood[i];
+			}
+		}
+		if(oldest == NULL)
+		{
+			break;
+		}
+		WebcfgInfo("Evicting last good payload of %s\n", oldest->name);
+		//entries move down on drop
+		if(entry != NULL && entry > oldest)
+		{
+			entry--;
+		}
+		dropLastGoodEntry(oldest);
+	}
+
+	if(writeLastGoodFile(docname, &hdr, comp_size ? (const void *)comp : (const void *)data, file_size - sizeof(hdr)) != WEBCFG_SUCCESS)
+	{
+		dropLastGoodEntry(entry);
+		pthread_mutex_unlock(&lastgood_mut);
+		if(comp != NULL)
+		{
+			WEBCFG_FREE(comp);
+		}
+		return WEBCFG_FAILURE;
+	}
+	if(entry == NULL)
+	{
+		entry = &g_lastgood[g_lastgood_count++];
+		memset(entry, 0, sizeof(lastgood_entry_t));
+		strncpy(entry->name, docname, WEBCFG_LASTGOOD_NAME_SIZE-1);
+	}
+	entry->version = version;
+	entry->digest = digest;
+	entry->file_size = file_size;
+	entry->seq = ++g_lastgood_seq;
+	entry->rollback_from = 0;
+	g_lastgood_bytes += file_size;
+	pthread_mutex_unlock(&lastgood_mut);
+	WebcfgDebug("Cached last good %s version %lu, %zu of %zu bytes\n", docname, (long)version, file_size, size);
+	if(comp != NULL)
+	{
+		WEBCFG_FREE(comp);
+	}
+	return WEBCFG_SUCCESS;
+}
+
+WEBCFG_STATUS loadLastGoodPayload(char *docname, uint32_t *version, char **data, size_t *size)
+{
+	char path[256] = {'\0'};
+	lastgood_entry_t *entry = NULL;
+	lastgood_hdr_t hdr;
+	uint8_t *body = NULL;
+	char *raw = NULL;
+	size_t body_size = 0;
+	FILE *fp = NULL;
+	WEBCFG_STATUS rv = WEBCFG_FAILURE;
+
+	*data = NULL;
+	*size = 0;
+	memset(&hdr, 0, sizeof(hdr));
+	pthread_mutex_lock(&lastgood_mut);
+	loadLastGoodIndex();
+	entry = getLastGoodEntry(docname);
+	if(entry == NULL)
+	{
+		pthread_mutex_unlock(&lastgood_mut);
+		return WEBCFG_FAILURE;
+	}
+	getLastGoodPath(docname, path, sizeof(path));
+	fp = fopen(path, "rb");
+	if(fp != NULL && fread(&hdr, sizeof(hdr), 1, fp) == 1 && memcmp(hdr.magic, LASTGOOD_MAGIC, sizeof(hdr.magic)) == 0 && hdr.raw_size > 0)
+	{
+		body_size = hdr.comp_size ? hdr.comp_size : hdr.raw_size;
+		body = (uint8_t *) malloc(body_size);
+		raw = (char *) malloc(hdr.raw_size + 1);
+		if(body != NULL && raw != NULL && fread(body, 1, body_size, fp) == body_size)
+		{
+			if(hdr.comp_size == 0)
+			{
+				memcpy(raw, body, body_size);
+				rv = WEBCFG_SUCCESS;
+			}
+			else if(decompressPayload(body, body_size, (uint8_t *)raw, hdr.raw_size) == hdr.raw_size)
+			{
+				rv = WEBCFG_SUCCESS;
+			}
+		}
+		if(rv == WEBCFG_SUCCESS && xxhash64(raw, hdr.raw_size, 0) != hdr.digest)
+		{
+			rv = WEBCFG_FAILURE;
+		}
+	}
+	if(fp != NULL)
+	{
+		fclose(fp);
+	}
+	if(body != NULL)
+	{
+		WEBCFG_FREE(body);
+	}
+	if(rv != WEBCFG_SUCCESS)
+	{
+		WebcfgError("Last good payload of %s is corrupted, dropped\n", docname);
+		dropLastGoodEntry(entry);
+		pthread_mutex_unlock(&lastgood_mut);
+		if(raw != NULL)
+		{
+			WEBCFG_FREE(raw);
+		}
+		return WEBCFG_FAILURE;
+	}
+	pthread_mutex_unlock(&lastgood_mut);
+	raw[hdr.raw_size] = '\0';
+	*version = hdr.version;
+	*data = raw;
+	*size = hdr.raw_size;
+	return WEBCFG_SUCCESS;
+}
+
+void removeLastGoodPayload(char *docname)
+{
+	pthread_mutex_lock(&lastgood_mut);
+	loadLastGoodIndex();
+	dropLastGoodEntry(getLastGoodEntry(docname));
+	pthread_mutex_unlock(&lastgood_mut);
+}
+
+void clearLastGoodCache()
+{
+	pthread_mutex_lock(&lastgood_mut);
+	loadLastGoodIndex();
+	while(g_lastgood_count > 0)
+	{
+		dropLastGoodEntry(&g_lastgood[g_lastgood_count - 1]);
+	}
+	pthread_mutex_unlock(&lastgood_mut);
+}
+
+WEBCFG_STATUS rollbackSubdoc(char *docname, uint32_t failed_version)
+{
+	lastgood_entry_t *entry = NULL;
+	webcfg_request_t *req = NULL;
+	char *data = NULL;
+	size_t size = 0;
+	uint32_t version = 0;
+	WDMP_STATUS ret = WDMP_FAILURE;
+	int ccspStatus = 0;
+
+	if(!g_local_rollback || docname == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	//aker blobs are sent through its own path, the cloud restores aker
+	if(strcmp(docname, "aker") == 0)
+	{
+		return WEBCFG_FAILURE;
+	}
+	pthread_mutex_lock(&lastgood_mut);
+	loadLastGoodIndex();
+	entry = getLastGoodEntry(docname);
+	if(entry == NULL || entry->version == failed_version || entry->rollback_from == failed_version)
+	{
+		pthread_mutex_unlock(&lastgood_mut);
+		WebcfgInfo("No local rollback of %s version %lu\n", docname, (long)failed_version);
+		return WEBCFG_FAILURE;
+	}
+	entry->rollback_from = failed_version;
+	pthread_mutex_unlock(&lastgood_mut);
+
+	if(loadLastGoodPayload(docname, &version, &data, &size) != WEBCFG_SUCCESS)
+	{
+		return WEBCFG_FAILURE;
+	}
+	if(buildWebcfgRequest(docname, version, data, size, &req) != REQUEST_BUILD_SUCCESS)
+	{
+		WebcfgError("Failed to build last good request of %s version %lu\n", docname, (long)version);
+		WEBCFG_FREE(data);
+		return WEBCFG_FAILURE;
+	}
+	WEBCFG_FREE(data);
+	/* The blob carries a fresh reserved trans_id that no tmp node owns, so
+	component events of the rollback never resolve the failed version. The
+	id is freed with the request. */
+	WebcfgInfo("Rolling back %s from version %lu to last good version %lu\n", docname, (long)failed_version, (long)version);
+	setValues(req->params, req->count, ATOMIC_SET_WEBCONFIG, NULL, NULL, &ret, &ccspStatus);
+	releaseWebcfgRequest(req);
+	if(ret != WDMP_SUCCESS)
+	{
+		WebcfgError("Rollback of %s to version %lu failed. ccspStatus : %d\n", docname, (long)version, ccspStatus);
+		return WEBCFG_FAILURE;
+	}
+	WebcfgInfo("Rollback of %s to version %lu is success\n", docname, (long)version);
+	return WEBCFG_SUCCESS;
+}
+
+void setLocalRollback(int enable)
+{
+	g_local_rollback = enable;
+}
+
+int isLocalRollbackEnabled()
+{
+	return g_local_rollback;
+}
+
+size_t compressPayload(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+	uint32_t htab[LZ_HASH_SIZE];
+	size_t ip = 0, op = 1, lit = 0;
+	size_t ref = 0, off = 0, len = 0, maxlen = 0;
+	uint32_t h = 0;
+
+	if(in_len == 0 || out_len < 2)
+	{
+		return 0;
+	}
+	memset(htab, 0xff, sizeof(htab));
+	//out[op - lit - 1] is the length byte of the open literal run
+	while(ip < in_len)
+	{
+		if(ip + 2 < in_len)
+		{
+			h = lzHash(in + ip);
+			ref = htab[h];
+			htab[h] = (uint32_t)ip;
+			if(ref < ip && (off = ip - ref - 1) < LZ_MAX_OFF && memcmp(in + ref, in + ip, 3) == 0)
+			{
+				maxlen = in_len - ip;
+				if(maxlen > LZ_MAX_REF)
+				{
+					maxlen = LZ_MAX_REF;
+				}
+				len = 3;
+				while(len < maxlen && in[ref + len] == in[ip + len])
+				{
+					len++;
+				}
+				if(lit)
+				{
+					out[op - lit - 1] = (uint8_t)(lit - 1);
+				}
+				else
+				{
+					op--;
+				}
+				if(op + 4 > out_len)
+				{
+					return 0;
+				}
+				if(len - 2 < 7)
+				{
+					out[op++] = (uint8_t)((off >> 8) + ((len - 2) << 5));
+				}
+				else
+				{
+					out[op++] = (uint8_t)((off >> 8) + (7 << 5));
+					out[op++] = (uint8_t)(len - 2 - 7);
+				}
+				out[op++] = (uint8_t)(off & 0xff);
+				ip += len;
+				lit = 0;
+				op++;
+				continue;
+			}
+		}
+		if(op >= out_len)
+		{
+			return 0;
+		}
+		out[op++] = in[ip++];
+		lit++;
+		if(lit == LZ_MAX_LIT)
+		{
+			out[op - lit - 1] = (uint8_t)(lit - 1);
+			lit = 0;
+			op++;
+			if(op > out_len)
+			{
+				return 0;
+			}
+		}
+	}
+	if(lit)
+	{
+		out[op - lit - 1] = (uint8_t)(lit - 1);
+	}
+	else
+	{
+		op--;
+	}
+	return op;
+}
+
+size_t decompressPayload(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+	size_t ip = 0, op = 0;
+	size_t len = 0, off = 0;
+	uint8_t ctrl = 0;
+
+	while(ip < in_len)
+	{
+		ctrl = in[ip++];
+		if(ctrl < LZ_MAX_LIT)
+		{
+			len = (size_t)ctrl + 1;
+			if(ip + len > in_len || op + len > out_len)
+			{
+				return 0;
+			}
+			memcpy(out + op, in + ip, len);
+			ip += len;
+			op += len;
+			continue;
+		}
+		len = ctrl >> 5;
+		if(len == 7)
+		{
+			if(ip >= in_len)
+			{
+				return 0;
+			}
+			len += in[ip++];
+		}
+		if(ip >= in_len)
+		{
+			return 0;
+		}
+		off = ((size_t)(ctrl & 0x1f) << 8) | in[ip++];
+		len += 2;
+		if(off + 1 > op || op + len > out_len)
+		{
+			return 0;
+		}
+		//the reference may overlap the bytes being written
+		for(; len > 0; len--, op++)
+		{
+			out[op] = out[op - off - 1];
+		}
+	}
+	return op;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+//Called with lastgood_mut held, rebuilds the index from the cache dir once per boot.
+static void loadLastGoodIndex()
+{
+	char path[256] = {'\0'};
+	lastgood_entry_t *entry = NULL;
+	lastgood_hdr_t hdr;
+	struct dirent *de = NULL;
+	struct stat st;
+	DIR *dir = NULL;
+	FILE *fp = NULL;
+	size_t name_len = 0;
+	size_t suffix_len = strlen(WEBCFG_LASTGOOD_SUFFIX);
+
+	if(g_lastgood_loaded)
+	{
+		return;
+	}
+	g_lastgood_loaded = 1;
+	if(mkdir(WEBCFG_LASTGOOD_DIR, 0700) != 0 && errno != EEXIST)
+	{
+		WebcfgError("Failed to create %s: %s\n", WEBCFG_LASTGOOD_DIR, strerror(errno));
+		return;
+	}
+	dir = opendir(WEBCFG_LASTGOOD_DIR);
+	if(dir == NULL)
+	{
+		return;
+	}
+	while((de = readdir(dir)) != NULL)
+	{
+		name_len = strlen(de->d_name);
+		if(name_len <= suffix_len || name_len - suffix_len >= WEBCFG_LASTGOOD_NAME_SIZE || strcmp(de->d_name + name_len - suffix_len, WEBCFG_LASTGOOD_SUFFIX) != 0)
+		{
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", WEBCFG_LASTGOOD_DIR, de->d_name);
+		fp = fopen(path, "rb");
+		if(fp == NULL)
+		{
+			continue;
+		}
+		if(fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, LASTGOOD_MAGIC, sizeof(hdr.magic)) != 0 || fstat(fileno(fp), &st) != 0 || g_lastgood_count == WEBCFG_LASTGOOD_MAX_DOCS || g_lastgood_bytes + (size_t)st.st_size > WEBCFG_LASTGOOD_MAX_BYTES)
+		{
+			fclose(fp);
+			unlink(path);
+			continue;
+		}
+		fclose(fp);
+		entry = &g_lastgood[g_lastgood_count++];
+		memset(entry, 0, sizeof(lastgood_entry_t));
+		strncpy(entry->name, de->d_name, name_len - suffix_len);
+		entry->version = hdr.version;
+		entry->digest = hdr.digest;
+		entry->file_size = (size_t)st.st_size;
+		entry->seq = (uint64_t)st.st_mtime;
+		g_lastgood_bytes += entry->file_size;
+		if(entry->seq > g_lastgood_seq)
+		{
+			g_lastgood_seq = entry->seq;
+		}
+	}
+	closedir(dir);
+	WebcfgInfo("Loaded %d last good payloads, %zu bytes\n", g_lastgood_count, g_lastgood_bytes);
+}
+
+static lastgood_entry_t* getLastGoodEntry(const char *docname)
+{
+	int i = 0;
+
+	for(i = 0; i < g_lastgood_count; i++)
+	{
+		if(strcmp(g_lastgood[i].name, docname) == 0)
+		{
+			return &g_lastgood[i];
+		}
+	}
+	return NULL;
+}
+
+//Called with lastgood_mut held, removes the file and compacts the index.
+static void dropLastGoodEntry(lastgood_entry_t *entry)
+{
+	char path[256] = {'\0'};
+	int index = 0;
+
+	if(entry == NULL)
+	{
+		return;
+	}
+	getLastGoodPath(entry->name, path, sizeof(path));
+	unlink(path);
+	g_lastgood_bytes -= entry->file_size;
+	index = (int)(entry - g_lastgood);
+	memmove(&g_lastgood[index], &g_lastgood[index + 1], sizeof(lastgood_entry_t) * (g_lastgood_count - index - 1));
+	g_lastgood_count--;
+}
+
+static void getLastGoodPath(const char *docname, char *path, size_t len)
+{
+	snprintf(path, len, "%s/%s%s", WEBCFG_LASTGOOD_DIR, docname, WEBCFG_LASTGOOD_SUFFIX);
+}
+
+//Writes a tmp file first so a power cut never leaves a partial payload.
+static WEBCFG_STATUS writeLastGoodFile(const char *docname, lastgood_hdr_t *hdr, const void *body, size_t body_size)
+{
+	char path[256] = {'\0'};
+	char tmp_path[256] = {'\0'};
+	FILE *fp = NULL;
+	int ok = 0;
+
+	getLastGoodPath(docname, path, sizeof(path));
+	snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, LASTGOOD_TMP_SUFFIX);
+	fp = fopen(tmp_path, "wb");
+	if(fp == NULL)
+	{
+		WebcfgError("Failed to open %s: %s\n", tmp_path, strerror(errno));
+		return WEBCFG_FAILURE;
+	}
+	ok = (fwrite(hdr, sizeof(lastgood_hdr_t), 1, fp) == 1) && (fwrite(body, 1, body_size, fp) == body_size);
+	if(fclose(fp) != 0)
+	{
+		ok = 0;
+	}
+	if(!ok || rename(tmp_path, path) != 0)
+	{
+		WebcfgError("Failed to write last good payload of %s\n", docname);
+		unlink(tmp_path);
+		return WEBCFG_FAILURE;
+	}
+	return WEBCFG_SUCCESS;
+}
+
+static uint32_t lzHash(const uint8_t *p)
+{
+	uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+
+	return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBCFG_ROLLBACK_H__
+#define __WEBCFG_ROLLBACK_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "webcfg.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#ifdef BUILD_YOCTO
+#if defined(RDK_PERSISTENT_PATH_VIDEO)
+#define WEBCFG_LASTGOOD_DIR		"/opt/webconfig_lastgood"
+#else
+#define WEBCFG_LASTGOOD_DIR		"/nvram/webconfig_lastgood"
+#endif
+#else
+#define WEBCFG_LASTGOOD_DIR		"/tmp/webconfig_lastgood"
+#endif
+#define WEBCFG_LASTGOOD_SUFFIX		".lgc"
+#define WEBCFG_LASTGOOD_MAX_DOCS	32
+//header and compressed payload of all docs, the oldest saved doc is evicted first
+#define WEBCFG_LASTGOOD_MAX_BYTES	(256 * 1024)
+#define WEBCFG_LASTGOOD_NAME_SIZE	64
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/**
+ *  Stores the msgpack of a successfully applied subdoc version, replacing the
+ *  previous one of the doc. Nothing is written when the same content is cached.
+ *
+ *  @param docname the subdoc name
+ *  @param version the applied version
+ *  @param data    msgpack of the subdoc
+ *  @param size    size of data
+ *
+ *  @return WEBCFG_SUCCESS when the payload is cached
+ */
+WEBCFG_STATUS saveLastGoodPayload(char *docname, uint32_t version, const char *data, size_t size);
+
+/**
+ *  Reads back the cached payload of a subdoc.
+ *
+ *  @param docname the subdoc name
+ *  @param version version of the cached payload
+ *  @param data    the payload, caller frees
+ *  @param size    size of data
+ *
+ *  @return WEBCFG_FAILURE when nothing is cached or the file is corrupted
+ */
+WEBCFG_STATUS loadLastGoodPayload(char *docname, uint32_t *version, char **data, size_t *size);
+void removeLastGoodPayload(char *docname);
+void clearLastGoodCache();
+
+/**
+ *  Re-applies the cached last good payload of a doc whose new version failed,
+ *  once per failed version. Only done when local rollback is enabled.
+ *
+ *  @param docname        the subdoc name
+ *  @param failed_version the version NACKed or expired
+ *
+ *  @return WEBCFG_SUCCESS when the last good payload is set again
+ */
+WEBCFG_STATUS rollbackSubdoc(char *docname, uint32_t failed_version);
+void setLocalRollback(int enable);
+int isLocalRollbackEnabled();
+
+//LZF style codec of the cache files, both return 0 when out is too small or in is corrupted
+size_t compressPayload(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+size_t decompressPayload(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+#endif
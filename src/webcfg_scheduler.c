@@ -0,0 +1,612 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "webcfg.h"
+#include "webcfg_log.h"
+#include "webcfg_generic.h"
+#include "webcfg_metadata.h"
+#include "webcfg_timer.h"
+#include "webcfg_scheduler.h"
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+//min heap on deadline, type and seq, guarded by the sync mutex
+static sync_job_t g_jobs[WEBCFG_SYNC_MAX_JOBS];
+static int g_job_count = 0;
+static uint32_t g_job_seq = 0;
+static webcfg_timer_t g_sched_timer;
+//wall clock time the maintenance sync is planned at, owned by the sync thread
+static time_t g_maintenance_target = 0;
+//backoff state of failed docs, guarded by the sync mutex
+static doc_retry_t g_retries[WEBCFG_SYNC_MAX_JOBS];
+static int g_retry_count = 0;
+static uint32_t g_poke_window_ms = WEBCFG_POKE_WINDOW_MS;
+//poke transaction of the job being dispatched
+static char g_sync_trans_id[WEBCFG_SYNC_TRANSID_SIZE];
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static int queueJobLocked(SYNC_JOB_TYPE type, const char *doc, int forced, uint32_t delay_ms, const char *trans_id);
+static int requestForceSyncLocked(char *doc, char *trans_id);
+static int findJobLocked(SYNC_JOB_TYPE type, const char *doc);
+static void removeJobLocked(int pos);
+static WEBCFG_STATUS popDueJobLocked(sync_job_t *job);
+static int jobBefore(const sync_job_t *a, const sync_job_t *b);
+static int jobPriorTo(const sync_job_t *a, const sync_job_t *b);
+static void jobSiftUp(int pos);
+static void jobSiftDown(int pos);
+static void armSchedulerTimerLocked();
+static void schedulerTimerExpired(void *arg);
+static void collectForceSync();
+static int findRetryLocked(const char *docname);
+static uint32_t wallClockDelay(long secs);
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+WEBCFG_STATUS scheduleSyncJob(SYNC_JOB_TYPE type, const char *doc, int forced, uint32_t delay_ms)
+{
+	int rv = 0;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	rv = queueJobLocked(type, doc, forced, delay_ms, NULL);
+	//sync thread recomputes its wait for the new head
+	pthread_cond_broadcast(get_global_sync_condition());
+	pthread_mutex_unlock (get_global_sync_mutex());
+	return (rv < 0) ? WEBCFG_FAILURE : WEBCFG_SUCCESS;
+}
+
+int cancelSyncJob(SYNC_JOB_TYPE type, const char *doc)
+{
+	int pos = 0;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	pos = findJobLocked(type, doc);
+	if(pos >= 0)
+	{
+		removeJobLocked(pos);
+	}
+	pthread_mutex_unlock (get_global_sync_mutex());
+	return (pos >= 0);
+}
+
+int getSyncJobCount()
+{
+	int count = 0;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	count = g_job_count;
+	pthread_mutex_unlock (get_global_sync_mutex());
+	return count;
+}
+
+void clearSyncJobs()
+{
+	pthread_mutex_lock (get_global_sync_mutex());
+	g_job_count = 0;
+	g_retry_count = 0;
+	pthread_mutex_unlock (get_global_sync_mutex());
+	if(webcfgTimerIsArmed(&g_sched_timer))
+	{
+		webcfgTimerDisarm(&g_sched_timer);
+	}
+}
+
+WEBCFG_STATUS takeDueSyncJob(sync_job_t *job)
+{
+	WEBCFG_STATUS rv = WEBCFG_FAILURE;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	rv = popDueJobLocked(job);
+	pthread_mutex_unlock (get_global_sync_mutex());
+	return rv;
+}
+
+WEBCFG_STATUS waitSyncJob(sync_job_t *job)
+{
+	pthread_mutex_lock (get_global_sync_mutex());
+	while(!get_global_shutdown())
+	{
+		collectForceSync();
+		if(popDueJobLocked(job) == WEBCFG_SUCCESS)
+		{
+			memcpy(g_sync_trans_id, job->trans_id, sizeof(g_sync_trans_id));
+			pthread_mutex_unlock (get_global_sync_mutex());
+			WebcfgDebug("Dispatching %s sync job %s\n", getSyncJobName(job->type), job->doc);
+			return WEBCFG_SUCCESS;
+		}
+		armSchedulerTimerLocked();
+		WebcfgDebug("B4 sync_condition wait, %d sync jobs queued\n", g_job_count);
+		pthread_cond_wait(get_global_sync_condition(), get_global_sync_mutex());
+	}
+	pthread_mutex_unlock (get_global_sync_mutex());
+	if(webcfgTimerIsArmed(&g_sched_timer))
+	{
+		webcfgTimerDisarm(&g_sched_timer);
+	}
+	WebcfgInfo("g_shutdown is %d, proceeding to kill webconfig thread\n", get_global_shutdown());
+	return WEBCFG_FAILURE;
+}
+
+WEBCFG_STATUS requestForceSync(char *doc, char *trans_id)
+{
+	int rv = 0;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	rv = requestForceSyncLocked(doc, trans_id);
+	pthread_cond_broadcast(get_global_sync_condition());
+	pthread_mutex_unlock (get_global_sync_mutex());
+	return (rv < 0) ? WEBCFG_FAILURE : WEBCFG_SUCCESS;
+}
+
+char* getForceSyncTransID()
+{
+	char *trans_id = NULL;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	if(strlen(g_sync_trans_id) > 0)
+	{
+		trans_id = strdup(g_sync_trans_id);
+	}
+	pthread_mutex_unlock (get_global_sync_mutex());
+	return trans_id;
+}
+
+void setForceSyncWindow(uint32_t window_ms)
+{
+	g_poke_window_ms = window_ms;
+}
+
+void scheduleMaintenanceJob(int next_day)
+{
+	struct timespec rt;
+	long secs = 0;
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	secs = getMaintenanceSyncSeconds(next_day);
+	g_maintenance_target = rt.tv_sec + secs;
+	WebcfgInfo("The Maintenance Sync triggers at %s\n", printTime((long long)g_maintenance_target));
+	cancelSyncJob(SYNC_JOB_MAINTENANCE, NULL);
+	scheduleSyncJob(SYNC_JOB_MAINTENANCE, NULL, 0, wallClockDelay(secs));
+}
+
+int isMaintenanceDue()
+{
+	struct timespec rt;
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	if(rt.tv_sec < g_maintenance_target)
+	{
+		//not reached yet or the clock was stepped back, wait for the rest
+		WebcfgDebug("Maintenance sync due in %ld sec\n", (long)(g_maintenance_target - rt.tv_sec));
+		scheduleSyncJob(SYNC_JOB_MAINTENANCE, NULL, 0, wallClockDelay(g_maintenance_target - rt.tv_sec));
+		return 0;
+	}
+	if(rt.tv_sec - g_maintenance_target >= 86400)
+	{
+		//target was planned before the clock was set, plan it again on the real time
+		WebcfgInfo("Wall clock stepped past the maintenance sync, rescheduling\n");
+		scheduleMaintenanceJob(0);
+		return 0;
+	}
+	return 1;
+}
+
+const char* getSyncJobName(SYNC_JOB_TYPE type)
+{
+	switch(type)
+	{
+		case SYNC_JOB_PRIMARY:
+			return "primary";
+		case SYNC_JOB_SUPPLEMENTARY:
+			return "supplementary";
+		case SYNC_JOB_RETRY:
+			return "retry";
+		case SYNC_JOB_MAINTENANCE:
+			return "maintenance";
+	}
+	return "unknown";
+}
+
+long long scheduleDocRetry(char *docname, uint32_t version)
+{
+	struct timespec rt;
+	uint32_t backoff = WEBCFG_RETRY_BASE_SECS;
+	int pos = 0;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	pos = findRetryLocked(docname);
+	if(pos < 0 && g_retry_count < WEBCFG_SYNC_MAX_JOBS)
+	{
+		pos = g_retry_count++;
+		memset(&g_retries[pos], 0, sizeof(doc_retry_t));
+		strncpy(g_retries[pos].name, docname, sizeof(g_retries[pos].name) - 1);
+	}
+	if(pos >= 0)
+	{
+		if(g_retries[pos].version != version)
+		{
+			g_retries[pos].version = version;
+			g_retries[pos].attempts = 0;
+		}
+		backoff = getDocRetryBackoff(g_retries[pos].attempts);
+		g_retries[pos].attempts++;
+	}
+	//replaces a queued retry of the doc, the new deadline may be later
+	pos = findJobLocked(SYNC_JOB_RETRY, docname);
+	if(pos >= 0)
+	{
+		removeJobLocked(pos);
+	}
+	queueJobLocked(SYNC_JOB_RETRY, docname, 0, backoff * 1000, NULL);
+	pthread_cond_broadcast(get_global_sync_condition());
+	pthread_mutex_unlock (get_global_sync_mutex());
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	WebcfgInfo("Retry of %s version %lu in %lu sec\n", docname, (unsigned long)version, (unsigned long)backoff);
+	return (long long)rt.tv_sec + backoff;
+}
+
+void clearDocRetry(char *docname)
+{
+	int pos = 0;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	pos = findRetryLocked(docname);
+	if(pos >= 0)
+	{
+		g_retry_count--;
+		g_retries[pos] = g_retries[g_retry_count];
+	}
+	pos = findJobLocked(SYNC_JOB_RETRY, docname);
+	if(pos >= 0)
+	{
+		removeJobLocked(pos);
+	}
+	pthread_mutex_unlock (get_global_sync_mutex());
+}
+
+int getDocRetryAttempts(char *docname)
+{
+	int pos = 0;
+	int attempts = 0;
+
+	pthread_mutex_lock (get_global_sync_mutex());
+	pos = findRetryLocked(docname);
+	if(pos >= 0)
+	{
+		attempts = g_retries[pos].attempts;
+	}
+	pthread_mutex_unlock (get_global_sync_mutex());
+	return attempts;
+}
+
+uint32_t getDocRetryBackoff(int attempts)
+{
+	uint32_t backoff = WEBCFG_RETRY_BASE_SECS;
+
+	while(attempts-- > 0 && backoff < WEBCFG_RETRY_MAX_SECS)
+	{
+		backoff *= 2;
+	}
+	return (backoff > WEBCFG_RETRY_MAX_SECS) ? WEBCFG_RETRY_MAX_SECS : backoff;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+//Returns 1 when queued, 0 when coalesced and -1 when the queue is full.
+static int queueJobLocked(SYNC_JOB_TYPE type, const char *doc, int forced, uint32_t delay_ms, const char *trans_id)
+{
+	sync_job_t job;
+	int pos = 0;
+
+	memset(&job, 0, sizeof(sync_job_t));
+	job.type = type;
+	if(doc != NULL)
+	{
+		strncpy(job.doc, doc, sizeof(job.doc) - 1);
+	}
+	job.forced = forced;
+	if(trans_id != NULL)
+	{
+		strncpy(job.trans_id, trans_id, sizeof(job.trans_id) - 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &job.deadline);
+	job.deadline.tv_sec += delay_ms / 1000;
+	job.deadline.tv_nsec += (long)(delay_ms % 1000) * 1000000L;
+	if(job.deadline.tv_nsec >= 1000000000L)
+	{
+		job.deadline.tv_sec += 1;
+		job.deadline.tv_nsec -= 1000000000L;
+	}
+
+	pos = findJobLocked(type, job.doc);
+	if(pos >= 0)
+	{
+		g_jobs[pos].forced |= forced;
+		if(strlen(g_jobs[pos].trans_id) == 0)
+		{
+			memcpy(g_jobs[pos].trans_id, job.trans_id, sizeof(job.trans_id));
+		}
+		if(jobBefore(&job, &g_jobs[pos]))
+		{
+			g_jobs[pos].deadline = job.deadline;
+			jobSiftUp(pos);
+		}
+		WebcfgDebug("%s sync job %s coalesced\n", getSyncJobName(type), job.doc);
+		return 0;
+	}
+	if(g_job_count == WEBCFG_SYNC_MAX_JOBS)
+	{
+		WebcfgError("Sync job queue full, %s job %s dropped\n", getSyncJobName(type), job.doc);
+		return -1;
+	}
+	job.seq = g_job_seq++;
+	g_jobs[g_job_count] = job;
+	g_job_count++;
+	jobSiftUp(g_job_count - 1);
+	WebcfgDebug("%s sync job %s queued in %lu ms\n", getSyncJobName(type), job.doc, (unsigned long)delay_ms);
+	return 1;
+}
+
+static int findJobLocked(SYNC_JOB_TYPE type, const char *doc)
+{
+	int i = 0;
+	const char *name = (doc != NULL) ? doc : "";
+
+	for(i = 0; i < g_job_count; i++)
+	{
+		if(g_jobs[i].type == type && strncmp(g_jobs[i].doc, name, sizeof(g_jobs[i].doc)) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void removeJobLocked(int pos)
+{
+	g_job_count--;
+	if(pos == g_job_count)
+	{
+		return;
+	}
+	g_jobs[pos] = g_jobs[g_job_count];
+	jobSiftUp(pos);
+	jobSiftDown(pos);
+}
+
+//Of all due jobs the highest priority runs first, a primary poke goes ahead of maintenance.
+static WEBCFG_STATUS popDueJobLocked(sync_job_t *job)
+{
+	struct timespec now;
+	int best = 0;
+	int i = 0;
+
+	if(g_job_count == 0)
+	{
+		return WEBCFG_FAILURE;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(g_jobs[0].deadline.tv_sec > now.tv_sec ||
+		(g_jobs[0].deadline.tv_sec == now.tv_sec && g_jobs[0].deadline.tv_nsec > now.tv_nsec))
+	{
+		return WEBCFG_FAILURE;
+	}
+	for(i = 1; i < g_job_count; i++)
+	{
+		if(g_jobs[i].deadline.tv_sec > now.tv_sec ||
+			(g_jobs[i].deadline.tv_sec == now.tv_sec && g_jobs[i].deadline.tv_nsec > now.tv_nsec))
+		{
+			continue;
+		}
+		if(jobPriorTo(&g_jobs[i], &g_jobs[best]))
+		{
+			best = i;
+		}
+	}
+	*job = g_jobs[best];
+	removeJobLocked(best);
+	return WEBCFG_SUCCESS;
+}
+
+static int jobBefore(const sync_job_t *a, const sync_job_t *b)
+{
+	if(a->deadline.tv_sec != b->deadline.tv_sec)
+	{
+		return a->deadline.tv_sec < b->deadline.tv_sec;
+	}
+	if(a->deadline.tv_nsec != b->deadline.tv_nsec)
+	{
+		return a->deadline.tv_nsec < b->deadline.tv_nsec;
+	}
+	if(a->type != b->type)
+	{
+		return a->type < b->type;
+	}
+	return a->seq < b->seq;
+}
+
+static int jobPriorTo(const sync_job_t *a, const sync_job_t *b)
+{
+	if(a->type != b->type)
+	{
+		return a->type < b->type;
+	}
+	return jobBefore(a, b);
+}
+
+static void jobSiftUp(int pos)
+{
+	sync_job_t tmp;
+	int parent = 0;
+
+	while(pos > 0)
+	{
+		parent = (pos - 1) / 2;
+		if(!jobBefore(&g_jobs[pos], &g_jobs[parent]))
+		{
+			break;
+		}
+		tmp = g_jobs[parent];
+		g_jobs[parent] = g_jobs[pos];
+		g_jobs[pos] = tmp;
+		pos = parent;
+	}
+}
+
+static void jobSiftDown(int pos)
+{
+	sync_job_t tmp;
+	int child = 0;
+
+	while((child = 2 * pos + 1) < g_job_count)
+	{
+		if(child + 1 < g_job_count && jobBefore(&g_jobs[child + 1], &g_jobs[child]))
+		{
+			child++;
+		}
+		if(!jobBefore(&g_jobs[child], &g_jobs[pos]))
+		{
+			break;
+		}
+		tmp = g_jobs[child];
+		g_jobs[child] = g_jobs[pos];
+		g_jobs[pos] = tmp;
+		pos = child;
+	}
+}
+
+//One timer for the head of the queue, a stale expiry only causes an extra pass.
+static void armSchedulerTimerLocked()
+{
+	struct timespec now;
+	long long ms = 0;
+
+	if(g_job_count == 0)
+	{
+		if(webcfgTimerIsArmed(&g_sched_timer))
+		{
+			webcfgTimerDisarm(&g_sched_timer);
+		}
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (long long)(g_jobs[0].deadline.tv_sec - now.tv_sec) * 1000 +
+		(g_jobs[0].deadline.tv_nsec - now.tv_nsec + 999999L) / 1000000L;
+	if(ms < 0)
+	{
+		ms = 0;
+	}
+	else if(ms > UINT32_MAX)
+	{
+		ms = UINT32_MAX;
+	}
+	webcfgTimerArm(&g_sched_timer, (uint32_t)ms, schedulerTimerExpired, NULL);
+}
+
+static void schedulerTimerExpired(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock (get_global_sync_mutex());
+	//aker retry waits share the condition, wake all so the sync thread sees it
+	pthread_cond_broadcast(get_global_sync_condition());
+	pthread_mutex_unlock (get_global_sync_mutex());
+}
+
+//Consumes the poke slot of a platform which does not call requestForceSync.
+static void collectForceSync()
+{
+	char *ForceSyncDoc = NULL;
+	char *ForceSyncTransID = NULL;
+
+	getForceSync(&ForceSyncDoc, &ForceSyncTransID);
+	if(ForceSyncTransID != NULL)
+	{
+		WebcfgDebug("ForceSyncDoc %s ForceSyncTransID. %s\n", ForceSyncDoc, ForceSyncTransID);
+		if((ForceSyncDoc != NULL) && strlen(ForceSyncDoc)>0)
+		{
+			requestForceSyncLocked(ForceSyncDoc, ForceSyncTransID);
+		}
+		else
+		{
+			WebcfgError("ForceSyncDoc is NULL\n");
+		}
+		setForceSync("", "", 0);
+		WEBCFG_FREE(ForceSyncTransID);
+	}
+	if(ForceSyncDoc != NULL)
+	{
+		WEBCFG_FREE(ForceSyncDoc);
+	}
+}
+
+static int requestForceSyncLocked(char *doc, char *trans_id)
+{
+	int rv = 0;
+
+	//To check poke string received is supplementary doc or not.
+	if(isSupplementaryDoc(doc) == WEBCFG_SUCCESS)
+	{
+		rv = queueJobLocked(SYNC_JOB_SUPPLEMENTARY, doc, 1, g_poke_window_ms, trans_id);
+	}
+	else
+	{
+		rv = queueJobLocked(SYNC_JOB_PRIMARY, NULL, 1, g_poke_window_ms, trans_id);
+	}
+	if(rv > 0)
+	{
+		WebcfgInfo("Received force sync poke for %s\n", doc);
+	}
+	else if(rv == 0)
+	{
+		WebcfgInfo("Force sync poke for %s merged into the queued sync\n", doc);
+	}
+	return rv;
+}
+
+static int findRetryLocked(const char *docname)
+{
+	int i = 0;
+
+	for(i = 0; i < g_retry_count; i++)
+	{
+		if(strncmp(g_retries[i].name, docname, sizeof(g_retries[i].name)) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static uint32_t wallClockDelay(long secs)
+{
+	if(secs < 0)
+	{
+		secs = 0;
+	}
+	else if(secs > WEBCFG_SYNC_RECHECK_SECS)
+	{
+		secs = WEBCFG_SYNC_RECHECK_SECS;
+	}
+	return (uint32_t)secs * 1000;
+}
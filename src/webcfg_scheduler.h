@@ -0,0 +1,145 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBCFG_SCHEDULER_H__
+#define __WEBCFG_SCHEDULER_H__
+
+#include <stdint.h>
+#include <time.h>
+#include "webcfg.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define WEBCFG_SYNC_MAX_JOBS		64
+#define WEBCFG_SYNC_DOC_SIZE		64
+#define WEBCFG_SYNC_TRANSID_SIZE	64
+//pokes within this time of the first one are served by one sync
+#define WEBCFG_POKE_WINDOW_MS		2000
+//longest wait on a wall clock target, so a clock step is noticed within this time
+#define WEBCFG_SYNC_RECHECK_SECS	3600
+//failed doc retry waits 15 min and doubles per attempt up to 4 hours
+#define WEBCFG_RETRY_BASE_SECS		900
+#define WEBCFG_RETRY_MAX_SECS		(4 * 3600)
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+//Lower value runs first among due jobs
+typedef enum
+{
+    SYNC_JOB_PRIMARY = 0,
+    SYNC_JOB_SUPPLEMENTARY,
+    SYNC_JOB_RETRY,
+    SYNC_JOB_MAINTENANCE
+} SYNC_JOB_TYPE;
+
+//Retry state of one failed doc, the deadline is its SYNC_JOB_RETRY job
+typedef struct doc_retry
+{
+	char name[WEBCFG_SYNC_DOC_SIZE];
+	uint32_t version;		//a new failed version restarts the backoff
+	int attempts;
+} doc_retry_t;
+
+typedef struct sync_job
+{
+	SYNC_JOB_TYPE type;
+	char doc[WEBCFG_SYNC_DOC_SIZE];	//empty for jobs not bound to a doc
+	int forced;			//requested by a force sync poke
+	char trans_id[WEBCFG_SYNC_TRANSID_SIZE];	//transaction of the first merged poke
+	struct timespec deadline;	//absolute CLOCK_MONOTONIC time
+	uint32_t seq;
+} sync_job_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/**
+ *  Queues a sync job. A job of the same type and doc already queued is
+ *  coalesced with it, keeping the earlier deadline.
+ *
+ *  @param type     the job type
+ *  @param doc      doc of the job, NULL when not bound to a doc
+ *  @param forced   1 when requested by a force sync poke
+ *  @param delay_ms time from now the job is due
+ *
+ *  @return WEBCFG_FAILURE when the queue is full
+ */
+WEBCFG_STATUS scheduleSyncJob(SYNC_JOB_TYPE type, const char *doc, int forced, uint32_t delay_ms);
+int cancelSyncJob(SYNC_JOB_TYPE type, const char *doc);
+int getSyncJobCount();
+void clearSyncJobs();
+
+/**
+ *  Queues the sync requested by a poke after the poke window. Pokes for a
+ *  sync already queued are merged into it, also while another sync runs.
+ *  Primary docs share one sync. Each supplementary doc is fetched from its
+ *  own URL, so it has its own sync and repeated pokes of it share that one.
+ *  A merged sync reports the transaction id of the first poke only.
+ *  This is the entry point of poke handlers.
+ *
+ *  @param doc      the poked doc
+ *  @param trans_id transaction id of the poke
+ *
+ *  @return WEBCFG_FAILURE when the queue is full
+ */
+WEBCFG_STATUS requestForceSync(char *doc, char *trans_id);
+char* getForceSyncTransID();
+void setForceSyncWindow(uint32_t window_ms);
+
+/**
+ *  Takes the due job of the highest priority, without waiting.
+ *
+ *  @return WEBCFG_FAILURE when no job is due
+ */
+WEBCFG_STATUS takeDueSyncJob(sync_job_t *job);
+
+/**
+ *  Blocks the sync thread until a job is due. Force sync pokes are queued
+ *  while waiting.
+ *
+ *  @return WEBCFG_FAILURE on shutdown
+ */
+WEBCFG_STATUS waitSyncJob(sync_job_t *job);
+
+/**
+ *  Plans the maintenance sync on the wall clock, today or the next day.
+ *  The job is rechecked at least every WEBCFG_SYNC_RECHECK_SECS.
+ */
+void scheduleMaintenanceJob(int next_day);
+
+/**
+ *  Checks a dispatched maintenance job against its wall clock target and
+ *  queues it again when the target is not reached.
+ *
+ *  @return 1 when the maintenance sync is to run now
+ */
+int isMaintenanceDue();
+const char* getSyncJobName(SYNC_JOB_TYPE type);
+
+/**
+ *  Queues the retry of a failed doc after its own backoff. A doc that fails
+ *  again while retrying is queued after a longer backoff, never in the same pass.
+ *
+ *  @param docname the failed subdoc
+ *  @param version the failed version
+ *
+ *  @return wall clock time of the retry
+ */
+long long scheduleDocRetry(char *docname, uint32_t version);
+void clearDocRetry(char *docname);
+int getDocRetryAttempts(char *docname);
+uint32_t getDocRetryBackoff(int attempts);
+#endif
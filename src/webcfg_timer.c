@@ -32,7 +32,7 @@
 /*----------------------------------------------------------------------------*/
 #define MIN_MAINTENANCE_TIME		3600					//1hrs in seconds
 #define MAX_MAINTENANCE_TIME		14400					//4hrs in seconds
-#define MAX_RETRY_TIMEOUT               900
+#define TIMER_HEAP_INITIAL_SIZE		16
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
@@ -41,12 +41,28 @@
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
-static int g_retry_timer = 900;
 static long g_retry_timestamp = 0;
 static long g_maintenance_time = 0;
+
+//Timer service, min-heap of armed timers ordered by monotonic deadline.
+static pthread_t TimerServiceThreadId = 0;
+static pthread_mutex_t timer_service_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_service_con;
+static int timer_service_running = 0;
+static int timer_service_stop = 0;
+static webcfg_timer_t **g_timer_heap = NULL;
+static int g_timer_count = 0;
+static int g_timer_capacity = 0;
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
+void* webcfgTimerService();
+WEBCFG_STATUS startTimerServiceLocked();
+int timerDeadlineBefore(const webcfg_timer_t *a, const webcfg_timer_t *b);
+void timerHeapSwap(int i, int j);
+void timerHeapSiftUp(int i);
+void timerHeapSiftDown(int i);
+void timerHeapRemove(webcfg_timer_t *timer);
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
@@ -61,16 +77,6 @@ void set_global_maintenance_time(long value)
     g_maintenance_time = value;
 }
 
-int get_retry_timer()
-{
-	return g_retry_timer;
-}
-
-void set_retry_timer(int value)
-{
-	g_retry_timer = value;
-}
-
 long get_global_retry_timestamp()
 {
     return g_retry_timestamp;
@@ -260,64 +266,303 @@ long getTimeInSeconds(long long time)
 	return sec_of_cur_time;
 }
 
-int updateRetryTimeDiff(long long expiry_time)
+//To check the timer expiry for retry
+int checkRetryTimer( long long timestamp)
 {
-	struct timespec ct;
-	int time_diff = 0;
-	long long present_time = 0;
+	struct timespec rt;
 
-	clock_gettime(CLOCK_REALTIME, &ct);
-	present_time = ct.tv_sec;
+	long long cur_time = 0;
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	cur_time = rt.tv_sec;
+
+	WebcfgDebug("The current time in device is %lld at %s\n", cur_time, printTime(cur_time));
+	WebcfgDebug("The Retry timestamp is %lld at %s\n", timestamp, printTime(timestamp));
+
+	if(cur_time >= timestamp)
+	{
+		WebcfgInfo("Retry timestamp is equal to current time\n");
+		return 1;
+	}
+	return 0;
+}
 
-	time_diff = expiry_time - present_time;
+/* Arms or re-arms the timer to fire after timeout_ms, O(log n). The first
+call starts the timer service thread. */
+WEBCFG_STATUS webcfgTimerArm(webcfg_timer_t *timer, uint32_t timeout_ms, webcfgTimerCallback callback, void *arg)
+{
+	webcfg_timer_t **heap = NULL;
+	int wake = 0;
+	int count = 0;
 
-	//To set the lowest retry timeout of all the docs
-	if(get_retry_timer() > time_diff)
+	if(timer == NULL || callback == NULL)
+	{
+		WebcfgError("Invalid timer arm request\n");
+		return WEBCFG_FAILURE;
+	}
+
+	pthread_mutex_lock (&timer_service_mut);
+	if(!timer_service_running && startTimerServiceLocked() != WEBCFG_SUCCESS)
+	{
+		pthread_mutex_unlock (&timer_service_mut);
+		return WEBCFG_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &timer->deadline);
+	timer->deadline.tv_sec += timeout_ms / 1000;
+	timer->deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if(timer->deadline.tv_nsec >= 1000000000L)
+	{
+		timer->deadline.tv_sec += 1;
+		timer->deadline.tv_nsec -= 1000000000L;
+	}
+	timer->callback = callback;
+	timer->arg = arg;
+
+	if(timer->heap_pos == 0)
+	{
+		if(g_timer_count == g_timer_capacity)
+		{
+			int capacity = (g_timer_capacity == 0) ? TIMER_HEAP_INITIAL_SIZE : g_timer_capacity * 2;
+			heap = (webcfg_timer_t **)realloc(g_timer_heap, capacity * sizeof(webcfg_timer_t *));
+			if(heap == NULL)
+			{
+				pthread_mutex_unlock (&timer_service_mut);
+				WebcfgError("Failed to grow timer heap\n");
+				return WEBCFG_FAILURE;
+			}
+			g_timer_heap = heap;
+			g_timer_capacity = capacity;
+		}
+		g_timer_heap[g_timer_count] = timer;
+		g_timer_count++;
+		timer->heap_pos = g_timer_count;
+		timerHeapSiftUp(g_timer_count - 1);
+	}
+	else
 	{
-		set_retry_timer(time_diff);
-		set_global_retry_timestamp(getTimeInSeconds(expiry_time));
-		WebcfgDebug("The retry_timer is %d after set\n", get_retry_timer());
+		timerHeapSiftUp(timer->heap_pos - 1);
+		timerHeapSiftDown(timer->heap_pos - 1);
 	}
-	if(get_global_retry_timestamp() == 0)
+
+	//service only has to recompute its wait when the earliest deadline changed
+	wake = (g_timer_heap[0] == timer);
+	if(wake)
 	{
-		set_global_retry_timestamp(getTimeInSeconds(present_time+900));
+		pthread_cond_signal(&timer_service_con);
 	}
-	return time_diff;
+	count = g_timer_count;
+	pthread_mutex_unlock (&timer_service_mut);
+	WebcfgDebug("timer armed for %lu ms, %d timers active\n", (unsigned long)timeout_ms, count);
+	return WEBCFG_SUCCESS;
 }
 
-//To set the retry_timestamp to 15 min from current time
-long long getRetryExpiryTimeout()
+//Cancels the timer, O(log n). Disarming a timer that is not armed fails.
+WEBCFG_STATUS webcfgTimerDisarm(webcfg_timer_t *timer)
 {
-	struct timespec ts;
-	struct timeval tp;
+	if(timer == NULL)
+	{
+		return WEBCFG_FAILURE;
+	}
+	pthread_mutex_lock (&timer_service_mut);
+	if(timer->heap_pos == 0)
+	{
+		pthread_mutex_unlock (&timer_service_mut);
+		return WEBCFG_FAILURE;
+	}
+	timerHeapRemove(timer);
+	pthread_mutex_unlock (&timer_service_mut);
+	return WEBCFG_SUCCESS;
+}
 
-	gettimeofday(&tp, NULL);
+bool webcfgTimerIsArmed(webcfg_timer_t *timer)
+{
+	bool armed = false;
 
-	ts.tv_sec = tp.tv_sec;
-	ts.tv_nsec = tp.tv_usec * 1000;
+	pthread_mutex_lock (&timer_service_mut);
+	armed = (timer != NULL && timer->heap_pos != 0);
+	pthread_mutex_unlock (&timer_service_mut);
+	return armed;
+}
 
-	ts.tv_sec += MAX_RETRY_TIMEOUT;
+int get_timer_service_count()
+{
+	int count = 0;
 
-	return (long long)ts.tv_sec;
+	pthread_mutex_lock (&timer_service_mut);
+	count = g_timer_count;
+	pthread_mutex_unlock (&timer_service_mut);
+	return count;
 }
 
-//To check the timer expiry for retry
-int checkRetryTimer( long long timestamp)
+//Stops the service thread and disarms all pending timers, used at shutdown.
+void stopWebcfgTimerService()
 {
-	struct timespec rt;
+	pthread_t tid = 0;
 
-	long long cur_time = 0;
+	pthread_mutex_lock (&timer_service_mut);
+	if(!timer_service_running)
+	{
+		pthread_mutex_unlock (&timer_service_mut);
+		return;
+	}
+	timer_service_stop = 1;
+	tid = TimerServiceThreadId;
+	pthread_cond_signal(&timer_service_con);
+	pthread_mutex_unlock (&timer_service_mut);
 
-	clock_gettime(CLOCK_REALTIME, &rt);
-	cur_time = rt.tv_sec;
+	WebcfgDebug("timer service thread: pthread_join\n");
+	pthread_join(tid, NULL);
 
-	WebcfgDebug("The current time in device is %lld at %s\n", cur_time, printTime(cur_time));
-	WebcfgDebug("The Retry timestamp is %lld at %s\n", timestamp, printTime(timestamp));
+	pthread_mutex_lock (&timer_service_mut);
+	while(g_timer_count > 0)
+	{
+		timerHeapRemove(g_timer_heap[0]);
+	}
+	WEBCFG_FREE(g_timer_heap);
+	g_timer_capacity = 0;
+	pthread_cond_destroy(&timer_service_con);
+	timer_service_running = 0;
+	timer_service_stop = 0;
+	TimerServiceThreadId = 0;
+	pthread_mutex_unlock (&timer_service_mut);
+}
 
-	if(cur_time >= timestamp)
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+
+/* Sleeps until the earliest deadline, or indefinitely when no timer is armed,
+so an idle agent never wakes up. Expired timers are popped and their callback
+is run without the service lock so callbacks are free to re-arm. */
+void* webcfgTimerService()
+{
+	struct timespec now;
+	webcfg_timer_t *timer = NULL;
+	webcfgTimerCallback callback = NULL;
+	void *arg = NULL;
+
+	pthread_mutex_lock (&timer_service_mut);
+	while(!timer_service_stop)
 	{
-		WebcfgInfo("Retry timestamp is equal to current time\n");
-		return 1;
+		if(g_timer_count == 0)
+		{
+			pthread_cond_wait(&timer_service_con, &timer_service_mut);
+			continue;
+		}
+
+		timer = g_timer_heap[0];
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(now.tv_sec > timer->deadline.tv_sec || (now.tv_sec == timer->deadline.tv_sec && now.tv_nsec >= timer->deadline.tv_nsec))
+		{
+			callback = timer->callback;
+			arg = timer->arg;
+			timerHeapRemove(timer);
+			pthread_mutex_unlock (&timer_service_mut);
+			callback(arg);
+			pthread_mutex_lock (&timer_service_mut);
+		}
+		else
+		{
+			pthread_cond_timedwait(&timer_service_con, &timer_service_mut, &timer->deadline);
+		}
 	}
-	return 0;
+	pthread_mutex_unlock (&timer_service_mut);
+	WebcfgDebug("timer service thread exits\n");
+	return NULL;
+}
+
+//Called with timer_service_mut held
+WEBCFG_STATUS startTimerServiceLocked()
+{
+	pthread_condattr_t attr;
+	int err = 0;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&timer_service_con, &attr);
+	pthread_condattr_destroy(&attr);
+
+	timer_service_stop = 0;
+	err = pthread_create(&TimerServiceThreadId, NULL, webcfgTimerService, NULL);
+	if (err != 0)
+	{
+		WebcfgError("Error creating webconfig timer service thread :[%s]\n", strerror(err));
+		pthread_cond_destroy(&timer_service_con);
+		return WEBCFG_FAILURE;
+	}
+	WebcfgInfo("Webconfig timer service thread created Successfully\n");
+	timer_service_running = 1;
+	return WEBCFG_SUCCESS;
+}
+
+int timerDeadlineBefore(const webcfg_timer_t *a, const webcfg_timer_t *b)
+{
+	if(a->deadline.tv_sec != b->deadline.tv_sec)
+	{
+		return a->deadline.tv_sec < b->deadline.tv_sec;
+	}
+	return a->deadline.tv_nsec < b->deadline.tv_nsec;
+}
+
+void timerHeapSwap(int i, int j)
+{
+	webcfg_timer_t *tmp = g_timer_heap[i];
+
+	g_timer_heap[i] = g_timer_heap[j];
+	g_timer_heap[j] = tmp;
+	g_timer_heap[i]->heap_pos = i + 1;
+	g_timer_heap[j]->heap_pos = j + 1;
+}
+
+void timerHeapSiftUp(int i)
+{
+	while(i > 0 && timerDeadlineBefore(g_timer_heap[i], g_timer_heap[(i - 1) / 2]))
+	{
+		timerHeapSwap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+void timerHeapSiftDown(int i)
+{
+	int smallest = i;
+	int left = 0, right = 0;
+
+	while(1)
+	{
+		left = 2 * i + 1;
+		right = 2 * i + 2;
+		if(left < g_timer_count && timerDeadlineBefore(g_timer_heap[left], g_timer_heap[smallest]))
+		{
+			smallest = left;
+		}
+		if(right < g_timer_count && timerDeadlineBefore(g_timer_heap[right], g_timer_heap[smallest]))
+		{
+			smallest = right;
+		}
+		if(smallest == i)
+		{
+			break;
+		}
+		timerHeapSwap(i, smallest);
+		i = smallest;
+	}
+}
+
+//Called with timer_service_mut held
+void timerHeapRemove(webcfg_timer_t *timer)
+{
+	int i = timer->heap_pos - 1;
+
+	g_timer_count--;
+	if(i != g_timer_count)
+	{
+		g_timer_heap[i] = g_timer_heap[g_timer_count];
+		g_timer_heap[i]->heap_pos = i + 1;
+		timerHeapSiftUp(i);
+		timerHeapSiftDown(g_timer_heap[i]->heap_pos - 1);
+	}
+	g_timer_heap[g_timer_count] = NULL;
+	timer->heap_pos = 0;
 }
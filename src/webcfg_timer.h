@@ -22,17 +22,32 @@
 #include <pthread.h>
 #include <time.h>
 #include <ctype.h>
+#include "webcfg.h"
 /*----------------------------------------------------------------------------*/
 /*                                   Macros                                   */
 /*----------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef void (*webcfgTimerCallback)(void *arg);
+
+/* Deadline timer owned by the caller and scheduled by the timer service.
+ * A zeroed struct is a valid disarmed timer. Callbacks run on the timer
+ * service thread with no webcfg lock held. */
+typedef struct webcfg_timer
+{
+	struct timespec deadline;	//absolute CLOCK_MONOTONIC expiry
+	webcfgTimerCallback callback;
+	void *arg;
+	int heap_pos;			//1 based position in timer heap, 0 when not armed
+} webcfg_timer_t;
+
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
 void initMaintenanceTimer();
 char* printTime(long long time);
-void set_retry_timer(int value);
-int get_retry_timer();
 int checkMaintenanceTimer();
 int getMaintenanceSyncSeconds(int maintenance_count);
 int retrySyncSeconds();
@@ -40,7 +55,10 @@ long getTimeInSeconds(long long time);
 void set_global_maintenance_time(long value);
 void set_global_retry_timestamp(long value);
 long get_global_retry_timestamp();
-int updateRetryTimeDiff(long long expiry_time);
 int checkRetryTimer( long long timestamp);
-long long getRetryExpiryTimeout();
+WEBCFG_STATUS webcfgTimerArm(webcfg_timer_t *timer, uint32_t timeout_ms, webcfgTimerCallback callback, void *arg);
+WEBCFG_STATUS webcfgTimerDisarm(webcfg_timer_t *timer);
+bool webcfgTimerIsArmed(webcfg_timer_t *timer);
+void stopWebcfgTimerService();
+int get_timer_service_count();
 #endif
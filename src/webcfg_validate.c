@@ -0,0 +1,171 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <wdmp-c.h>
+#include "webcfg.h"
+#include "webcfg_log.h"
+#include "webcfg_metadata.h"
+#include "webcfg_request.h"
+#include "webcfg_validate.h"
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static size_t g_validate_max_size = WEBCFG_VALIDATE_DEFAULT_MAX_SIZE;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static WEBCFG_STATUS checkParamValue(const param_t *param);
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+WEBCFG_VERDICT validateSubdoc(char *docname, uint32_t version, char *data, size_t data_size, int supplementary, doc_verdict_t *v)
+{
+	webcfg_request_t *req = NULL;
+	REQUEST_BUILD_STATUS buildStatus = REQUEST_BUILD_SUCCESS;
+	int i = 0;
+
+	memset(v, 0, sizeof(doc_verdict_t));
+	v->param_index = -1;
+	if(data == NULL || data_size == 0)
+	{
+		v->verdict = VERDICT_EMPTY;
+		return v->verdict;
+	}
+	if(g_validate_max_size > 0 && data_size > g_validate_max_size)
+	{
+		v->verdict = VERDICT_TOO_LARGE;
+		return v->verdict;
+	}
+	//without a supported list the component decides, as before
+	if(!supplementary && isSupportedDocsLoaded() && isSubDocSupported(docname) != WEBCFG_SUCCESS)
+	{
+		v->verdict = VERDICT_UNSUPPORTED;
+		return v->verdict;
+	}
+
+	//a dry run, the request is never sent so it takes no transaction_id
+	buildStatus = buildWebcfgProbeRequest(docname, version, data, data_size, &req);
+	if(buildStatus == REQUEST_DECODE_FAILURE)
+	{
+		v->decode_err = errno;
+		v->verdict = VERDICT_DECODE_FAILURE;
+		return v->verdict;
+	}
+	if(buildStatus != REQUEST_BUILD_SUCCESS)
+	{
+		v->verdict = VERDICT_INVALID_PARAM;
+		return v->verdict;
+	}
+	for(i = 0; i < req->count; i++)
+	{
+		if(checkParamValue(&req->params[i]) != WEBCFG_SUCCESS)
+		{
+			WebcfgError("%s param %s of type %d has invalid value\n", docname, req->params[i].name, req->params[i].type);
+			v->param_index = i;
+			v->verdict = VERDICT_INVALID_TYPE;
+			break;
+		}
+	}
+	releaseWebcfgRequest(req);
+	return v->verdict;
+}
+
+const char* getVerdictString(WEBCFG_VERDICT verdict)
+{
+	switch(verdict)
+	{
+		case VERDICT_ACCEPT:
+			return "accept";
+		case VERDICT_EMPTY:
+			return "empty";
+		case VERDICT_TOO_LARGE:
+			return "too_large";
+		case VERDICT_UNSUPPORTED:
+			return "unsupported";
+		case VERDICT_DECODE_FAILURE:
+			return "decode_failure";
+		case VERDICT_INVALID_PARAM:
+			return "invalid_param";
+		case VERDICT_INVALID_TYPE:
+			return "invalid_type";
+	}
+	return "unknown";
+}
+
+void setValidateMaxDocSize(size_t size)
+{
+	g_validate_max_size = size;
+}
+
+size_t getValidateMaxDocSize()
+{
+	return g_validate_max_size;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+//Rejects values the component would fail to convert to the declared type.
+static WEBCFG_STATUS checkParamValue(const param_t *param)
+{
+	const char *value = param->value;
+	char *end = NULL;
+
+	if(param->type < WDMP_STRING || param->type >= WDMP_NONE)
+	{
+		return WEBCFG_FAILURE;
+	}
+	errno = 0;
+	switch(param->type)
+	{
+		case WDMP_INT:
+		case WDMP_LONG:
+			strtoll(value, &end, 0);
+			break;
+		case WDMP_UINT:
+		case WDMP_ULONG:
+			if(strchr(value, '-') != NULL)
+			{
+				return WEBCFG_FAILURE;
+			}
+			strtoull(value, &end, 0);
+			break;
+		case WDMP_FLOAT:
+		case WDMP_DOUBLE:
+			strtod(value, &end);
+			break;
+		case WDMP_BOOLEAN:
+			if(strcasecmp(value, "true") == 0 || strcasecmp(value, "false") == 0 || strcmp(value, "1") == 0 || strcmp(value, "0") == 0)
+			{
+				return WEBCFG_SUCCESS;
+			}
+			return WEBCFG_FAILURE;
+		default:
+			return WEBCFG_SUCCESS;
+	}
+	if(errno != 0 || end == value || *end != '\0')
+	{
+		return WEBCFG_FAILURE;
+	}
+	return WEBCFG_SUCCESS;
+}
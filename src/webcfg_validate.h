@@ -0,0 +1,70 @@
+/*
+ * Copyright 2020 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __WEBCFG_VALIDATE_H__
+#define __WEBCFG_VALIDATE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "webcfg.h"
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+//0 disables the size check, set by WEBCONFIG_MAX_SUBDOC_SIZE
+#define WEBCFG_VALIDATE_DEFAULT_MAX_SIZE	0
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef enum
+{
+    VERDICT_ACCEPT = 0,
+    VERDICT_EMPTY,
+    VERDICT_TOO_LARGE,
+    VERDICT_UNSUPPORTED,
+    VERDICT_DECODE_FAILURE,
+    VERDICT_INVALID_PARAM,
+    VERDICT_INVALID_TYPE
+} WEBCFG_VERDICT;
+
+//Outcome of the dry run of one subdoc, nothing is sent to components
+typedef struct doc_verdict
+{
+	WEBCFG_VERDICT verdict;
+	int decode_err;		//webcfgparam error of VERDICT_DECODE_FAILURE
+	int param_index;	//offending param of VERDICT_INVALID_TYPE
+} doc_verdict_t;
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/**
+ *  Decodes and checks a subdoc without applying it. The decoded request is
+ *  kept by the request builder, so the apply that follows does not decode again.
+ *
+ *  @param docname       the subdoc name
+ *  @param version       the subdoc version
+ *  @param data          msgpack of the subdoc
+ *  @param data_size     size of data
+ *  @param supplementary 1 for docs of a supplementary sync, not in the supported list
+ *  @param v             filled with the verdict
+ *
+ *  @return the verdict
+ */
+WEBCFG_VERDICT validateSubdoc(char *docname, uint32_t version, char *data, size_t data_size, int supplementary, doc_verdict_t *v);
+const char* getVerdictString(WEBCFG_VERDICT verdict);
+void setValidateMaxDocSize(size_t size);
+size_t getValidateMaxDocSize();
+#endif
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <CUnit/Basic.h>
 #include "../src/webcfg_db.h"
 #include "../src/webcfg_pack.h"
@@ -71,6 +72,24 @@ char * webcfg_appendeddoc(char * subdoc_name, uint32_t version, char * blob_data
 	return NULL;
 }
 
+size_t webcfg_appenddoc_prefix(char * subdoc_name, uint32_t version, char * blob_data, size_t blob_size, void **embeddeddoc)
+{
+	UNUSED(subdoc_name);
+	UNUSED(version);
+	UNUSED(blob_data);
+	UNUSED(blob_size);
+	UNUSED(embeddeddoc);
+	return 0;
+}
+
+size_t webcfg_pack_transid(uint16_t trans_id, unsigned char *buf, size_t len)
+{
+	UNUSED(trans_id);
+	UNUSED(buf);
+	UNUSED(len);
+	return 0;
+}
+
 void initEventHandlingTask(){
 	return;
 }
@@ -119,6 +138,11 @@ void isSubDocSupported(){
 
 }
 
+int isSupportedDocsLoaded()
+{
+	return 0;
+}
+
 void checkAkerStatus(){
 	
 	return;
@@ -134,6 +158,12 @@ void processAkerSubdoc(){
 return ;
 }
 
+WEBCFG_STATUS deferAkerSubdoc(multipartdocs_t *akerIndex)
+{
+	UNUSED(akerIndex);
+	return WEBCFG_SUCCESS;
+}
+
 
 char * getsupportedDocs()
 {
@@ -143,6 +173,18 @@ char * getsupportedVersion()
 {
 	return NULL;
 }
+const char * getSupportedDocsHeader()
+{
+	return NULL;
+}
+const char * getSupportedVersionHeader()
+{
+	return NULL;
+}
+const char * getSupplementaryDocsHeader()
+{
+	return NULL;
+}
 
 char * getDeviceBootTime()
 {
@@ -179,6 +221,26 @@ char * getModelName()
 void retryMultipartSubdoc(){
 	return ;
 }
+long long scheduleDocRetry(char *docname, uint32_t version)
+{
+	UNUSED(docname);
+	UNUSED(version);
+	return 0;
+}
+void clearDocRetry(char *docname)
+{
+	UNUSED(docname);
+	return;
+}
+int getDocRetryAttempts(char *docname)
+{
+	UNUSED(docname);
+	return 0;
+}
+char* getForceSyncTransID()
+{
+	return NULL;
+}
 char *get_global_systemReadyTime()
 {
 	char *sTime = strdup("158000123");
@@ -279,8 +341,8 @@ void test_blobPackUnpack(){
 	webcfgtemp=(webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	webcfgtemp->name = strdup("wan");
 	webcfgtemp->version = 410448631;
-	webcfgtemp->status = strdup("pending");
-	webcfgtemp->error_details = strdup("none");
+	webcfgtemp->state = DOC_STATE_PENDING;
+	webcfgtemp->error_details = getInternedString("none");
 	webcfgtemp->error_code = 0;
 	webcfgtemp->trans_id = 0;
 	webcfgtemp->retry_count = 0;
@@ -335,6 +397,107 @@ void test_dbPackUnpack(){
 	
 }
 
+void test_dbFileHeaderFallback(){
+	char *path = "/tmp/test_webcfg_db.bin";
+	char backup[64] = {'\0'};
+	void *dbData = NULL;
+	size_t dbPackSize = 0;
+	webconfig_db_data_t wd = {"wan", 410448631, NULL, NULL, 0};
+	webconfig_db_data_t *node = NULL;
+	char magic[5] = {'\0'};
+	FILE *fp = NULL;
+	int last = 0;
+
+	snprintf(backup, sizeof(backup), "%s%s", path, WEBCFG_DB_BACKUP_SUFFIX);
+	unlink(path);
+	unlink(backup);
+
+	dbPackSize = webcfgdb_pack(&wd, &dbData, 1);
+	CU_ASSERT_EQUAL(1, writeDBFileWithHeader(path, (char *)dbData, dbPackSize, 1));
+	WEBCFG_FREE(dbData);
+
+	//second write keeps the first one as last good snapshot
+	wd.version = 410448632;
+	dbPackSize = webcfgdb_pack(&wd, &dbData, 1);
+	CU_ASSERT_EQUAL(1, writeDBFileWithHeader(path, (char *)dbData, dbPackSize, 1));
+	WEBCFG_FREE(dbData);
+	CU_ASSERT_EQUAL(0, access(backup, F_OK));
+
+	fp = fopen(path, "r+b");
+	CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+	CU_ASSERT_EQUAL(4, fread(magic, 1, 4, fp));
+	CU_ASSERT_STRING_EQUAL("WCDB", magic);
+	//corrupt the last payload byte, checksum check has to reject the file
+	fseek(fp, -1, SEEK_END);
+	last = fgetc(fp);
+	fseek(fp, -1, SEEK_END);
+	fputc(0xFF ^ last, fp);
+	fclose(fp);
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, initDB(path));
+	node = get_global_db_node();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(node);
+	CU_ASSERT_STRING_EQUAL("wan", node->name);
+	CU_ASSERT_EQUAL(410448631, node->version);
+
+	//the corrupt file is not kept as snapshot, the next write leaves the good one
+	wd.version = 410448633;
+	dbPackSize = webcfgdb_pack(&wd, &dbData, 1);
+	CU_ASSERT_EQUAL(1, writeDBFileWithHeader(path, (char *)dbData, dbPackSize, 1));
+	WEBCFG_FREE(dbData);
+	deleteDBList();
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, initDB(backup));
+	node = get_global_db_node();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(node);
+	CU_ASSERT_EQUAL(410448631, node->version);
+	deleteDBList();
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, initDB(path));
+	node = get_global_db_node();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(node);
+	CU_ASSERT_EQUAL(410448633, node->version);
+
+	//a wiped DB file is not brought back from the snapshot
+	unlink(path);
+	CU_ASSERT_EQUAL(0, access(backup, F_OK));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, initDB(path));
+
+	unlink(backup);
+}
+
+void test_contentDigest(){
+	char *path = "/tmp/test_webcfg_digest.bin";
+	char backup[64] = {'\0'};
+	void *dbData = NULL;
+	size_t dbPackSize = 0;
+	webconfig_db_data_t lan = {"lan", 410448633, NULL, NULL, 0x0123456789ABCDEFULL};
+	webconfig_db_data_t root = {"root", 410448630, "portmapping", &lan, 0};
+	const char *text = "Nobody inspects the spammish repetition";
+
+	//reference values of XXH64 with seed 0
+	CU_ASSERT_EQUAL(0xEF46DB3751D8E999ULL, xxhash64("", 0, 0));
+	CU_ASSERT_EQUAL(0xD24EC4F1A98C6E5BULL, xxhash64("a", 1, 0));
+	CU_ASSERT_EQUAL(0x44BC2CF5AD770999ULL, xxhash64("abc", 3, 0));
+	CU_ASSERT_EQUAL(0xFBCEA83C8A378BF1ULL, xxhash64(text, strlen(text), 0));
+
+	snprintf(backup, sizeof(backup), "%s%s", path, WEBCFG_DB_BACKUP_SUFFIX);
+	unlink(path);
+	unlink(backup);
+	dbPackSize = webcfgdb_pack(&root, &dbData, 2);
+	CU_ASSERT_EQUAL(1, writeDBFileWithHeader(path, (char *)dbData, dbPackSize, 2));
+	WEBCFG_FREE(dbData);
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, initDB(path));
+	CU_ASSERT_EQUAL(0x0123456789ABCDEFULL, getDBDigest("lan"));
+	CU_ASSERT_EQUAL(0, getDBDigest("root"));
+	CU_ASSERT_EQUAL(0, getDBDigest("wan"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateDBDigest("lan", 42));
+	CU_ASSERT_EQUAL(42, getDBDigest("lan"));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, updateDBDigest("wan", 42));
+
+	unlink(path);
+	unlink(backup);
+}
+
 void test_addToDBList(){
 	webconfig_db_data_t *wd;
 	wd = (webconfig_db_data_t *) malloc (sizeof(webconfig_db_data_t));
@@ -347,12 +510,171 @@ void test_addToDBList(){
 	WEBCFG_FREE(wd);
 }
 
+void test_blobBase64Cache(){
+	webconfig_db_data_t *wd;
+	char *b64_first = NULL, *b64_second = NULL, *b64_updated = NULL;
+
+	wd = (webconfig_db_data_t *) malloc (sizeof(webconfig_db_data_t));
+	CU_ASSERT_PTR_NOT_NULL(wd);
+	wd->name = strdup("lan");
+	wd->version = 1234567;
+	wd->root_string = NULL;
+	wd->next=NULL;
+	addToDBList(wd);
+
+	b64_first = get_DB_BLOB_base64();
+	b64_second = get_DB_BLOB_base64();
+	CU_ASSERT_PTR_NOT_NULL(b64_first);
+	CU_ASSERT_PTR_NOT_NULL(b64_second);
+	CU_ASSERT_STRING_EQUAL(b64_first, b64_second);
+
+	//version update has to invalidate the cached blob
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateDBlist("lan", 7654321, NULL));
+	b64_updated = get_DB_BLOB_base64();
+	CU_ASSERT_PTR_NOT_NULL(b64_updated);
+	CU_ASSERT_NOT_EQUAL(0, strcmp(b64_first, b64_updated));
+
+	WEBCFG_FREE(b64_first);
+	WEBCFG_FREE(b64_second);
+	WEBCFG_FREE(b64_updated);
+}
+
+webconfig_tmp_data_t * createTmpNode(char *name, WEBCFG_DOC_STATE state)
+{
+	webconfig_tmp_data_t *node = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
+	memset(node, 0, sizeof(webconfig_tmp_data_t));
+	node->name = strdup(name);
+	node->version = 1234;
+	node->state = state;
+	node->error_details = getInternedString("none");
+	node->cloud_trans_id = strdup("abcdef");
+	return node;
+}
+
+void test_tmpListStateAndIndex(){
+	webconfig_tmp_data_t *root = createTmpNode("root", DOC_STATE_PENDING);
+	webconfig_tmp_data_t *wan = createTmpNode("wan", DOC_STATE_PENDING_APPLY);
+	webconfig_tmp_data_t *lan = createTmpNode("lan", DOC_STATE_PENDING_APPLY);
+
+	root->next = wan;
+	wan->next = lan;
+	lan->next = NULL;
+	set_global_tmp_node(root);
+
+	CU_ASSERT_PTR_EQUAL(wan, getTmpNode("wan"));
+	CU_ASSERT_PTR_EQUAL(lan, getTmpNode("lan"));
+	CU_ASSERT_PTR_NULL(getTmpNode("moca"));
+
+	//fixed error details are interned, equal strings share the pointer
+	CU_ASSERT_PTR_EQUAL(getInternedString("doc_rejected"), getInternedString("doc_rejected"));
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(wan, "wan", 1235, DOC_STATE_PENDING, "none", 0, 10, 0));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(wan, "wan", 1235, DOC_STATE_SUCCESS, "none", 0, 10, 0));
+	CU_ASSERT_EQUAL(DOC_STATE_SUCCESS, wan->state);
+	//success can not move to failed or back to pending_apply
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, updateTmpList(wan, "wan", 1235, DOC_STATE_FAILED, "doc_rejected", 111, 0, 0));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, updateTmpList(wan, "wan", 1235, DOC_STATE_PENDING_APPLY, "none", 0, 0, 0));
+	CU_ASSERT_EQUAL(DOC_STATE_SUCCESS, wan->state);
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(lan, "lan", 1234, DOC_STATE_FAILED, "doc_rejected", 111, 0, 0));
+	CU_ASSERT_PTR_EQUAL(getInternedString("doc_rejected"), lan->error_details);
+	CU_ASSERT_STRING_EQUAL("failed", DOC_STATE_STRING(lan->state));
+	//free form details are copied per node, never dropped to "unknown"
+	CU_ASSERT_PTR_NULL(getInternedString("doc_rejected:ssid too long"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(lan, "lan", 1234, DOC_STATE_FAILED, "doc_rejected:ssid too long", 111, 0, 0));
+	CU_ASSERT_STRING_EQUAL("doc_rejected:ssid too long", lan->error_details);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(lan, "lan", 1234, DOC_STATE_FAILED, "doc_rejected", 111, 0, 0));
+	CU_ASSERT_PTR_EQUAL(getInternedString("doc_rejected"), lan->error_details);
+
+	//unlink from the middle keeps list order and index consistent
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, deleteFromTmpList("wan"));
+	CU_ASSERT_PTR_NULL(getTmpNode("wan"));
+	CU_ASSERT_PTR_EQUAL(lan, getTmpNode("lan"));
+	CU_ASSERT_PTR_EQUAL(lan, get_global_tmp_node()->next);
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, deleteFromTmpList("wan"));
+
+	delete_tmp_list();
+	CU_ASSERT_PTR_NULL(get_global_tmp_node());
+	CU_ASSERT_PTR_NULL(getTmpNode("root"));
+}
+
+void test_transIdAllocator(){
+	webconfig_tmp_data_t *wan = createTmpNode("wan", DOC_STATE_PENDING);
+	webconfig_tmp_data_t *lan = createTmpNode("lan", DOC_STATE_PENDING);
+	uint16_t t1 = 0, t2 = 0, t3 = 0;
+
+	wan->next = lan;
+	lan->next = NULL;
+	set_global_tmp_node(wan);
+
+	t1 = allocateTransId();
+	t2 = allocateTransId();
+	CU_ASSERT_NOT_EQUAL(0, t1);
+	CU_ASSERT_NOT_EQUAL(0, t2);
+	CU_ASSERT_NOT_EQUAL(t1, t2);
+	//reserved but not bound yet
+	CU_ASSERT_PTR_NULL(getTmpNodeByTransId(t1));
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(wan, "wan", 1234, DOC_STATE_PENDING, "none", 0, t1, 0));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(lan, "lan", 1234, DOC_STATE_PENDING, "none", 0, t2, 0));
+	CU_ASSERT_PTR_EQUAL(wan, getTmpNodeByTransId(t1));
+	CU_ASSERT_PTR_EQUAL(lan, getTmpNodeByTransId(t2));
+
+	//retry moves wan to a new txid, the old one becomes stale
+	t3 = allocateTransId();
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(wan, "wan", 1234, DOC_STATE_PENDING, "none", 0, t3, 1));
+	CU_ASSERT_PTR_NULL(getTmpNodeByTransId(t1));
+	CU_ASSERT_PTR_EQUAL(wan, getTmpNodeByTransId(t3));
+
+	CU_ASSERT_EQUAL(0, getReservedTransIdCount());
+
+	//an abandoned reservation is released, a bound id stays with its doc
+	t1 = allocateTransId();
+	CU_ASSERT_EQUAL(1, getReservedTransIdCount());
+	releaseTransId(t1);
+	CU_ASSERT_EQUAL(0, getReservedTransIdCount());
+	releaseTransId(t3);
+	CU_ASSERT_PTR_EQUAL(wan, getTmpNodeByTransId(t3));
+
+	//a rejected transition does not keep the id reserved
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpList(lan, "lan", 1234, DOC_STATE_SUCCESS, "none", 0, t2, 0));
+	t1 = allocateTransId();
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, updateTmpList(lan, "lan", 1234, DOC_STATE_FAILED, "doc_rejected", 111, t1, 0));
+	CU_ASSERT_EQUAL(0, getReservedTransIdCount());
+	CU_ASSERT_PTR_NULL(getTmpNodeByTransId(t1));
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, deleteFromTmpList("lan"));
+	CU_ASSERT_PTR_NULL(getTmpNodeByTransId(t2));
+
+	//by name only the version the caller holds is updated
+	t1 = allocateTransId();
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, updateTmpListByName("wan", 1233, DOC_STATE_FAILED, "doc_rejected", 111, t1, 0));
+	CU_ASSERT_EQUAL(0, getReservedTransIdCount());
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, updateTmpListByName("lan", 1234, DOC_STATE_FAILED, "doc_rejected", 111, 0, 0));
+	CU_ASSERT_EQUAL(DOC_STATE_PENDING, wan->state);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, updateTmpListByName("wan", 1234, DOC_STATE_FAILED, "doc_rejected", 111, 0, 0));
+	CU_ASSERT_EQUAL(DOC_STATE_FAILED, wan->state);
+
+	//a reset drops the bound ids, not the ones of requests still being built
+	t1 = allocateTransId();
+	delete_tmp_list();
+	CU_ASSERT_PTR_NULL(getTmpNodeByTransId(t3));
+	CU_ASSERT_EQUAL(1, getReservedTransIdCount());
+	releaseTransId(t1);
+	CU_ASSERT_EQUAL(0, getReservedTransIdCount());
+}
+
 void add_suites( CU_pSuite *suite )
 {
     *suite = CU_add_suite( "tests", NULL, NULL );
     CU_add_test( *suite, "test blobPackUnpack", test_blobPackUnpack);
     CU_add_test( *suite, "test dbPackUnpack", test_dbPackUnpack);
+    CU_add_test( *suite, "test dbFileHeaderFallback", test_dbFileHeaderFallback);
+    CU_add_test( *suite, "test blobBase64Cache", test_blobBase64Cache);
+    CU_add_test( *suite, "test tmpListStateAndIndex", test_tmpListStateAndIndex);
+    CU_add_test( *suite, "test transIdAllocator", test_transIdAllocator);
     CU_add_test( *suite, "test addToDBList", test_addToDBList);
+    CU_add_test( *suite, "test contentDigest", test_contentDigest);
     
 }
 
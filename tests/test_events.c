@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <CUnit/Basic.h>
 #include "../src/webcfg_param.h"
 #include "../src/webcfg.h"
@@ -30,6 +31,7 @@
 #include <base64.h>
 #include "../src/webcfg_generic.h"
 #include "../src/webcfg_event.h"
+#include "../src/webcfg_latency.h"
 #define FILE_URL "/tmp/webcfg_url"
 
 #define UNUSED(x) (void )(x)
@@ -125,11 +127,17 @@ char * getRebootReason()
 	return reason;
 }
 
+static int notifySentCount = 0;
+static char notifyLastDest[256];
+static char notifyLastPayload[1024];
+
 void sendNotification(char *payload, char *source, char *destination)
 {
+	snprintf(notifyLastPayload, sizeof(notifyLastPayload), "%s", payload);
 	WEBCFG_FREE(payload);
 	WEBCFG_FREE(source);
-	UNUSED(destination);
+	notifySentCount++;
+	snprintf(notifyLastDest, sizeof(notifyLastDest), "%s", destination);
 	return;
 }
 
@@ -171,11 +179,11 @@ void test_eventACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -193,11 +201,11 @@ void test_invalidVersionACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 4210448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -211,8 +219,6 @@ void test_invalidVersionACK()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -226,11 +232,11 @@ void test_eventTimeout()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("homessid");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -244,8 +250,6 @@ void test_eventTimeout()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -256,11 +260,11 @@ void test_invalidVersionTimeout()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 4210448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -274,8 +278,6 @@ void test_invalidVersionTimeout()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -287,11 +289,11 @@ void test_eventNACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("portforwarding");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("NACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -306,8 +308,6 @@ void test_eventNACK()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -318,11 +318,11 @@ void test_invalidVersionNACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 4210448631;
-	tmpData->status = strdup("NACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -336,8 +336,6 @@ void test_invalidVersionNACK()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -349,11 +347,11 @@ void test_eventEXPIRE()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("portforwarding");
 	tmpData->version = 0;
-	tmpData->status = strdup("EXPIRE");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -399,11 +397,11 @@ void test_eventEXPIREWithoutRetry()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("homessid");
 	tmpData->version = 0;
-	tmpData->status = strdup("EXPIRE");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -419,8 +417,6 @@ void test_eventEXPIREWithoutRetry()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -432,7 +428,7 @@ void test_eventCrash()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -454,7 +450,7 @@ void test_eventCrashNewVersion()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -503,7 +499,7 @@ void test_eventCrashNewVersionWithoutRetry()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("homessid");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -521,8 +517,6 @@ void test_eventCrashNewVersionWithoutRetry()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 
@@ -534,7 +528,7 @@ void test_eventCrashSameVersion()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("portforwarding");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -583,7 +577,7 @@ void test_eventCrashSameVersionWithoutRetry()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -602,8 +596,6 @@ void test_eventCrashSameVersionWithoutRetry()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -614,7 +606,7 @@ void test_eventCrashLatestVersion()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 12345;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -633,8 +625,6 @@ void test_eventCrashLatestVersion()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -645,11 +635,11 @@ void err_invalidACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("privatessid");
 	tmpData->version = 4210448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 1464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -663,8 +653,6 @@ void err_invalidACK()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -677,11 +665,11 @@ void test_eventACKEnabled()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("mesh");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK;enabled");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -700,11 +688,11 @@ void test_eventACKDisabled()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("mesh");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK;disabled");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 1234;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -723,11 +711,11 @@ void test_adveventACKEnabled()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("advsecurity");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK;enabled");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -746,11 +734,11 @@ void test_adveventACKDisabled()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("advsecurity");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK;disabled");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=0;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -763,9 +751,538 @@ void test_adveventACKDisabled()
 	sleep(1);
 }
 
+static int timer_fired[3] = {0};
+static int timer_fire_order = 0;
+
+void timerServiceCallback(void *arg)
+{
+	timer_fired[(intptr_t)arg] = ++timer_fire_order;
+}
+
+void test_timerService()
+{
+	webcfg_timer_t t[3];
+
+	memset(t, 0, sizeof(t));
+	//armed out of order, service has to fire them by deadline
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, webcfgTimerArm(&t[0], 300, timerServiceCallback, (void *)0));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, webcfgTimerArm(&t[1], 100, timerServiceCallback, (void *)1));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, webcfgTimerArm(&t[2], 200, timerServiceCallback, (void *)2));
+	CU_ASSERT_TRUE(webcfgTimerIsArmed(&t[2]));
+	//re-arm moves t[2] behind t[0], then cancel it
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, webcfgTimerArm(&t[2], 500, timerServiceCallback, (void *)2));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, webcfgTimerDisarm(&t[2]));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, webcfgTimerDisarm(&t[2]));
+	sleep(1);
+	CU_ASSERT_EQUAL(1, timer_fired[1]);
+	CU_ASSERT_EQUAL(2, timer_fired[0]);
+	CU_ASSERT_EQUAL(0, timer_fired[2]);
+	CU_ASSERT_FALSE(webcfgTimerIsArmed(&t[0]));
+	CU_ASSERT_EQUAL(0, get_timer_service_count());
+}
+
+void test_eventQueueOversize()
+{
+	char big[WEBCFG_EVENT_SLOT_SIZE + 16];
+	event_queue_stats_t before, after;
+
+	memset(big, 'a', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	getEventQueueStats(&before);
+	CU_ASSERT_EQUAL(1, addToEventQueue(big));
+	CU_ASSERT_EQUAL(1, addToEventQueue(NULL));
+	getEventQueueStats(&after);
+	CU_ASSERT_EQUAL(before.dropped_oversize + 1, after.dropped_oversize);
+	CU_ASSERT_EQUAL(before.enqueued, after.enqueued);
+}
+
+//No consumer runs yet, the test thread pops as the single consumer.
+void test_eventQueueFifo()
+{
+	char data[WEBCFG_EVENT_SLOT_SIZE];
+	char expected[32];
+	int i = 0;
+
+	CU_ASSERT_EQUAL(0, eventQueuePop(NULL, 0));
+	for(i = 0; i < 10; i++)
+	{
+		snprintf(expected, sizeof(expected), "fifo,%d,1,ACK,0", i);
+		CU_ASSERT_EQUAL(0, addToEventQueue(expected));
+	}
+	for(i = 0; i < 10; i++)
+	{
+		snprintf(expected, sizeof(expected), "fifo,%d,1,ACK,0", i);
+		CU_ASSERT_EQUAL(1, eventQueuePop(data, sizeof(data)));
+		CU_ASSERT_STRING_EQUAL(expected, data);
+	}
+	CU_ASSERT_EQUAL(0, eventQueuePop(data, sizeof(data)));
+}
+
+void test_eventQueueFull()
+{
+	char data[WEBCFG_EVENT_SLOT_SIZE];
+	char event[32];
+	event_queue_stats_t before, after;
+	int i = 0;
+
+	getEventQueueStats(&before);
+	for(i = 0; i < WEBCFG_EVENT_QUEUE_SIZE; i++)
+	{
+		snprintf(event, sizeof(event), "full,%d,1,ACK,0", i);
+		CU_ASSERT_EQUAL(0, addToEventQueue(event));
+	}
+	//producer is never blocked, the overflow event is dropped and counted
+	CU_ASSERT_EQUAL(1, addToEventQueue("full,99,1,ACK,0"));
+	getEventQueueStats(&after);
+	CU_ASSERT_EQUAL(before.dropped_full + 1, after.dropped_full);
+	CU_ASSERT_EQUAL(before.enqueued + WEBCFG_EVENT_QUEUE_SIZE, after.enqueued);
+	CU_ASSERT_EQUAL(WEBCFG_EVENT_QUEUE_SIZE, after.high_watermark);
+
+	//one free slot takes one more event, behind the queued ones
+	CU_ASSERT_EQUAL(1, eventQueuePop(data, sizeof(data)));
+	CU_ASSERT_STRING_EQUAL("full,0,1,ACK,0", data);
+	CU_ASSERT_EQUAL(0, addToEventQueue("full,64,1,ACK,0"));
+	for(i = 1; i <= WEBCFG_EVENT_QUEUE_SIZE; i++)
+	{
+		snprintf(event, sizeof(event), "full,%d,1,ACK,0", i);
+		CU_ASSERT_EQUAL(1, eventQueuePop(data, sizeof(data)));
+		CU_ASSERT_STRING_EQUAL(event, data);
+	}
+	CU_ASSERT_EQUAL(0, eventQueuePop(NULL, 0));
+}
+
+#define RING_PRODUCERS	4
+#define RING_EVENTS	(WEBCFG_EVENT_QUEUE_SIZE / RING_PRODUCERS)
+
+void* ringProducer(void *arg)
+{
+	long id = (long)arg;
+	char event[32];
+	int i = 0;
+
+	for(i = 0; i < RING_EVENTS; i++)
+	{
+		snprintf(event, sizeof(event), "p%ld,%d,1,ACK,0", id, i);
+		CU_ASSERT_EQUAL(0, addToEventQueue(event));
+	}
+	return NULL;
+}
+
+void test_eventQueueMultiProducer()
+{
+	pthread_t tid[RING_PRODUCERS];
+	int next[RING_PRODUCERS] = {0};
+	char data[WEBCFG_EVENT_SLOT_SIZE];
+	long id = 0;
+	int seq = 0, popped = 0;
+
+	for(id = 0; id < RING_PRODUCERS; id++)
+	{
+		CU_ASSERT_EQUAL(0, pthread_create(&tid[id], NULL, ringProducer, (void *)id));
+	}
+	for(id = 0; id < RING_PRODUCERS; id++)
+	{
+		pthread_join(tid[id], NULL);
+	}
+	//producers interleave, but each producer's events keep their order
+	while(eventQueuePop(data, sizeof(data)))
+	{
+		CU_ASSERT_EQUAL(2, sscanf(data, "p%ld,%d", &id, &seq));
+		CU_ASSERT_FATAL(id >= 0 && id < RING_PRODUCERS);
+		CU_ASSERT_EQUAL(next[id], seq);
+		next[id] = seq + 1;
+		popped++;
+	}
+	CU_ASSERT_EQUAL(WEBCFG_EVENT_QUEUE_SIZE, popped);
+}
+
+//The consumer sleeps on the eventfd once the queue is empty, a producer has to wake it.
+void test_eventQueueWakeup()
+{
+	int i = 0;
+
+	numLoops = 2;
+	processWebcfgEvents();
+	usleep(200000);
+	CU_ASSERT_EQUAL(0, addToEventQueue("ringwake,0,1"));
+	for(i = 0; i < 100 && eventQueuePop(NULL, 0); i++)
+	{
+		usleep(10000);
+	}
+	CU_ASSERT_EQUAL(0, eventQueuePop(NULL, 0));
+	sleep(1);
+}
+
+void test_parseEventData()
+{
+	event_params_t param;
+	char longname[EVENT_SUBDOC_NAME_SIZE + 8];
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, parseEventData("wan,14464,410448631,ACK;disabled,0", &param));
+	CU_ASSERT_STRING_EQUAL("wan", param.subdoc_name);
+	CU_ASSERT_EQUAL(14464, param.trans_id);
+	CU_ASSERT_EQUAL(410448631, param.version);
+	CU_ASSERT_EQUAL(EVENT_STATUS_ACK_DISABLED, param.status_type);
+	CU_ASSERT_STRING_EQUAL("ACK;disabled", param.status);
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, parseEventData("lan,1,2,NACK,0,ccsp,204,invalid value", &param));
+	CU_ASSERT_EQUAL(EVENT_STATUS_NACK, param.status_type);
+	CU_ASSERT_STRING_EQUAL("ccsp", param.process_name);
+	CU_ASSERT_EQUAL(204, param.err_code);
+	CU_ASSERT_STRING_EQUAL("invalid value", param.failure_reason);
+
+	//crash event carries no status
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, parseEventData("moca,0,5", &param));
+	CU_ASSERT_EQUAL(EVENT_STATUS_NONE, param.status_type);
+	CU_ASSERT_EQUAL(5, param.version);
+
+	memset(longname, 'a', sizeof(longname) - 1);
+	longname[sizeof(longname) - 1] = '\0';
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, parseEventData(longname, &param));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, parseEventData(NULL, &param));
+}
+
+//Parses a synthetic corpus of component events and reports the throughput.
+void test_parseEventBenchmark()
+{
+	const char *corpus[] = {
+		"wan,14464,410448631,ACK,0",
+		"lan,14465,410448632,ACK;enabled,0",
+		"mesh,14466,410448633,ACK,60",
+		"moca,14467,410448634,NACK,0,CcspPandMSsp,204,failed to apply moca config",
+		"homessid,2001,0,EXPIRE,0",
+		"portforwarding,0,410448635,COMP_INIT",
+		"privatessid,0,410448636"
+	};
+	size_t n = sizeof(corpus)/sizeof(corpus[0]);
+	int iterations = 20000, i = 0;
+	size_t j = 0;
+	int ok = 0;
+	event_params_t param;
+	struct timespec start, end;
+	double elapsed_ns = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < iterations; i++)
+	{
+		for(j = 0; j < n; j++)
+		{
+			ok += (parseEventData(corpus[j], &param) == WEBCFG_SUCCESS);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	CU_ASSERT_EQUAL(iterations * (int)n, ok);
+	printf("parseEventData: %d events in %.0f us, %.1f ns/event\n", ok, elapsed_ns / 1000, elapsed_ns / ok);
+}
+
+void test_coalesceEvents()
+{
+	const char *events[] = {
+		"wan,10,1,ACK,60",
+		"wan,10,1,ACK,60",
+		"lan,11,2,EXPIRE,0",
+		"wan,10,1,ACK,0",
+		"lan,11,2,NACK,0,ccsp,204,failed",
+		"wan,10,1,NACK,0,ccsp,204,late",
+		"moca,12,3,ACK,30",
+		"moca,12,3,ACK,90",
+		"mesh,0,4",
+		"mesh,0,4"
+	};
+	int expected[] = {0, 0, 0, 1, 1, 0, 0, 1, 1, 0};
+	int count = sizeof(events)/sizeof(events[0]);
+	event_params_t batch[10];
+	int keep[10];
+	event_queue_stats_t before, after;
+	int i = 0;
+	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
+
+	//lan is applying with txid 11, so its final event resolves the EXPIRE
+	memset(tmpData, 0, sizeof(webconfig_tmp_data_t));
+	tmpData->name = strdup("lan");
+	tmpData->version = 2;
+	tmpData->state = DOC_STATE_PENDING;
+	tmpData->trans_id = 11;
+	tmpData->error_details = getInternedString("none");
+	tmpData->cloud_trans_id = strdup("abcdef");
+	set_global_tmp_node(tmpData);
+
+	for(i = 0; i < count; i++)
+	{
+		CU_ASSERT_EQUAL(WEBCFG_SUCCESS, parseEventData(events[i], &batch[i]));
+	}
+	getEventQueueStats(&before);
+	coalesceEvents(batch, keep, count);
+	getEventQueueStats(&after);
+	for(i = 0; i < count; i++)
+	{
+		CU_ASSERT_EQUAL(expected[i], keep[i]);
+	}
+	CU_ASSERT_EQUAL(before.coalesced_duplicates + 2, after.coalesced_duplicates);
+	CU_ASSERT_EQUAL(before.coalesced_superseded + 4, after.coalesced_superseded);
+
+	//a final of an older txid is rejected later, the EXPIRE has to stay for the retry
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, parseEventData("lan,40,2,EXPIRE,0", &batch[0]));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, parseEventData("lan,7,2,ACK,0", &batch[1]));
+	coalesceEvents(batch, keep, 2);
+	CU_ASSERT_EQUAL(1, keep[0]);
+	CU_ASSERT_EQUAL(1, keep[1]);
+	delete_tmp_list();
+}
+
+void test_eventShard()
+{
+	const char *docs[] = {"wan", "lan", "mesh", "moca", "privatessid", "homessid", "portforwarding", "advsecurity"};
+	int used[WEBCFG_EVENT_WORKERS] = {0};
+	int shard = 0, spread = 0;
+	size_t i = 0;
+
+	for(i = 0; i < sizeof(docs)/sizeof(docs[0]); i++)
+	{
+		shard = getEventShard(docs[i]);
+		CU_ASSERT(shard >= 0 && shard < WEBCFG_EVENT_WORKERS);
+		//same doc always maps to the same worker
+		CU_ASSERT_EQUAL(shard, getEventShard(docs[i]));
+		used[shard] = 1;
+	}
+	for(i = 0; i < WEBCFG_EVENT_WORKERS; i++)
+	{
+		spread += used[i];
+	}
+	CU_ASSERT(spread > 1);
+	CU_ASSERT_EQUAL(getEventShard(""), getEventShard(NULL));
+}
+
+void test_latencyStats()
+{
+	latency_stats_t stats;
+	char *dump = NULL;
+	FILE *fp = NULL;
+	int i = 0;
+
+	CU_ASSERT_EQUAL(0, getLatencyBucket(0));
+	CU_ASSERT_EQUAL(1, getLatencyBucket(1));
+	CU_ASSERT_EQUAL(2, getLatencyBucket(3));
+	CU_ASSERT_EQUAL(11, getLatencyBucket(1500));
+	CU_ASSERT_EQUAL(LATENCY_HIST_BUCKETS - 1, getLatencyBucket(UINT64_MAX));
+
+	resetLatencyStats();
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, getLatencyStats("wan", &stats));
+	latencyRecordApply("wan", 100);
+	latencyRecordEvent("wan", 100, LATENCY_EVENT_TIMEOUT);
+	latencyRecordEvent("wan", 100, LATENCY_EVENT_TIMEOUT);
+	//stale txid does not close the pending apply
+	latencyRecordEvent("wan", 99, LATENCY_EVENT_ACK);
+	latencyRecordEvent("wan", 100, LATENCY_EVENT_ACK);
+	//the doc timer queues EXPIRE with a txid of its own, it still closes the apply
+	latencyRecordApply("lan", 101);
+	numLoops = 2;
+	processWebcfgEvents();
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, startWebcfgTimer(NULL, "lan", 101, 1));
+	for(i = 0; i < 50; i++)
+	{
+		if(getLatencyStats("lan", &stats) == WEBCFG_SUCCESS && stats.expires == 1)
+		{
+			break;
+		}
+		usleep(100000);
+	}
+	deleteFromTimerList("lan");
+	latencyRecordApply("lan", 102);
+	latencyRecordEvent("lan", 102, LATENCY_EVENT_NACK);
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, getLatencyStats("wan", &stats));
+	CU_ASSERT_EQUAL(1, stats.applies);
+	CU_ASSERT_EQUAL(1, stats.timeouts);
+	CU_ASSERT_EQUAL(1, stats.acks);
+	CU_ASSERT_EQUAL(1, stats.unmatched);
+	CU_ASSERT_EQUAL(1, stats.ack_hist[getLatencyBucket(stats.ack_max_ms)]);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, getLatencyStats("lan", &stats));
+	CU_ASSERT_EQUAL(2, stats.applies);
+	CU_ASSERT_EQUAL(1, stats.expires);
+	CU_ASSERT_EQUAL(1, stats.nacks);
+	CU_ASSERT_EQUAL(0, stats.unmatched);
+
+	dump = getLatencyStatsDump();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(dump);
+	CU_ASSERT_PTR_NOT_NULL(strstr(dump, "\"wan\""));
+	CU_ASSERT_PTR_NOT_NULL(strstr(dump, "\"lan\""));
+	WEBCFG_FREE(dump);
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, writeLatencyStatsFile("/tmp/test_webcfg_latency.json"));
+	fp = fopen("/tmp/test_webcfg_latency.json", "r");
+	CU_ASSERT_PTR_NOT_NULL(fp);
+	if(fp != NULL)
+	{
+		fclose(fp);
+	}
+	remove("/tmp/test_webcfg_latency.json");
+
+	//the dump timer writes the default file once per interval
+	latencyDumpTimerExpired(NULL);
+	CU_ASSERT_EQUAL(0, access(WEBCFG_LATENCY_FILE, F_OK));
+	remove(WEBCFG_LATENCY_FILE);
+	resetLatencyStats();
+}
+
+static notify_params_t *newNotifyMsg(char *name, char *status, char *txid)
+{
+	notify_params_t *msg = (notify_params_t *)calloc(1, sizeof(notify_params_t));
+	msg->name = strdup(name);
+	msg->application_status = strdup(status);
+	msg->version = strdup("1");
+	msg->transaction_uuid = strdup(txid);
+	msg->type = strdup("status");
+	msg->error_details = strdup("none");
+	msg->response_code = 200;
+	return msg;
+}
+
+//Root doc report as queued by processWebconfigSync, it has no doc name.
+static notify_params_t *newRootNotifyMsg(char *txid, long response_code)
+{
+	notify_params_t *msg = (notify_params_t *)calloc(1, sizeof(notify_params_t));
+	msg->version = strdup("1");
+	msg->transaction_uuid = strdup(txid);
+	msg->type = strdup("status");
+	msg->response_code = response_code;
+	return msg;
+}
+
+//Hands the message to the notify thread like addWebConfgNotifyMsg.
+static void queueNotifyMsg(notify_params_t *msg)
+{
+	pthread_mutex_lock(get_global_notify_mut());
+	enqueueNotifyMsg(msg);
+	pthread_cond_signal(get_global_notify_con());
+	pthread_mutex_unlock(get_global_notify_mut());
+}
+
+//Waits until the notify thread has taken and handled all queued messages.
+static void waitNotifyIdle()
+{
+	notify_queue_stats_t stats;
+	int i = 0;
+
+	getNotifyQueueStats(&stats);
+	for(i = 0; i < 100 && stats.depth != 0; i++)
+	{
+		usleep(10000);
+		getNotifyQueueStats(&stats);
+	}
+	usleep(100000);
+}
+
+void test_notifyBatching()
+{
+	int sent = 0;
+	int i = 0;
+
+	//batch state belongs to the notify thread, stop the ones of earlier tests and run a single one
+	set_global_shutdown(true);
+	for(i = 0; i < 100 && get_notify_thread_count() > 0; i++)
+	{
+		pthread_mutex_lock(get_global_notify_mut());
+		pthread_cond_broadcast(get_global_notify_con());
+		pthread_mutex_unlock(get_global_notify_mut());
+		usleep(10000);
+	}
+	set_global_shutdown(false);
+	CU_ASSERT_EQUAL(0, get_notify_thread_count());
+	initWebConfigNotifyTask();
+	setNotifyBatchConfig(60000, 3);
+	sent = notifySentCount;
+
+	queueNotifyMsg(newNotifyMsg("wan", "pending", "txA"));
+	queueNotifyMsg(newNotifyMsg("lan", "pending", "txA"));
+	waitNotifyIdle();
+	CU_ASSERT_EQUAL(sent, notifySentCount);
+
+	//other transaction flushes the batch as one message
+	queueNotifyMsg(newNotifyMsg("wan", "success", "txB"));
+	waitNotifyIdle();
+	CU_ASSERT_EQUAL(sent + 1, notifySentCount);
+	CU_ASSERT_PTR_NOT_NULL(strstr(notifyLastDest, "/multiple/"));
+
+	//failure goes out at once, after the single pending entry
+	queueNotifyMsg(newNotifyMsg("lan", "failed", "txB"));
+	waitNotifyIdle();
+	CU_ASSERT_EQUAL(sent + 3, notifySentCount);
+	CU_ASSERT_PTR_NOT_NULL(strstr(notifyLastDest, "subdoc-report/lan/"));
+	CU_ASSERT_STRING_EQUAL("{\"device_id\":\"mac:b42xxxxxxxxx\",\"namespace\":\"lan\",\"application_status\":\"failed\",\"transaction_uuid\":\"txB\",\"version\":\"1\"}", notifyLastPayload);
+
+	queueNotifyMsg(newNotifyMsg("wan", "pending", "txC"));
+	queueNotifyMsg(newNotifyMsg("lan", "pending", "txC"));
+	queueNotifyMsg(newNotifyMsg("moca", "pending", "txC"));
+	waitNotifyIdle();
+	CU_ASSERT_EQUAL(sent + 4, notifySentCount);
+	CU_ASSERT_PTR_NOT_NULL(strstr(notifyLastPayload, "\"notifications\":[{\"namespace\":\"wan\""));
+
+	setNotifyBatchConfig(0, 0);
+}
+
+void test_notifyQueueBackpressure()
+{
+	notify_queue_stats_t before, after;
+	notify_params_t *dropped = NULL, *root = NULL;
+	int i = 0;
+
+	//let the notify threads of earlier tests drain the queue
+	getNotifyQueueStats(&before);
+	for(i = 0; i < 100 && before.depth != 0; i++)
+	{
+		usleep(10000);
+		getNotifyQueueStats(&before);
+	}
+	CU_ASSERT_EQUAL(0, before.depth);
+	setNotifyQueueMax(3);
+
+	//hold the queue lock so the consumers cannot drain while filling it
+	pthread_mutex_lock(get_global_notify_mut());
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("wan", "pending", "txD")));
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("lan", "pending", "txD")));
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("wan", "success", "txD")));
+	//full, the oldest progress updates make room
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("moca", "pending", "txD")));
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("lan", "success", "txD")));
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("moca", "failed", "txD")));
+	//only finals left, a progress update is dropped itself
+	dropped = newNotifyMsg("mesh", "pending", "txD");
+	CU_ASSERT_EQUAL(1, enqueueNotifyMsg(dropped));
+	//finals are kept, replacing an older final of the same doc and transaction first
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("wan", "failed", "txD")));
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("wan", "success", "txE")));
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newNotifyMsg("mesh", "success", "txE")));
+	//a newer root report of the transaction replaces the older one
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newRootNotifyMsg("txE", 304)));
+	CU_ASSERT_EQUAL(0, enqueueNotifyMsg(newRootNotifyMsg("txE", 200)));
+	//beyond twice the capacity even a final is dropped
+	root = newRootNotifyMsg("txF", 200);
+	CU_ASSERT_EQUAL(1, enqueueNotifyMsg(root));
+	pthread_cond_signal(get_global_notify_con());
+	pthread_mutex_unlock(get_global_notify_mut());
+	free_notify_params_struct(dropped);
+	free_notify_params_struct(root);
+
+	getNotifyQueueStats(&after);
+	CU_ASSERT_EQUAL(before.enqueued + 11, after.enqueued);
+	CU_ASSERT_EQUAL(before.dropped_nonfinal + 4, after.dropped_nonfinal);
+	CU_ASSERT_EQUAL(before.dropped_superseded + 2, after.dropped_superseded);
+	CU_ASSERT_EQUAL(before.over_capacity + 3, after.over_capacity);
+	CU_ASSERT_EQUAL(before.dropped_final + 1, after.dropped_final);
+	CU_ASSERT(after.high_watermark >= 6);
+	setNotifyQueueMax(0);
+}
+
 void add_suites( CU_pSuite *suite )
 {
     *suite = CU_add_suite( "tests", NULL, NULL );
+    //ring tests run before any test starts the event consumer
+    CU_add_test( *suite, "Event queue fifo\n", test_eventQueueFifo);
+    CU_add_test( *suite, "Event queue full\n", test_eventQueueFull);
+    CU_add_test( *suite, "Event queue multi producer\n", test_eventQueueMultiProducer);
+    CU_add_test( *suite, "Event queue wakeup\n", test_eventQueueWakeup);
     CU_add_test( *suite, "ACK Event\n", test_eventACK);
 	CU_add_test( *suite, "Invalid Version ACK Event\n",test_invalidVersionACK);
 	CU_add_test( *suite, "Timeout Event\n", test_eventTimeout);
@@ -785,6 +1302,15 @@ void add_suites( CU_pSuite *suite )
 	CU_add_test( *suite, "ACK disabled Event\n", test_eventACKDisabled);
 	CU_add_test( *suite, "adv ACK enabled Event\n", test_adveventACKEnabled);
 	CU_add_test( *suite, "adv ACK disabled Event\n", test_adveventACKDisabled);
+	CU_add_test( *suite, "Timer service\n", test_timerService);
+	CU_add_test( *suite, "Event queue oversize\n", test_eventQueueOversize);
+	CU_add_test( *suite, "Parse event data\n", test_parseEventData);
+	CU_add_test( *suite, "Parse event benchmark\n", test_parseEventBenchmark);
+	CU_add_test( *suite, "Coalesce events\n", test_coalesceEvents);
+	CU_add_test( *suite, "Event shard\n", test_eventShard);
+	CU_add_test( *suite, "Latency stats\n", test_latencyStats);
+	CU_add_test( *suite, "Notify batching\n", test_notifyBatching);
+	CU_add_test( *suite, "Notify queue backpressure\n", test_notifyQueueBackpressure);
 }
 
 /*----------------------------------------------------------------------------*/
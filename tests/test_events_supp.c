@@ -171,11 +171,11 @@ void test_eventACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=1;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -197,11 +197,11 @@ void test_eventTimeout()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=1;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -215,8 +215,6 @@ void test_eventTimeout()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -230,11 +228,11 @@ void test_eventNACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("NACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=1;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -249,8 +247,6 @@ void test_eventNACK()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -263,11 +259,11 @@ void test_eventEXPIRE()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 0;
-	tmpData->status = strdup("EXPIRE");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=1;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -317,7 +313,7 @@ void test_eventCrash()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -339,7 +335,7 @@ void test_eventCrashNewVersion()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -391,7 +387,7 @@ void test_eventCrashSameVersion()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 3097089542;
-	tmpData->status = strdup("CRASH");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
@@ -441,11 +437,11 @@ void err_invalidACK()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("telemetry");
 	tmpData->version = 4210448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 1464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=1;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("a2b3c4d5e6f");
@@ -459,8 +455,6 @@ void err_invalidACK()
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData->cloud_trans_id);
 		WEBCFG_FREE(tmpData);
 	}
@@ -474,11 +468,11 @@ void test_adveventACKEnabled()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("advsecurity");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK;enabled");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=1;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
@@ -497,11 +491,11 @@ void test_adveventACKDisabled()
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("advsecurity");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK;disabled");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->isSupplementarySync=1;
 	tmpData->retry_timestamp=0;
 	tmpData->cloud_trans_id=strdup("abcdef");
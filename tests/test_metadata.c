@@ -131,6 +131,27 @@ void test_isSubDocSupported()
 	isSubDocSupported("mesh");
 }
 
+void test_docLookupExactMatch()
+{
+	char buf[512] = {'\0'};
+	snprintf(buf,sizeof(buf),"WEBCONFIG_SUBDOC_MAP=lanx:2:true,lan:3:false,wan:4:true\nWEBCONFIG_SUPPLEMENTARY_DOCS=telemetry,aker\nWEBCONFIG_DOC_SCHEMA_VERSION=1234-v0\n");
+	writeToFile(WEBCFG_PROPERTIES_FILE, buf, strlen(buf));
+	delete_supplementary_list();
+	initWebcfgProperties(WEBCFG_PROPERTIES_FILE);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, isSubDocSupported("lanx"));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, isSubDocSupported("lan"));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, isSubDocSupported("la"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, isSubDocSupported("wan"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, isSupplementaryDoc("telemetry"));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, isSupplementaryDoc("tele"));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, isSupplementaryDoc("wan"));
+	CU_ASSERT_STRING_EQUAL("X-System-Schema-Version: 1234-v0", getSupportedVersionHeader());
+	CU_ASSERT_STRING_EQUAL("X-System-SupplementaryService-Sync: telemetry,aker", getSupplementaryDocsHeader());
+	delete_supplementary_list();
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, isSupplementaryDoc("telemetry"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, isSubDocSupported("lanx"));
+}
+
 void add_suites( CU_pSuite *suite )
 {
     *suite = CU_add_suite( "tests", NULL, NULL );
@@ -139,6 +160,7 @@ void add_suites( CU_pSuite *suite )
 	CU_add_test( *suite, "Test Supported docs\n", test_supportedDocs);
 	CU_add_test( *suite, "Test Supported versions\n", test_supportedVersions);
 	CU_add_test( *suite, "Test isSubDocSupported\n", test_isSubDocSupported);
+	CU_add_test( *suite, "Test doc lookup exact match\n", test_docLookupExactMatch);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -43,6 +43,11 @@
 #include "../src/webcfg_auth.h"
 #include "../src/webcfg_blob.h"
 #include "../src/webcfg_aker.h"
+#include "../src/webcfg_apply.h"
+#include "../src/webcfg_request.h"
+#include "../src/webcfg_validate.h"
+#include "../src/webcfg_rollback.h"
+#include "../src/webcfg_scheduler.h"
 
 
 #define MAX_HEADER_LEN	4096
@@ -88,20 +93,6 @@ char * getModelName()
 	char *mName = strdup("Model");
 	return mName;
 }
-long long getRetryExpiryTimeout()
-{
-return 0;
-}
-int get_retry_timer()
-{
-	return 0;
-}
-
-void set_retry_timer(int value)
-{
-	UNUSED(value);	
-	return;
-}
 char* printTime(long long time)
 {
 	UNUSED(time);
@@ -117,11 +108,6 @@ void set_global_retry_timestamp(long value)
     	UNUSED(value);	
         return;
 }
-int updateRetryTimeDiff(long long expiry_time)
-{
-	UNUSED(expiry_time);
-	return 0;
-}
 int checkRetryTimer( long long timestamp)
 {
 	UNUSED(timestamp);
@@ -149,6 +135,28 @@ void set_global_maintenance_time(long value)
 	UNUSED(value);    
 	return;
 }
+WEBCFG_STATUS webcfgTimerArm(webcfg_timer_t *timer, uint32_t timeout_ms, webcfgTimerCallback callback, void *arg)
+{
+	UNUSED(timer);
+	UNUSED(timeout_ms);
+	UNUSED(callback);
+	UNUSED(arg);
+	return WEBCFG_SUCCESS;
+}
+WEBCFG_STATUS webcfgTimerDisarm(webcfg_timer_t *timer)
+{
+	UNUSED(timer);
+	return WEBCFG_SUCCESS;
+}
+bool webcfgTimerIsArmed(webcfg_timer_t *timer)
+{
+	UNUSED(timer);
+	return false;
+}
+void stopWebcfgTimerService()
+{
+	return;
+}
 	
 
 
@@ -202,11 +210,11 @@ void test_checkRootUpdate(){
 	webconfig_tmp_data_t *tmpData = (webconfig_tmp_data_t *)malloc(sizeof(webconfig_tmp_data_t));
 	tmpData->name = strdup("wan");
 	tmpData->version = 410448631;
-	tmpData->status = strdup("ACK");
+	tmpData->state = DOC_STATE_PENDING;
 	tmpData->trans_id = 14464;
 	tmpData->retry_count = 0;
 	tmpData->error_code = 0;
-	tmpData->error_details = strdup("success");
+	tmpData->error_details = getInternedString("success");
 	tmpData->next = NULL;
 	set_global_tmp_node(tmpData);
 	int m=checkRootUpdate();
@@ -214,8 +222,6 @@ void test_checkRootUpdate(){
 	if(tmpData)
 	{
 		WEBCFG_FREE(tmpData->name);
-		WEBCFG_FREE(tmpData->status);
-		WEBCFG_FREE(tmpData->error_details);
 		WEBCFG_FREE(tmpData);
 	}
 
@@ -315,6 +321,482 @@ void test_akerWait(){
 	CU_ASSERT_EQUAL(0,wait);
 }
 
+static void sendAkerRetrieveResponse(const char *status)
+{
+	char payload[64] = {0};
+	wrp_msg_t *msg = (wrp_msg_t *)malloc(sizeof(wrp_msg_t));
+
+	memset(msg, 0, sizeof(wrp_msg_t));
+	snprintf(payload, sizeof(payload), "{\"service-status\":\"%s\"}", status);
+	msg->msg_type = WRP_MSG_TYPE__RETREIVE;
+	msg->u.crud.source = strdup("mac:b42xxxxxxxxx/parodus/service-status/aker");
+	msg->u.crud.dest = strdup("mac:b42xxxxxxxxx/webcfg");
+	msg->u.crud.payload = strdup(payload);
+	msg->u.crud.payload_size = strlen(payload);
+	processAkerRetrieve(msg);
+}
+
+void test_akerStatusCache(){
+	invalidateAkerStatus();
+	CU_ASSERT_EQUAL(-1, getAkerStatusCached());
+	sendAkerRetrieveResponse("online");
+	CU_ASSERT_EQUAL(1, getAkerStatusCached());
+	//a cached online status needs no retrieve round trip
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, checkAkerStatus());
+	sendAkerRetrieveResponse("offline");
+	CU_ASSERT_EQUAL(0, getAkerStatusCached());
+	invalidateAkerStatus();
+	CU_ASSERT_EQUAL(-1, getAkerStatusCached());
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, deferAkerSubdoc(NULL));
+}
+
+//start and finish sequence numbers of each doc applied by runApplySchedule
+static int applyStart[8];
+static int applyEnd[8];
+static int applySeq = 0;
+static int applyStopAt = -1;
+pthread_mutex_t applyTestMut = PTHREAD_MUTEX_INITIALIZER;
+
+static int recordApply(int index, void *arg)
+{
+	UNUSED(arg);
+	pthread_mutex_lock(&applyTestMut);
+	applyStart[index] = ++applySeq;
+	pthread_mutex_unlock(&applyTestMut);
+	usleep(20000);
+	pthread_mutex_lock(&applyTestMut);
+	applyEnd[index] = ++applySeq;
+	pthread_mutex_unlock(&applyTestMut);
+	return (index == applyStopAt) ? 1 : 0;
+}
+
+static void resetApplyRecord()
+{
+	memset(applyStart, 0, sizeof(applyStart));
+	memset(applyEnd, 0, sizeof(applyEnd));
+	applySeq = 0;
+	applyStopAt = -1;
+}
+
+void test_applySchedule(){
+	char *names[] = {"aker", "wan", "lan", "mesh", "moca"};
+	int i = 0;
+
+	//lan after wan, mesh after lan, aker after everything
+	setApplyWorkers(4);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, setApplyDependencies(" lan:wan , mesh:lan|privatessid,aker:*\n"));
+	resetApplyRecord();
+	CU_ASSERT_EQUAL(5, runApplySchedule(names, 5, recordApply, NULL));
+	CU_ASSERT(applyStart[2] > applyEnd[1]);
+	CU_ASSERT(applyStart[3] > applyEnd[2]);
+	for(i = 1; i < 5; i++)
+	{
+		CU_ASSERT(applyStart[0] > applyEnd[i]);
+	}
+	//independent docs overlap
+	CU_ASSERT(applyStart[4] < applyEnd[1]);
+
+	//one worker keeps the multipart order among ready docs
+	setApplyWorkers(1);
+	resetApplyRecord();
+	CU_ASSERT_EQUAL(5, runApplySchedule(names, 5, recordApply, NULL));
+	CU_ASSERT(applyEnd[1] < applyStart[2] && applyEnd[2] < applyStart[3] && applyEnd[3] < applyStart[4] && applyEnd[4] < applyStart[0]);
+
+	//a stop request skips the docs not yet dispatched
+	resetApplyRecord();
+	applyStopAt = 1;
+	CU_ASSERT_EQUAL(1, runApplySchedule(names, 5, recordApply, NULL));
+	CU_ASSERT_EQUAL(0, applyStart[2]);
+
+	//a cycle still applies every doc
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, setApplyDependencies("wan:lan,lan:wan"));
+	resetApplyRecord();
+	CU_ASSERT_EQUAL(2, runApplySchedule(&names[1], 2, recordApply, NULL));
+
+	setApplyWorkers(WEBCFG_APPLY_DEFAULT_WORKERS);
+	setApplyDependencies(WEBCFG_APPLY_DEFAULT_DEPS);
+}
+
+void test_applyBatchComponents(){
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, setApplyBatchComponents("Device.WiFi.:wifi, Device.WiFi.Radio.:radio,Device.X_CISCO_COM_DeviceControl.:pam,Device.DHCPv4.:pam,invalid"));
+	CU_ASSERT_EQUAL(1, isApplyBatchEnabled());
+	CU_ASSERT_NOT_EQUAL(-1, getApplyComponent("Device.WiFi.SSID.1.Enable"));
+	CU_ASSERT_EQUAL(getApplyComponent("Device.WiFi.SSID.1.Enable"), getApplyComponent("Device.WiFi.AccessPoint.1.Enable"));
+	//the longest prefix wins
+	CU_ASSERT_NOT_EQUAL(getApplyComponent("Device.WiFi.SSID.1.Enable"), getApplyComponent("Device.WiFi.Radio.1.Enable"));
+	CU_ASSERT_STRING_EQUAL("radio", getApplyComponentName(getApplyComponent("Device.WiFi.Radio.1.Enable")));
+	//prefixes of one component batch together
+	CU_ASSERT_EQUAL(getApplyComponent("Device.DHCPv4.Server.Enable"), getApplyComponent("Device.X_CISCO_COM_DeviceControl.LanManagementEntry.1.LanMode"));
+	CU_ASSERT_STRING_EQUAL("pam", getApplyComponentName(getApplyComponent("Device.DHCPv4.Server.Enable")));
+	CU_ASSERT_EQUAL(-1, getApplyComponent("Device.NAT.PortMapping.1.Enable"));
+	CU_ASSERT_EQUAL(-1, getApplyComponent("invalid"));
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, setApplyDependencies("wan:lan,aker:*"));
+	CU_ASSERT_EQUAL(1, hasApplyDependencies("wan"));
+	CU_ASSERT_EQUAL(1, hasApplyDependencies("aker"));
+	CU_ASSERT_EQUAL(0, hasApplyDependencies("lan"));
+	setApplyDependencies(WEBCFG_APPLY_DEFAULT_DEPS);
+
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, setApplyBatchComponents(""));
+	CU_ASSERT_EQUAL(0, isApplyBatchEnabled());
+	CU_ASSERT_EQUAL(-1, getApplyComponent("Device.WiFi.SSID.1.Enable"));
+}
+
+//Packs a one param subdoc, value goes first as process_params stops once name and dataType are read.
+static size_t packParamDoc(const char *name, const char *value, size_t value_size, int type, void **data)
+{
+	msgpack_sbuffer sbuf;
+	msgpack_packer pk;
+	size_t size = 0;
+
+	msgpack_sbuffer_init( &sbuf );
+	msgpack_packer_init( &pk, &sbuf, msgpack_sbuffer_write );
+	msgpack_pack_map( &pk, 1 );
+	msgpack_pack_str( &pk, strlen("parameters") );
+	msgpack_pack_str_body( &pk, "parameters", strlen("parameters") );
+	msgpack_pack_array( &pk, 1 );
+	msgpack_pack_map( &pk, 3 );
+	msgpack_pack_str( &pk, strlen("value") );
+	msgpack_pack_str_body( &pk, "value", strlen("value") );
+	msgpack_pack_str( &pk, value_size );
+	msgpack_pack_str_body( &pk, value, value_size );
+	msgpack_pack_str( &pk, strlen("name") );
+	msgpack_pack_str_body( &pk, "name", strlen("name") );
+	msgpack_pack_str( &pk, strlen(name) );
+	msgpack_pack_str_body( &pk, name, strlen(name) );
+	msgpack_pack_str( &pk, strlen("dataType") );
+	msgpack_pack_str_body( &pk, "dataType", strlen("dataType") );
+	msgpack_pack_int( &pk, type );
+	*data = malloc(sbuf.size + 1);
+	memcpy(*data, sbuf.data, sbuf.size);
+	((char *)*data)[sbuf.size] = '\0';
+	size = sbuf.size;
+	msgpack_sbuffer_destroy( &sbuf );
+	return size;
+}
+
+//The request blob must decode to the embedded doc of its own transaction_id.
+static void checkRequestBlob(webcfg_request_t *req, const char *blob, size_t blob_size)
+{
+	appenddoc_t appenddata;
+	void *appenddocdata = NULL;
+	void *embeddeddocdata = NULL;
+	ssize_t appenddocPackSize = 0;
+	size_t embeddeddocPackSize = 0;
+	size_t decodeSize = 0;
+	uint8_t *decoded = NULL;
+
+	memset(&appenddata, 0, sizeof(appenddoc_t));
+	appenddata.subdoc_name = "portforwarding";
+	appenddata.version = 410448631;
+	appenddata.transaction_id = req->trans_id;
+	appenddocPackSize = webcfg_pack_appenddoc(&appenddata, &appenddocdata);
+	embeddeddocPackSize = appendWebcfgEncodedData(&embeddeddocdata, (void *)blob, blob_size, appenddocdata, appenddocPackSize);
+
+	decoded = malloc(b64_get_decoded_buffer_size(strlen(req->params[0].value)));
+	decodeSize = b64_decode((uint8_t *)req->params[0].value, strlen(req->params[0].value), decoded);
+	CU_ASSERT_EQUAL(embeddeddocPackSize, decodeSize);
+	CU_ASSERT_EQUAL(0, memcmp(embeddeddocdata, decoded, decodeSize));
+	free(decoded);
+	WEBCFG_FREE(appenddocdata);
+	WEBCFG_FREE(embeddeddocdata);
+}
+
+void test_requestBuilder(){
+	webcfg_request_t *req = NULL;
+	webcfg_request_t *retry = NULL;
+	webcfg_request_t *probe = NULL;
+	void *data = NULL;
+	size_t size = 0;
+	//fixmap of 1 entry, the appended metadata extends it
+	char blob[] = "\x81\xa4port\xcd\x1f\x90";
+	uint16_t first_trans_id = 0;
+	int reserved = getReservedTransIdCount();
+
+	clearWebcfgRequestCache();
+	size = packParamDoc("Device.NAT.X_RDKCENTRAL-COM_PortMapping", blob, sizeof(blob) - 1, WDMP_BLOB, &data);
+	CU_ASSERT_EQUAL(REQUEST_BUILD_SUCCESS, buildWebcfgRequest("portforwarding", 410448631, data, size, &req));
+	CU_ASSERT_FATAL(NULL != req);
+	CU_ASSERT_EQUAL(1, req->count);
+	CU_ASSERT_EQUAL(1, req->blob);
+	CU_ASSERT_EQUAL(WDMP_BASE64, req->params[0].type);
+	CU_ASSERT_STRING_EQUAL("Device.NAT.X_RDKCENTRAL-COM_PortMapping", req->params[0].name);
+	CU_ASSERT_EQUAL(sizeof(blob) - 1, req->blob_size);
+	CU_ASSERT_EQUAL(0, memcmp(blob, req->blob_data, req->blob_size));
+	checkRequestBlob(req, blob, sizeof(blob) - 1);
+	first_trans_id = req->trans_id;
+
+	//retry of the same version is served from the cache with a fresh transaction_id
+	CU_ASSERT_EQUAL(REQUEST_BUILD_SUCCESS, buildWebcfgRequest("portforwarding", 410448631, "x", 1, &retry));
+	CU_ASSERT_FATAL(NULL != retry);
+	CU_ASSERT_NOT_EQUAL(first_trans_id, retry->trans_id);
+	checkRequestBlob(retry, blob, sizeof(blob) - 1);
+	//a probe is never sent, it takes no transaction_id
+	CU_ASSERT_EQUAL(REQUEST_BUILD_SUCCESS, buildWebcfgProbeRequest("portforwarding", 410448631, "x", 1, &probe));
+	CU_ASSERT_FATAL(NULL != probe);
+	CU_ASSERT_EQUAL(0, probe->trans_id);
+	CU_ASSERT_EQUAL(reserved + 2, getReservedTransIdCount());
+	releaseWebcfgRequest(probe);
+	releaseWebcfgRequest(retry);
+	releaseWebcfgRequest(req);
+	//the ids were never bound to a doc, releasing the requests frees them
+	CU_ASSERT_EQUAL(reserved, getReservedTransIdCount());
+
+	//a doc leaving the mp cache is decoded again
+	dropWebcfgRequestCache("portforwarding");
+	CU_ASSERT_EQUAL(REQUEST_DECODE_FAILURE, buildWebcfgRequest("portforwarding", 410448631, "x", 1, &req));
+	CU_ASSERT_PTR_NULL(req);
+	WEBCFG_FREE(data);
+
+	size = packParamDoc("Device.X_RDK_WebConfig.Enable", "true", 4, WDMP_BOOLEAN, &data);
+	CU_ASSERT_EQUAL(REQUEST_BUILD_SUCCESS, buildWebcfgRequest("moca", 12, data, size, &req));
+	CU_ASSERT_FATAL(NULL != req);
+	CU_ASSERT_EQUAL(0, req->blob);
+	CU_ASSERT_EQUAL(0, req->trans_id);
+	CU_ASSERT_EQUAL(WDMP_BOOLEAN, req->params[0].type);
+	CU_ASSERT_STRING_EQUAL("true", req->params[0].value);
+	releaseWebcfgRequest(req);
+	WEBCFG_FREE(data);
+
+	size = packParamDoc("Device.X_RDK_WebConfig.Enable", "", 0, WDMP_BOOLEAN, &data);
+	CU_ASSERT_EQUAL(REQUEST_INVALID_PARAM, buildWebcfgRequest("moca", 13, data, size, &req));
+	WEBCFG_FREE(data);
+	clearWebcfgRequestCache();
+}
+
+void test_lastGoodCache(){
+	uint8_t in[4096];
+	uint8_t comp[4096];
+	uint8_t out[4096];
+	char doc[2048];
+	char name[32];
+	char *data = NULL;
+	size_t size = 0, comp_size = 0;
+	uint32_t version = 0;
+	int i = 0;
+	FILE *fp = NULL;
+
+	for(i = 0; i < (int)sizeof(in); i++)
+	{
+		in[i] = "Device.NAT.PortMapping."[i % 23];
+	}
+	comp_size = compressPayload(in, sizeof(in), comp, sizeof(comp));
+	CU_ASSERT(comp_size > 0 && comp_size < sizeof(in) / 4);
+	CU_ASSERT_EQUAL(sizeof(in), decompressPayload(comp, comp_size, out, sizeof(out)));
+	CU_ASSERT_EQUAL(0, memcmp(in, out, sizeof(in)));
+	//truncated or undersized input is rejected
+	CU_ASSERT_EQUAL(0, decompressPayload(comp, comp_size, out, sizeof(out) - 1));
+	CU_ASSERT_EQUAL(0, compressPayload(in, sizeof(in), comp, 16));
+
+	clearLastGoodCache();
+	memcpy(doc, in, sizeof(doc));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, saveLastGoodPayload("portforwarding", 410448631, doc, sizeof(doc)));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, loadLastGoodPayload("portforwarding", &version, &data, &size));
+	CU_ASSERT_EQUAL(410448631, version);
+	CU_ASSERT_EQUAL(sizeof(doc), size);
+	CU_ASSERT_FATAL(NULL != data);
+	CU_ASSERT_EQUAL(0, memcmp(doc, data, size));
+	WEBCFG_FREE(data);
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, loadLastGoodPayload("lan", &version, &data, &size));
+
+	//rollback is off by default and never targets the failed version itself
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, rollbackSubdoc("portforwarding", 410448632));
+	setLocalRollback(1);
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, rollbackSubdoc("portforwarding", 410448631));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, rollbackSubdoc("lan", 1));
+	setLocalRollback(0);
+
+	//the oldest saved doc is evicted once the cache is full
+	for(i = 0; i < WEBCFG_LASTGOOD_MAX_DOCS; i++)
+	{
+		snprintf(name, sizeof(name), "doc%d", i);
+		CU_ASSERT_EQUAL(WEBCFG_SUCCESS, saveLastGoodPayload(name, i + 1, doc, sizeof(doc)));
+	}
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, loadLastGoodPayload("portforwarding", &version, &data, &size));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, loadLastGoodPayload("doc0", &version, &data, &size));
+	CU_ASSERT_EQUAL(1, version);
+	WEBCFG_FREE(data);
+
+	//a corrupted file is dropped instead of being applied
+	fp = fopen(WEBCFG_LASTGOOD_DIR "/doc1" WEBCFG_LASTGOOD_SUFFIX, "r+b");
+	CU_ASSERT_FATAL(NULL != fp);
+	fseek(fp, 40, SEEK_SET);
+	fputc(0xff, fp);
+	fclose(fp);
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, loadLastGoodPayload("doc1", &version, &data, &size));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, loadLastGoodPayload("doc1", &version, &data, &size));
+	clearLastGoodCache();
+}
+
+void test_validateSubdoc(){
+	doc_verdict_t v;
+	void *data = NULL;
+	size_t size = 0;
+	FILE *fp = NULL;
+
+	clearWebcfgRequestCache();
+	CU_ASSERT_EQUAL(VERDICT_EMPTY, validateSubdoc("moca", 1, NULL, 0, 0, &v));
+	CU_ASSERT_STRING_EQUAL("empty", getVerdictString(v.verdict));
+	CU_ASSERT_EQUAL(VERDICT_DECODE_FAILURE, validateSubdoc("moca", 1, "x", 1, 0, &v));
+
+	size = packParamDoc("Device.X_RDK_WebConfig.Enable", "true", 4, WDMP_BOOLEAN, &data);
+	CU_ASSERT_EQUAL(VERDICT_ACCEPT, validateSubdoc("moca", 2, data, size, 0, &v));
+	setValidateMaxDocSize(size - 1);
+	CU_ASSERT_EQUAL(VERDICT_TOO_LARGE, validateSubdoc("moca", 2, data, size, 0, &v));
+	setValidateMaxDocSize(WEBCFG_VALIDATE_DEFAULT_MAX_SIZE);
+	WEBCFG_FREE(data);
+
+	size = packParamDoc("Device.X_RDK_WebConfig.Enable", "yes", 3, WDMP_BOOLEAN, &data);
+	CU_ASSERT_EQUAL(VERDICT_INVALID_TYPE, validateSubdoc("moca", 3, data, size, 0, &v));
+	CU_ASSERT_EQUAL(0, v.param_index);
+	WEBCFG_FREE(data);
+
+	size = packParamDoc("Device.MoCA.Interface.1.Channel", "-5", 2, WDMP_UINT, &data);
+	CU_ASSERT_EQUAL(VERDICT_INVALID_TYPE, validateSubdoc("moca", 4, data, size, 0, &v));
+	WEBCFG_FREE(data);
+
+	size = packParamDoc("Device.MoCA.Interface.1.Channel", "", 0, WDMP_UINT, &data);
+	CU_ASSERT_EQUAL(VERDICT_INVALID_PARAM, validateSubdoc("moca", 5, data, size, 0, &v));
+	WEBCFG_FREE(data);
+
+	//docs missing from or disabled in the supported list never reach the component
+	fp = fopen(WEBCFG_PROPERTIES_FILE, "w");
+	CU_ASSERT_FATAL(NULL != fp);
+	fprintf(fp, "WEBCONFIG_SUBDOC_MAP=moca:1:true,wan:2:false\n");
+	fclose(fp);
+	initWebcfgProperties(WEBCFG_PROPERTIES_FILE);
+	CU_ASSERT_EQUAL(1, isSupportedDocsLoaded());
+	size = packParamDoc("Device.X_RDK_WebConfig.Enable", "true", 4, WDMP_BOOLEAN, &data);
+	CU_ASSERT_EQUAL(VERDICT_ACCEPT, validateSubdoc("moca", 6, data, size, 0, &v));
+	CU_ASSERT_EQUAL(VERDICT_UNSUPPORTED, validateSubdoc("wan", 6, data, size, 0, &v));
+	CU_ASSERT_EQUAL(VERDICT_UNSUPPORTED, validateSubdoc("lan", 6, data, size, 0, &v));
+	//supplementary docs are not in the supported list
+	CU_ASSERT_EQUAL(VERDICT_ACCEPT, validateSubdoc("telemetry", 6, data, size, 1, &v));
+	WEBCFG_FREE(data);
+	clearWebcfgRequestCache();
+}
+
+void test_syncScheduler(){
+	sync_job_t job;
+
+	clearSyncJobs();
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, scheduleSyncJob(SYNC_JOB_SUPPLEMENTARY, "telemetry", 0, 0));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, scheduleSyncJob(SYNC_JOB_PRIMARY, NULL, 0, 0));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, scheduleSyncJob(SYNC_JOB_MAINTENANCE, NULL, 0, 60000));
+	//same type and doc coalesce, keeping the earlier deadline and the poke
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, scheduleSyncJob(SYNC_JOB_SUPPLEMENTARY, "telemetry", 1, 30000));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, scheduleSyncJob(SYNC_JOB_MAINTENANCE, NULL, 0, 0));
+	CU_ASSERT_EQUAL(3, getSyncJobCount());
+
+	//due jobs run by priority, not by deadline
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, takeDueSyncJob(&job));
+	CU_ASSERT_EQUAL(SYNC_JOB_PRIMARY, job.type);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, takeDueSyncJob(&job));
+	CU_ASSERT_EQUAL(SYNC_JOB_SUPPLEMENTARY, job.type);
+	CU_ASSERT_STRING_EQUAL("telemetry", job.doc);
+	CU_ASSERT_EQUAL(1, job.forced);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, takeDueSyncJob(&job));
+	CU_ASSERT_EQUAL(SYNC_JOB_MAINTENANCE, job.type);
+
+	//pokes during the running sync are merged into one follow-up sync, the later ids are not kept
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, requestForceSync("wan", "poke-4"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, requestForceSync("moca", "poke-5"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, requestForceSync("lan", "poke-6"));
+	CU_ASSERT_EQUAL(1, getSyncJobCount());
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, takeDueSyncJob(&job));
+	CU_ASSERT_EQUAL(SYNC_JOB_PRIMARY, job.type);
+	CU_ASSERT_STRING_EQUAL("poke-4", job.trans_id);
+	CU_ASSERT_EQUAL(0, getSyncJobCount());
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, takeDueSyncJob(&job));
+
+	//a job is not taken before its deadline
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, scheduleSyncJob(SYNC_JOB_RETRY, NULL, 0, 60000));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, takeDueSyncJob(&job));
+	CU_ASSERT_EQUAL(1, cancelSyncJob(SYNC_JOB_RETRY, NULL));
+	CU_ASSERT_EQUAL(0, cancelSyncJob(SYNC_JOB_RETRY, NULL));
+	CU_ASSERT_EQUAL(0, getSyncJobCount());
+	clearSyncJobs();
+}
+
+void test_docRetryBackoff(){
+	sync_job_t job;
+
+	clearSyncJobs();
+	CU_ASSERT_EQUAL(WEBCFG_RETRY_BASE_SECS, getDocRetryBackoff(0));
+	CU_ASSERT_EQUAL(2 * WEBCFG_RETRY_BASE_SECS, getDocRetryBackoff(1));
+	CU_ASSERT_EQUAL(WEBCFG_RETRY_MAX_SECS, getDocRetryBackoff(10));
+
+	//each doc has its own entry, a repeated failure backs off further
+	CU_ASSERT(scheduleDocRetry("lan", 5) > 0);
+	CU_ASSERT(scheduleDocRetry("lan", 5) > 0);
+	CU_ASSERT(scheduleDocRetry("moca", 1) > 0);
+	CU_ASSERT_EQUAL(2, getDocRetryAttempts("lan"));
+	CU_ASSERT_EQUAL(1, getDocRetryAttempts("moca"));
+	CU_ASSERT_EQUAL(2, getSyncJobCount());
+	//retries are never due in the pass that failed them
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, takeDueSyncJob(&job));
+
+	//a new failed version starts over
+	scheduleDocRetry("lan", 6);
+	CU_ASSERT_EQUAL(1, getDocRetryAttempts("lan"));
+	clearDocRetry("lan");
+	CU_ASSERT_EQUAL(0, getDocRetryAttempts("lan"));
+	CU_ASSERT_EQUAL(1, getSyncJobCount());
+	clearSyncJobs();
+	CU_ASSERT_EQUAL(0, getDocRetryAttempts("moca"));
+}
+
+void test_forceSyncMerge(){
+	sync_job_t job;
+
+	clearSyncJobs();
+	setForceSyncWindow(0);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, scheduleSyncJob(SYNC_JOB_MAINTENANCE, NULL, 0, 0));
+	//pokes of primary docs are served by one sync with the first transaction
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, requestForceSync("wan", "poke-1"));
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, requestForceSync("lan", "poke-2"));
+	CU_ASSERT_EQUAL(2, getSyncJobCount());
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, takeDueSyncJob(&job));
+	CU_ASSERT_EQUAL(SYNC_JOB_PRIMARY, job.type);
+	CU_ASSERT_EQUAL(1, job.forced);
+	CU_ASSERT_STRING_EQUAL("poke-1", job.trans_id);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, takeDueSyncJob(&job));
+	CU_ASSERT_EQUAL(SYNC_JOB_MAINTENANCE, job.type);
+
+	//a poke waits for the window so a burst is merged
+	setForceSyncWindow(WEBCFG_POKE_WINDOW_MS);
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, requestForceSync("wan", "poke-3"));
+	CU_ASSERT_EQUAL(WEBCFG_FAILURE, takeDueSyncJob(&job));
+	clearSyncJobs();
+}
+
+void test_mpCachePinned(){
+	multipartdocs_t *mp = NULL;
+	char data[] = "payload";
+	int count = 0;
+
+	delete_multipart();
+	addToMpList(1, "wan", data, sizeof(data));
+	addToMpList(2, "lan", data, sizeof(data));
+	addToMpList(3, "moca", data, sizeof(data));
+	CU_ASSERT_EQUAL(3, get_multipartdoc_count());
+
+	//nodes deleted during a pinned walk stay valid until it is released
+	mp = acquire_global_mp();
+	mp = mp->next;
+	CU_ASSERT_EQUAL(WEBCFG_SUCCESS, deleteFromMpList("lan"));
+	delete_multipart();
+	CU_ASSERT_PTR_NULL(get_global_mp());
+	CU_ASSERT_STRING_EQUAL("lan", mp->name_space);
+	for(; mp != NULL; mp = mp->next)
+	{
+		count++;
+	}
+	CU_ASSERT_EQUAL(2, count);
+	release_global_mp();
+	CU_ASSERT_EQUAL(0, get_multipartdoc_count());
+}
+
 void add_suites( CU_pSuite *suite )
 {
     *suite = CU_add_suite( "tests", NULL, NULL );
@@ -329,6 +811,16 @@ void add_suites( CU_pSuite *suite )
       CU_add_test( *suite, "test  Aker update blob send", test_UpdateErrorsendAkerblob);
       CU_add_test( *suite, "test  Aker delete blob send", test_DeleteErrorsendAkerblob);
       CU_add_test( *suite, "test  Aker wait", test_akerWait);
+      CU_add_test( *suite, "test  Aker status cache", test_akerStatusCache);
+      CU_add_test( *suite, "test  apply schedule", test_applySchedule);
+      CU_add_test( *suite, "test  apply batch components", test_applyBatchComponents);
+      CU_add_test( *suite, "test  request builder", test_requestBuilder);
+      CU_add_test( *suite, "test  validate subdoc", test_validateSubdoc);
+      CU_add_test( *suite, "test  last good cache", test_lastGoodCache);
+      CU_add_test( *suite, "test  sync scheduler", test_syncScheduler);
+      CU_add_test( *suite, "test  doc retry backoff", test_docRetryBackoff);
+      CU_add_test( *suite, "test  force sync merge", test_forceSyncMerge);
+      CU_add_test( *suite, "test  mp cache pinned", test_mpCachePinned);
       
      
 }
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <CUnit/Basic.h>
 #include "../src/webcfg_param.h"
+#include "../src/webcfg_helpers.h"
 
 #define WEB_CFG_FILE "../../tests/webcfg-now100.bin"
 int readFromFile(char **data, int *len)
@@ -81,10 +82,66 @@ void test_basic()
 	}
 }
 
+void test_strbuf()
+{
+	strbuf_t sb;
+	char expected[16];
+	char *str = NULL;
+	int i;
+
+	CU_ASSERT_FATAL( HELPERS_OK == strbuf_init(&sb, 8) );
+	CU_ASSERT_STRING_EQUAL( "", sb.str );
+	CU_ASSERT( HELPERS_OK == strbuf_appendf(&sb, "%s", "root") );
+	//grow well beyond the old fixed 512 byte list without truncation
+	for(i = 0; i < 200; i++)
+	{
+		CU_ASSERT( HELPERS_OK == strbuf_appendf(&sb, ",%d", 1000000 + i) );
+	}
+	CU_ASSERT( strlen(sb.str) == sb.len );
+	CU_ASSERT( (4 + 200 * 8) == sb.len );
+	CU_ASSERT( 0 == strncmp(sb.str, "root,1000000,1000001", 20) );
+	snprintf(expected, sizeof(expected), ",%d", 1000199);
+	CU_ASSERT_STRING_EQUAL( expected, sb.str + sb.len - 8 );
+
+	strbuf_reset(&sb);
+	CU_ASSERT( 0 == sb.len );
+	CU_ASSERT( HELPERS_OK == strbuf_appendf(&sb, "IF-NONE-MATCH:%s", "0") );
+	CU_ASSERT_STRING_EQUAL( "IF-NONE-MATCH:0", sb.str );
+
+	str = strbuf_detach(&sb);
+	CU_ASSERT_PTR_NULL( sb.str );
+	CU_ASSERT_STRING_EQUAL( "IF-NONE-MATCH:0", str );
+	free(str);
+	strbuf_free(&sb);
+}
+
+void test_strbuf_json()
+{
+	strbuf_t sb;
+
+	CU_ASSERT_FATAL( HELPERS_OK == strbuf_init(&sb, 4) );
+	CU_ASSERT( HELPERS_OK == strbuf_append_json_string(&sb, "plain") );
+	CU_ASSERT_STRING_EQUAL( "\"plain\"", sb.str );
+
+	strbuf_reset(&sb);
+	CU_ASSERT( HELPERS_OK == strbuf_append_json_string(&sb, "a\"b\\c\n\t\x01") );
+	CU_ASSERT_STRING_EQUAL( "\"a\\\"b\\\\c\\n\\t\\u0001\"", sb.str );
+	CU_ASSERT( strlen(sb.str) == sb.len );
+
+	strbuf_reset(&sb);
+	CU_ASSERT( HELPERS_OK == strbuf_append(&sb, "{", 1) );
+	CU_ASSERT( HELPERS_OK == strbuf_append_json_string(&sb, NULL) );
+	CU_ASSERT( HELPERS_OK == strbuf_append_json_string(&sb, "\xc3\xa9") );
+	CU_ASSERT_STRING_EQUAL( "{null\"\xc3\xa9\"", sb.str );
+	strbuf_free(&sb);
+}
+
 void add_suites( CU_pSuite *suite )
 {
     *suite = CU_add_suite( "tests", NULL, NULL );
     CU_add_test( *suite, "Full", test_basic);
+    CU_add_test( *suite, "strbuf", test_strbuf);
+    CU_add_test( *suite, "strbuf json", test_strbuf_json);
 }
 
 /*----------------------------------------------------------------------------*/